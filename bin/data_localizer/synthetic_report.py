@@ -0,0 +1,30 @@
+from traj_analysis import pickle_traj_error_from_csv
+from traj_analysis import report_traj_error_from_dict
+import os
+import pickle
+import numpy as np
+
+result_file = 'synthetic_results.csv'
+results_path = os.path.splitext(result_file)[0]
+summary = np.median
+
+# Summarize the result file once (its errors are kept with the names of the former per-trajectory files)
+if not os.path.isfile(results_path + '.pickle'):
+    pickle_traj_error_from_csv(result_file, summarize=summary)
+
+print('\n## ' + result_file)
+f = open(results_path + '.pickle', 'rb')
+err_rec = pickle.load(f)
+f.close()
+
+
+print('\n### All Errors w.r.t. { Method, GPS Offset, Motion Noise }')
+for gps_freq in ['10Hz', '01Hz']:
+    print('\n### Localization Accuracy with ' + gps_freq + ' GPS Data')
+    for traj in ['Stop', 'Line', 'Circle', 'Sine', 'Square']:
+        print('#### ' + traj)
+        print(report_traj_error_from_dict(err_rec, None), end='')
+        for method in ['GPS', 'CV', 'HT', 'ZG', 'CVS', 'HTS', 'ZGS']:
+            for gps_offset in ['0m', '1m']:
+                for motion_noise in ['0.10', '0.50']:
+                    print(report_traj_error_from_dict(err_rec, results_path + '/' + traj + '(' + gps_freq + ',00s,0)(0.5,' + gps_offset + ',' + motion_noise + ').' + method + '.*.csv', summarize=summary, header=False), end='')
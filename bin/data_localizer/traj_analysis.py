@@ -2,6 +2,8 @@ import numpy as np
 import matplotlib.pyplot as plt
 import matplotlib.ticker as ticker
 import glob
+import fnmatch
+import os
 import pickle
 
 def draw_graph(title, datax, datay, label=None, lwidth=2, lcolor=None, lalpha=1):
@@ -146,6 +148,41 @@ def pickle_traj_error(path, summarize=np.median, path_truth='truth', file_filter
         pickle.dump(error_record, f)
         f.close()
 
+def pickle_traj_error_from_csv(result_file, summarize=np.median, path_truth='synthetic_truth', verbose=True):
+    # Read trajectories in a result file of 'expLocalizersSynthetic()'
+    # (Each row is 'Traj, GPSFreq, WaitTime, Init, GPSNoise, GPSOffset, MotionNoise, Method, Trial, Time, X, Y, Theta, LinVel, AngVel'.)
+    path = os.path.splitext(result_file)[0]
+    trajs = {}
+    with open(result_file, 'r') as f:
+        for line in f:
+            if line.startswith('#'):
+                continue
+            cols = [c.strip() for c in line.split(',')]
+            if len(cols) < 15:
+                continue
+            freq, wait = int(float(cols[1])), int(float(cols[2]))
+            traj_file = path + '/%s(%02dHz,%02ds,%s)(%s,%sm,%s).%s.%03d.csv' % (cols[0], freq, wait, cols[3], cols[4], cols[5], cols[6], cols[7], int(cols[8]))
+            if traj_file not in trajs:
+                true_file = path_truth + '/%s(%02dHz,%02ds).pose.csv' % (cols[0], freq, wait)
+                trajs[traj_file] = (true_file, [])
+            trajs[traj_file][1].append([float(c) for c in cols[9:15]])
+
+    # Keep errors with the file names of the former per-trajectory results
+    error_record = {}
+    true_cache = {}
+    for idx, (traj_file, (true_file, rows)) in enumerate(trajs.items()):
+        if true_file not in true_cache:
+            true_cache[true_file] = load_csv_file(true_file)
+        e_ps, e_os, e_vs, e_ws = calc_traj_error(true_cache[true_file], np.array(rows))
+        error_record[traj_file] = [ summarize(e_ps), summarize(e_os), summarize(e_vs), summarize(e_ws) ]
+
+        if verbose and (idx % max(len(trajs) // 100, 1) == 0):
+            print('Progress %d %%' % (idx * 100 / len(trajs)))
+
+    f = open(path + '.pickle', 'wb')
+    pickle.dump(error_record, f)
+    f.close()
+
 def summarize_traj_error_from_dict(error_record, fnames, summarize=np.median):
     summary = []
     if error_record == None or fnames == None or len(fnames) == 0:
@@ -154,7 +191,7 @@ def summarize_traj_error_from_dict(error_record, fnames, summarize=np.median):
         fnames = [ fnames ]
 
     for fname in fnames:
-        files = glob.glob(fname)
+        files = fnmatch.filter(error_record.keys(), fname)
         if len(files) > 0:
             e_p = []
             e_o = []
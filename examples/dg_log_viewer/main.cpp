@@ -94,7 +94,7 @@ public:
                 vps.get(svs);
                 cv::Mat sv_image;
                 cv::Mat sv_image_resized;
-                if (!svs.empty() && svs[0].id>0 && map_manager.getStreetViewImage(svs[0].id, sv_image, "f") && !sv_image.empty())
+                if (!svs.empty() && svs[0].id>0 && map_manager.getStreetViewImage(svs[0].id, sv_image, "f", 10, cv::Size(0, image.rows)) && !sv_image.empty())
                 {
                     int h = image.rows;
                     int w = sv_image.cols * image.rows / sv_image.rows;
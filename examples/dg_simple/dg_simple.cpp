@@ -62,6 +62,19 @@ protected:
     std::string m_video_input = "data/191115_ETRI.avi";
 
     bool m_use_high_gps = false;                    // use high-precision gps (novatel)
+    bool m_use_imu = false;                         // use IMU for localizer prediction
+
+    std::string m_checkpoint_path = "";             // localizer checkpoint for warm restart (empty: disabled)
+    double m_checkpoint_interval = 1;               // period to save the localizer checkpoint [sec]
+    double m_checkpoint_max_age = 60;               // maximum age of the localizer checkpoint to restore [sec]
+
+    std::string m_map_cache_dir = "";               // disk cache of map server responses (empty: disabled)
+    double m_map_cache_ttl = 86400;                 // time-to-live of cached responses before revalidation [sec]
+    double m_map_stream_corridor = 50;              // half width of the map streamed along the path [m]
+    double m_map_stream_lookahead = 600;            // distance to stream the map ahead of the current pose [m]
+    std::string m_sv_image_cache_dir = "";          // disk cache of StreetView images (empty: disabled)
+    double m_sv_prefetch_radius = 30;               // radius to prefetch StreetView images around the camera [m] (0: disabled)
+    dg::Point2 m_sv_prefetch_pos = dg::Point2(DBL_MAX, DBL_MAX); // the last position to prefetch StreetView images
 
     bool m_data_logging = false;
     bool m_enable_tts = false;
@@ -89,6 +102,10 @@ protected:
     bool m_dest_defined = false;
     bool m_pose_initialized = false;
     bool m_path_initialized = false;
+    bool m_guide_initialized = false;
+    dg::Path m_path;
+    std::shared_ptr<const dg::Map> m_streamed_map;  // the latest map streamed along the path
+    dg::Map m_path_map;                             // a copy of the streamed map to find nodes
     std::string m_winname = "DeepGuider";           // title of gui window
 
     // internal api's
@@ -101,11 +118,14 @@ protected:
     void drawOcr(cv::Mat target_image, std::vector<OCRResult> pois, cv::Size original_image_size);
     void drawIntersection(cv::Mat image, IntersectionResult r, cv::Size original_image_size);
     void procGpsData(dg::LatLon gps_datum, dg::Timestamp ts);
+    void procImuData(double gyro, double accel, dg::Timestamp ts);
+    void procMapStreaming();
     void procGuidance(dg::Timestamp ts);
     bool procIntersectionClassifier();
     bool procLogo();
     bool procOcr();
     bool procVps();
+    void prefetchStreetViews(const dg::LatLon& pos);
     bool procRoadTheta();
 
     // tts
@@ -151,6 +171,8 @@ protected:
     cv::Mat m_vps_image;            // top-1 matched streetview image
     dg::ID m_vps_id;                // top-1 matched streetview id
     double m_vps_confidence;        // top-1 matched confidence(similarity)
+    dg::ID m_vps_request = 0;       // request ID of downloading the top-1 streetview image
+    cv::Size m_vps_image_size = cv::Size(0, 288); // smallest size of the streetview image to display (decoded at a reduced resolution)
 
     cv::Mutex m_logo_mutex;
     cv::Mat m_logo_image;
@@ -168,6 +190,7 @@ protected:
     cv::Mutex m_map_mutex;
     cv::Mutex m_guider_mutex;
     int m_gps_update_cnt = 0;
+    dg::Timestamp m_checkpoint_time = 0;
 
     // sub modules
     dg::MapManager m_map_manager;
@@ -242,6 +265,17 @@ bool DeepGuider::loadConfig(std::string config_file)
     LOAD_PARAM_VALUE(fn, "dg_srcdir", m_srcdir);
 
     LOAD_PARAM_VALUE(fn, "use_high_gps", m_use_high_gps);
+    LOAD_PARAM_VALUE(fn, "use_imu", m_use_imu);
+
+    LOAD_PARAM_VALUE(fn, "localizer_checkpoint", m_checkpoint_path);
+    LOAD_PARAM_VALUE(fn, "localizer_checkpoint_interval", m_checkpoint_interval);
+    LOAD_PARAM_VALUE(fn, "localizer_checkpoint_max_age", m_checkpoint_max_age);
+    LOAD_PARAM_VALUE(fn, "map_cache_dir", m_map_cache_dir);
+    LOAD_PARAM_VALUE(fn, "map_cache_ttl", m_map_cache_ttl);
+    LOAD_PARAM_VALUE(fn, "map_stream_corridor", m_map_stream_corridor);
+    LOAD_PARAM_VALUE(fn, "map_stream_lookahead", m_map_stream_lookahead);
+    LOAD_PARAM_VALUE(fn, "sv_image_cache_dir", m_sv_image_cache_dir);
+    LOAD_PARAM_VALUE(fn, "sv_prefetch_radius", m_sv_prefetch_radius);
 
     LOAD_PARAM_VALUE(fn, "enable_data_logging", m_data_logging);
     LOAD_PARAM_VALUE(fn, "enable_tts", m_enable_tts);
@@ -275,6 +309,8 @@ bool DeepGuider::initialize(std::string config_file)
 
     // initialize map manager
     m_map_manager.setIP(m_server_ip);
+    if (!m_map_cache_dir.empty() && m_map_manager.setCacheDir(m_map_cache_dir, m_map_cache_ttl)) printf("\tMap cache opened at %s!\n", m_map_cache_dir.c_str());
+    if (!m_sv_image_cache_dir.empty() && m_map_manager.setImageCacheDir(m_sv_image_cache_dir)) printf("\tStreetView image cache opened at %s!\n", m_sv_image_cache_dir.c_str());
     if (!m_map_manager.initialize()) return false;
     printf("\tMapManager initialized!\n");
 
@@ -371,6 +407,8 @@ bool DeepGuider::initialize(std::string config_file)
     m_dest_defined = false;
     m_pose_initialized = false;
     m_path_initialized = false;
+    m_guide_initialized = false;
+    m_streamed_map.reset();
     m_gps_update_cnt = 0;
     m_cam_image.release();
     m_cam_capture_time = -1;
@@ -388,6 +426,13 @@ bool DeepGuider::initialize(std::string config_file)
     m_guidance_cmd = dg::GuidanceManager::Motion::STOP;
     m_guidance_status = dg::GuidanceManager::GuideStatus::GUIDE_INITIAL;
 
+    // restore the localizer from its recent checkpoint
+    if (!m_checkpoint_path.empty() && m_localizer.loadState(m_checkpoint_path.c_str(), m_checkpoint_max_age))
+    {
+        m_pose_initialized = true;
+        printf("\tLocalizer is restored from %s!\n", m_checkpoint_path.c_str());
+    }
+
     // tts
     if (m_enable_tts)
     {
@@ -555,6 +600,7 @@ int DeepGuider::run()
     printf("End deepguider system...\n");
     terminateThreadFunctions();
     printf("\tthread terminated\n");
+    if (m_pose_initialized && !m_checkpoint_path.empty()) m_localizer.saveState(m_checkpoint_path.c_str());
     if(m_recording) m_video_gui.release();
     if(m_data_logging) m_video_cam.release();
     printf("\tclose recording\n");
@@ -571,8 +617,8 @@ void DeepGuider::procGpsData(dg::LatLon gps_datum, dg::Timestamp ts)
     // apply gps to localizer
     m_localizer_mutex.lock();
     VVS_CHECK_TRUE(m_localizer.applyGPS(gps_datum, ts));
-    double pose_confidence = m_localizer.getPoseConfidence();
-    m_localizer_mutex.unlock();    
+    m_localizer_mutex.unlock();
+    double pose_confidence = m_localizer.getPoseSnapshot()->confidence;    
 
     // check pose initialization
     m_gps_update_cnt++;
@@ -585,6 +631,28 @@ void DeepGuider::procGpsData(dg::LatLon gps_datum, dg::Timestamp ts)
         }
         printf("[Localizer] initial pose is estimated!\n");
     }
+
+    // save the localizer checkpoint periodically
+    if (m_pose_initialized && !m_checkpoint_path.empty())
+    {
+        dg::Timestamp now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count() / 1000.0;
+        if (now - m_checkpoint_time >= m_checkpoint_interval && m_localizer.saveState(m_checkpoint_path.c_str())) m_checkpoint_time = now;
+    }
+
+    // follow the current pose with the streamed map
+    procMapStreaming();
+}
+
+
+void DeepGuider::procImuData(double gyro, double accel, dg::Timestamp ts)
+{
+    if (!m_use_imu) return;
+
+    // accumulate the sample (the localizer applies them together as one prediction)
+    // (the forward acceleration should be free from gravity; the localizer does not estimate its bias)
+    m_localizer_mutex.lock();
+    m_localizer.applyIMU(gyro, accel, ts);
+    m_localizer_mutex.unlock();
 }
 
 
@@ -627,10 +695,9 @@ bool DeepGuider::setDeepGuiderDestination(dg::LatLon gps_dest)
     }
 
     // get current pose
-    m_localizer_mutex.lock();
-    dg::LatLon pose_gps = m_localizer.getPoseGPS();
-    dg::TopometricPose pose_topo = m_localizer.getPoseTopometric();
-    m_localizer_mutex.unlock();
+    std::shared_ptr<const dg::PoseSnapshot> snapshot = m_localizer.getPoseSnapshot();
+    dg::LatLon pose_gps = snapshot->pose_gps;
+    dg::TopometricPose pose_topo = snapshot->pose_topo;
 
     // generate & apply new path
     bool ok = updateDeepGuiderPath(pose_topo, pose_gps, gps_dest);
@@ -648,9 +715,9 @@ bool DeepGuider::updateDeepGuiderPath(dg::TopometricPose pose_topo, dg::LatLon g
 {
     // set start position to nearest node position
     m_map_mutex.lock();
-    dg::Map& tmpmap = m_map_manager.getMap();    
     dg::LatLon pose_gps = gps_start;
-    dg::Node* node = tmpmap.findNode(pose_topo.node_id);
+    dg::Node* node = m_path_map.findNode(pose_topo.node_id);
+    if(node == nullptr) node = m_map_manager.getMap().findNode(pose_topo.node_id);
     if(node)
     {
         pose_gps.lat = node->lat;
@@ -658,14 +725,15 @@ bool DeepGuider::updateDeepGuiderPath(dg::TopometricPose pose_topo, dg::LatLon g
     }
     m_map_mutex.unlock();
 
-    // generate path to destination
+    // generate path to destination and stream its map in background
     dg::Path path;
     m_map_mutex.lock();
-    bool ok = m_map_manager.getPath_expansion(pose_gps.lat, pose_gps.lon, gps_dest.lat, gps_dest.lon, path);
+    bool ok = m_map_manager.getPath_streaming(pose_gps.lat, pose_gps.lon, gps_dest.lat, gps_dest.lon, path);
+    if(ok) ok = m_map_manager.startMapStreaming(path, m_map_stream_corridor, 200, m_map_stream_lookahead);
     m_map_mutex.unlock();
     path.start_pos = gps_start;
     path.dest_pos = gps_dest;
-    if(!ok)
+    if(!ok || path.pts.empty())
     {
         printf("[MapManager] fail to find path to (lat=%lf, lon=%lf)\n", gps_dest.lat, gps_dest.lon);
         return false;
@@ -673,32 +741,55 @@ bool DeepGuider::updateDeepGuiderPath(dg::TopometricPose pose_topo, dg::LatLon g
     dg::ID nid_start = path.pts.front().node_id;
     dg::ID nid_dest = path.pts.back().node_id;
     printf("[MapManager] New path generated! start=%zu, dest=%zu\n", nid_start, nid_dest);    
+    m_map_manager.updateMapStreaming(gps_start);
+
+    // localizer, guidance and GUI map are updated when the streamed map arrives (see procMapStreaming())
+    m_path = path;
+    m_streamed_map.reset();
+    m_guide_initialized = false;
+
+    return true;    
+}
 
-    // check if the generated path is valid on the map
-    m_map_mutex.lock();
-    dg::Map& map = m_map_manager.getMap();    
-    dg::Node* node_start = map.findNode(nid_start);
-    dg::Node* node_dest = map.findNode(nid_dest);
-    m_map_mutex.unlock();
-    VVS_CHECK_TRUE(node_start != nullptr);
-    VVS_CHECK_TRUE(node_dest != nullptr);
 
-    // localizer: set map to localizer
+void DeepGuider::procMapStreaming()
+{
+    if(!m_path_initialized) return;
+
+    // move the streamed map with the current pose (tiles are downloaded in background)
+    m_map_manager.updateMapStreaming(m_localizer.getPoseSnapshot()->pose_gps);
+    std::shared_ptr<const dg::Map> streamed = m_map_manager.getStreamedMap();
+    if(streamed == nullptr || streamed == m_streamed_map) return;
+    m_streamed_map = streamed;
+    dg::Map map = *streamed;
+
+    // localizer: update map of localizer (only changed regions)
     m_localizer_mutex.lock();
-    VVS_CHECK_TRUE(m_localizer.loadMap(map));
+    VVS_CHECK_TRUE(m_localizer.updateMap(map));
     m_localizer_mutex.unlock();
-    printf("\tLocalizer is updated with new map!\n");
+    printf("\tLocalizer is updated with the streamed map! n_nodes=%d\n", (int)map.nodes.size());
 
-    // guidance: init map and path for guidance
-    m_guider_mutex.lock();
-    VVS_CHECK_TRUE(m_guider.initiateNewGuidance(path, map));
-    m_guider_mutex.unlock();
-    printf("\tGuidance is updated with new map and path!\n");
+    // guidance: init map and path for guidance when the streamed map covers the path
+    if(!m_guide_initialized)
+    {
+        bool covered = true;
+        for(auto itr = m_path.pts.begin(); covered && itr != m_path.pts.end(); itr++)
+        {
+            covered = (map.findNode(itr->node_id) != nullptr);
+        }
+        if(covered)
+        {
+            m_guider_mutex.lock();
+            m_guide_initialized = m_guider.initiateNewGuidance(m_path, map);
+            m_guider_mutex.unlock();
+            if(m_guide_initialized) printf("\tGuidance is updated with new map and path!\n");
+        }
+    }
 
     // draw map
     m_map_image_original.copyTo(m_map_image);
     m_painter.drawMap(m_map_image, m_map_info, map);
-    m_painter.drawPath(m_map_image, m_map_info, map, path);
+    m_painter.drawPath(m_map_image, m_map_info, map, m_path);
     for(auto itr = m_gps_history_novatel.begin(); itr != m_gps_history_novatel.end(); itr++)
     {
         m_painter.drawNode(m_map_image, m_map_info, *itr, 2, 0, cv::Vec3b(0, 0, 255));
@@ -708,9 +799,9 @@ bool DeepGuider::updateDeepGuiderPath(dg::TopometricPose pose_topo, dg::LatLon g
         m_painter.drawNode(m_map_image, m_map_info, *itr, 2, 0, cv::Vec3b(0, 255, 0));
     }
 
-    printf("\tGUI map is updated with new map and path!\n");
-
-    return true;    
+    m_map_mutex.lock();
+    m_path_map = map;
+    m_map_mutex.unlock();
 }
 
 
@@ -885,12 +976,11 @@ void DeepGuider::drawGuiDisplay(cv::Mat& image)
     }
 
     // current localization
-    m_localizer_mutex.lock();
-    dg::Pose2 pose_metric = m_localizer.getPose();
-    dg::TopometricPose pose_topo = m_localizer.getPoseTopometric();
-    dg::LatLon pose_gps = m_localizer.getPoseGPS();
-    double pose_confidence = m_localizer.getPoseConfidence();
-    m_localizer_mutex.unlock();
+    std::shared_ptr<const dg::PoseSnapshot> snapshot = m_localizer.getPoseSnapshot();
+    dg::Pose2 pose_metric = snapshot->pose;
+    dg::TopometricPose pose_topo = snapshot->pose_topo;
+    dg::LatLon pose_gps = snapshot->pose_gps;
+    double pose_confidence = snapshot->confidence;
 
     // draw robot on the map
     m_painter.drawNode(image, m_map_info, pose_gps, 10, 0, cx::COLOR_YELLOW);
@@ -1074,21 +1164,21 @@ void DeepGuider::drawIntersection(cv::Mat image, IntersectionResult r, cv::Size
 
 void DeepGuider::procGuidance(dg::Timestamp ts)
 {
-    if(!m_path_initialized || !m_dest_defined) return;
+    if(!m_path_initialized || !m_dest_defined || !m_guide_initialized) return;
 
     // get updated pose & localization confidence
-    m_localizer_mutex.lock();
-    dg::TopometricPose pose_topo = m_localizer.getPoseTopometric();
-    dg::Pose2 pose_metric = m_localizer.getPose();
-    dg::LatLon pose_gps = m_localizer.getPoseGPS();
-    double pose_confidence = m_localizer.getPoseConfidence();
-    m_localizer_mutex.unlock();
+    std::shared_ptr<const dg::PoseSnapshot> snapshot = m_localizer.getPoseSnapshot();
+    dg::TopometricPose pose_topo = snapshot->pose_topo;
+    dg::Pose2 pose_metric = snapshot->pose;
+    dg::LatLon pose_gps = snapshot->pose_gps;
+    double pose_confidence = snapshot->confidence;
 
     // Guidance: generate navigation guidance
     dg::GuidanceManager::GuideStatus cur_status;
     dg::GuidanceManager::Guidance cur_guide;
     m_map_mutex.lock();
-    dg::Node* node = m_map_manager.getMap().findNode(pose_topo.node_id);
+    dg::Node* node = m_path_map.findNode(pose_topo.node_id);
+    dg::LatLon node_gps = (node != nullptr) ? dg::LatLon(node->lat, node->lon) : dg::LatLon();
     m_map_mutex.unlock();
     if(node==nullptr)
     {
@@ -1099,10 +1189,7 @@ void DeepGuider::procGuidance(dg::Timestamp ts)
     m_guider.update(pose_topo, pose_confidence);
     cur_status = m_guider.getGuidanceStatus();
     cur_guide = m_guider.getGuidance();
-    if (node != nullptr)
-    {
-        m_guider.applyPoseGPS(dg::LatLon(node->lat, node->lon));
-    }
+    m_guider.applyPoseGPS(node_gps);
     m_guider_mutex.unlock();
 
     // print guidance message
@@ -1355,12 +1442,29 @@ bool DeepGuider::procRoadTheta()
     {
         double angle, confidence;
         m_roadtheta.get(angle, confidence);
-        VVS_CHECK_TRUE(m_localizer.applyLocClue(id_invalid, Polar2(-1, angle), capture_time, confidence));
+
+        // Convert the road-relative angle to the heading with the current road direction
+        std::shared_ptr<const dg::PoseSnapshot> snapshot = m_localizer.getPoseSnapshot();
+        dg::TopometricPose pose_topo = snapshot->pose_topo;
+        if (pose_topo.node_id > 0)
+        {
+            double road_theta = snapshot->pose.theta - pose_topo.head;
+            VVS_CHECK_TRUE(m_localizer.applyOrientation(cx::trimRad(road_theta + angle), capture_time, confidence));
+        }
     }
 
     return true;
 }
 
+void DeepGuider::prefetchStreetViews(const dg::LatLon& pos)
+{
+    // Request again only after moving the half of the radius
+    if (m_sv_prefetch_radius <= 0) return;
+    dg::Point2 p = m_localizer.toMetric(pos);
+    if (cv::norm(p - m_sv_prefetch_pos) < m_sv_prefetch_radius / 2) return;
+    m_sv_prefetch_pos = p;
+    m_map_manager.prefetchStreetViewImages(pos, m_sv_prefetch_radius, 4, "f", 10, m_vps_image_size);
+}
 
 #ifdef VPSSERVER
 std::size_t DeepGuider::curl_callback(const char* in, std::size_t size, std::size_t num, std::string* out)
@@ -1457,8 +1561,13 @@ bool DeepGuider::procVps() // This sends query image and parameters to server us
     dg::LatLon capture_pos = m_cam_gps;
     int cam_fnumber = m_cam_fnumber;
     m_cam_mutex.unlock();
+    prefetchStreetViews(capture_pos);
 
-    int N = 3;  // top-3
+    // skip or extend the query by the vps priority of the geofence zone
+    int vps_priority = m_localizer.getVPSPriority(m_localizer.toMetric(capture_pos));
+    if (vps_priority < 0) return true;
+
+    int N = 3 + vps_priority;  // top-3 (more candidates in prior zones)
     double gps_accuracy = 1;   // 0: search radius = 230m ~ 1: search radius = 30m
 
 	const std::string vps_server_addr = "http://localhost:7729";
@@ -1529,26 +1638,23 @@ bool DeepGuider::procVps() // This sends query image and parameters to server us
             VVS_CHECK_TRUE(m_localizer.applyLocClue(ids, obs, capture_time, confs));
             m_localizer_mutex.unlock();
 
-            cv::Mat sv_image;
-            if(m_map_manager.getStreetViewImage(ids[0], sv_image, "f") && !sv_image.empty())
-            {
-                m_vps_mutex.lock();
-                m_vps_image = sv_image;
-                m_vps_id = ids[0];
-                m_vps_confidence = confs[0];
-                m_vps_mutex.unlock();
-            }
-            else
+            // Download the matched image in background not to block this thread
+            dg::ID sv_id = ids[0];
+            double sv_confidence = confs[0];
+            m_map_manager.cancelAsync(m_vps_request);
+            m_vps_request = m_map_manager.getStreetViewImageAsync(sv_id, [this, sv_id, sv_confidence](bool ok, cv::Mat& sv_image)
             {
                 m_vps_mutex.lock();
-                m_vps_image = cv::Mat();
-                m_vps_id = ids[0];
-                m_vps_confidence = confs[0];
+                m_vps_image = ok ? sv_image : cv::Mat();
+                m_vps_id = sv_id;
+                m_vps_confidence = sv_confidence;
                 m_vps_mutex.unlock();
-            }
+            }, "f", 10, m_vps_image_size);
         }
         else
         {
+            m_map_manager.cancelAsync(m_vps_request);
+            m_vps_request = 0;
             m_vps_mutex.lock();
             m_vps_image = cv::Mat();
             m_vps_id = 0;
@@ -1575,8 +1681,13 @@ bool DeepGuider::procVps() // This will call apply() in vps.py embedded by C++
     dg::LatLon capture_pos = m_cam_gps;
     int cam_fnumber = m_cam_fnumber;
     m_cam_mutex.unlock();
+    prefetchStreetViews(capture_pos);
+
+    // skip or extend the query by the vps priority of the geofence zone
+    int vps_priority = m_localizer.getVPSPriority(m_localizer.toMetric(capture_pos));
+    if (vps_priority < 0) return true;
 
-    int N = 3;  // top-3
+    int N = 3 + vps_priority;  // top-3 (more candidates in prior zones)
     double gps_accuracy = 1;   // 0: search radius = 230m ~ 1: search radius = 30m
     if (!cam_image.empty() && m_vps.apply(cam_image, N, capture_pos.lat, capture_pos.lon, gps_accuracy, capture_time, m_server_ip.c_str()))
     {
@@ -1607,26 +1718,23 @@ bool DeepGuider::procVps() // This will call apply() in vps.py embedded by C++
             VVS_CHECK_TRUE(m_localizer.applyLocClue(ids, obs, capture_time, confs));
             m_localizer_mutex.unlock();
 
-            cv::Mat sv_image;
-            if(m_map_manager.getStreetViewImage(ids[0], sv_image, "f") && !sv_image.empty())
-            {
-                m_vps_mutex.lock();
-                m_vps_image = sv_image;
-                m_vps_id = ids[0];
-                m_vps_confidence = confs[0];
-                m_vps_mutex.unlock();
-            }
-            else
+            // Download the matched image in background not to block this thread
+            dg::ID sv_id = ids[0];
+            double sv_confidence = confs[0];
+            m_map_manager.cancelAsync(m_vps_request);
+            m_vps_request = m_map_manager.getStreetViewImageAsync(sv_id, [this, sv_id, sv_confidence](bool ok, cv::Mat& sv_image)
             {
                 m_vps_mutex.lock();
-                m_vps_image = cv::Mat();
-                m_vps_id = ids[0];
-                m_vps_confidence = confs[0];
+                m_vps_image = ok ? sv_image : cv::Mat();
+                m_vps_id = sv_id;
+                m_vps_confidence = sv_confidence;
                 m_vps_mutex.unlock();
-            }
+            }, "f", 10, m_vps_image_size);
         }
         else
         {
+            m_map_manager.cancelAsync(m_vps_request);
+            m_vps_request = 0;
             m_vps_mutex.lock();
             m_vps_image = cv::Mat();
             m_vps_id = 0;
@@ -20,6 +20,7 @@ public:
 
 protected:
     double m_wait_sec = 0.01;
+    double m_ocr_poi_radius = 100;          // radius to match OCR results with POIs [m]
 
     // DeepGuider Topic subscribers
     ros::Subscriber sub_ocr;
@@ -81,6 +82,7 @@ DeepGuiderROS::DeepGuiderROS(ros::NodeHandle& nh) : nh_dg(nh)
     m_map_canvas_offset = dg::Point2(344, 293);
 
     m_use_high_gps = false;                 // use high-precision gps (novatel)
+    m_use_imu = false;                      // use IMU for localizer prediction
 
     m_data_logging = false;
     m_enable_tts = false;
@@ -91,6 +93,7 @@ DeepGuiderROS::DeepGuiderROS(ros::NodeHandle& nh) : nh_dg(nh)
     // Read ros-specific parameters
     m_wait_sec = 0.1;
     nh_dg.param<double>("wait_sec", m_wait_sec, m_wait_sec);
+    nh_dg.param<double>("ocr_poi_radius", m_ocr_poi_radius, m_ocr_poi_radius);
 
     // Initialize deepguider subscribers
     sub_ocr = nh_dg.subscribe("/dg_ocr/output", 1, &DeepGuiderROS::callbackOCR, this);
@@ -142,6 +145,7 @@ int DeepGuiderROS::run()
     printf("End deepguider system...\n");
     terminateThreadFunctions();
     printf("\tthread terminated\n");
+    if (m_pose_initialized && !m_checkpoint_path.empty()) m_localizer.saveState(m_checkpoint_path.c_str());
     if(m_recording) m_video_gui.release();
     if(m_data_logging) m_video_cam.release();
     printf("\tclose recording\n");
@@ -321,6 +325,17 @@ void DeepGuiderROS::callbackIMU(const sensor_msgs::Imu::ConstPtr& msg)
     double linacc_z = msg->linear_acceleration.z;
 
     ROS_INFO_THROTTLE(1.0, "IMU: seq=%d, orientation=(%f,%f,%f), angular_veloctiy=(%f,%f,%f), linear_acceleration=(%f,%f,%f)", seq, ori_x, ori_y, ori_z, angvel_x, angvel_y, angvel_z, linacc_x, linacc_y, linacc_z);
+
+    // remove gravity from the forward acceleration using the IMU orientation (assume the IMU is level if its orientation is not provided)
+    double linacc_fwd = linacc_x;
+    if (msg->orientation_covariance[0] >= 0)
+    {
+        double ori_w = msg->orientation.w;
+        linacc_fwd -= 9.80665 * 2 * (ori_x * ori_z - ori_w * ori_y);
+    }
+
+    const dg::Timestamp imu_time = msg->header.stamp.toSec();
+    procImuData(angvel_z, linacc_fwd, imu_time);
 }
 
 // A callback function for subscribing OCR output
@@ -358,11 +373,13 @@ void DeepGuiderROS::callbackOCR(const dg_simple_ros::ocr_info::ConstPtr& msg)
         std::vector<dg::ID> ids;
         std::vector<Polar2> obs;
         std::vector<double> confs;
-        std::vector<OCRResult> ocrs;
+        m_localizer_mutex.lock();
+        dg::LatLon pose_gps = m_localizer.getPoseGPS();
+        m_localizer_mutex.unlock();
         for (int k = 0; k < (int)ocrs.size(); k++)
         {
             dg::ID ocr_id = 0;
-            std::vector<dg::POI> pois = m_map_manager.getPOI(ocrs[k].label);
+            std::vector<dg::POI> pois = m_map_manager.getPOI_similar(ocrs[k].label, pose_gps, m_ocr_poi_radius);
             if(!pois.empty()) ocr_id = pois[0].id;
             ids.push_back(ocr_id);
             obs.push_back(rel_pose_defualt);
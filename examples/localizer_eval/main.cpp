@@ -1,29 +1,35 @@
 #include "dg_localizer.hpp"
+#include <thread>
+#include <mutex>
+#include <atomic>
 
 using namespace std;
 
-vector<cv::Vec3d> getGPSData(const string& dataset, double gps_noise = 0.5, const dg::Polar2& gps_offset = dg::Polar2(1, 0))
+vector<cv::Vec3d> getGPSData(const cx::CSVReader::Double2D& gps_truth, double gps_noise = 0.5, const dg::Polar2& gps_offset = dg::Polar2(1, 0), cv::RNG& rng = cv::theRNG())
 {
     vector<cv::Vec3d> gps_data;
 
-    // Load the true trajectory
-    cx::CSVReader gps_reader;
-    if (!gps_reader.open(dataset)) return gps_data;
-    cx::CSVReader::Double2D gps_truth = gps_reader.extDouble2D(1, { 0, 1, 2, 3 });
-    if (gps_truth.empty()) return gps_data;
-
     // Generate noisy GPS data
     for (size_t i = 0; i < gps_truth.size(); i++)
     {
         if (gps_truth[i].size() < 4) return gps_data;
         double t = gps_truth[i][0];
-        double x = gps_truth[i][1] + gps_offset.lin * cos(gps_truth[i][3] + gps_offset.ang) + cv::theRNG().gaussian(gps_noise);
-        double y = gps_truth[i][2] + gps_offset.lin * sin(gps_truth[i][3] + gps_offset.ang) + cv::theRNG().gaussian(gps_noise);
+        double x = gps_truth[i][1] + gps_offset.lin * cos(gps_truth[i][3] + gps_offset.ang) + rng.gaussian(gps_noise);
+        double y = gps_truth[i][2] + gps_offset.lin * sin(gps_truth[i][3] + gps_offset.ang) + rng.gaussian(gps_noise);
         gps_data.push_back(cv::Vec3d(t, x, y));
     }
     return gps_data;
 }
 
+vector<cv::Vec3d> getGPSData(const string& dataset, double gps_noise = 0.5, const dg::Polar2& gps_offset = dg::Polar2(1, 0), cv::RNG& rng = cv::theRNG())
+{
+    // Load the true trajectory
+    cx::CSVReader gps_reader;
+    if (!gps_reader.open(dataset)) return vector<cv::Vec3d>();
+    cx::CSVReader::Double2D gps_truth = gps_reader.extDouble2D(1, { 0, 1, 2, 3 });
+    return getGPSData(gps_truth, gps_noise, gps_offset, rng);
+}
+
 cv::Ptr<dg::EKFLocalizer> getEKFLocalizer(const string& name)
 {
     cv::Ptr<dg::EKFLocalizer> localizer;
@@ -181,7 +187,28 @@ int runLocalizerSynthetic(const string& localizer_name, const string& gps_file,
     return runLocalizer(localizer, gps_data, "", wait_msec, &painter);
 }
 
-int expLocalizersSynthetic(int trial_num = 100)
+uint64 mixSeed(uint64 x)
+{
+    // The SplitMix64 finalizer
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+struct ExpTask
+{
+    size_t traj;
+    size_t gps_noise;
+    size_t gps_offset;
+    size_t gps_freq;
+    size_t wait_time;
+    size_t init;
+    size_t motion_noise;
+    int trial;
+};
+
+int expLocalizersSynthetic(int trial_num = 100, bool smoothing = false, const string& result_file = "data_localizer/synthetic_results.csv", uint64 seed = 0x2020, int thread_num = -1)
 {
     const vector<double> gps_noise_set = { 0.1, 0.2, 0.3, 0.4, 0.5, 0.6, 0.7, 0.8, 0.9, 1.0 };
     const vector<double> gps_offset_set = { 0, 1 };
@@ -195,63 +222,116 @@ int expLocalizersSynthetic(int trial_num = 100)
     const vector<string> localizer_name_set = { "EKFLocalizer", "EKFLocalizerHyperTan", "EKFLocalizerZeroGyro" };
     const vector<string> localizer_abbr_set = { "CV", "HT", "ZG" };
 
-    const size_t total_num = gps_noise_set.size() * gps_offset_set.size() * gps_freq_set.size() * wait_time_set.size() * init_set.size() * motion_noise_set.size();
-    size_t count = 0;
-    for (auto gps_noise = gps_noise_set.begin(); gps_noise != gps_noise_set.end(); gps_noise++)
+    // Load the true trajectories once and share them among tasks
+    map<string, cx::CSVReader::Double2D> truth_set;
+    for (auto traj = traj_set.begin(); traj != traj_set.end(); traj++)
     {
-        for (auto gps_offset = gps_offset_set.begin(); gps_offset != gps_offset_set.end(); gps_offset++)
+        for (auto gps_freq = gps_freq_set.begin(); gps_freq != gps_freq_set.end(); gps_freq++)
         {
-            for (auto gps_freq = gps_freq_set.begin(); gps_freq != gps_freq_set.end(); gps_freq++)
+            for (auto wait_time = wait_time_set.begin(); wait_time != wait_time_set.end(); wait_time++)
             {
-                for (auto wait_time = wait_time_set.begin(); wait_time != wait_time_set.end(); wait_time++)
+                string dataset_file = cv::format("data_localizer/synthetic_truth/%s(%02.0fHz,%02.0fs).pose.csv", traj->c_str(), *gps_freq, *wait_time);
+                cx::CSVReader csv;
+                if (!csv.open(dataset_file)) return -1;
+                truth_set[dataset_file] = csv.extDouble2D(1, { 0, 1, 2, 3 });
+                if (truth_set[dataset_file].empty()) return -1;
+            }
+        }
+    }
+
+    // Flatten all configurations and trials into independent tasks
+    vector<ExpTask> tasks;
+    for (size_t gps_noise = 0; gps_noise < gps_noise_set.size(); gps_noise++)
+        for (size_t gps_offset = 0; gps_offset < gps_offset_set.size(); gps_offset++)
+            for (size_t gps_freq = 0; gps_freq < gps_freq_set.size(); gps_freq++)
+                for (size_t wait_time = 0; wait_time < wait_time_set.size(); wait_time++)
+                    for (size_t init = 0; init < init_set.size(); init++)
+                        for (size_t motion_noise = 0; motion_noise < motion_noise_set.size(); motion_noise++)
+                            for (size_t traj = 0; traj < traj_set.size(); traj++)
+                                for (int trial = 0; trial < trial_num; trial++)
+                                    tasks.push_back({ traj, gps_noise, gps_offset, gps_freq, wait_time, init, motion_noise, trial });
+
+    // Prepare the result file
+    FILE* result = fopen(result_file.c_str(), "wt");
+    if (result == nullptr) return -1;
+    fprintf(result, "# Traj, GPSFreq[Hz], WaitTime[sec], Init, GPSNoise[m], GPSOffset[m], MotionNoise, Method, Trial, Time[sec], X[m], Y[m], Theta[rad], LinVel[m/s], AngVel[rad/s]\n");
+
+    // Run the tasks on all cores (each worker takes the next remaining task)
+    std::atomic<size_t> next_task(0);
+    std::atomic<int> error_code(0);
+    size_t done_num = 0;
+    std::mutex result_mutex;
+    auto worker = [&]()
+    {
+        for (size_t t = next_task++; t < tasks.size() && error_code == 0; t = next_task++)
+        {
+            const ExpTask& task = tasks[t];
+            const double gps_noise = gps_noise_set[task.gps_noise], gps_offset = gps_offset_set[task.gps_offset], motion_noise = motion_noise_set[task.motion_noise];
+            const dg::Pose2& init = init_set[task.init];
+            string config_text = cv::format("%s, %.0f, %.0f, %zd, %.1f, %.0f, %.02f", traj_set[task.traj].c_str(), gps_freq_set[task.gps_freq], wait_time_set[task.wait_time], task.init, gps_noise, gps_offset, motion_noise);
+            string dataset_file = cv::format("data_localizer/synthetic_truth/%s(%02.0fHz,%02.0fs).pose.csv", traj_set[task.traj].c_str(), gps_freq_set[task.gps_freq], wait_time_set[task.wait_time]);
+
+            // Generate GPS data with the task's own random seed (hashed not to correlate streams of adjacent tasks)
+            cv::RNG rng(mixSeed(mixSeed(seed) ^ t));
+            vector<cv::Vec3d> gps_data = getGPSData(truth_set.at(dataset_file), gps_noise, dg::Polar2(gps_offset, 0), rng);
+            if (gps_data.empty())
+            {
+                error_code = -1;
+                break;
+            }
+            string rows;
+            for (auto gps = gps_data.begin(); gps != gps_data.end(); gps++)
+                rows += cv::format("%s, GPS, %d, %f, %f, %f, 0, 0, 0\n", config_text.c_str(), task.trial, gps->val[0], gps->val[1], gps->val[2]);
+
+            // Run three localizers
+            for (size_t l = 0; l < localizer_name_set.size(); l++)
+            {
+                cv::Ptr<dg::EKFLocalizer> localizer = getEKFLocalizer(localizer_name_set[l]);
+                if (localizer.empty()
+                    || !localizer->setParamMotionNoise(motion_noise, motion_noise)
+                    || !localizer->setParamGPSNoise(gps_noise)
+                    || !localizer->setParamValue("offset_gps", { gps_offset, 0 })
+                    || !localizer->setState(cv::Vec<double, 5>(init.x, init.y, init.theta, 0, 0))
+                    || (smoothing && !localizer->startSmoothing()))
                 {
-                    for (auto init = init_set.begin(); init != init_set.end(); init++)
+                    error_code = -2;
+                    break;
+                }
+
+                for (auto gps = gps_data.begin(); gps != gps_data.end(); gps++)
+                {
+                    localizer->applyPosition({ gps->val[1], gps->val[2] }, gps->val[0]);
+                    dg::Pose2 pose = localizer->getPose();
+                    dg::Polar2 velocity = localizer->getVelocity();
+                    rows += cv::format("%s, %s, %d, %f, %f, %f, %f, %f, %f\n", config_text.c_str(), localizer_abbr_set[l].c_str(), task.trial, gps->val[0], pose.x, pose.y, pose.theta, velocity.lin, velocity.ang);
+                }
+
+                vector<dg::Timestamp> times;
+                cv::Mat states;
+                if (smoothing && localizer->getSmoothedStates(times, states))
+                {
+                    for (int i = 0; i < states.rows; i++)
                     {
-                        for (auto motion_noise = motion_noise_set.begin(); motion_noise != motion_noise_set.end(); motion_noise++)
-                        {
-                            string config_text = cv::format("(%02.0fHz,%02.0fs,%d)(%.1f,%.0fm,%.02f)", *gps_freq, *wait_time, *init, *gps_noise, *gps_offset, *motion_noise);
-                            printf("Experiment Progress: %zd / %zd %s\n", ++count, total_num, config_text.c_str());
-
-                            for (auto traj = traj_set.begin(); traj != traj_set.end(); traj++)
-                            {
-                                string dataset_file = cv::format("data_localizer/synthetic_truth/%s(%02.0fHz,%02.0fs).pose.csv", traj->c_str(), *gps_freq, *wait_time);
-                                for (int trial = 0; trial < trial_num; trial++)
-                                {
-                                    string result_name = cv::format("data_localizer/synthetic_results/%s%s", traj->c_str(), config_text.c_str()) + ".%s" + cv::format(".%03d.csv", trial);
-
-                                    // Generate and save GPS data
-                                    dg::Polar2 gps_offset_polar(*gps_offset, 0);
-                                    vector<cv::Vec3d> gps_data = getGPSData(dataset_file, *gps_noise, gps_offset_polar);
-                                    if (gps_data.empty()) return -1;
-                                    FILE* gps_file = fopen(cv::format(result_name.c_str(), "GPS").c_str(), "wt");
-                                    if (gps_file == nullptr) return -1;
-                                    fprintf(gps_file, "# Time[sec], X[m], Y[m], Theta[rad], LinVel[m/s], AngVel[rad/s]\n");
-                                    for (auto gps = gps_data.begin(); gps != gps_data.end(); gps++)
-                                        fprintf(gps_file, "%f, %f, %f, 0, 0, 0\n", gps->val[0], gps->val[1], gps->val[2]);
-                                    fclose(gps_file);
-
-                                    // Run three localizers
-                                    for (size_t l = 0; l < localizer_name_set.size(); l++)
-                                    {
-                                        cv::Ptr<dg::EKFLocalizer> localizer = getEKFLocalizer(localizer_name_set[l]);
-                                        if (localizer.empty()) return -2;
-                                        if (!localizer->setParamMotionNoise(*motion_noise, *motion_noise)) return -2;
-                                        if (!localizer->setParamGPSNoise(*gps_noise)) return -2;
-                                        if (!localizer->setParamValue("offset_gps", { *gps_offset, 0 })) return -2;
-                                        if (!localizer->setState(cv::Vec<double, 5>(init->x, init->y, init->theta, 0, 0))) return -2;
-
-                                        if (runLocalizer(localizer, gps_data, cv::format(result_name.c_str(), localizer_abbr_set[l])) < 0)
-                                            printf("  %s failed at %s and %d trial\n", localizer_abbr_set[l].c_str(), traj->c_str(), trial);
-                                    }
-                                }
-                            }
-                        }
+                        if (times[i] < 0) continue; // Skip the initial state
+                        const double* state = states.ptr<double>(i);
+                        rows += cv::format("%s, %sS, %d, %f, %f, %f, %f, %f, %f\n", config_text.c_str(), localizer_abbr_set[l].c_str(), task.trial, times[i], state[0], state[1], state[2], state[3], state[4]);
                     }
                 }
             }
+
+            // Stream the task results into the result file
+            std::lock_guard<std::mutex> lock(result_mutex);
+            fputs(rows.c_str(), result);
+            if (++done_num % 100 == 0 || done_num == tasks.size())
+                printf("Experiment Progress: %zd / %zd\n", done_num, tasks.size());
         }
-    }
-    return 0;
+    };
+    if (thread_num <= 0) thread_num = max(cv::getNumberOfCPUs(), 1);
+    vector<std::thread> workers;
+    for (int i = 0; i < thread_num; i++) workers.push_back(std::thread(worker));
+    for (auto w = workers.begin(); w != workers.end(); w++) w->join();
+    fclose(result);
+    return error_code;
 }
 
 int cvtGPSData2UTM(const string& gps_file = "data/191115_ETRI_asen_fix.csv", const string& utm_file = "ETRI_191115.pose.csv", const dg::LatLon& ref_pts = dg::LatLon(36.383837659737, 127.367880828442))
@@ -4,6 +4,8 @@
 #include "test_localizer_road.hpp"
 #include "test_localizer_simple.hpp"
 #include "test_localizer_ekf.hpp"
+#include "test_localizer_particle.hpp"
+#include "test_localizer_hmm.hpp"
 #include "test_localizer_etri.hpp"
 
 int main()
@@ -41,12 +43,28 @@ int main()
     // 4. Test localizers
     VVS_RUN_TEST(testLocBaseDist2());
     VVS_RUN_TEST(testLocBaseNearest());
+    VVS_RUN_TEST(testLocBaseUpdateMap());
     VVS_RUN_TEST(testLocBaseTrack());
     VVS_RUN_TEST(testLocSimple());
 
     VVS_RUN_TEST(testLocEKFGPS());
     VVS_RUN_TEST(testLocEKFGyroGPS());
     VVS_RUN_TEST(testLocEKFLocClue());
+    VVS_RUN_TEST(testLocEKFLocClueBatch());
+    VVS_RUN_TEST(testLocEKFDelayedGPS());
+    VVS_RUN_TEST(testLocEKFSnapshot());
+    VVS_RUN_TEST(testLocEKFCache());
+    VVS_RUN_TEST(testLocEKFSmoother());
+    VVS_RUN_TEST(testLocEKFIMU());
+    VVS_RUN_TEST(testLocEKFOrientation());
+    VVS_RUN_TEST(testLocEKFGeofence());
+    VVS_RUN_TEST(testLocEKFCheckpoint());
+    VVS_RUN_TEST(testLocEKFPoseAt());
+    VVS_RUN_TEST(testLocEKFEnsemble());
+
+    VVS_RUN_TEST(testLocParticleJunction());
+    VVS_RUN_TEST(testLocParticleShared());
+    VVS_RUN_TEST(testLocHMMJunction());
 
     VVS_RUN_TEST(testLocETRIMap2RoadMap());
     VVS_RUN_TEST(testLocETRISyntheticMap());
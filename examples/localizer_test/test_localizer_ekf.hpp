@@ -98,4 +98,504 @@ int testLocEKFLocClue(const dg::Polar2 obs_noise = dg::Polar2(0.3, 0.1), const d
     return 0;
 }
 
+int testLocEKFLocClueBatch(const dg::Polar2 obs_noise = dg::Polar2(0.3, 0.1), double interval = 0.1, double velocity = 1)
+{
+    const std::vector<dg::Point2ID> landmarks = { dg::Point2ID(3335, 15, 1), dg::Point2ID(3336, 5, 8), dg::Point2ID(3337, 12, -6) };
+    dg::EKFLocalizer localizer;
+    dg::RoadMap map;
+    for (auto lm = landmarks.begin(); lm != landmarks.end(); lm++)
+        if (!map.addNode(*lm)) return -1;
+    if (!localizer.loadMap(map)) return -1;
+    if (!localizer.setParamLocClueNoise(obs_noise.lin, obs_noise.ang)) return -1;
+    if (!localizer.setParamValue("gate_loc_clue", 1000)) return -1;
+
+    printf("| Time [sec] | Outlier Rejected | Pose [m] [deg] | Velocity [m/s] [deg/s] | Confidence |\n");
+    printf("| ---------- | ---------------- | -------------- | ---------------------- | ---------- |\n");
+    for (double t = interval; t < 10; t += interval)
+    {
+        dg::Pose2 truth(velocity * t, 1, 0); // Going straight from (0, 1, 0)
+
+        // Apply noisy observations of all landmarks at once
+        std::vector<dg::ID> ids;
+        std::vector<dg::Polar2> obs;
+        for (auto lm = landmarks.begin(); lm != landmarks.end(); lm++)
+        {
+            double dx = lm->x - truth.x, dy = lm->y - truth.y;
+            ids.push_back(lm->id);
+            obs.push_back(dg::Polar2(sqrt(dx * dx + dy * dy) + cv::theRNG().gaussian(obs_noise.lin), atan2(dy, dx) + cv::theRNG().gaussian(obs_noise.ang)));
+        }
+        if (!localizer.applyLocClue(ids, obs, t)) return -1;
+
+        // Apply an outlier (a wrong ID) which should be rejected by the gate
+        bool rejected = false;
+        if (t > 5)
+        {
+            rejected = !localizer.applyLocClue(landmarks.front().id, dg::Polar2(20, CV_PI / 2), t);
+            VVS_CHECK_TRUE(rejected);
+        }
+
+        // Print the current pose
+        dg::Pose2 pose = localizer.getPose();
+        dg::Polar2 velocity = localizer.getVelocity();
+        double confidence = localizer.getPoseConfidence();
+        printf("| %.1f | %d | %.3f, %.3f, %.1f | %.3f, %.1f | %.3f |\n",
+            t, rejected, pose.x, pose.y, cx::cvtRad2Deg(pose.theta), velocity.lin, cx::cvtRad2Deg(velocity.ang), confidence);
+    }
+
+    // Check a clue with lower confidence is applied with larger noise
+    dg::EKFLocalizer confident, doubtful;
+    if (!confident.loadMap(map) || !doubtful.loadMap(map)) return -1;
+    if (!confident.setParamLocClueNoise(obs_noise.lin, obs_noise.ang) || !doubtful.setParamLocClueNoise(obs_noise.lin, obs_noise.ang)) return -1;
+    const dg::Point2ID& lm = landmarks.front();
+    dg::Polar2 clue(sqrt((lm.x - 0) * (lm.x - 0) + (lm.y - 1) * (lm.y - 1)), atan2(lm.y - 1, lm.x - 0));
+    VVS_CHECK_TRUE(confident.applyLocClue(lm.id, clue, 1, 1));
+    VVS_CHECK_TRUE(doubtful.applyLocClue(lm.id, clue, 1, 0.1));
+    VVS_CHECK_TRUE(confident.getPoseConfidence() > doubtful.getPoseConfidence());
+    VVS_CHECK_TRUE(!doubtful.applyLocClue(lm.id, clue, 2, 0));
+    return 0;
+}
+
+int testLocEKFDelayedGPS(int delay_steps = 3, double gyro_noise = 0.01, double gps_noise = 0.3, double interval = 0.1, double velocity = 1)
+{
+    dg::EKFLocalizer localizer_seq, localizer_oos;
+    VVS_CHECK_TRUE(localizer_seq.setParamMotionNoise(1, 1, gyro_noise));
+    VVS_CHECK_TRUE(localizer_seq.setParamGPSNoise(gps_noise));
+    VVS_CHECK_TRUE(localizer_oos.setParamMotionNoise(1, 1, gyro_noise));
+    VVS_CHECK_TRUE(localizer_oos.setParamGPSNoise(gps_noise));
+
+    std::vector<std::pair<double, dg::Point2>> gps_queue;
+    double gyro_prev = 0;
+    for (double t = interval; t < 10; t += interval)
+    {
+        dg::Pose2 truth(velocity * t, 1, 0); // Going straight from (0, 1, 0)
+        double gyro = cv::theRNG().gaussian(gyro_noise);
+        dg::Point2 gps(truth.x + cv::theRNG().gaussian(gps_noise), truth.y + cv::theRNG().gaussian(gps_noise));
+
+        // Apply data in sequence
+        VVS_CHECK_TRUE(localizer_seq.applyOdometry(gyro, gyro_prev, t, t - interval));
+        VVS_CHECK_TRUE(localizer_seq.applyPosition(gps, t));
+
+        // Apply gyroscope data in sequence but GPS data with delay
+        VVS_CHECK_TRUE(localizer_oos.applyOdometry(gyro, gyro_prev, t, t - interval));
+        gps_queue.push_back(std::make_pair(t, gps));
+        if (gps_queue.size() > static_cast<size_t>(delay_steps))
+        {
+            VVS_CHECK_TRUE(localizer_oos.applyPosition(gps_queue.front().second, gps_queue.front().first));
+            gps_queue.erase(gps_queue.begin());
+        }
+        gyro_prev = gyro;
+    }
+    for (auto gps = gps_queue.begin(); gps != gps_queue.end(); gps++)
+        VVS_CHECK_TRUE(localizer_oos.applyPosition(gps->second, gps->first));
+
+    // Check both results are same
+    dg::Pose2 pose_seq = localizer_seq.getPose(), pose_oos = localizer_oos.getPose();
+    VVS_CHECK_NEAR(pose_seq.x, pose_oos.x);
+    VVS_CHECK_NEAR(pose_seq.y, pose_oos.y);
+    VVS_CHECK_NEAR(pose_seq.theta, pose_oos.theta);
+    VVS_CHECK_NEAR(localizer_seq.getPoseConfidence(), localizer_oos.getPoseConfidence());
+    return 0;
+}
+
+int testLocEKFSnapshot(double interval = 0.1, double velocity = 1)
+{
+    dg::EKFLocalizer localizer;
+    VVS_CHECK_TRUE(localizer.getPoseSnapshot() != nullptr);
+    VVS_CHECK_TRUE(localizer.getPoseSnapshot()->time < 0);
+
+    std::shared_ptr<const dg::PoseSnapshot> snapshot_prev;
+    for (double t = interval; t < 3; t += interval)
+    {
+        dg::Pose2 truth(velocity * t, 1, 0); // Going straight from (0, 1, 0)
+        VVS_CHECK_TRUE(localizer.applyPosition(truth, t));
+
+        // Check the published snapshot is consistent with the current state
+        std::shared_ptr<const dg::PoseSnapshot> snapshot = localizer.getPoseSnapshot();
+        dg::Pose2 pose = localizer.getPose();
+        VVS_CHECK_NEAR(snapshot->time, t);
+        VVS_CHECK_NEAR(snapshot->pose.x, pose.x);
+        VVS_CHECK_NEAR(snapshot->pose.y, pose.y);
+        VVS_CHECK_NEAR(snapshot->pose.theta, pose.theta);
+        VVS_CHECK_NEAR(snapshot->confidence, localizer.getPoseConfidence());
+        VVS_CHECK_TRUE(snapshot->covariance.rows == 5 && snapshot->covariance.cols == 5);
+        VVS_CHECK_NEAR(snapshot->pose_gps.lat, localizer.getPoseGPS().lat);
+        VVS_CHECK_NEAR(snapshot->pose_gps.lon, localizer.getPoseGPS().lon);
+        VVS_CHECK_TRUE(snapshot->pose_topo.node_id == localizer.getPoseTopometric().node_id);
+
+        // Check the previous snapshot is not modified by the update
+        if (snapshot_prev) VVS_CHECK_NEAR(snapshot_prev->time, t - interval);
+        snapshot_prev = snapshot;
+    }
+    return 0;
+}
+
+int testLocEKFCache(double interval = 0.1, double velocity = 1)
+{
+    dg::EKFLocalizer localizer;
+    VVS_CHECK_TRUE(localizer.setReference(dg::LatLon(36.383837659737, 127.367880828442)));
+    for (double t = interval; t < 3; t += interval)
+    {
+        dg::Pose2 truth(velocity * t, 1, 0); // Going straight from (0, 1, 0)
+        VVS_CHECK_TRUE(localizer.applyPosition(truth, t));
+
+        // Check cached outputs are same with their direct calculation
+        for (int repeat = 0; repeat < 2; repeat++)
+        {
+            dg::LatLon ll = localizer.getPoseGPS(), ll_direct = localizer.toLatLon(localizer.getPose());
+            VVS_CHECK_TRUE(ll.lat == ll_direct.lat && ll.lon == ll_direct.lon);
+
+            cv::Mat cov = localizer.getStateCov();
+            double conf = 1 / (1 + exp(log10(cv::determinant(cov.rowRange(0, 3).colRange(0, 3))) + 2));
+            VVS_CHECK_TRUE(localizer.getPoseConfidence() == conf);
+        }
+    }
+
+    // Check the cache is invalidated by the changed state
+    uint64 version = localizer.getStateVersion();
+    dg::LatLon ll_prev = localizer.getPoseGPS();
+    cv::Mat state = (cv::Mat_<double>(5, 1) << 100, 100, 0, 0, 0);
+    VVS_CHECK_TRUE(localizer.setState(state));
+    VVS_CHECK_TRUE(localizer.getStateVersion() != version);
+    VVS_CHECK_TRUE(localizer.getPoseGPS().lat != ll_prev.lat);
+    return 0;
+}
+
+int testLocEKFSmoother(double gps_noise = 0.5, double interval = 0.1, double velocity = 1)
+{
+    dg::EKFLocalizer localizer;
+    VVS_CHECK_TRUE(localizer.setParamMotionNoise(0.1, 0.1));
+    VVS_CHECK_TRUE(localizer.setParamGPSNoise(gps_noise));
+    VVS_CHECK_TRUE(localizer.startSmoothing());
+
+    cv::RNG rng(3);
+    std::vector<dg::Pose2> truth_set, filter_set;
+    double t_last = 0;
+    for (double t = interval; t < 20; t += interval)
+    {
+        dg::Pose2 truth(velocity * t, 1, 0); // Going straight from (0, 1, 0)
+        dg::Point2 gps(truth.x + rng.gaussian(gps_noise), truth.y + rng.gaussian(gps_noise));
+        VVS_CHECK_TRUE(localizer.applyPosition(gps, t));
+        truth_set.push_back(truth);
+        filter_set.push_back(localizer.getPose());
+        t_last = t;
+    }
+
+    // Apply a fix without prediction (it should not re-stamp the last step)
+    VVS_CHECK_TRUE(localizer.applyPosition(dg::Point2(velocity * t_last, 1), t_last + 0.001));
+
+    // Check the smoothed trajectory is more accurate than the filtered one
+    std::vector<dg::Timestamp> times;
+    cv::Mat states;
+    VVS_CHECK_TRUE(localizer.getSmoothedStates(times, states));
+    VVS_CHECK_EQUL(times.size(), truth_set.size()); // The initial state is updated by the first fix
+    VVS_CHECK_EQUL(states.rows, static_cast<int>(times.size()));
+    VVS_CHECK_NEAR(times.front(), interval);
+    VVS_CHECK_NEAR(times.back(), t_last);
+    double error_filter = 0, error_smooth = 0;
+    for (size_t i = 0; i < truth_set.size(); i++)
+    {
+        const double* smooth = states.ptr<double>(static_cast<int>(i));
+        error_filter += sqrt((filter_set[i].x - truth_set[i].x) * (filter_set[i].x - truth_set[i].x) + (filter_set[i].y - truth_set[i].y) * (filter_set[i].y - truth_set[i].y));
+        error_smooth += sqrt((smooth[0] - truth_set[i].x) * (smooth[0] - truth_set[i].x) + (smooth[1] - truth_set[i].y) * (smooth[1] - truth_set[i].y));
+    }
+    VVS_CHECK_TRUE(error_smooth < error_filter);
+
+    // Check the last smoothed state is same with the filtered one
+    dg::Pose2 pose = localizer.getPose();
+    VVS_CHECK_NEAR(states.at<double>(states.rows - 1, 0), pose.x);
+    VVS_CHECK_NEAR(states.at<double>(states.rows - 1, 1), pose.y);
+    VVS_CHECK_TRUE(localizer.stopSmoothing());
+    VVS_CHECK_TRUE(!localizer.getSmoothedStates(times, states));
+    return 0;
+}
+
+int testLocEKFIMU(double rate = 256, double gyro = 0.1, double accel = 0.05, double duration = 10)
+{
+    const double gyro_noise = 0.01, accel_noise = 0.1;
+    dg::EKFLocalizer localizer_seq, localizer_pre;
+    VVS_CHECK_TRUE(localizer_seq.setParamValue("imu_period", 0));
+    VVS_CHECK_TRUE(localizer_pre.setParamValue("imu_period", 0.125));
+    VVS_CHECK_TRUE(localizer_seq.setParamIMUNoise(gyro_noise, accel_noise));
+    VVS_CHECK_TRUE(localizer_pre.setParamIMUNoise(gyro_noise, accel_noise));
+    cv::Mat state = (cv::Mat_<double>(5, 1) << 0, 0, 0, 1, gyro);
+    VVS_CHECK_TRUE(localizer_seq.setState(state.clone()));
+    VVS_CHECK_TRUE(localizer_pre.setState(state.clone()));
+
+    // Apply IMU samples one by one and preintegrated
+    uint64 version_seq = localizer_seq.getStateVersion(), version_pre = localizer_pre.getStateVersion();
+    for (int i = 0; i <= duration * rate; i++)
+    {
+        double t = i / rate;
+        VVS_CHECK_TRUE(localizer_seq.applyIMU(gyro, accel, t));
+        VVS_CHECK_TRUE(localizer_pre.applyIMU(gyro, accel, t));
+    }
+    VVS_CHECK_TRUE((localizer_pre.getStateVersion() - version_pre) * 10 < localizer_seq.getStateVersion() - version_seq);
+
+    // Check both results are same
+    dg::Pose2 pose_seq = localizer_seq.getPose(), pose_pre = localizer_pre.getPose();
+    VVS_CHECK_NEAR(pose_seq.x, pose_pre.x);
+    VVS_CHECK_NEAR(pose_seq.y, pose_pre.y);
+    VVS_CHECK_NEAR(pose_seq.theta, pose_pre.theta);
+    VVS_CHECK_NEAR(localizer_seq.getVelocity().lin, localizer_pre.getVelocity().lin);
+    cv::Mat cov_seq = localizer_seq.getStateCov(), cov_pre = localizer_pre.getStateCov();
+    VVS_CHECK_NEAR(cv::trace(cov_seq(cv::Rect(0, 0, 4, 4)))[0], cv::trace(cov_pre(cv::Rect(0, 0, 4, 4)))[0]);
+
+    // Check the angular velocity is as uncertain as the gyro noise density over each prediction
+    VVS_CHECK_NEAR(cov_seq.at<double>(4, 4), gyro_noise * gyro_noise * rate);
+    VVS_CHECK_NEAR(cov_pre.at<double>(4, 4), gyro_noise * gyro_noise / 0.125);
+
+    // Check the result is close to the truth, (v_0 + a t) [ cos(w t), sin(w t) ]
+    VVS_CHECK_TRUE(fabs(pose_pre.theta - gyro * duration) < 1e-6);
+    VVS_CHECK_TRUE(fabs(localizer_pre.getVelocity().lin - (1 + accel * duration)) < 1e-6);
+    return 0;
+}
+
+int testLocEKFOrientation(double interval = 0.1)
+{
+    // Check heading observations with different confidence
+    dg::EKFLocalizer localizer_high, localizer_low;
+    VVS_CHECK_TRUE(localizer_high.applyOrientation(0.5, interval, 1));
+    VVS_CHECK_TRUE(localizer_low.applyOrientation(0.5, interval, 0.1));
+    VVS_CHECK_TRUE(!localizer_low.applyOrientation(0.5, interval, 0));
+    double theta_high = localizer_high.getPose().theta, theta_low = localizer_low.getPose().theta;
+    VVS_CHECK_TRUE(theta_high > 0 && theta_high < 0.5);
+    VVS_CHECK_TRUE(theta_low > 0 && theta_low < theta_high);
+
+    // Check the heading observation across the discontinuity at +-CV_PI
+    cv::Mat state = (cv::Mat_<double>(5, 1) << 0, 0, 3, 0, 0);
+    VVS_CHECK_TRUE(localizer_high.setState(state));
+    VVS_CHECK_TRUE(localizer_high.applyOrientation(-3, 2 * interval, 1));
+    VVS_CHECK_TRUE(fabs(cx::trimRad(localizer_high.getPose().theta - CV_PI)) < 0.2);
+
+    // Check pose observations
+    dg::EKFLocalizer localizer_pose;
+    VVS_CHECK_TRUE(localizer_pose.setParamPoseNoise(0.1, 0.01));
+    dg::Pose2 truth(10, 5, 1);
+    for (int i = 1; i < 10; i++)
+        VVS_CHECK_TRUE(localizer_pose.applyPose(truth, i * interval));
+    dg::Pose2 pose = localizer_pose.getPose();
+    VVS_CHECK_TRUE(fabs(pose.x - truth.x) < 1 && fabs(pose.y - truth.y) < 1 && fabs(pose.theta - truth.theta) < 0.1);
+    return 0;
+}
+
+int testLocEKFGeofence(int zone_num = 2000)
+{
+    // Check the geofence index with many triangular zones
+    dg::Geofence geofence;
+    cv::RNG rng(7);
+    std::vector<dg::GeoZone> zones;
+    for (int i = 1; i <= zone_num; i++)
+    {
+        dg::GeoZone zone;
+        zone.id = i;
+        zone.gps_noise = i;
+        dg::Point2 center(rng.uniform(-1000., 1000.), rng.uniform(-1000., 1000.));
+        zone.polygon = { center + dg::Point2(-20, -20), center + dg::Point2(20, -20), center + dg::Point2(0, 20) };
+        VVS_CHECK_TRUE(geofence.addZone(zone));
+        zones.push_back(zone);
+    }
+    VVS_CHECK_EQUL(geofence.countZones(), zone_num);
+    for (int i = 0; i < 1000; i++)
+    {
+        // Compare with the brute-force search
+        dg::Point2 p(rng.uniform(-1000., 1000.), rng.uniform(-1000., 1000.));
+        dg::ID truth = 0;
+        for (auto zone = zones.begin(); zone != zones.end(); zone++)
+        {
+            const std::vector<dg::Point2>& t = zone->polygon;
+            double d0 = (t[1] - t[0]).cross(p - t[0]), d1 = (t[2] - t[1]).cross(p - t[1]), d2 = (t[0] - t[2]).cross(p - t[2]);
+            if (d0 > 0 && d1 > 0 && d2 > 0) truth = zone->id; // The last zone has the largest GPS noise
+        }
+        const dg::GeoZone* found = geofence.findZone(p);
+        VVS_CHECK_EQUL(found == nullptr ? 0 : found->id, truth);
+    }
+    VVS_CHECK_TRUE(geofence.removeZone(1));
+    VVS_CHECK_TRUE(geofence.getZone(1) == nullptr);
+    VVS_CHECK_EQUL(geofence.countZones(), zone_num - 1);
+
+    // Check a zone whose maximum corner is on a cell edge is removed from all its cells
+    dg::Geofence geofence_edge;
+    const double edge_min = -948.5384743373694, edge_max = 750; // 'edge_min + (edge_max - edge_min)' is rounded below 'edge_max'
+    VVS_CHECK_TRUE(geofence_edge.addZone(dg::Point2(edge_min, edge_min), dg::Point2(edge_max, edge_max), 1));
+    VVS_CHECK_TRUE(geofence_edge.addZone(dg::Point2(edge_max, edge_max), dg::Point2(edge_max + 10, edge_max + 10), 2));
+    VVS_CHECK_TRUE(geofence_edge.removeZone(1));
+    const dg::GeoZone* found_edge = geofence_edge.findZone(dg::Point2(edge_max + 5, edge_max + 5));
+    VVS_CHECK_TRUE(found_edge != nullptr && found_edge->id == 2);
+    VVS_CHECK_TRUE(geofence_edge.removeZone(2));
+    VVS_CHECK_TRUE(geofence_edge.findZone(dg::Point2(edge_max, edge_max)) == nullptr);
+
+    // Check GPS data in a noisy zone are less trusted
+    dg::EKFLocalizer localizer_normal, localizer_zone;
+    dg::GeoZone canyon;
+    canyon.id = 1;
+    canyon.gps_noise = 10;
+    canyon.vps_priority = 2;
+    canyon.polygon = { dg::Point2(-100, -100), dg::Point2(100, -100), dg::Point2(0, 100) };
+    VVS_CHECK_TRUE(localizer_zone.addGeoZone(canyon));
+    dg::GeoZone found;
+    VVS_CHECK_TRUE(localizer_zone.findGeoZone(dg::Point2(0, 0), found) && found.id == canyon.id);
+    VVS_CHECK_TRUE(!localizer_zone.findGeoZone(dg::Point2(90, 90), found));
+    VVS_CHECK_EQUL(localizer_zone.getVPSPriority(dg::Point2(0, 0)), 2);
+    VVS_CHECK_EQUL(localizer_zone.getVPSPriority(dg::Point2(90, 90)), 0);
+    VVS_CHECK_TRUE(localizer_normal.applyPosition(dg::Point2(5, 5), 0.1));
+    VVS_CHECK_TRUE(localizer_zone.applyPosition(dg::Point2(5, 5), 0.1));
+    VVS_CHECK_TRUE(localizer_zone.getPose().x < localizer_normal.getPose().x);
+    return 0;
+}
+
+int testLocEKFCheckpoint(const char* filename = "test_localizer_checkpoint.bin", double interval = 0.1, double velocity = 1)
+{
+    dg::EKFLocalizer localizer;
+    VVS_CHECK_TRUE(localizer.setReference(dg::LatLon(36.383837659737, 127.367880828442)));
+    VVS_CHECK_TRUE(localizer.setParamGPSNoise(0.3));
+    for (double t = interval; t < 5; t += interval)
+        VVS_CHECK_TRUE(localizer.applyPosition(dg::Point2(velocity * t, 1), t));
+    VVS_CHECK_TRUE(localizer.saveState(filename));
+
+    // Check the restored localizer is same with the original one
+    dg::EKFLocalizer restored;
+    VVS_CHECK_TRUE(restored.setReference(dg::LatLon(36.383837659737, 127.367880828442)));
+    VVS_CHECK_TRUE(restored.loadState(filename, 60));
+    VVS_CHECK_TRUE(cv::norm(restored.getState(), localizer.getState()) < 1e-9);
+    VVS_CHECK_TRUE(cv::norm(restored.getStateCov(), localizer.getStateCov()) < 1e-9);
+    VVS_CHECK_NEAR(restored.getPoseSnapshot()->pose.x, localizer.getPose().x);
+
+    // Check both localizers continue same
+    VVS_CHECK_TRUE(localizer.applyPosition(dg::Point2(velocity * 5, 1), 5));
+    VVS_CHECK_TRUE(restored.applyPosition(dg::Point2(velocity * 5, 1), 5));
+    VVS_CHECK_NEAR(restored.getPose().x, localizer.getPose().x);
+    VVS_CHECK_NEAR(restored.getPose().y, localizer.getPose().y);
+    VVS_CHECK_NEAR(restored.getPoseConfidence(), localizer.getPoseConfidence());
+
+    // Check invalid checkpoints are rejected
+    dg::EKFLocalizer other;
+    VVS_CHECK_TRUE(other.setReference(dg::LatLon(37.506207, 127.05482)));
+    VVS_CHECK_TRUE(!other.loadState(filename));
+    VVS_CHECK_TRUE(!other.loadState("not_exist_checkpoint.bin"));
+    remove(filename);
+    return 0;
+}
+
+int testLocEKFPoseAt(double interval = 0.1, double velocity = 1, double horizon = 0.5)
+{
+    dg::EKFLocalizer localizer;
+    VVS_CHECK_TRUE(localizer.setExtrapolationHorizon(horizon));
+    std::vector<dg::Pose2> poses;
+    for (double t = interval; t < 3; t += interval)
+    {
+        VVS_CHECK_TRUE(localizer.applyPosition(dg::Point2(velocity * t, 1), t));
+        poses.push_back(localizer.getPose());
+    }
+    std::shared_ptr<const dg::PoseSnapshot> snapshot = localizer.getPoseSnapshot();
+    VVS_CHECK_TRUE(snapshot->trail.size() > 2);
+    VVS_CHECK_NEAR(snapshot->trail.back().first, snapshot->time);
+
+    // Check interpolation between the last two updates
+    const dg::Pose2& p0 = poses[poses.size() - 2];
+    const dg::Pose2& p1 = poses.back();
+    dg::Pose2 mid = localizer.getPoseAt(snapshot->time - interval / 2);
+    VVS_CHECK_NEAR(mid.x, (p0.x + p1.x) / 2);
+    VVS_CHECK_NEAR(mid.y, (p0.y + p1.y) / 2);
+    dg::Pose2 last = localizer.getPoseAt(snapshot->time);
+    VVS_CHECK_NEAR(last.x, p1.x);
+
+    // Check extrapolation with the velocity and its horizon
+    VVS_CHECK_TRUE(snapshot->velocity.lin > 0);
+    dg::Pose2 ahead = localizer.getPoseAt(snapshot->time + horizon / 2);
+    dg::Pose2 edge = localizer.getPoseAt(snapshot->time + horizon);
+    dg::Pose2 clamped = localizer.getPoseAt(snapshot->time + 100);
+    VVS_CHECK_TRUE(ahead.x > p1.x && edge.x > ahead.x);
+    VVS_CHECK_NEAR(clamped.x, edge.x);
+    VVS_CHECK_NEAR(clamped.y, edge.y);
+    return 0;
+}
+
+int testLocEKFEnsemble(double interval = 0.1, double velocity = 1)
+{
+    // Check a single-member ensemble is same with its member
+    dg::EKFLocalizer single;
+    dg::EnsembleLocalizer ensemble_one;
+    VVS_CHECK_TRUE(ensemble_one.addMember(cv::makePtr<dg::EKFLocalizer>(), "EKF"));
+    for (double t = interval; t < 3; t += interval)
+    {
+        VVS_CHECK_TRUE(single.applyPosition(dg::Point2(velocity * t, 1), t));
+        VVS_CHECK_TRUE(ensemble_one.applyPosition(dg::Point2(velocity * t, 1), t));
+    }
+    VVS_CHECK_NEAR(ensemble_one.getPose().x, single.getPose().x);
+    VVS_CHECK_NEAR(ensemble_one.getPose().y, single.getPose().y);
+    VVS_CHECK_NEAR(ensemble_one.getPoseConfidence(), single.getPoseConfidence());
+
+    // Check multiple members are updated and combined
+    dg::Map map;
+    map.addNode(dg::Node(1, 36.383837659737, 127.367880828442));
+    dg::EnsembleLocalizer ensemble(2);
+    VVS_CHECK_TRUE(ensemble.setReference(dg::LatLon(36.383837659737, 127.367880828442)));
+    VVS_CHECK_TRUE(ensemble.addMember(cv::makePtr<dg::EKFLocalizer>(), "EKF"));
+    VVS_CHECK_TRUE(ensemble.addMember(cv::makePtr<dg::EKFLocalizerHyperTan>(), "EKFHyperTan"));
+    VVS_CHECK_TRUE(ensemble.addMember(cv::makePtr<dg::EKFLocalizerZeroGyro>(), "EKFZeroGyro"));
+    VVS_CHECK_EQUL(ensemble.countMembers(), 3);
+    for (int fusion = dg::EnsembleLocalizer::FUSION_CONFIDENCE; fusion <= dg::EnsembleLocalizer::FUSION_COVARIANCE_INTERSECTION; fusion++)
+    {
+        VVS_CHECK_TRUE(ensemble.setParamFusion(fusion));
+        double t_last = 0;
+        for (double t = 3 * fusion + interval; t < 3 * fusion + 3; t += interval)
+        {
+            VVS_CHECK_TRUE(ensemble.applyPosition(dg::Point2(velocity * t, 1), t));
+            t_last = t;
+        }
+        dg::Pose2 pose = ensemble.getPose();
+        VVS_CHECK_TRUE(fabs(pose.x - velocity * t_last) < 0.5 && fabs(pose.y - 1) < 0.5);
+
+        std::vector<dg::EnsembleMemberStatus> status = ensemble.getMemberStatus();
+        VVS_CHECK_EQUL(static_cast<int>(status.size()), 3);
+        double weight_sum = 0, x_min = DBL_MAX, x_max = -DBL_MAX;
+        for (auto s = status.begin(); s != status.end(); s++)
+        {
+            VVS_CHECK_TRUE(s->updated && s->snapshot != nullptr && s->weight >= 0);
+            weight_sum += s->weight;
+            x_min = std::min(x_min, s->snapshot->pose.x);
+            x_max = std::max(x_max, s->snapshot->pose.x);
+        }
+        VVS_CHECK_NEAR(weight_sum, 1);
+        VVS_CHECK_TRUE(pose.x >= x_min - 1e-6 && pose.x <= x_max + 1e-6);
+    }
+
+    // Check the topometric pose follows the fused pose and the map
+    VVS_CHECK_EQUL(ensemble.getPoseTopometric().node_id, 0);
+    dg::RoadMap road;
+    VVS_CHECK_TRUE(road.addNode(dg::Point2ID(1, 0, 1)) != nullptr);
+    VVS_CHECK_TRUE(road.addNode(dg::Point2ID(2, 100, 1)) != nullptr);
+    VVS_CHECK_TRUE(road.addRoad(1, 2));
+    VVS_CHECK_TRUE(ensemble.loadMap(road));
+    dg::TopometricPose pose_t = ensemble.getPoseTopometric();
+    VVS_CHECK_TRUE(pose_t.node_id == 1 && fabs(pose_t.dist - ensemble.getPose().x) < 1e-6);
+    VVS_CHECK_EQUL(ensemble.getMember(0)->getPoseTopometric().node_id, 1);
+
+    // Check members use the map of the ensemble without their copies
+    VVS_CHECK_TRUE(ensemble.loadMap(map));
+    VVS_CHECK_TRUE(!ensemble.getMember(0)->loadMap(map));
+    dg::Point2 landmark;
+    VVS_CHECK_TRUE(ensemble.getMember(0)->findLandmark(1, landmark));
+    VVS_CHECK_TRUE(ensemble.getMember(3).empty());
+
+    // Check members follow the reference of the ensemble
+    dg::LatLon refer_new(37.506207, 127.05482);
+    VVS_CHECK_TRUE(ensemble.setReference(refer_new));
+    VVS_CHECK_NEAR(ensemble.getMember(1)->getReference().x, ensemble.getReference().x);
+    VVS_CHECK_NEAR(ensemble.getMember(1)->getReference().y, ensemble.getReference().y);
+
+    // Check a member can outlive its ensemble
+    cv::Ptr<dg::EKFLocalizer> survivor = cv::makePtr<dg::EKFLocalizer>();
+    {
+        dg::EnsembleLocalizer ensemble_tmp;
+        VVS_CHECK_TRUE(ensemble_tmp.loadMap(map));
+        VVS_CHECK_TRUE(ensemble_tmp.addMember(survivor));
+        VVS_CHECK_TRUE(survivor->findLandmark(1, landmark));
+    }
+    VVS_CHECK_TRUE(!survivor->findLandmark(1, landmark));
+    VVS_CHECK_TRUE(survivor->loadMap(map));
+    VVS_CHECK_TRUE(survivor->findLandmark(1, landmark));
+    return 0;
+}
+
 #endif // End of '__TEST_LOCALIZER_EKF__'
@@ -0,0 +1,63 @@
+#ifndef __TEST_LOCALIZER_HMM__
+#define __TEST_LOCALIZER_HMM__
+
+#include "vvs.h"
+#include "dg_localizer.hpp"
+
+int testLocHMMJunction(double gps_noise = 3, double interval = 1, double velocity = 1)
+{
+    // Prepare a T-junction: (0, 0) - (50, 0) - (100, 0) and (50, 0) - (50, 50)
+    dg::RoadMap map;
+    for (int i = 0; i <= 10; i++)
+        VVS_CHECK_TRUE(map.addNode(dg::Point2ID(i + 1, 10 * i, 0)) != nullptr);
+    for (int i = 1; i <= 5; i++)
+        VVS_CHECK_TRUE(map.addNode(dg::Point2ID(i + 20, 50, 10 * i)) != nullptr);
+    for (int i = 1; i <= 10; i++)
+        VVS_CHECK_TRUE(map.addRoad(i, i + 1));
+    VVS_CHECK_TRUE(map.addRoad(6, 21));
+    for (int i = 21; i < 25; i++)
+        VVS_CHECK_TRUE(map.addRoad(i, i + 1));
+
+    dg::HMMMapMatcher matcher;
+    VVS_CHECK_TRUE(matcher.setReference(dg::LatLon(36.383837659737, 127.367880828442)));
+    VVS_CHECK_TRUE(matcher.setParamValue("noise_gps", gps_noise));
+    VVS_CHECK_TRUE(matcher.loadMap(map));
+
+    // Turn left at the junction with noisy GPS
+    std::vector<std::pair<double, dg::LatLon>> gps_data;
+    std::vector<dg::Point2> truth;
+    for (double t = 0; t < 100; t += interval)
+    {
+        double s = velocity * t;
+        dg::Point2 p = (s < 50) ? dg::Point2(s, 0) : dg::Point2(50, s - 50);
+        dg::Point2 gps(p.x + cv::theRNG().gaussian(gps_noise), p.y + cv::theRNG().gaussian(gps_noise));
+        gps_data.push_back(std::make_pair(t, matcher.toLatLon(gps)));
+        truth.push_back(p);
+    }
+
+    // Check the batch result
+    std::vector<dg::TopometricPose> path;
+    VVS_CHECK_TRUE(matcher.matchBatch(gps_data, path));
+    VVS_CHECK_EQUL(path.size(), gps_data.size());
+    int n_correct = 0;
+    for (size_t i = 0; i < path.size(); i++)
+    {
+        dg::Pose2 p = matcher.cvtTopmetric2Metric(path[i]);
+        double dx = p.x - truth[i].x, dy = p.y - truth[i].y;
+        if (sqrt(dx * dx + dy * dy) < 3 * gps_noise) n_correct++;
+    }
+    VVS_CHECK_TRUE(n_correct > 0.9 * path.size());
+
+    // Check the online result
+    for (size_t i = 0; i < gps_data.size(); i++)
+        VVS_CHECK_TRUE(matcher.applyGPS(gps_data[i].second, gps_data[i].first));
+    dg::TopometricPose pose_lagged;
+    dg::Timestamp time_lagged;
+    VVS_CHECK_TRUE(matcher.getPoseLagged(pose_lagged, time_lagged));
+    VVS_CHECK_TRUE(time_lagged < gps_data.back().first);
+    dg::Pose2 pose = matcher.getPose();
+    VVS_CHECK_TRUE(fabs(pose.x - truth.back().x) < 1);
+    return 0;
+}
+
+#endif // End of '__TEST_LOCALIZER_HMM__'
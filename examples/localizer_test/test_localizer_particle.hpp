@@ -0,0 +1,91 @@
+#ifndef __TEST_LOCALIZER_PARTICLE__
+#define __TEST_LOCALIZER_PARTICLE__
+
+#include "vvs.h"
+#include "dg_localizer.hpp"
+
+int testLocParticleJunction(double gps_noise = 1, double interval = 0.1, double velocity = 1, int n_particles = 2000)
+{
+    // Prepare a T-junction: (0, 0) - (50, 0) - (100, 0) and (50, 0) - (50, 50)
+    dg::RoadMap map;
+    for (int i = 0; i <= 10; i++)
+        VVS_CHECK_TRUE(map.addNode(dg::Point2ID(i + 1, 10 * i, 0)) != nullptr);
+    for (int i = 1; i <= 5; i++)
+        VVS_CHECK_TRUE(map.addNode(dg::Point2ID(i + 20, 50, 10 * i)) != nullptr);
+    for (int i = 1; i <= 10; i++)
+        VVS_CHECK_TRUE(map.addRoad(i, i + 1));
+    VVS_CHECK_TRUE(map.addRoad(6, 21));
+    for (int i = 21; i < 25; i++)
+        VVS_CHECK_TRUE(map.addRoad(i, i + 1));
+
+    dg::ParticleLocalizer localizer;
+    VVS_CHECK_TRUE(localizer.setParamValue("num_particles", n_particles));
+    VVS_CHECK_TRUE(localizer.setParamValue("noise_gps", gps_noise));
+    VVS_CHECK_TRUE(localizer.loadMap(map));
+
+    // Go straight through the junction with a gyroscope and GPS
+    int step = 0;
+    dg::Pose2 truth;
+    for (double t = interval; t < 80; t += interval, step++)
+    {
+        truth = dg::Pose2(velocity * t, 0, 0);
+        if (step > 0) VVS_CHECK_TRUE(localizer.applyOdometry(0, 0, t, t - interval));
+        if (step % 10 == 0)
+        {
+            dg::Point2 gps(truth.x + cv::theRNG().gaussian(gps_noise), truth.y + cv::theRNG().gaussian(gps_noise));
+            VVS_CHECK_TRUE(localizer.applyPosition(gps, t));
+        }
+    }
+    VVS_CHECK_EQUL(localizer.countParticles(), n_particles);
+
+    // Check the pose is on the straight road, not on the branch
+    dg::Pose2 pose = localizer.getPose();
+    VVS_CHECK_TRUE(fabs(pose.x - truth.x) < 3 * gps_noise);
+    VVS_CHECK_TRUE(fabs(pose.y - truth.y) < 1);
+    dg::TopometricPose pose_t = localizer.getPoseTopometric();
+    VVS_CHECK_TRUE(pose_t.node_id >= 7 && pose_t.node_id <= 11);
+    VVS_CHECK_TRUE(localizer.getPoseConfidence() > 0);
+    VVS_CHECK_NEAR(localizer.getPoseSnapshot()->pose.x, pose.x);
+    return 0;
+}
+
+int testLocParticleShared(double gps_noise = 1, double interval = 0.1, double velocity = 1, int n_particles = 1000)
+{
+    // Prepare a straight road: (0, 0) - (10, 0) - ... - (100, 0)
+    dg::RoadMap map;
+    for (int i = 0; i <= 10; i++)
+        VVS_CHECK_TRUE(map.addNode(dg::Point2ID(i + 1, 10 * i, 0)) != nullptr);
+    for (int i = 1; i <= 10; i++)
+        VVS_CHECK_TRUE(map.addRoad(i, i + 1));
+
+    // Use the map of another localizer
+    dg::ParticleLocalizer owner, localizer;
+    VVS_CHECK_TRUE(owner.loadMap(map));
+    VVS_CHECK_TRUE(localizer.shareMap(&owner));
+    VVS_CHECK_TRUE(localizer.setParamValue("num_particles", n_particles));
+    VVS_CHECK_TRUE(localizer.setParamValue("noise_gps", gps_noise));
+
+    // Go straight with a gyroscope, GPS, and a clue without its distance
+    int step = 0;
+    dg::Pose2 truth;
+    for (double t = interval; t < 40; t += interval, step++)
+    {
+        truth = dg::Pose2(velocity * t, 0, 0);
+        if (step > 0) VVS_CHECK_TRUE(localizer.applyOdometry(0, 0, t, t - interval));
+        if (step % 10 == 0)
+        {
+            dg::Point2 gps(truth.x + cv::theRNG().gaussian(gps_noise), truth.y + cv::theRNG().gaussian(gps_noise));
+            VVS_CHECK_TRUE(localizer.applyPosition(gps, t));
+        }
+    }
+    VVS_CHECK_TRUE(localizer.applyLocClue(11, dg::Polar2(-1, 0), truth.x / velocity));
+    VVS_CHECK_FALSE(localizer.applyLocClue(11, dg::Polar2(-1, CV_PI), truth.x / velocity));
+    VVS_CHECK_EQUL(localizer.countParticles(), n_particles);
+
+    dg::Pose2 pose = localizer.getPose();
+    VVS_CHECK_TRUE(fabs(pose.x - truth.x) < 3 * gps_noise);
+    VVS_CHECK_TRUE(fabs(pose.y - truth.y) < 1);
+    return 0;
+}
+
+#endif // End of '__TEST_LOCALIZER_PARTICLE__'
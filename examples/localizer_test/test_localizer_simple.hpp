@@ -110,6 +110,97 @@ int testLocBaseNearest()
     return 0;
 }
 
+int testLocBaseUpdateMap(int grid_size = 8, double grid_step = 0.0005)
+{
+    // Prepare a grid map and its lower half
+    dg::Map map_full, map_half;
+    const dg::LatLon origin(36.38, 127.37);
+    for (int r = 0; r < grid_size; r++)
+    {
+        for (int c = 0; c < grid_size; c++)
+        {
+            dg::Node node(r * grid_size + c + 1, origin.lat + r * grid_step, origin.lon + c * grid_step);
+            map_full.addNode(node);
+            if (r < grid_size / 2) map_half.addNode(node);
+        }
+    }
+    for (int r = 0; r < grid_size; r++)
+    {
+        for (int c = 0; c < grid_size; c++)
+        {
+            dg::ID id = r * grid_size + c + 1;
+            if (c + 1 < grid_size)
+            {
+                map_full.addEdge(id, id + 1, dg::Edge(id * 10 + 1));
+                if (r < grid_size / 2) map_half.addEdge(id, id + 1, dg::Edge(id * 10 + 1));
+            }
+            if (r + 1 < grid_size)
+            {
+                map_full.addEdge(id, id + grid_size, dg::Edge(id * 10 + 2));
+                if (r + 1 < grid_size / 2) map_half.addEdge(id, id + grid_size, dg::Edge(id * 10 + 2));
+            }
+        }
+    }
+    dg::POI poi;
+    poi.id = 10000;
+    poi.lat = origin.lat + grid_step / 2;
+    poi.lon = origin.lon + grid_step / 2;
+    map_full.pois.push_back(poi);
+
+    // Load the half map and expand it
+    dg::SimpleLocalizer localizer;
+    VVS_CHECK_TRUE(localizer.setReference(origin));
+    VVS_CHECK_TRUE(localizer.loadMap(map_half, true));
+    VVS_CHECK_EQUL(localizer.getMap().countNodes(), map_half.nodes.size());
+    VVS_CHECK_TRUE(localizer.updateMap(map_full, true));
+    dg::RoadMap road_map = localizer.getMap();
+    VVS_CHECK_EQUL(road_map.countNodes(), map_full.nodes.size()); // POIs are not included in the graph
+
+    // Check the nearest edges are same with the exhaustive search
+    for (int i = 0; i < 100; i++)
+    {
+        dg::Pose2 pose(cv::theRNG().uniform(-50., 400.), cv::theRNG().uniform(-50., 400.), 0);
+        dg::TopometricPose pose_t = localizer.findNearestTopoPose(pose);
+        double min_dist2 = DBL_MAX;
+        for (auto from = road_map.getHeadNodeConst(); from != road_map.getTailNodeConst(); from++)
+            for (auto edge = road_map.getHeadEdgeConst(from); edge != road_map.getTailEdgeConst(from); edge++)
+                min_dist2 = std::min(min_dist2, dg::BaseLocalizer::calcDist2FromLineSeg(from->data, edge->to->data, pose).first);
+        dg::RoadMap::Node* node = road_map.getNode(pose_t.node_id);
+        VVS_CHECK_TRUE(node != nullptr);
+        dg::RoadMap::Edge* edge = road_map.getEdge(node, pose_t.edge_idx);
+        VVS_CHECK_TRUE(edge != nullptr);
+        VVS_CHECK_NEAR(dg::BaseLocalizer::calcDist2FromLineSeg(node->data, edge->to->data, pose).first, min_dist2);
+    }
+
+    // Shrink the map and check the nearest edges again (also far from the map)
+    VVS_CHECK_TRUE(localizer.updateMap(map_half, true));
+    road_map = localizer.getMap();
+    VVS_CHECK_EQUL(road_map.countNodes(), map_half.nodes.size());
+    for (int i = 0; i < 100; i++)
+    {
+        dg::Pose2 pose(cv::theRNG().uniform(-5000., 5000.), cv::theRNG().uniform(-5000., 5000.), 0);
+        if (i < 50) pose = dg::Pose2(cv::theRNG().uniform(-50., 400.), cv::theRNG().uniform(-50., 400.), 0);
+        dg::TopometricPose pose_t = localizer.findNearestTopoPose(pose);
+        double min_dist2 = DBL_MAX;
+        for (auto from = road_map.getHeadNodeConst(); from != road_map.getTailNodeConst(); from++)
+            for (auto edge = road_map.getHeadEdgeConst(from); edge != road_map.getTailEdgeConst(from); edge++)
+                min_dist2 = std::min(min_dist2, dg::BaseLocalizer::calcDist2FromLineSeg(from->data, edge->to->data, pose).first);
+        dg::RoadMap::Node* node = road_map.getNode(pose_t.node_id);
+        VVS_CHECK_TRUE(node != nullptr);
+        dg::RoadMap::Edge* edge = road_map.getEdge(node, pose_t.edge_idx);
+        VVS_CHECK_TRUE(edge != nullptr);
+        VVS_CHECK_NEAR(dg::BaseLocalizer::calcDist2FromLineSeg(node->data, edge->to->data, pose).first, min_dist2);
+    }
+    VVS_CHECK_TRUE(localizer.updateMap(map_full, true));
+
+    // Check a POI is available as a localization clue
+    VVS_CHECK_TRUE(localizer.applyLocClue(poi.id));
+    dg::Point2 poi_xy = localizer.toMetric(poi);
+    VVS_CHECK_NEAR(localizer.getPose().x, poi_xy.x);
+    VVS_CHECK_NEAR(localizer.getPose().y, poi_xy.y);
+    return 0;
+}
+
 int testLocBaseTrack()
 {
     dg::SimpleLocalizer localizer;
@@ -6,6 +6,20 @@ int main()
 
     // Test simple cases
     VVS_RUN_TEST(testSimpleMapManager());
+    VVS_RUN_TEST(testMapManagerAsync());
+    VVS_RUN_TEST(testMapManagerCache());
+    VVS_RUN_TEST(testMapManagerParse());
+    VVS_RUN_TEST(testMapManagerStreaming());
+    VVS_RUN_TEST(testMapManagerImageCache());
+    VVS_RUN_TEST(testMapManagerReducedDecode());
+    VVS_RUN_TEST(testMapManagerPOIIndex());
+    VVS_RUN_TEST(testMapManagerPOIFuzzy());
+
+    // Benchmark connection reuse (it needs a local stand-in server)
+    VVS_NUN_TEST(testMapManagerLatency());
+
+    // Benchmark parsing a large map
+    VVS_RUN_TEST(testMapManagerParseBench());
 
     return 0;
 }
\ No newline at end of file
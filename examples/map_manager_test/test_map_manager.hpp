@@ -5,6 +5,11 @@
 #include "dg_map_manager.hpp"
 #include <stdint.h>
 #include <cstdint>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
 
 int testSimpleMapManager()
 {
@@ -91,4 +96,510 @@ int testSimpleMapManager()
     return 0;
 }
 
+int testMapManagerAsync()
+{
+	dg::MapManager manager;
+
+	// Request the map, POIs and StreetViews together without blocking
+	std::future<dg::Map> map = manager.getMapAsync(36.384102, 127.374838, 700);
+	std::future<std::vector<dg::POI>> pois = manager.getPOIAsync(36.384063, 127.374733, 650.0);
+	std::future<std::vector<dg::StreetView>> svs = manager.getStreetViewAsync(36.384063, 127.374733, 650.0);
+
+	// Check their results are same with synchronous ones
+	dg::Map map_sync;
+	if (manager.getMap(36.384102, 127.374838, 700, map_sync))
+		VVS_CHECK_EQUL(map.get().nodes.size(), map_sync.nodes.size());
+	std::vector<dg::POI> poi_vec;
+	if (manager.getPOI(36.384063, 127.374733, 650.0, poi_vec))
+		VVS_CHECK_EQUL(pois.get().size(), poi_vec.size());
+	std::vector<dg::StreetView> sv_vec;
+	if (manager.getStreetView(36.384063, 127.374733, 650.0, sv_vec))
+		VVS_CHECK_EQUL(svs.get().size(), sv_vec.size());
+
+	// Check a canceled request finishes soon
+	dg::ID request_id = 0;
+	std::future<cv::Mat> sv_image = manager.getStreetViewImageAsync(14255003037, "f", 10, &request_id);
+	VVS_CHECK_TRUE(request_id > 0);
+	manager.cancelAsync(request_id);
+	VVS_CHECK_TRUE(sv_image.wait_for(std::chrono::seconds(1)) == std::future_status::ready);
+
+	return 0;
+}
+
+int testMapManagerCache(const char* cache_dir = "map_manager_cache")
+{
+	// Check the normalized request ignores letter cases of the host, the default port and the order of parameters
+	VVS_CHECK_TRUE(dg::ResponseCache::normalize("HTTP://LocalHost:80/poi?b=2&a=1#top") == "http://localhost/poi?a=1&b=2");
+
+	// Check stored responses are served after reopening
+	dg::ResponseCache cache;
+	VVS_CHECK_TRUE(cache.open(cache_dir, 3600, 1000));
+	cache.clear();
+	std::vector<uchar> body(300, 'A');
+	VVS_CHECK_TRUE(cache.store("http://localhost:21500/wgs/1/2/3", body, "\"v1\""));
+	VVS_CHECK_TRUE(cache.store("http://localhost:21500/wgs/4/5/6", body));
+	VVS_CHECK_TRUE(cache.open(cache_dir, 3600, 1000));
+	VVS_CHECK_EQUL(cache.countResponses(), 2);
+	dg::CachedResponse response;
+	VVS_CHECK_TRUE(cache.load("http://LOCALHOST:21500/wgs/1/2/3", response));
+	VVS_CHECK_TRUE(response.fresh);
+	VVS_CHECK_TRUE(response.etag == "\"v1\"");
+	VVS_CHECK_TRUE(response.body == body);
+
+	// Check the least recently used response is evicted over the size bound
+	VVS_CHECK_TRUE(cache.store("http://localhost:21500/wgs/7/8/9", body));
+	VVS_CHECK_EQUL(cache.countResponses(), 2);
+	VVS_CHECK_TRUE(!cache.load("http://localhost:21500/wgs/4/5/6", response));
+	VVS_CHECK_TRUE(cache.load("http://localhost:21500/wgs/1/2/3", response));
+
+	// Check responses are kept but stale after their time-to-live
+	VVS_CHECK_TRUE(cache.open(cache_dir, 0, 1000));
+	VVS_CHECK_TRUE(cache.load("http://localhost:21500/wgs/7/8/9", response));
+	VVS_CHECK_TRUE(!response.fresh);
+	cache.clear();
+	VVS_CHECK_EQUL(cache.countResponses(), 0);
+
+	// Check only temporary files of dead writers are removed when the cache is opened
+#ifdef _WIN32
+	int pid = _getpid();
+#else
+	int pid = getpid();
+#endif
+	std::string temp_dead = std::string(cache_dir) + "/0123456789abcdef.dgc.2147483646.0.tmp";
+	std::string temp_alive = std::string(cache_dir) + "/0123456789abcdef.dgc." + std::to_string(pid) + ".0.tmp";
+	fclose(fopen(temp_dead.c_str(), "wb"));
+	fclose(fopen(temp_alive.c_str(), "wb"));
+	VVS_CHECK_TRUE(cache.open(cache_dir, 3600, 1000));
+	FILE* fid = fopen(temp_dead.c_str(), "rb");
+	VVS_CHECK_TRUE(fid == nullptr);
+	fid = fopen(temp_alive.c_str(), "rb");
+	VVS_CHECK_TRUE(fid != nullptr);
+	fclose(fid);
+	std::remove(temp_alive.c_str());
+
+	// Check a restarted map manager is served from the cache when the server is not reachable
+	const std::string ip = "dg-server.invalid"; // A reserved name which is never resolved
+	auto poi_url = [&ip](double lat, double lon, double radius) { return "http://" + ip + ":21502/wgs/" + std::to_string(lat) + "/" + std::to_string(lon) + "/" + std::to_string(radius); };
+	std::string poi_json = "{\"type\": \"FeatureCollection\", \"features\": ["
+		"{\"properties\": {\"id\": 1, \"name\": \"POI\", \"floor\": 1, \"latitude\": 36.384, \"longitude\": 127.374}},"
+		"{\"properties\": {\"id\": 2, \"name\": \"POI\", \"floor\": 1, \"latitude\": 36.385, \"longitude\": 127.375}}]}\n";
+	std::vector<uchar> poi_body(poi_json.begin(), poi_json.end());
+	dg::MapManager offline;
+	VVS_CHECK_TRUE(offline.setCacheDir(cache_dir, 0));
+	VVS_CHECK_TRUE(offline.setIP(ip));
+	VVS_CHECK_TRUE(offline.getCache().store(poi_url(36.384063, 127.374733, 40000.0), poi_body)); // Used by 'initialize()'
+	VVS_CHECK_TRUE(offline.getCache().store(poi_url(36.384063, 127.374733, 650.0), poi_body));
+	VVS_CHECK_TRUE(offline.initialize());
+	std::vector<dg::POI> poi_offline;
+	VVS_CHECK_TRUE(offline.getPOI(36.384063, 127.374733, 650.0, poi_offline));
+	VVS_CHECK_EQUL(poi_offline.size(), 2);
+	VVS_CHECK_TRUE(offline.getCache().remove(poi_url(36.384063, 127.374733, 650.0)));
+	VVS_CHECK_TRUE(!offline.getPOI(36.384063, 127.374733, 650.0, poi_offline));
+	offline.getCache().clear();
+
+	return 0;
+}
+
+class MapManagerBench : public dg::MapManager
+{
+public:
+	using dg::MapManager::write_callback;
+
+	bool query(const std::string& url) { return query2server(url); }
+
+	using dg::MapManager::parseMap;
+	using dg::MapManager::parsePath;
+	using dg::MapManager::parsePOI;
+	using dg::MapManager::buildMap;
+	using dg::MapManager::decodeImage;
+	using dg::MapManager::getStreetViewImageKey;
+	using dg::MapManager::isValidResponse;
+
+	void setPOIs(const std::vector<dg::POI>& pois) { m_poi_index.build(pois); }
+};
+
+int testMapManagerParse()
+{
+	MapManagerBench manager;
+
+	// Check nodes are connected by edges even if the edges come later
+	std::string json = "{\"type\": \"FeatureCollection\", \"features\": ["
+		"{\"type\": \"Feature\", \"geometry\": {\"type\": \"Point\", \"coordinates\": [127.1, 36.1]}, \"properties\": {\"name\": \"Node\", \"id\": 1, \"type\": 1, \"floor\": 0, \"latitude\": 36.1, \"longitude\": 127.1, \"edge_ids\": [10]}},"
+		"{\"type\": \"Feature\", \"properties\": {\"name\": \"edge\", \"id\": 10, \"type\": 2, \"length\": 12.5}},"
+		"{\"type\": \"Feature\", \"properties\": {\"name\": \"Node\", \"id\": 2, \"type\": 0, \"floor\": 0, \"latitude\": 127.2, \"longitude\": 36.2, \"edge_ids\": [10, 20]}},"
+		"{\"type\": \"Feature\", \"properties\": {\"name\": \"Node\", \"id\": 3, \"type\": 0, \"floor\": 0, \"latitude\": 36.3, \"longitude\": 127.3, \"edge_ids\": [20]}},"
+		"{\"type\": \"Feature\", \"properties\": {\"name\": \"edge\", \"id\": 20, \"type\": 0, \"length\": 7.0}}]}\n";
+	dg::Map map;
+	VVS_CHECK_TRUE(manager.parseMap(&json[0], map));
+	VVS_CHECK_EQUL(map.nodes.size(), 3);
+	VVS_CHECK_EQUL(map.edges.size(), 2);
+	VVS_CHECK_TRUE(map.findNode(1) != nullptr && map.findNode(1)->type == dg::Node::NODE_JUNCTION);
+	VVS_CHECK_TRUE(map.findNode(2) != nullptr && map.findNode(2)->lat == 36.2);
+	VVS_CHECK_TRUE(map.findEdge(10) != nullptr && map.findEdge(10)->type == dg::Edge::EDGE_CROSSWALK);
+	VVS_CHECK_TRUE(map.findEdge(2, 3) != nullptr);
+
+	// Check only the first path is read
+	json = "[{\"type\": \"FeatureCollection\", \"features\": ["
+		"{\"properties\": {\"name\": \"Node\", \"id\": 1, \"latitude\": 36.1, \"longitude\": 127.1}},"
+		"{\"properties\": {\"name\": \"Edge\", \"id\": 10}},"
+		"{\"properties\": {\"name\": \"Node\", \"id\": 2, \"latitude\": 36.2, \"longitude\": 127.2}}]},"
+		"{\"type\": \"FeatureCollection\", \"features\": ["
+		"{\"properties\": {\"name\": \"Node\", \"id\": 3, \"latitude\": 36.3, \"longitude\": 127.3}}]}]\n";
+	dg::Path path;
+	std::map<dg::ID, dg::LatLon> lookup;
+	VVS_CHECK_TRUE(manager.parsePath(&json[0], path, lookup));
+	VVS_CHECK_EQUL(path.pts.size(), 2);
+	VVS_CHECK_EQUL(path.pts[0].edge_id, 10);
+	VVS_CHECK_EQUL(path.pts[1].node_id, 2);
+	VVS_CHECK_EQUL(path.pts[1].edge_id, 0);
+	VVS_CHECK_EQUL(lookup.size(), 2);
+
+	// Check a truncated response is rejected
+	json = "{\"type\": \"FeatureCollection\", \"features\": [{\"properties\": {\"id\": 1, \"name\": \"POI\"";
+	VVS_CHECK_TRUE(!manager.parsePOI(&json[0], map));
+
+	// Check error messages, empty results and truncated responses are not worth caching
+	auto isValid = [](const std::string& text) { return MapManagerBench::isValidResponse(std::vector<uchar>(text.begin(), text.end())); };
+	VVS_CHECK_TRUE(!isValid("No valid data"));
+	VVS_CHECK_TRUE(!isValid("[]\n"));
+	VVS_CHECK_TRUE(!isValid("{\"type\": \"FeatureCollection\", \"features\": []}\n"));
+	std::string truncated = "{\"type\": \"FeatureCollection\", \"features\": [{\"properties\": {\"id\": 1, \"name\": \"POI\"";
+	VVS_CHECK_TRUE(!isValid(truncated));
+	VVS_CHECK_TRUE(isValid(truncated + "}}]}\n"));
+	VVS_CHECK_TRUE(isValid("\xFF\xD8\xFF\xE0"));
+
+	return 0;
+}
+
+int testMapManagerStreaming()
+{
+	MapManagerBench manager;
+
+	// Check an edge across two tiles is connected after merging them
+	std::string json1 = "{\"type\": \"FeatureCollection\", \"features\": ["
+		"{\"properties\": {\"name\": \"Node\", \"id\": 1, \"latitude\": 36.1, \"longitude\": 127.1, \"edge_ids\": [10]}},"
+		"{\"properties\": {\"name\": \"Node\", \"id\": 2, \"latitude\": 36.2, \"longitude\": 127.2, \"edge_ids\": [10, 20]}},"
+		"{\"properties\": {\"name\": \"edge\", \"id\": 10, \"length\": 5.0}},"
+		"{\"properties\": {\"name\": \"edge\", \"id\": 20, \"length\": 7.0}}]}\n";
+	std::string json2 = "{\"type\": \"FeatureCollection\", \"features\": ["
+		"{\"properties\": {\"name\": \"Node\", \"id\": 2, \"latitude\": 36.2, \"longitude\": 127.2, \"edge_ids\": [10, 20]}},"
+		"{\"properties\": {\"name\": \"Node\", \"id\": 3, \"latitude\": 36.3, \"longitude\": 127.3, \"edge_ids\": [20]}},"
+		"{\"properties\": {\"name\": \"edge\", \"id\": 20, \"length\": 7.0}}]}\n";
+	dg::MapTile tile1, tile2;
+	VVS_CHECK_TRUE(manager.parseMap(&json1[0], tile1));
+	VVS_CHECK_TRUE(manager.parseMap(&json2[0], tile2));
+	dg::Map map;
+	manager.buildMap(std::vector<const dg::MapTile*>(1, &tile1), map);
+	VVS_CHECK_EQUL(map.nodes.size(), 2);
+	VVS_CHECK_EQUL(map.edges.size(), 1);
+	map = dg::Map();
+	manager.buildMap({ &tile1, &tile2 }, map);
+	VVS_CHECK_EQUL(map.nodes.size(), 3);
+	VVS_CHECK_EQUL(map.edges.size(), 2);
+	VVS_CHECK_TRUE(map.findEdge(2, 3) != nullptr);
+
+	// Stream the map along a route and check the number of tiles is bounded
+	const int max_tiles = 8;
+	std::vector<dg::LatLon> route = { dg::LatLon(36.381873, 127.36803), dg::LatLon(36.384063, 127.374733) };
+	VVS_CHECK_TRUE(manager.startMapStreaming(route, 50, 200, 600, max_tiles));
+	VVS_CHECK_TRUE(manager.updateMapStreaming(dg::LatLon(36.382423, 127.369433)));
+
+	// Wait for tiles only if the server answers within a short timeout
+	bool server_available = !manager.getMapAsync(36.382423, 127.369433, 10, 1).get().nodes.empty();
+	for (int i = 0; server_available && i < 50 && manager.getStreamedMap() == nullptr; i++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	std::shared_ptr<const dg::Map> streamed = manager.getStreamedMap();
+	if (streamed != nullptr)
+	{
+		VVS_CHECK_TRUE(!streamed->nodes.empty());
+		VVS_CHECK_TRUE(manager.countStreamedTiles() <= max_tiles);
+	}
+	manager.stopMapStreaming();
+	VVS_CHECK_TRUE(manager.getStreamedMap() == nullptr);
+	VVS_CHECK_EQUL(manager.countStreamedTiles(), 0);
+
+	return 0;
+}
+
+int testMapManagerImageCache()
+{
+	// Check the least recently used image is removed when the total size exceeds its bound
+	dg::ImageCache cache(3 * 100);
+	cv::Mat image(10, 10, CV_8UC1, cv::Scalar(1));
+	VVS_CHECK_TRUE(cache.store("a", image));
+	VVS_CHECK_TRUE(cache.store("b", image));
+	VVS_CHECK_TRUE(cache.store("c", image));
+	cv::Mat loaded;
+	VVS_CHECK_TRUE(cache.load("a", loaded));
+	VVS_CHECK_TRUE(cache.store("d", image));
+	VVS_CHECK_EQUL(cache.countImages(), 3);
+	VVS_CHECK_TRUE(cache.contains("a"));
+	VVS_CHECK_TRUE(!cache.contains("b"));
+	VVS_CHECK_TRUE(!cache.store("e", cv::Mat(20, 20, CV_8UC1)));
+
+	// Check a loaded image is a copy
+	loaded.at<uchar>(0, 0) = 7;
+	VVS_CHECK_TRUE(cache.load("a", loaded));
+	VVS_CHECK_EQUL(loaded.at<uchar>(0, 0), 1);
+
+	// Check a repeated request is served from memory
+	dg::MapManager manager;
+	cv::Mat sv_image;
+	if (manager.getStreetViewImage(14255003037, sv_image, "f"))
+	{
+		VVS_CHECK_EQUL(manager.getImageCache().countImages(), 1);
+		std::future<cv::Mat> sv_async = manager.getStreetViewImageAsync(14255003037, "f");
+		VVS_CHECK_TRUE(sv_async.wait_for(std::chrono::milliseconds(100)) == std::future_status::ready);
+		VVS_CHECK_EQUL(sv_async.get().rows, sv_image.rows);
+	}
+
+	// Check the faces of the nearest StreetView are prefetched (only if the server answers)
+	if (!manager.getStreetViewAsync(36.384063, 127.374733, 30, 1).get().empty())
+	{
+		const size_t n_faces = 2, n_before = manager.getImageCache().countImages();
+		VVS_CHECK_TRUE(manager.prefetchStreetViewImages(dg::LatLon(36.384063, 127.374733), 30, 1, "bl") > 0);
+		for (int i = 0; i < 100 && manager.getImageCache().countImages() < n_before + n_faces; i++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		VVS_CHECK_EQUL(manager.getImageCache().countImages(), n_before + n_faces);
+	}
+
+	return 0;
+}
+
+int testMapManagerReducedDecode()
+{
+	// Check a JPEG image is decoded at the lowest resolution which is not smaller than the target
+	cv::Mat image(600, 800, CV_8UC3, cv::Scalar(0, 128, 255));
+	std::vector<uchar> jpeg;
+	VVS_CHECK_TRUE(cv::imencode(".jpg", image, jpeg));
+	VVS_CHECK_TRUE(MapManagerBench::decodeImage(jpeg, cv::Size()).size() == cv::Size(800, 600));
+	VVS_CHECK_TRUE(MapManagerBench::decodeImage(jpeg, cv::Size(100, 0)).size() == cv::Size(100, 75));
+	VVS_CHECK_TRUE(MapManagerBench::decodeImage(jpeg, cv::Size(0, 150)).size() == cv::Size(200, 150));
+	VVS_CHECK_TRUE(MapManagerBench::decodeImage(jpeg, cv::Size(300, 300)).size() == cv::Size(400, 300));
+	VVS_CHECK_TRUE(MapManagerBench::decodeImage(jpeg, cv::Size(500, 0)).size() == cv::Size(800, 600));
+
+	// Check a PNG image is decoded at its full resolution
+	std::vector<uchar> png;
+	VVS_CHECK_TRUE(cv::imencode(".png", image, png));
+	VVS_CHECK_TRUE(MapManagerBench::decodeImage(png, cv::Size(100, 0)).size() == cv::Size(800, 600));
+
+	// Check each resolution is cached separately
+	VVS_CHECK_TRUE(MapManagerBench::getStreetViewImageKey(1, "f") != MapManagerBench::getStreetViewImageKey(1, "f", cv::Size(0, 288)));
+	dg::MapManager manager;
+	cv::Mat sv_image, sv_reduced;
+	if (manager.getStreetViewImage(14255003037, sv_image, "f") && manager.getStreetViewImage(14255003037, sv_reduced, "f", 10, cv::Size(0, sv_image.rows / 4)))
+	{
+		VVS_CHECK_EQUL(sv_reduced.rows, sv_image.rows / 4);
+		VVS_CHECK_EQUL(manager.getImageCache().countImages(), 2);
+	}
+
+	return 0;
+}
+
+int testMapManagerPOIIndex()
+{
+	// Prepare POIs along a meridian about every 11 m with duplicated names
+	std::vector<dg::POI> pois;
+	for (int i = 0; i < 100; i++)
+	{
+		dg::POI poi;
+		poi.id = 1000 + i;
+		poi.lat = 36.38 + i * 1e-4;
+		poi.lon = 127.37;
+		poi.name = (i % 10 == 0) ? L"Cafe" : L"Bank";
+		poi.floor = 1;
+		pois.push_back(poi);
+	}
+
+	// Check POIs are found by their names and IDs
+	dg::POIIndex index(50);
+	index.build(pois);
+	VVS_CHECK_EQUL(index.size(), pois.size());
+	VVS_CHECK_EQUL(index.findByName(L"Cafe").size(), 10);
+	VVS_CHECK_EQUL(index.findByName(L"Bank").size(), 90);
+	VVS_CHECK_TRUE(index.findByName(L"Bakery").empty());
+	VVS_CHECK_TRUE(index.findPOI(1042) != nullptr && index.findPOI(1042)->id == 1042);
+	VVS_CHECK_TRUE(index.findPOI(42) == nullptr);
+
+	// Check POIs are found within a radius (a small and a huge radius)
+	dg::LatLon center(36.38 + 50e-4, 127.37);
+	std::vector<const dg::POI*> nearby = index.findByName(L"Cafe", center, 30);
+	VVS_CHECK_EQUL(nearby.size(), 1);
+	VVS_CHECK_TRUE(!nearby.empty() && nearby.front()->id == 1050);
+	VVS_CHECK_EQUL(index.findByName(L"Bank", center, 30).size(), 4);
+	VVS_CHECK_EQUL(index.findInRadius(center, 30).size(), 5);
+	VVS_CHECK_EQUL(index.findByName(L"Cafe", center, 1e6).size(), 10);
+	VVS_CHECK_EQUL(index.findInRadius(center, 1e6).size(), 100);
+
+	// Check POIs are sorted by distance and all POIs with the same distance are kept
+	std::vector<const dg::POI*> cafes = index.findByName(L"Cafe");
+	index.sortByDistance(cafes, center);
+	VVS_CHECK_EQUL(cafes.size(), 10);
+	VVS_CHECK_TRUE(cafes.front()->id == 1050);
+	VVS_CHECK_TRUE(cafes[1]->id == 1040 || cafes[1]->id == 1060);
+	VVS_CHECK_TRUE(cafes[2]->id == 1040 || cafes[2]->id == 1060);
+
+	// Check the map manager serves POIs without network
+	MapManagerBench manager;
+	manager.setPOIs(pois);
+	VVS_CHECK_EQUL(manager.getPOI("Cafe").size(), 10);
+	VVS_CHECK_EQUL(manager.getPOI("Cafe", center, 30).size(), 1);
+	std::vector<dg::POI> sorted = manager.getPOI_sorting("Cafe", dg::LatLon(36.38, 127.37));
+	VVS_CHECK_EQUL(sorted.size(), 10);
+	VVS_CHECK_TRUE(!sorted.empty() && sorted.front().id == 1000 && sorted.back().id == 1090);
+
+	return 0;
+}
+
+int testMapManagerPOIFuzzy(int n_pois = 50000)
+{
+	// Check names are normalized (composed Hangul, lowercase, and no space)
+	VVS_CHECK_TRUE(dg::POIIndex::normalizeName(L"\u1100\u1161\u11A8 Cafe") == L"\uAC01cafe");
+	VVS_CHECK_EQUL(dg::POIIndex::getEditDistance(L"kitten", L"sitting", 5), 3);
+	VVS_CHECK_EQUL(dg::POIIndex::getEditDistance(L"kitten", L"sitting", 1), 2);
+	VVS_CHECK_EQUL(dg::POIIndex::getEditDistance(L"cafe", L"cafe", 0), 0);
+
+	// Prepare POIs including a distant duplicate
+	const wchar_t* names[] = { L"Starbucks", L"Star Mart", L"Olive Young", L"\uC2A4\uD0C0\uBC85\uC2A4", L"Starbucks" };
+	const double offsets[] = { 0, 2e-4, 4e-4, 6e-4, 0.1 };
+	std::vector<dg::POI> pois;
+	for (int i = 0; i < 5; i++)
+	{
+		dg::POI poi;
+		poi.id = i + 1;
+		poi.lat = 36.38 + offsets[i];
+		poi.lon = 127.37;
+		poi.name = names[i];
+		poi.floor = 1;
+		pois.push_back(poi);
+	}
+	dg::POIIndex index;
+	index.build(pois);
+	dg::LatLon center(36.38, 127.37);
+
+	// Check prefix search
+	VVS_CHECK_EQUL(index.findByPrefix(L"STAR").size(), 3);
+	VVS_CHECK_EQUL(index.findByPrefix(L"star", center, 100).size(), 2);
+	VVS_CHECK_EQUL(index.findByPrefix(L"\uC2A4\uD0C0").size(), 1);
+
+	// Check similar names are found within a radius
+	std::vector<dg::POIMatch> matches = index.findSimilar(L"Starbucs", 2);
+	VVS_CHECK_EQUL(matches.size(), 2);
+	VVS_CHECK_TRUE(!matches.empty() && matches.front().edits == 1);
+	matches = index.findSimilar(L"Star bucs", 2, center, 100);
+	VVS_CHECK_EQUL(matches.size(), 1);
+	VVS_CHECK_TRUE(!matches.empty() && matches.front().poi->id == 1);
+	matches = index.findSimilar(L"\u1109\u1173\uD0C0\uBC85\u1109\u1173", 0, center, 100);
+	VVS_CHECK_TRUE(matches.size() == 1 && matches.front().poi->id == 4);
+	VVS_CHECK_TRUE(index.findSimilar(L"Olive", 1).empty());
+
+	// Check the map manager matches a noisy name
+	MapManagerBench manager;
+	manager.setPOIs(pois);
+	std::vector<dg::POI> similar = manager.getPOI_similar("0live Yuong", center, 100);
+	VVS_CHECK_TRUE(similar.size() == 1 && similar.front().id == 3);
+	VVS_CHECK_EQUL(manager.getPOI_prefix("olive", center, 100).size(), 1);
+
+	// Benchmark matching noisy names with many POIs
+	pois.clear();
+	char buffer[64];
+	for (int i = 0; i < n_pois; i++)
+	{
+		dg::POI poi;
+		poi.id = 100 + i;
+		poi.lat = 36.38 + (i % 250) * 2e-4;
+		poi.lon = 127.37 + (i / 250) * 2e-4;
+		sprintf(buffer, "Shop %05d", i);
+		poi.name = std::wstring(buffer, buffer + strlen(buffer));
+		poi.floor = 1;
+		pois.push_back(poi);
+	}
+	index.build(pois);
+	int n_found = 0, n_queries = 1000;
+	int64 tick = cv::getTickCount();
+	for (int i = 0; i < n_queries; i++)
+	{
+		const dg::POI& target = pois[(i * 7919) % n_pois];
+		std::wstring noisy = target.name;
+		noisy[1] = L'X';
+		matches = index.findSimilar(noisy, 2, target, 100);
+		if (!matches.empty() && matches.front().poi->id == target.id) n_found++;
+	}
+	double elapse = 1000 * (cv::getTickCount() - tick) / cv::getTickFrequency();
+	printf("Matching %d noisy names with %d POIs: %.3f ms per query\n", n_queries, n_pois, elapse / n_queries);
+	VVS_CHECK_EQUL(n_found, n_queries);
+	return 0;
+}
+
+int testMapManagerLatency(const char* url = "http://localhost:21500/", int repeat = 100)
+{
+	// Run a local stand-in server before this test (e.g. 'python3 -m http.server 21500')
+	MapManagerBench manager;
+
+	// Measure requests with global initialization and a new connection for each (the previous way)
+	int n_fresh = 0;
+	int64 tick = cv::getTickCount();
+	for (int i = 0; i < repeat; i++)
+	{
+		curl_global_init(CURL_GLOBAL_ALL);
+		CURL* curl = curl_easy_init();
+		if (curl)
+		{
+			std::string response;
+			curl_easy_setopt(curl, CURLOPT_URL, url);
+			curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, MapManagerBench::write_callback);
+			curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+			if (curl_easy_perform(curl) == CURLE_OK) n_fresh++;
+			curl_easy_cleanup(curl);
+		}
+		curl_global_cleanup();
+	}
+	double latency_fresh = 1000 * (cv::getTickCount() - tick) / cv::getTickFrequency() / repeat;
+
+	// Measure requests on the persistent handle of MapManager
+	int n_reuse = 0;
+	tick = cv::getTickCount();
+	for (int i = 0; i < repeat; i++)
+		if (manager.query(url)) n_reuse++;
+	double latency_reuse = 1000 * (cv::getTickCount() - tick) / cv::getTickFrequency() / repeat;
+
+	printf("Latency per request: %.3f ms (new connection, %d/%d), %.3f ms (reused connection, %d/%d)\n", latency_fresh, n_fresh, repeat, latency_reuse, n_reuse, repeat);
+	VVS_CHECK_EQUL(n_reuse, n_fresh);
+	return 0;
+}
+
+int testMapManagerParseBench(int n_features = 100000)
+{
+	// Make a synthetic map whose nodes are chained by edges
+	int n_nodes = (n_features + 1) / 2, n_edges = n_features - n_nodes;
+	std::string json = "{\"type\": \"FeatureCollection\", \"features\": [";
+	char buffer[512];
+	for (int i = 1; i <= n_nodes; i++)
+	{
+		std::string edge_ids = (i > 1) ? std::to_string(100000000 + i - 1) : "";
+		if (i <= n_edges) edge_ids += ((i > 1) ? ", " : "") + std::to_string(100000000 + i);
+		sprintf(buffer, "{\"type\": \"Feature\", \"geometry\": {\"type\": \"Point\", \"coordinates\": [%.7f, %.7f]}, \"properties\": {\"name\": \"Node\", \"id\": %d, \"type\": 0, \"floor\": 0, \"latitude\": %.7f, \"longitude\": %.7f, \"edge_ids\": [%s]}}, ",
+			127.0 + i * 1e-5, 36.0, i, 36.0, 127.0 + i * 1e-5, edge_ids.c_str());
+		json += buffer;
+	}
+	for (int i = 1; i <= n_edges; i++)
+	{
+		sprintf(buffer, "{\"type\": \"Feature\", \"properties\": {\"name\": \"edge\", \"id\": %d, \"type\": 0, \"length\": 0.9}}%s", 100000000 + i, (i < n_edges) ? ", " : "");
+		json += buffer;
+	}
+	json += "]}\n";
+
+	MapManagerBench manager;
+	dg::Map map;
+	int64 tick = cv::getTickCount();
+	bool ok = manager.parseMap(&json[0], map);
+	double elapse = 1000 * (cv::getTickCount() - tick) / cv::getTickFrequency();
+
+	printf("Parsing %d features (%.1f MB): %.3f ms\n", n_features, json.size() / 1024.0 / 1024.0, elapse);
+	VVS_CHECK_TRUE(ok);
+	VVS_CHECK_EQUL(map.nodes.size(), n_nodes);
+	VVS_CHECK_EQUL(map.edges.size(), std::min(n_edges, n_nodes - 1));
+	return 0;
+}
+
 #endif // End of '__TEST_SIMPLE_MAP__'
@@ -6,9 +6,13 @@
 #include "localizer/directed_graph.hpp"
 #include "localizer/graph_painter.hpp"
 #include "localizer/road_map.hpp"
+#include "localizer/geofence.hpp"
 #include "localizer/localizer_base.hpp"
 #include "localizer/localizer_simple.hpp"
 #include "localizer/localizer_ekf.hpp"
 #include "localizer/localizer_ekf_variants.hpp"
+#include "localizer/localizer_ensemble.hpp"
+#include "localizer/localizer_particle.hpp"
+#include "localizer/map_matcher_hmm.hpp"
 
 #endif // End of '__DG_LOCALIZER__'
@@ -0,0 +1,285 @@
+#ifndef __GEOFENCE__
+#define __GEOFENCE__
+
+#include "core/basic_type.hpp"
+#include "opencv2/opencv.hpp"
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+
+namespace dg
+{
+
+/**
+ * @brief Geofence zone
+ *
+ * A <b>geofence zone</b> is a polygonal area which needs special treatment of sensor data such as an urban canyon.
+ */
+struct GeoZone
+{
+    /** The zone ID */
+    ID id = 0;
+
+    /** The vertices of the zone polygon (Unit: [m]) */
+    std::vector<Point2> polygon;
+
+    /** The standard deviation of GPS noise in the zone (Unit: [m]; non-positive for the default dead-zone noise) */
+    double gps_noise = -1;
+
+    /** A flag whether GPS data suffer from multipath in the zone */
+    bool multipath = false;
+
+    /** The priority of VPS invocation in the zone (0: normal, negative: no invocation, positive: more candidates) */
+    int vps_priority = 0;
+
+    /** The bounding box of the zone polygon */
+    cv::Rect2d box;
+
+    /** The range of grid cells overlapped with the bounding box */
+    cv::Rect cells;
+};
+
+/**
+ * @brief Geofence layer with a grid index
+ *
+ * A <b>geofence layer</b> stores polygonal zones and indexes them with a uniform grid.
+ * Each grid cell keeps the zones overlapped with it, so a point query checks only zones in its cell regardless of the number of zones.
+ *
+ * <b>File Format for Geofence (CSV File)</b>
+ *
+ * Each line starts from a prefix, <i>ZONE</i>, and follows ID, GPS noise, multipath flag, VPS priority, and X and Y of its vertices.
+ * The following example shows a triangular zone (ID: 7) whose GPS noise is 10 m with multipath.
+ * - ZONE, 7, 10, 1, 0, 0, 0, 100, 0, 0, 50
+ */
+class Geofence
+{
+public:
+    /**
+     * The default constructor
+     * @param cell_size The size of each grid cell (Unit: [m])
+     */
+    Geofence(double cell_size = 50) : m_cell_size(cell_size) { }
+
+    /**
+     * Read zones from the given file
+     * @param filename The filename to read zones
+     * @return Result of success (true) or failure (false)
+     */
+    bool load(const char* filename)
+    {
+        clear();
+        FILE* fid = fopen(filename, "rt");
+        if (fid == nullptr) return false;
+
+        char buffer[4096];
+        while (fgets(buffer, sizeof(buffer), fid) != nullptr)
+        {
+            char* token = strtok(buffer, ",");
+            if (token == nullptr || (token[0] != 'Z' && token[0] != 'z')) continue;
+
+            GeoZone zone;
+            double values[4];
+            for (int i = 0; i < 4; i++)
+            {
+                if ((token = strtok(nullptr, ",")) == nullptr) goto GEOFENCE_LOAD_FAIL;
+                values[i] = strtod(token, nullptr);
+            }
+            zone.id = static_cast<ID>(values[0]);
+            zone.gps_noise = values[1];
+            zone.multipath = (values[2] != 0);
+            zone.vps_priority = static_cast<int>(values[3]);
+            while ((token = strtok(nullptr, ",")) != nullptr)
+            {
+                double x = strtod(token, nullptr);
+                if ((token = strtok(nullptr, ",")) == nullptr) goto GEOFENCE_LOAD_FAIL;
+                zone.polygon.push_back(Point2(x, strtod(token, nullptr)));
+            }
+            if (!addZone(zone)) goto GEOFENCE_LOAD_FAIL;
+        }
+        fclose(fid);
+        return true;
+
+    GEOFENCE_LOAD_FAIL:
+        clear();
+        fclose(fid);
+        return false;
+    }
+
+    /**
+     * Add a zone (the zone with the same ID is replaced)
+     * @param zone The zone to add
+     * @return Result of success (true) or failure (false)
+     */
+    bool addZone(const GeoZone& zone)
+    {
+        if (zone.polygon.size() < 3 || m_cell_size <= 0) return false;
+        removeZone(zone.id);
+
+        GeoZone& added = m_zones[zone.id];
+        added = zone;
+        cv::Point2d box_min = zone.polygon.front(), box_max = zone.polygon.front();
+        for (auto p = zone.polygon.begin(); p != zone.polygon.end(); p++)
+        {
+            box_min.x = std::min(box_min.x, p->x);
+            box_min.y = std::min(box_min.y, p->y);
+            box_max.x = std::max(box_max.x, p->x);
+            box_max.y = std::max(box_max.y, p->y);
+        }
+        added.box = cv::Rect2d(box_min, box_max);
+
+        // Register the zone to all cells overlapped with its bounding box (the cells are kept to unregister it)
+        const int x0 = getCellIndex(box_min.x), x1 = getCellIndex(box_max.x);
+        const int y0 = getCellIndex(box_min.y), y1 = getCellIndex(box_max.y);
+        added.cells = cv::Rect(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+        for (int y = y0; y <= y1; y++)
+            for (int x = x0; x <= x1; x++)
+                m_grid[getCellKey(x, y)].push_back(zone.id);
+        return true;
+    }
+
+    /**
+     * Add a rectangular zone
+     * @param p1 A corner of the rectangle
+     * @param p2 The opposite corner of the rectangle
+     * @param id The zone ID (0 for a new ID)
+     * @return Result of success (true) or failure (false)
+     */
+    bool addZone(const Point2& p1, const Point2& p2, ID id = 0)
+    {
+        GeoZone zone;
+        zone.id = (id > 0) ? id : getNewID();
+        zone.polygon = { p1, Point2(p2.x, p1.y), p2, Point2(p1.x, p2.y) };
+        return addZone(zone);
+    }
+
+    /**
+     * Remove a zone
+     * @param id The ID of the zone to remove
+     * @return Result of success (true) or failure (false)
+     */
+    bool removeZone(ID id)
+    {
+        auto found = m_zones.find(id);
+        if (found == m_zones.end()) return false;
+        const cv::Rect& cells = found->second.cells;
+        for (int y = cells.y; y < cells.y + cells.height; y++)
+        {
+            for (int x = cells.x; x < cells.x + cells.width; x++)
+            {
+                auto cell = m_grid.find(getCellKey(x, y));
+                if (cell == m_grid.end()) continue;
+                cell->second.erase(std::remove(cell->second.begin(), cell->second.end(), id), cell->second.end());
+                if (cell->second.empty()) m_grid.erase(cell);
+            }
+        }
+        m_zones.erase(found);
+        return true;
+    }
+
+    /**
+     * Remove all zones
+     */
+    void clear()
+    {
+        m_zones.clear();
+        m_grid.clear();
+    }
+
+    /**
+     * Get the number of zones
+     * @return The number of zones
+     */
+    int countZones() const { return static_cast<int>(m_zones.size()); }
+
+    /**
+     * Get an unused zone ID
+     * @return The next ID of the largest one
+     */
+    ID getNewID() const { return m_zones.empty() ? 1 : m_zones.rbegin()->first + 1; }
+
+    /**
+     * Find a zone using its ID
+     * @param id The ID to search
+     * @return A pointer to the found zone (nullptr if not exist)
+     */
+    const GeoZone* getZone(ID id) const
+    {
+        auto found = m_zones.find(id);
+        if (found == m_zones.end()) return nullptr;
+        return &found->second;
+    }
+
+    /**
+     * Find the zone which contains the given point
+     * @param p The point to query
+     * @return A pointer to the found zone (nullptr if not exist)
+     * @note When zones are overlapped, the zone with the largest GPS noise is selected.
+     */
+    const GeoZone* findZone(const Point2& p) const
+    {
+        auto cell = m_grid.find(getCellKey(getCellIndex(p.x), getCellIndex(p.y)));
+        if (cell == m_grid.end()) return nullptr;
+
+        const GeoZone* best = nullptr;
+        for (auto id = cell->second.begin(); id != cell->second.end(); id++)
+        {
+            auto zone = m_zones.find(*id);
+            if (zone == m_zones.end() || !isInside(zone->second, p)) continue;
+            if (best == nullptr || zone->second.gps_noise > best->gps_noise) best = &zone->second;
+        }
+        return best;
+    }
+
+    /**
+     * Get the priority of VPS invocation at the given point
+     * @param p The point to query
+     * @return The largest priority of zones which contain the point (0 if no zone)
+     */
+    int getVPSPriority(const Point2& p) const
+    {
+        auto cell = m_grid.find(getCellKey(getCellIndex(p.x), getCellIndex(p.y)));
+        if (cell == m_grid.end()) return 0;
+
+        bool found = false;
+        int priority = 0;
+        for (auto id = cell->second.begin(); id != cell->second.end(); id++)
+        {
+            auto zone = m_zones.find(*id);
+            if (zone == m_zones.end() || !isInside(zone->second, p)) continue;
+            if (!found || zone->second.vps_priority > priority) priority = zone->second.vps_priority;
+            found = true;
+        }
+        return priority;
+    }
+
+protected:
+    static bool isInside(const GeoZone& zone, const Point2& p)
+    {
+        if (p.x < zone.box.x || p.y < zone.box.y || p.x > zone.box.br().x || p.y > zone.box.br().y) return false;
+
+        // Count crossings of a horizontal ray from the point
+        bool inside = false;
+        const std::vector<Point2>& poly = zone.polygon;
+        for (size_t i = 0, j = poly.size() - 1; i < poly.size(); j = i++)
+        {
+            if ((poly[i].y > p.y) != (poly[j].y > p.y) &&
+                p.x < (poly[j].x - poly[i].x) * (p.y - poly[i].y) / (poly[j].y - poly[i].y) + poly[i].x)
+                inside = !inside;
+        }
+        return inside;
+    }
+
+    int getCellIndex(double v) const { return static_cast<int>(floor(v / m_cell_size)); }
+
+    static uint64 getCellKey(int x, int y) { return (static_cast<uint64>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y); }
+
+    double m_cell_size;
+
+    std::map<ID, GeoZone> m_zones;
+
+    std::unordered_map<uint64, std::vector<ID>> m_grid;
+};
+
+} // End of 'dg'
+
+#endif // End of '__GEOFENCE__'
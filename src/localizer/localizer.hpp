@@ -115,7 +115,8 @@ public:
      * @param obs The relative observation from each clue (Unit: [m] and [rad])
      * @param time The observed time (Unit: [sec])
      * @param The observation confidence
-     * @return True if successful (false if failed)
+     * @return True if all clues are applied (false if any clue is invalid, unknown, or rejected)<br>
+     *  Even if it returns false, a localizer may still apply the rest of usable clues.
      */
     virtual bool applyLocClue(const std::vector<ID>& ids, const std::vector<Polar2>& obs, Timestamp time = -1, const std::vector<double>& confidence = std::vector<double>()) = 0;
 };
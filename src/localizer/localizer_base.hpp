@@ -5,35 +5,329 @@
 #include "localizer/localizer.hpp"
 #include "utils/opencx.hpp"
 #include <set>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
 
 namespace dg
 {
 
+/**
+ * @brief Reader-writer lock
+ *
+ * Many readers can hold the lock together, but a writer holds it alone. A waiting writer blocks new readers not to starve.
+ * (std::shared_timed_mutex is not available in C++11.)
+ */
+class SharedMutex
+{
+public:
+    SharedMutex() : m_readers(0), m_writers(0), m_writing(false) { }
+
+    void lock()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_writers++;
+        while (m_writing || m_readers > 0) m_cond.wait(lock);
+        m_writers--;
+        m_writing = true;
+    }
+
+    void unlock()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_writing = false;
+        m_cond.notify_all();
+    }
+
+    void lock_shared()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (m_writing || m_writers > 0) m_cond.wait(lock);
+        m_readers++;
+    }
+
+    void unlock_shared()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (--m_readers == 0) m_cond.notify_all();
+    }
+
+protected:
+    std::mutex m_mutex;
+
+    std::condition_variable m_cond;
+
+    int m_readers;
+
+    int m_writers;
+
+    bool m_writing;
+};
+
+/**
+ * @brief Scoped reader lock of SharedMutex
+ */
+class SharedLock
+{
+public:
+    explicit SharedLock(SharedMutex& mutex) : m_mutex(mutex) { m_mutex.lock_shared(); }
+
+    ~SharedLock() { m_mutex.unlock_shared(); }
+
+protected:
+    SharedMutex& m_mutex;
+};
+
+/**
+ * @brief Immutable snapshot of localization results
+ *
+ * A localizer publishes a new snapshot after each update so that readers can access its results without locking.
+ */
+struct PoseSnapshot
+{
+    /** The time of the latest update (Unit: [sec]) */
+    Timestamp time = -1;
+
+    /** The metric pose (Unit: [m] and [rad]) */
+    Pose2 pose;
+
+    /** The geodesic pose (Unit: [deg]) */
+    LatLon pose_gps;
+
+    /** The topometric pose on the map of the localizer */
+    TopometricPose pose_topo;
+
+    /** The pose confidence */
+    double confidence = 0;
+
+    /** The linear and angular velocity (Unit: [m/s] and [rad/s]) */
+    Polar2 velocity;
+
+    /** The state covariance (empty if not available) */
+    cv::Mat covariance;
+
+    /** The maximum duration to extrapolate the pose (Unit: [sec]) */
+    double horizon = 1;
+
+    /** The recent poses in time order, ending with the latest one (Unit: [sec], [m], and [rad]) */
+    std::vector<std::pair<Timestamp, Pose2>> trail;
+};
+
 class BaseLocalizer : public Localizer, public TopometricLocalizer, public UTMConverter
 {
 public:
-    virtual bool loadMap(Map& map, bool auto_cost = false)
+    BaseLocalizer() : m_map_version(0), m_index_cell(50), m_index_slots(0), m_extrapolation_horizon(1), m_trail_size(50), m_map_owner(nullptr), m_snapshot(std::make_shared<PoseSnapshot>()) { }
+
+    std::shared_ptr<const PoseSnapshot> getPoseSnapshot() const
+    {
+        return std::atomic_load(&m_snapshot);
+    }
+
+    Pose2 getPoseAt(Timestamp time) const
+    {
+        std::shared_ptr<const PoseSnapshot> snapshot = getPoseSnapshot();
+        const Pose2& pose = snapshot->pose;
+        if (time >= snapshot->time || snapshot->trail.empty())
+        {
+            // Extrapolate the latest pose with its velocity
+            double dt = std::min(time - snapshot->time, snapshot->horizon);
+            if (snapshot->time < 0 || dt <= 0) return pose;
+            const double vt = snapshot->velocity.lin * dt, wt = snapshot->velocity.ang * dt;
+            const double c = cos(pose.theta + wt / 2), s = sin(pose.theta + wt / 2);
+            return Pose2(pose.x + vt * c, pose.y + vt * s, cx::trimRad(pose.theta + wt));
+        }
+
+        // Interpolate two recent poses
+        const std::vector<std::pair<Timestamp, Pose2>>& trail = snapshot->trail;
+        auto next = std::lower_bound(trail.begin(), trail.end(), time, [](const std::pair<Timestamp, Pose2>& p, Timestamp t) { return p.first < t; });
+        if (next == trail.begin()) return next->second;
+        if (next == trail.end()) return trail.back().second;
+        auto prev = next - 1;
+        const double ratio = (time - prev->first) / (next->first - prev->first);
+        const Pose2& p0 = prev->second;
+        const Pose2& p1 = next->second;
+        return Pose2(p0.x + ratio * (p1.x - p0.x), p0.y + ratio * (p1.y - p0.y), cx::trimRad(p0.theta + ratio * cx::trimRad(p1.theta - p0.theta)));
+    }
+
+    bool setExtrapolationHorizon(double horizon)
+    {
+        cv::AutoLock lock(m_mutex);
+        m_extrapolation_horizon = horizon;
+        return true;
+    }
+
+    bool shareMap(BaseLocalizer* owner)
     {
+        // Use the map of 'owner' instead of keeping a copy
         cv::AutoLock lock(m_mutex);
-        m_map = cvtMap2RoadMap(map, *this, auto_cost);
+        std::lock_guard<SharedMutex> map_lock(m_map_mutex);
+        m_map_owner = (owner != this) ? owner : nullptr;
+        m_map.removeAll();
+        m_pois.clear();
+        m_views.clear();
+        clearSegmentIndex();
+        m_map_version++;
         return true;
     }
 
+    virtual bool loadMap(Map& map, bool auto_cost = false)
+    {
+        cv::AutoLock lock(m_mutex);
+        if (m_map_owner != nullptr) return false;
+        {
+            std::lock_guard<SharedMutex> map_lock(m_map_mutex);
+            m_map.removeAll();
+            m_pois.clear();
+            m_views.clear();
+            clearSegmentIndex();
+        }
+        return updateMap(map, auto_cost);
+    }
+
     virtual bool loadMap(const RoadMap& map)
     {
         cv::AutoLock lock(m_mutex);
-        return map.copyTo(&m_map);
+        if (m_map_owner != nullptr) return false;
+        std::lock_guard<SharedMutex> map_lock(m_map_mutex);
+        m_map_version++;
+        m_pois.clear();
+        m_views.clear();
+        clearSegmentIndex();
+        if (!map.copyTo(&m_map)) return false;
+        for (auto node = m_map.getHeadNodeConst(); node != m_map.getTailNodeConst(); node++)
+            updateSegmentIndex(node->data.id);
+        return true;
     }
 
-    virtual RoadMap getMap() const
+    virtual bool updateMap(Map& map, bool auto_cost = false)
     {
+        // Convert coordinates before locking to keep localization running
+        std::vector<Point2> node_xy(map.nodes.size()), poi_xy(map.pois.size()), view_xy(map.views.size());
+        for (size_t i = 0; i < map.nodes.size(); i++) node_xy[i] = toMetric(map.nodes[i]);
+        for (size_t i = 0; i < map.pois.size(); i++) poi_xy[i] = toMetric(map.pois[i]);
+        for (size_t i = 0; i < map.views.size(); i++) view_xy[i] = toMetric(map.views[i]);
+
         cv::AutoLock lock(m_mutex);
+        if (m_map_owner != nullptr) return false;
+        std::lock_guard<SharedMutex> map_lock(m_map_mutex);
+        m_map_version++;
+
+        // Remove nodes which are disappeared or moved
+        std::set<ID> dirty;
+        std::map<ID, size_t> node_lookup;
+        for (size_t i = 0; i < map.nodes.size(); i++) node_lookup[map.nodes[i].id] = i;
+        std::vector<RoadMap::Node*> node_remove;
+        for (auto node = m_map.getHeadNode(); node != m_map.getTailNode(); node++)
+        {
+            auto found = node_lookup.find(node->data.id);
+            if (found == node_lookup.end() || node->data.x != node_xy[found->second].x || node->data.y != node_xy[found->second].y)
+                node_remove.push_back(&(*node));
+        }
+        if (!node_remove.empty())
+        {
+            // Mark nodes whose edges go to the removed nodes to remove their stale cells
+            std::set<const RoadMap::Node*> removed(node_remove.begin(), node_remove.end());
+            for (auto node = m_map.getHeadNodeConst(); node != m_map.getTailNodeConst(); node++)
+            {
+                if (removed.count(&(*node))) continue;
+                for (auto edge = m_map.getHeadEdgeConst(&(*node)); edge != m_map.getTailEdgeConst(&(*node)); edge++)
+                {
+                    if (removed.count(edge->to)) dirty.insert(node->data.id);
+                }
+            }
+        }
+        for (auto node = node_remove.begin(); node != node_remove.end(); node++)
+        {
+            ID id = (*node)->data.id;
+            removeSegmentIndex(id);
+            if (!m_map.removeNode(*node)) return false;
+        }
+
+        // Add new nodes
+        for (size_t i = 0; i < map.nodes.size(); i++)
+        {
+            if (m_map.getNode(map.nodes[i].id) != nullptr) continue;
+            if (m_map.addNode(Point2ID(map.nodes[i].id, node_xy[i])) == nullptr) return false;
+            dirty.insert(map.nodes[i].id);
+        }
+
+        // Rebuild edges only for nodes whose connection is changed
+        for (auto from = map.nodes.begin(); from != map.nodes.end(); from++)
+        {
+            RoadMap::Node* from_ptr = m_map.getNode(from->id);
+            std::vector<std::pair<RoadMap::Node*, double>> edges;
+            for (auto edge_id = from->edge_ids.begin(); edge_id != from->edge_ids.end(); edge_id++)
+            {
+                const Edge* edge = map.findEdge(*edge_id);
+                if (edge == nullptr) continue;
+                ID to_id = edge->node_id2;
+                if (from->id == to_id) to_id = edge->node_id1;
+                RoadMap::Node* to_ptr = m_map.getNode(to_id);
+                if (to_ptr == nullptr) continue;
+                edges.push_back(std::make_pair(to_ptr, auto_cost ? -1 : edge->length));
+            }
+
+            bool is_same = (m_map.countEdges(from_ptr) == edges.size());
+            auto edge_prev = m_map.getHeadEdgeConst(from_ptr);
+            for (auto edge = edges.begin(); is_same && edge != edges.end(); edge++, edge_prev++)
+                is_same = (edge_prev->to == edge->first) && (auto_cost || edge_prev->cost == edge->second);
+            if (is_same) continue;
+
+            while (m_map.countEdges(from_ptr) > 0)
+                m_map.removeEdge(from_ptr, m_map.getHeadEdge(from_ptr)->to);
+            for (auto edge = edges.begin(); edge != edges.end(); edge++)
+                if (m_map.addEdge(from_ptr, edge->first, edge->second) == nullptr) return false;
+            dirty.insert(from->id);
+        }
+        for (auto id = dirty.begin(); id != dirty.end(); id++) updateSegmentIndex(*id);
+        if (!node_remove.empty()) fitSegmentIndexRange();
+
+        // Update POI and StreetView layers
+        m_pois.clear();
+        for (size_t i = 0; i < map.pois.size(); i++) m_pois[map.pois[i].id] = poi_xy[i];
+        m_views.clear();
+        for (size_t i = 0; i < map.views.size(); i++) m_views[map.views[i].id] = view_xy[i];
+        return true;
+    }
+
+    bool findLandmark(ID id, Point2& xy)
+    {
+        if (m_map_owner != nullptr) return m_map_owner->findLandmark(id, xy);
+        SharedLock map_lock(m_map_mutex);
+        RoadMap::Node* node = m_map.getNode(id);
+        if (node != nullptr)
+        {
+            xy = node->data;
+            return true;
+        }
+        auto poi = m_pois.find(id);
+        if (poi != m_pois.end())
+        {
+            xy = poi->second;
+            return true;
+        }
+        auto view = m_views.find(id);
+        if (view != m_views.end())
+        {
+            xy = view->second;
+            return true;
+        }
+        return false;
+    }
+
+    virtual RoadMap getMap() const
+    {
+        if (m_map_owner != nullptr) return m_map_owner->getMap();
+        SharedLock map_lock(m_map_mutex);
         return m_map;
     }
 
     Pose2 cvtTopmetric2Metric(const TopometricPose& pose_t)
     {
-        cv::AutoLock lock(m_mutex);
+        if (m_map_owner != nullptr) return m_map_owner->cvtTopmetric2Metric(pose_t);
+        SharedLock map_lock(m_map_mutex);
 
         // Find two nodes, 'from' and 'to_id'
         RoadMap::Node* from = m_map.getNode(pose_t.node_id);
@@ -63,36 +357,56 @@ public:
 
     TopometricPose findNearestTopoPose(const Pose2& pose_m, double turn_weight = 0, double search_range = -1, const Pose2& search_pt = Pose2())
     {
-        cv::AutoLock lock(m_mutex);
+        if (m_map_owner != nullptr) return m_map_owner->findNearestTopoPose(pose_m, turn_weight, search_range, search_pt);
+        SharedLock map_lock(m_map_mutex);
 
         // Find the nearest edge
         std::pair<double, Point2> min_dist2 = std::make_pair(DBL_MAX, Point2());
         ID min_node_id = 0;
         int min_edge_idx = 0;
-        const double range2 = search_range * search_range;
-        for (auto from = m_map.getHeadNodeConst(); from != m_map.getTailNodeConst(); from++)
+        if (search_range > 0)
         {
-            if (m_map.countEdges(from) == 0) continue;
-            if (search_range > 0)
-            {
-                double dx = pose_m.x - search_pt.x, dy = pose_m.y - search_pt.y;
-                if ((dx * dx + dy * dy) > range2) continue;
-            }
-
-            int edge_idx = 0;
-            for (auto edge = m_map.getHeadEdgeConst(from); edge != m_map.getTailEdgeConst(from); edge++, edge_idx++)
+            double dx = pose_m.x - search_pt.x, dy = pose_m.y - search_pt.y;
+            if ((dx * dx + dy * dy) > search_range * search_range) return TopometricPose();
+        }
+        if (!m_index_grid.empty())
+        {
+            // Search cells around 'pose_m' ring by ring until no closer edge can exist
+            // (Only cells within the indexed range are visited, and each node is checked once using its slot.)
+            const int cx = cvFloor(pose_m.x / m_index_cell), cy = cvFloor(pose_m.y / m_index_cell);
+            const int x_min = m_index_range.x, x_max = m_index_range.x + m_index_range.width;
+            const int y_min = m_index_range.y, y_max = m_index_range.y + m_index_range.height;
+            const int ring_min = std::max(std::max(x_min - cx, cx - x_max), std::max(std::max(y_min - cy, cy - y_max), 0));
+            const int ring_max = std::max(std::max(cx - x_min, x_max - cx), std::max(cy - y_min, y_max - cy));
+            std::vector<bool> visited(m_index_slots, false);
+            for (int ring = ring_min; ring <= ring_max; ring++)
             {
-                const RoadMap::Node* to = edge->to;
-                if (to == nullptr) continue;
-                auto dist2 = calcDist2FromLineSeg(from->data, to->data, pose_m, turn_weight);
-                if (dist2.first < min_dist2.first)
+                const double bound = (ring - 1) * m_index_cell;
+                if (ring > 0 && min_dist2.first <= bound * bound) break;
+                for (int y = std::max(cy - ring, y_min); y <= std::min(cy + ring, y_max); y++)
                 {
-                    min_dist2 = dist2;
-                    min_node_id = from->data.id;
-                    min_edge_idx = edge_idx;
+                    const int step = (y == cy - ring || y == cy + ring) ? 1 : 2 * ring;
+                    for (int x = (step == 1) ? std::max(cx - ring, x_min) : cx - ring; x <= std::min(cx + ring, x_max); x += step)
+                    {
+                        if (x < x_min) continue;
+                        auto cell = m_index_grid.find(std::make_pair(x, y));
+                        if (cell == m_index_grid.end()) continue;
+                        for (auto node = cell->second.begin(); node != cell->second.end(); node++)
+                        {
+                            if (visited[node->second]) continue;
+                            visited[node->second] = true;
+                            const RoadMap::Node* from = m_map.getNode(node->first);
+                            if (from != nullptr) findNearestEdge(from, pose_m, turn_weight, min_dist2, min_node_id, min_edge_idx);
+                        }
+                    }
                 }
             }
         }
+        else
+        {
+            for (auto from = m_map.getHeadNodeConst(); from != m_map.getTailNodeConst(); from++)
+                findNearestEdge(&(*from), pose_m, turn_weight, min_dist2, min_node_id, min_edge_idx);
+        }
 
         // Return the nearest topometric pose
         TopometricPose pose_t;
@@ -114,7 +428,8 @@ public:
 
     TopometricPose trackTopoPose(const TopometricPose& topo_from, const Pose2& pose_m, double turn_weight = 0, int extend_depth = 1)
     {
-        cv::AutoLock lock(m_mutex);
+        if (m_map_owner != nullptr) return m_map_owner->trackTopoPose(topo_from, pose_m, turn_weight, extend_depth);
+        SharedLock map_lock(m_map_mutex);
 
         // Check 'pose_m' on the current edge
         TopometricPose pose_t;
@@ -275,9 +590,178 @@ public:
     }
 
 protected:
+    void findNearestEdge(const RoadMap::Node* from, const Pose2& pose_m, double turn_weight, std::pair<double, Point2>& min_dist2, ID& min_node_id, int& min_edge_idx)
+    {
+        int edge_idx = 0;
+        for (auto edge = m_map.getHeadEdgeConst(from); edge != m_map.getTailEdgeConst(from); edge++, edge_idx++)
+        {
+            const RoadMap::Node* to = edge->to;
+            if (to == nullptr) continue;
+            auto dist2 = calcDist2FromLineSeg(from->data, to->data, pose_m, turn_weight);
+            if (dist2.first < min_dist2.first)
+            {
+                min_dist2 = dist2;
+                min_node_id = from->data.id;
+                min_edge_idx = edge_idx;
+            }
+        }
+    }
+
+    bool updateSegmentIndex(ID node_id)
+    {
+        removeSegmentIndex(node_id);
+        const RoadMap::Node* from = m_map.getNode(node_id);
+        if (from == nullptr) return false;
+
+        // Register the node to all cells overlapped with its outgoing edges
+        std::set<std::pair<int, int>> cells;
+        for (auto edge = m_map.getHeadEdgeConst(from); edge != m_map.getTailEdgeConst(from); edge++)
+        {
+            if (edge->to == nullptr) continue;
+            const int x0 = cvFloor(std::min(from->data.x, edge->to->data.x) / m_index_cell), x1 = cvFloor(std::max(from->data.x, edge->to->data.x) / m_index_cell);
+            const int y0 = cvFloor(std::min(from->data.y, edge->to->data.y) / m_index_cell), y1 = cvFloor(std::max(from->data.y, edge->to->data.y) / m_index_cell);
+            for (int y = y0; y <= y1; y++)
+                for (int x = x0; x <= x1; x++)
+                    cells.insert(std::make_pair(x, y));
+        }
+        if (cells.empty()) return true;
+        bool is_first = m_index_cells.empty();
+        int slot = m_index_slots;
+        if (!m_index_slot_free.empty())
+        {
+            slot = m_index_slot_free.back();
+            m_index_slot_free.pop_back();
+        }
+        else m_index_slots++;
+        for (auto cell = cells.begin(); cell != cells.end(); cell++)
+        {
+            m_index_grid[*cell][node_id] = slot;
+            if (is_first)
+            {
+                m_index_range = cv::Rect(cell->first, cell->second, 0, 0);
+                is_first = false;
+            }
+            else
+            {
+                const int x0 = std::min(m_index_range.x, cell->first), x1 = std::max(m_index_range.x + m_index_range.width, cell->first);
+                const int y0 = std::min(m_index_range.y, cell->second), y1 = std::max(m_index_range.y + m_index_range.height, cell->second);
+                m_index_range = cv::Rect(x0, y0, x1 - x0, y1 - y0);
+            }
+        }
+        m_index_cells[node_id].assign(cells.begin(), cells.end());
+        return true;
+    }
+
+    bool removeSegmentIndex(ID node_id)
+    {
+        auto found = m_index_cells.find(node_id);
+        if (found == m_index_cells.end()) return false;
+        int slot = -1;
+        for (auto cell = found->second.begin(); cell != found->second.end(); cell++)
+        {
+            auto grid = m_index_grid.find(*cell);
+            if (grid == m_index_grid.end()) continue;
+            auto node = grid->second.find(node_id);
+            if (node == grid->second.end()) continue;
+            slot = node->second;
+            grid->second.erase(node);
+            if (grid->second.empty()) m_index_grid.erase(grid);
+        }
+        if (slot >= 0) m_index_slot_free.push_back(slot);
+        m_index_cells.erase(found);
+        return true;
+    }
+
+    void fitSegmentIndexRange()
+    {
+        // Shrink the indexed range to the remaining cells
+        m_index_range = cv::Rect();
+        for (auto cell = m_index_grid.begin(); cell != m_index_grid.end(); cell++)
+        {
+            if (cell == m_index_grid.begin()) m_index_range = cv::Rect(cell->first.first, cell->first.second, 0, 0);
+            const int x0 = std::min(m_index_range.x, cell->first.first), x1 = std::max(m_index_range.x + m_index_range.width, cell->first.first);
+            const int y0 = std::min(m_index_range.y, cell->first.second), y1 = std::max(m_index_range.y + m_index_range.height, cell->first.second);
+            m_index_range = cv::Rect(x0, y0, x1 - x0, y1 - y0);
+        }
+    }
+
+    void clearSegmentIndex()
+    {
+        m_index_grid.clear();
+        m_index_cells.clear();
+        m_index_range = cv::Rect();
+        m_index_slots = 0;
+        m_index_slot_free.clear();
+    }
+
+    uint64 getMapVersion() const
+    {
+        if (m_map_owner != nullptr) return m_map_owner->getMapVersion();
+        SharedLock map_lock(m_map_mutex);
+        return m_map_version;
+    }
+
+    virtual bool fillSnapshot(PoseSnapshot& snapshot)
+    {
+        snapshot.pose = getPose();
+        snapshot.pose_gps = getPoseGPS();
+        snapshot.pose_topo = getPoseTopometric();
+        snapshot.confidence = getPoseConfidence();
+        return true;
+    }
+
+    bool publishSnapshot(Timestamp time)
+    {
+        std::shared_ptr<PoseSnapshot> snapshot = std::make_shared<PoseSnapshot>();
+        snapshot->time = time;
+        snapshot->horizon = m_extrapolation_horizon;
+        if (!fillSnapshot(*snapshot)) return false;
+
+        // Keep the recent poses older than the new one (newer ones are replaced after rollback)
+        if (time >= 0 && m_trail_size > 0)
+        {
+            std::shared_ptr<const PoseSnapshot> prev = std::atomic_load(&m_snapshot);
+            auto end = std::lower_bound(prev->trail.begin(), prev->trail.end(), time, [](const std::pair<Timestamp, Pose2>& p, Timestamp t) { return p.first < t; });
+            auto start = (end - prev->trail.begin() >= m_trail_size) ? end - (m_trail_size - 1) : prev->trail.begin();
+            snapshot->trail.reserve(end - start + 1);
+            snapshot->trail.assign(start, end);
+            snapshot->trail.push_back(std::make_pair(time, snapshot->pose));
+        }
+        std::atomic_store(&m_snapshot, std::shared_ptr<const PoseSnapshot>(snapshot));
+        return true;
+    }
+
     RoadMap m_map;
 
+    uint64 m_map_version;
+
+    std::map<ID, Point2> m_pois;
+
+    std::map<ID, Point2> m_views;
+
+    double m_index_cell;
+
+    std::map<std::pair<int, int>, std::map<ID, int>> m_index_grid;
+
+    std::map<ID, std::vector<std::pair<int, int>>> m_index_cells;
+
+    cv::Rect m_index_range;
+
+    int m_index_slots;
+
+    std::vector<int> m_index_slot_free;
+
+    double m_extrapolation_horizon;
+
+    int m_trail_size;
+
+    BaseLocalizer* m_map_owner;
+
     mutable cv::Mutex m_mutex;
+
+    mutable SharedMutex m_map_mutex;
+
+    std::shared_ptr<const PoseSnapshot> m_snapshot;
 }; // End of 'BaseLocalizer'
 
 } // End of 'dg'
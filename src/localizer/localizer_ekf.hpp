@@ -2,6 +2,9 @@
 #define __EKF_LOCALIZER__
 
 #include "localizer/localizer_base.hpp"
+#include "localizer/geofence.hpp"
+#include <deque>
+#include <ctime>
 
 namespace dg
 {
@@ -14,18 +17,33 @@ public:
         // Parameters
         m_threshold_time = 0.01;
         m_threshold_dist = 1;
+        m_gate_loc_clue = -1;
+        m_gate_gps_multipath = -1;
         m_noise_motion = cv::Mat::eye(2, 2, CV_64F);
         m_noise_gps_normal = cv::Mat::eye(2, 2, CV_64F);
         m_noise_gps_deadzone = 10 * cv::Mat::eye(2, 2, CV_64F);
         m_noise_gps = m_noise_gps_normal;
         m_noise_loc_clue = cv::Mat::eye(4, 4, CV_64F);
+        m_noise_pose = cv::Mat::eye(3, 3, CV_64F);
+        m_noise_orientation = 0.1;
         m_offset_gps = cv::Vec2d(0, 0);
         m_norm_conf_a = 1;
         m_norm_conf_b = 2;
+        m_history_size = 100;
+        m_history_replay = 50;
+        m_imu_period = 0.1;
+        m_noise_imu = cv::Vec2d(0.01, 0.1);
 
         // Internal variables
         m_time_last_update = -1;
         m_time_last_delta = -1;
+        m_imu_time = -1;
+        m_imu_count = 0;
+        m_clue_rejected = 0;
+        m_noise_scale = 1;
+        m_cache_gps_version = UINT64_MAX;
+        m_cache_topo_version = UINT64_MAX;
+        m_cache_conf_version = UINT64_MAX;
 
         initialize(cv::Mat::zeros(5, 1, CV_64F), cv::Mat::eye(5, 5, CV_64F));
     }
@@ -35,12 +53,36 @@ public:
         int n_read = cx::Algorithm::readParam(fn);
         CX_LOAD_PARAM_COUNT(fn, "threshold_time", m_threshold_time, n_read);
         CX_LOAD_PARAM_COUNT(fn, "threshold_dist", m_threshold_dist, n_read);
+        CX_LOAD_PARAM_COUNT(fn, "gate_loc_clue", m_gate_loc_clue, n_read);
         CX_LOAD_PARAM_COUNT(fn, "noise_motion", m_noise_motion, n_read);
         CX_LOAD_PARAM_COUNT(fn, "noise_gps_normal", m_noise_gps_normal, n_read);
         CX_LOAD_PARAM_COUNT(fn, "noise_gps_deadzone", m_noise_gps_deadzone, n_read);
         CX_LOAD_PARAM_COUNT(fn, "noise_loc_clue", m_noise_loc_clue, n_read);
+        CX_LOAD_PARAM_COUNT(fn, "noise_pose", m_noise_pose, n_read);
+        CX_LOAD_PARAM_COUNT(fn, "noise_orientation", m_noise_orientation, n_read);
         CX_LOAD_PARAM_COUNT(fn, "offset_gps", m_offset_gps, n_read);
-        CX_LOAD_PARAM_COUNT(fn, "gps_dead_zones", m_gps_dead_zones, n_read);
+        CX_LOAD_PARAM_COUNT(fn, "gate_gps_multipath", m_gate_gps_multipath, n_read);
+        std::vector<cv::Rect2d> dead_zones;
+        int n_zone = n_read;
+        CX_LOAD_PARAM_COUNT(fn, "gps_dead_zones", dead_zones, n_read);
+        if (n_read > n_zone)
+        {
+            // Replace the dead zones of the previous parameters
+            for (auto id = m_dead_zone_ids.begin(); id != m_dead_zone_ids.end(); id++)
+                m_geofence.removeZone(*id);
+            m_dead_zone_ids.clear();
+            for (auto zone = dead_zones.begin(); zone != dead_zones.end(); zone++)
+            {
+                ID id = m_geofence.getNewID();
+                if (m_geofence.addZone(zone->tl(), zone->br(), id)) m_dead_zone_ids.push_back(id);
+            }
+        }
+        CX_LOAD_PARAM_COUNT(fn, "history_size", m_history_size, n_read);
+        CX_LOAD_PARAM_COUNT(fn, "history_replay", m_history_replay, n_read);
+        CX_LOAD_PARAM_COUNT(fn, "imu_period", m_imu_period, n_read);
+        CX_LOAD_PARAM_COUNT(fn, "noise_imu", m_noise_imu, n_read);
+        CX_LOAD_PARAM_COUNT(fn, "extrapolation_horizon", m_extrapolation_horizon, n_read);
+        CX_LOAD_PARAM_COUNT(fn, "pose_trail_size", m_trail_size, n_read);
         return n_read;
     }
 
@@ -68,13 +110,137 @@ public:
         return true;
     }
 
+    bool setParamPoseNoise(double xy, double theta)
+    {
+        cv::AutoLock lock(m_mutex);
+        m_noise_pose = (cv::Mat_<double>(3, 3) << xy * xy, 0, 0, 0, xy * xy, 0, 0, 0, theta * theta);
+        m_noise_orientation = theta;
+        return true;
+    }
+
+    bool setParamIMUNoise(double gyro, double accel)
+    {
+        cv::AutoLock lock(m_mutex);
+        m_noise_imu = cv::Vec2d(gyro, accel);
+        return true;
+    }
+
     bool addParamGPSDeadZone(const dg::Point2& p1, dg::Point2& p2)
     {
         cv::AutoLock lock(m_mutex);
-        m_gps_dead_zones.push_back(cv::Rect2d(p1, p2));
+        return m_geofence.addZone(p1, p2);
+    }
+
+    bool loadGeofence(const char* filename)
+    {
+        cv::AutoLock lock(m_mutex);
+        return m_geofence.load(filename);
+    }
+
+    bool addGeoZone(const GeoZone& zone)
+    {
+        cv::AutoLock lock(m_mutex);
+        return m_geofence.addZone(zone);
+    }
+
+    bool findGeoZone(const Point2& p, GeoZone& zone)
+    {
+        cv::AutoLock lock(m_mutex);
+        const GeoZone* found = m_geofence.findZone(p);
+        if (found == nullptr) return false;
+        zone = *found;
+        return true;
+    }
+
+    int getVPSPriority(const Point2& p)
+    {
+        cv::AutoLock lock(m_mutex);
+        return m_geofence.getVPSPriority(p);
+    }
+
+    bool startSmoothing()
+    {
+        cv::AutoLock lock(m_mutex);
+        m_smoother_time.clear();
+        if (!setSmoother(&m_rts_smoother)) return false;
+        if (!m_rts_smoother.setAngularDim(2)) return false;
+        syncSmootherTime(m_time_last_update);
+        return true;
+    }
+
+    bool stopSmoothing()
+    {
+        cv::AutoLock lock(m_mutex);
+        m_smoother_time.clear();
+        return setSmoother(nullptr);
+    }
+
+    bool getSmoothedStates(std::vector<Timestamp>& times, cv::Mat& states, std::vector<cv::Mat>* covs = nullptr)
+    {
+        cv::AutoLock lock(m_mutex);
+        if (m_smoother == nullptr) return false;
+        if (!m_rts_smoother.smooth(states, covs)) return false;
+        times = m_smoother_time;
         return true;
     }
 
+    bool saveState(const char* filename)
+    {
+        cv::AutoLock lock(m_mutex);
+        std::vector<uchar> payload;
+        if (!writeState(payload)) return false;
+
+        // Write to a temporary file and replace the previous checkpoint at once
+        std::string temp = std::string(filename) + ".tmp";
+        FILE* fd = fopen(temp.c_str(), "wb");
+        if (fd == nullptr) return false;
+        const uint32 header[2] = { CHECKPOINT_MAGIC, CHECKPOINT_VERSION };
+        const int64 saved = static_cast<int64>(time(nullptr));
+        const uint64 size = payload.size(), checksum = getChecksum(payload);
+        bool ok = (fwrite(header, sizeof(header), 1, fd) == 1) && (fwrite(&saved, sizeof(saved), 1, fd) == 1)
+            && (fwrite(&size, sizeof(size), 1, fd) == 1) && (fwrite(&checksum, sizeof(checksum), 1, fd) == 1)
+            && (fwrite(payload.data(), 1, payload.size(), fd) == payload.size());
+        ok = (fclose(fd) == 0) && ok;
+        if (ok && rename(temp.c_str(), filename) != 0)
+        {
+            remove(filename); // Some platforms do not overwrite the existing file
+            ok = (rename(temp.c_str(), filename) == 0);
+        }
+        if (!ok) remove(temp.c_str());
+        return ok;
+    }
+
+    bool loadState(const char* filename, double max_age = -1)
+    {
+        cv::AutoLock lock(m_mutex);
+        FILE* fd = fopen(filename, "rb");
+        if (fd == nullptr) return false;
+        uint32 header[2] = { 0, 0 };
+        int64 saved = 0;
+        uint64 size = 0, checksum = 0;
+        bool ok = (fread(header, sizeof(header), 1, fd) == 1) && (fread(&saved, sizeof(saved), 1, fd) == 1)
+            && (fread(&size, sizeof(size), 1, fd) == 1) && (fread(&checksum, sizeof(checksum), 1, fd) == 1)
+            && header[0] == CHECKPOINT_MAGIC && header[1] == CHECKPOINT_VERSION && size < (1 << 20);
+        std::vector<uchar> payload;
+        if (ok)
+        {
+            payload.resize(static_cast<size_t>(size));
+            ok = (fread(payload.data(), 1, payload.size(), fd) == payload.size());
+        }
+        fclose(fd);
+        if (!ok || getChecksum(payload) != checksum) return false;
+        if (max_age >= 0 && difftime(time(nullptr), static_cast<time_t>(saved)) > max_age) return false;
+
+        // Restore the state and restart from it
+        size_t offset = 0;
+        if (!readState(payload, offset) || offset != payload.size()) return false;
+        m_history.clear();
+        m_imu_count = 0;
+        m_state_version++;
+        if (m_smoother != nullptr) startSmoothing();
+        return publishSnapshot(m_time_last_update);
+    }
+
     virtual Pose2 getPose()
     {
         cv::AutoLock lock(m_mutex);
@@ -89,20 +255,42 @@ public:
 
     virtual LatLon getPoseGPS()
     {
-        return toLatLon(getPose());
+        cv::AutoLock lock(m_mutex);
+        Point2UTM refer = getReference();
+        if (m_cache_gps_version != m_state_version || m_cache_gps_refer.x != refer.x || m_cache_gps_refer.y != refer.y || m_cache_gps_refer.zone != refer.zone || m_cache_gps_refer.is_south != refer.is_south)
+        {
+            m_cache_gps = toLatLon(getPose());
+            m_cache_gps_refer = refer;
+            m_cache_gps_version = m_state_version;
+        }
+        return m_cache_gps;
     }
 
     virtual TopometricPose getPoseTopometric()
     {
-        return findNearestTopoPose(getPose());
+        cv::AutoLock lock(m_mutex);
+        const uint64 map_version = getMapVersion();
+        if (m_cache_topo_version != m_state_version || m_cache_topo_map != map_version)
+        {
+            m_cache_topo = findNearestTopoPose(getPose());
+            m_cache_topo_map = map_version;
+            m_cache_topo_version = m_state_version;
+        }
+        return m_cache_topo;
     }
 
     virtual double getPoseConfidence()
     {
         cv::AutoLock lock(m_mutex);
-        double conf = log10(cv::determinant(m_state_cov.rowRange(0, 3).colRange(0, 3)));
-        if (m_norm_conf_a > 0) conf = 1 / (1 + exp(m_norm_conf_a * conf + m_norm_conf_b));
-        return conf;
+        if (m_cache_conf_version != m_state_version || m_cache_conf_norm != cv::Vec2d(m_norm_conf_a, m_norm_conf_b))
+        {
+            double conf = log10(cv::determinant(m_state_cov.rowRange(0, 3).colRange(0, 3)));
+            if (m_norm_conf_a > 0) conf = 1 / (1 + exp(m_norm_conf_a * conf + m_norm_conf_b));
+            m_cache_conf = conf;
+            m_cache_conf_norm = cv::Vec2d(m_norm_conf_a, m_norm_conf_b);
+            m_cache_conf_version = m_state_version;
+        }
+        return m_cache_conf;
     }
 
     virtual bool applyOdometry(const Pose2& pose_curr, const Pose2& pose_prev, Timestamp time_curr = -1, Timestamp time_prev = -1, double confidence = -1)
@@ -113,13 +301,7 @@ public:
             double dx = pose_curr.x - pose_prev.x, dy = pose_curr.y - pose_prev.y;
             double v = sqrt(dx * dx + dy * dy) / dt, w = cx::trimRad(pose_curr.theta - pose_prev.theta) / dt;
             cv::AutoLock lock(m_mutex);
-            double interval = time_curr - m_time_last_update;
-            if (interval > DBL_EPSILON && predict(cv::Vec3d(interval, v, w)))
-            {
-                m_state_vec.at<double>(2) = cx::trimRad(m_state_vec.at<double>(2));
-                m_time_last_update = time_curr;
-                return true;
-            }
+            return applyEvent(EVENT_CONTROL, cv::Mat(cv::Vec2d(v, w)), time_curr);
         }
         return false;
     }
@@ -130,16 +312,7 @@ public:
         cv::AutoLock lock(m_mutex);
         if (m_time_last_delta > 0) dt = time - m_time_last_delta;
         m_time_last_delta = time;
-        if (dt > DBL_EPSILON)
-        {
-            double interval = time - m_time_last_update;
-            if (interval > DBL_EPSILON && predict(cv::Vec3d(interval, delta.lin / dt, delta.ang / dt)))
-            {
-                m_state_vec.at<double>(2) = cx::trimRad(m_state_vec.at<double>(2));
-                m_time_last_update = time;
-                return true;
-            }
-        }
+        if (dt > DBL_EPSILON) return applyEvent(EVENT_CONTROL, cv::Mat(cv::Vec2d(delta.lin / dt, delta.ang / dt)), time);
         return false;
     }
 
@@ -150,49 +323,77 @@ public:
         {
             double w = cx::trimRad(theta_curr - theta_prev) / dt;
             cv::AutoLock lock(m_mutex);
-            double interval = time_curr - m_time_last_update;
-            if (interval > DBL_EPSILON && predict(cv::Vec2d(interval, w)))
-            {
-                m_state_vec.at<double>(2) = cx::trimRad(m_state_vec.at<double>(2));
-                m_time_last_update = time_curr;
-                return true;
-            }
+            return applyEvent(EVENT_CONTROL, cv::Mat(1, 1, CV_64F, cv::Scalar(w)), time_curr);
         }
         return false;
     }
 
+    bool applyIMU(double gyro, double accel, Timestamp time, double confidence = -1)
+    {
+        cv::AutoLock lock(m_mutex);
+        if (m_time_last_update < 0)
+        {
+            // Start the filter clock at the first sample
+            m_time_last_update = time;
+            m_imu_time = time;
+            return true;
+        }
+        double time_prev = std::max(m_imu_time, m_time_last_update);
+        double dt = time - time_prev;
+        if (dt <= DBL_EPSILON) return false;
+        if (m_imu_count == 0) m_imu_preint = cv::Mat::zeros(IMU_PREINT_DIM, 1, CV_64F);
+
+        // Accumulate the sample on the preintegrated motion: [ d_theta, d_v, A_x, A_y, B_x, B_y, vec(Sigma) ]
+        double* preint = m_imu_preint.ptr<double>();
+        const double phi = preint[0], dv = preint[1];
+        const double phi_m = phi + gyro * dt / 2, dv_m = dv + accel * dt / 2;
+        const double c = cos(phi_m), s = sin(phi_m);
+        preint[0] = phi + gyro * dt;
+        preint[1] = dv + accel * dt;
+        preint[2] += dt * c;
+        preint[3] += dt * s;
+        preint[4] += dv_m * dt * c;
+        preint[5] += dv_m * dt * s;
+
+        // Propagate the covariance of the preintegrated motion
+        cv::Mat G = (cv::Mat_<double>(6, 6) <<
+            1, 0, 0, 0, 0, 0,
+            0, 1, 0, 0, 0, 0,
+            -dt * s, 0, 1, 0, 0, 0,
+             dt * c, 0, 0, 1, 0, 0,
+            -dv_m * dt * s, dt * c, 0, 0, 1, 0,
+             dv_m * dt * c, dt * s, 0, 0, 0, 1);
+        cv::Mat L = (cv::Mat_<double>(6, 2) <<
+            dt, 0,
+            0, dt,
+            -dt * s * dt / 2, 0,
+             dt * c * dt / 2, 0,
+            -dv_m * dt * s * dt / 2, dt * c * dt / 2,
+             dv_m * dt * c * dt / 2, dt * s * dt / 2);
+        cv::Mat Qc = (cv::Mat_<double>(2, 2) << m_noise_imu(0) * m_noise_imu(0) / dt, 0, 0, m_noise_imu(1) * m_noise_imu(1) / dt);
+        cv::Mat Sigma = m_imu_preint.rowRange(IMU_PREINT_DIM - 36, IMU_PREINT_DIM).reshape(1, 6);
+        cv::Mat Sigma_next = G * Sigma * G.t() + L * Qc * L.t();
+        Sigma_next.copyTo(Sigma);
+        m_imu_time = time;
+        m_imu_count++;
+
+        // Apply the preintegrated motion as a single prediction
+        if (m_imu_time - m_time_last_update >= m_imu_period) return flushIMU();
+        return true;
+    }
+
     virtual bool applyPose(const Pose2& pose, Timestamp time = -1, double confidence = -1)
     {
         cv::AutoLock lock(m_mutex);
-        // TODO: Consider pose observation
-        return false;
+        if (confidence == 0) return false;
+        double scale = (confidence > 0) ? 1 / confidence : 1;
+        return applyEvent(EVENT_OBSERVE_SCALED, cv::Mat(cv::Vec4d(pose.x, pose.y, pose.theta, scale)), time);
     }
 
     virtual bool applyPosition(const Point2& xy, Timestamp time = -1, double confidence = -1)
     {
         cv::AutoLock lock(m_mutex);
-        double interval = 0;
-        if (m_time_last_update > 0) interval = time - m_time_last_update;
-        if (interval > m_threshold_time) predict(interval);
-
-        bool is_normal = true;
-        for (auto zone = m_gps_dead_zones.begin(); zone != m_gps_dead_zones.end(); zone++)
-        {
-            if (xy.x > zone->x && xy.y > zone->y && xy.x < zone->br().x && xy.y < zone->br().y)
-            {
-                is_normal = false;
-                m_noise_gps = m_noise_gps_deadzone;
-                break;
-            }
-        }
-        if (is_normal) m_noise_gps = m_noise_gps_normal;
-        if (correct(cv::Vec2d(xy.x, xy.y)))
-        {
-            m_state_vec.at<double>(2) = cx::trimRad(m_state_vec.at<double>(2));
-            m_time_last_update = time;
-            return true;
-        }
-        return false;
+        return applyEvent(EVENT_OBSERVE, cv::Mat(cv::Vec2d(xy.x, xy.y)), time);
     }
 
     virtual bool applyGPS(const LatLon& ll, Timestamp time = -1, double confidence = -1)
@@ -204,43 +405,40 @@ public:
     virtual bool applyOrientation(double theta, Timestamp time = -1, double confidence = -1)
     {
         cv::AutoLock lock(m_mutex);
-        // TODO: Consider orientation observation
-        return false;
+        if (confidence == 0) return false;
+        double scale = (confidence > 0) ? 1 / confidence : 1;
+        return applyEvent(EVENT_OBSERVE_SCALED, cv::Mat(cv::Vec2d(theta, scale)), time);
     }
 
     virtual bool applyLocClue(ID node_id, const Polar2& obs = Polar2(-1, CV_PI), Timestamp time = -1, double confidence = -1)
     {
-        cv::AutoLock lock(m_mutex);
-        RoadMap::Node* node = m_map.getNode(Point2ID(node_id));
-        if (node == nullptr) return false;
-
-        double interval = 0;
-        if (m_time_last_update > 0) interval = time - m_time_last_update;
-        if (interval > m_threshold_time) predict(interval);
-        // TODO: Deal with missing observation
-        if (obs.lin > m_threshold_dist && obs.ang < CV_PI && correct(cv::Vec4d(obs.lin, obs.ang, node->data.x, node->data.y)))
-        {
-            m_state_vec.at<double>(2) = cx::trimRad(m_state_vec.at<double>(2));
-            m_time_last_update = time;
-            return true;
-        }
-        return false;
+        return applyLocClue(std::vector<ID>(1, node_id), std::vector<Polar2>(1, obs), time, std::vector<double>(1, confidence));
     }
 
     virtual bool applyLocClue(const std::vector<ID>& node_ids, const std::vector<Polar2>& obs, Timestamp time = -1, const std::vector<double>& confidence = std::vector<double>())
     {
         if (node_ids.empty() || node_ids.size() != obs.size()) return false;
-        if (confidence.size() == node_ids.size())
-        {
-            for (size_t i = 0; i < node_ids.size(); i++)
-                if (!applyLocClue(node_ids[i], obs[i], time, confidence[i])) return false;
-        }
-        else
+
+        // Stack valid clues into a single measurement with the noise scale of each clue
+        // (Clues without both distance and angle are skipped.)
+        cv::AutoLock lock(m_mutex);
+        cv::Mat measure;
+        for (size_t i = 0; i < node_ids.size(); i++)
         {
-            for (size_t i = 0; i < node_ids.size(); i++)
-                if (!applyLocClue(node_ids[i], obs[i], time)) return false;
+            if (obs[i].lin <= m_threshold_dist || obs[i].ang >= CV_PI) continue;
+            double conf = (i < confidence.size()) ? confidence[i] : -1;
+            if (conf == 0) continue;
+            Point2 landmark;
+            if (!findLandmark(node_ids[i], landmark)) continue;
+            double scale = (conf > 0) ? 1 / conf : 1;
+            measure.push_back(cv::Mat(cv::Vec<double, 5>(obs[i].lin, obs[i].ang, landmark.x, landmark.y, scale)));
         }
-        return true;
+        if (measure.empty()) return false;
+
+        // Apply the usable clues but report success only if all clues are applied
+        m_clue_rejected = 0;
+        if (!applyEvent(EVENT_OBSERVE_CLUE, measure, time)) return false;
+        return (measure.rows / 5 == static_cast<int>(node_ids.size())) && (m_clue_rejected == 0);
     }
 
 protected:
@@ -299,7 +497,36 @@ protected:
                 1, 0,
                 0, 1);
         }
-        else if (control.rows >= 3)
+        else if (control.rows == IMU_PREINT_DIM + 1)
+        {
+            // The control input: [ dt, d_theta, d_v, A_x, A_y, B_x, B_y, vec(Sigma) ] (preintegrated IMU samples)
+            const double v = state.at<double>(3);
+            const double phi = control.at<double>(1), dv = control.at<double>(2);
+            const double ax = control.at<double>(3), ay = control.at<double>(4), bx = control.at<double>(5), by = control.at<double>(6);
+            const double c = cos(theta), s = sin(theta);
+            const double px = v * ax + bx, py = v * ay + by;
+            func = (cv::Mat_<double>(5, 1) <<
+                x + c * px - s * py,
+                y + s * px + c * py,
+                theta + phi,
+                v + dv,
+                phi / dt);
+            jacobian = (cv::Mat_<double>(5, 5) <<
+                1, 0, -s * px - c * py, c * ax - s * ay, 0,
+                0, 1,  c * px - s * py, s * ax + c * ay, 0,
+                0, 0,                1,               0, 0,
+                0, 0,                0,               1, 0,
+                0, 0,                0,               0, 0);
+            cv::Mat J = (cv::Mat_<double>(5, 6) <<
+                0, 0, v * c, -v * s, c, -s,
+                0, 0, v * s,  v * c, s,  c,
+                1, 0, 0, 0, 0, 0,
+                0, 1, 0, 0, 0, 0,
+                1 / dt, 0, 0, 0, 0, 0);
+            cv::Mat Sigma = control.rowRange(7, IMU_PREINT_DIM + 1).clone().reshape(1, 6);
+            noise = J * Sigma * J.t(); // The variance of 'phi / dt' is the gyro noise density over 'dt', correlated with the heading
+        }
+        else if (control.rows == 3)
         {
             // The control input: [ dt, v_c, w_c ]
             const double v = control.at<double>(1), w = control.at<double>(2);
@@ -332,7 +559,14 @@ protected:
     {
         const double x = state.at<double>(0), y = state.at<double>(1), theta = state.at<double>(2);
         cv::Mat func;
-        if (measure.rows == 2)
+        if (measure.rows == 1)
+        {
+            // Measurement: [ theta ]
+            func = (cv::Mat_<double>(1, 1) << theta);
+            jacobian = (cv::Mat_<double>(1, 5) << 0, 0, 1, 0, 0);
+            noise = (cv::Mat_<double>(1, 1) << m_noise_scale * m_noise_orientation * m_noise_orientation);
+        }
+        else if (measure.rows == 2)
         {
             // Measurement: [ x_{GPS}, y_{GPS} ]
             const double c = cos(theta + m_offset_gps(1)), s = sin(theta + m_offset_gps(1));
@@ -344,31 +578,354 @@ protected:
                 0, 1,  m_offset_gps(0) * c, 0, 0);
             noise = m_noise_gps;
         }
-        else if (measure.rows >= 4)
+        else if (measure.rows == 3)
         {
-            // Measurement: [ rho_{id}, phi_{id}, x_{id}, y_{id} ]
-            const double dx = measure.at<double>(2) - x;
-            const double dy = measure.at<double>(3) - y;
-            const double r = sqrt(dx * dx + dy * dy);
-            func = (cv::Mat_<double>(4, 1) <<
-                r,
-                cx::trimRad(atan2(dy, dx) - theta),
-                measure.at<double>(2),
-                measure.at<double>(3));
-            jacobian = (cv::Mat_<double>(4, 5) <<
-               -2 * dx / r, -2 * dy / r,  0, 0, 0,
-                dy / r / r, -dx / r / r, -1, 0, 0,
-                0, 0, 0, 0, 0,
-                0, 0, 0, 0, 0);
-            noise = m_noise_loc_clue;
+            // Measurement: [ x, y, theta ]
+            func = (cv::Mat_<double>(3, 1) << x, y, theta);
+            jacobian = (cv::Mat_<double>(3, 5) <<
+                1, 0, 0, 0, 0,
+                0, 1, 0, 0, 0,
+                0, 0, 1, 0, 0);
+            noise = m_noise_scale * m_noise_pose;
+        }
+        else if (measure.rows >= 4 && measure.rows % 4 == 0)
+        {
+            // Measurement: [ rho_{id1}, phi_{id1}, x_{id1}, y_{id1}, rho_{id2}, ... ] (stacked clues)
+            const int n = measure.rows / 4;
+            func = cv::Mat::zeros(4 * n, 1, CV_64F);
+            jacobian = cv::Mat::zeros(4 * n, 5, CV_64F);
+            noise = cv::Mat::zeros(4 * n, 4 * n, CV_64F);
+            const bool scaled = (m_noise_clue_scale.size() == static_cast<size_t>(n));
+            for (int i = 0; i < n; i++)
+            {
+                const int r0 = 4 * i;
+                const double dx = measure.at<double>(r0 + 2) - x;
+                const double dy = measure.at<double>(r0 + 3) - y;
+                const double r = sqrt(dx * dx + dy * dy);
+                func.at<double>(r0 + 0) = r;
+                func.at<double>(r0 + 1) = cx::trimRad(atan2(dy, dx) - theta);
+                func.at<double>(r0 + 2) = measure.at<double>(r0 + 2);
+                func.at<double>(r0 + 3) = measure.at<double>(r0 + 3);
+                jacobian.at<double>(r0 + 0, 0) = -2 * dx / r;
+                jacobian.at<double>(r0 + 0, 1) = -2 * dy / r;
+                jacobian.at<double>(r0 + 1, 0) = dy / r / r;
+                jacobian.at<double>(r0 + 1, 1) = -dx / r / r;
+                jacobian.at<double>(r0 + 1, 2) = -1;
+                const double scale = scaled ? m_noise_clue_scale[i] : 1;
+                cv::Mat(scale * m_noise_loc_clue).copyTo(noise(cv::Rect(r0, r0, 4, 4)));
+            }
         }
         return func;
     }
 
+    virtual bool fillSnapshot(PoseSnapshot& snapshot)
+    {
+        if (!BaseLocalizer::fillSnapshot(snapshot)) return false;
+        snapshot.velocity = getVelocity();
+        snapshot.covariance = m_state_cov.clone();
+        return true;
+    }
+
+    enum
+    {
+        EVENT_CONTROL = 0,
+        EVENT_OBSERVE = 1,
+        EVENT_OBSERVE_SCALED = 2,
+        EVENT_OBSERVE_CLUE = 3,
+    };
+
+    static const int IMU_PREINT_DIM = 6 + 36;
+
+    static const uint32 CHECKPOINT_MAGIC = 0x534C4744; // "DGLS"
+
+    static const uint32 CHECKPOINT_VERSION = 1;
+
+    virtual bool writeState(std::vector<uchar>& buffer)
+    {
+        Point2UTM refer = getReference();
+        writeValue(buffer, refer.x);
+        writeValue(buffer, refer.y);
+        writeValue(buffer, refer.zone);
+        writeValue(buffer, refer.is_south);
+        writeValue(buffer, m_time_last_update);
+        writeValue(buffer, m_time_last_delta);
+        writeMat(buffer, m_state_vec);
+        writeMat(buffer, m_state_cov);
+        writeValue(buffer, m_threshold_time);
+        writeValue(buffer, m_threshold_dist);
+        writeValue(buffer, m_gate_loc_clue);
+        writeValue(buffer, m_gate_gps_multipath);
+        writeMat(buffer, m_noise_motion);
+        writeMat(buffer, m_noise_gps_normal);
+        writeMat(buffer, m_noise_gps_deadzone);
+        writeMat(buffer, m_noise_loc_clue);
+        writeMat(buffer, m_noise_pose);
+        writeValue(buffer, m_noise_orientation);
+        writeValue(buffer, m_offset_gps);
+        writeValue(buffer, m_norm_conf_a);
+        writeValue(buffer, m_norm_conf_b);
+        writeValue(buffer, m_imu_period);
+        writeValue(buffer, m_noise_imu);
+        return true;
+    }
+
+    virtual bool readState(const std::vector<uchar>& buffer, size_t& offset)
+    {
+        Point2UTM refer;
+        double time_last_update, time_last_delta, threshold_time, threshold_dist, gate_loc_clue, gate_gps_multipath, noise_orientation, norm_conf_a, norm_conf_b, imu_period;
+        cv::Mat state_vec, state_cov, noise_motion, noise_gps_normal, noise_gps_deadzone, noise_loc_clue, noise_pose;
+        cv::Vec2d offset_gps, noise_imu;
+        bool ok = readValue(buffer, offset, refer.x) && readValue(buffer, offset, refer.y) && readValue(buffer, offset, refer.zone) && readValue(buffer, offset, refer.is_south)
+            && readValue(buffer, offset, time_last_update) && readValue(buffer, offset, time_last_delta)
+            && readMat(buffer, offset, state_vec) && readMat(buffer, offset, state_cov)
+            && readValue(buffer, offset, threshold_time) && readValue(buffer, offset, threshold_dist) && readValue(buffer, offset, gate_loc_clue) && readValue(buffer, offset, gate_gps_multipath)
+            && readMat(buffer, offset, noise_motion) && readMat(buffer, offset, noise_gps_normal) && readMat(buffer, offset, noise_gps_deadzone) && readMat(buffer, offset, noise_loc_clue) && readMat(buffer, offset, noise_pose)
+            && readValue(buffer, offset, noise_orientation) && readValue(buffer, offset, offset_gps) && readValue(buffer, offset, norm_conf_a) && readValue(buffer, offset, norm_conf_b)
+            && readValue(buffer, offset, imu_period) && readValue(buffer, offset, noise_imu);
+        if (!ok || state_vec.size() != m_state_vec.size() || state_cov.size() != m_state_cov.size()) return false;
+
+        // Reject the state in a different metric frame
+        Point2UTM refer_curr = getReference();
+        if (refer.zone != refer_curr.zone || refer.is_south != refer_curr.is_south || fabs(refer.x - refer_curr.x) > 1e-3 || fabs(refer.y - refer_curr.y) > 1e-3) return false;
+
+        m_time_last_update = time_last_update;
+        m_time_last_delta = time_last_delta;
+        m_state_vec = state_vec;
+        m_state_cov = state_cov;
+        m_threshold_time = threshold_time;
+        m_threshold_dist = threshold_dist;
+        m_gate_loc_clue = gate_loc_clue;
+        m_gate_gps_multipath = gate_gps_multipath;
+        m_noise_motion = noise_motion;
+        m_noise_gps_normal = noise_gps_normal;
+        m_noise_gps_deadzone = noise_gps_deadzone;
+        m_noise_gps = m_noise_gps_normal;
+        m_noise_loc_clue = noise_loc_clue;
+        m_noise_pose = noise_pose;
+        m_noise_orientation = noise_orientation;
+        m_offset_gps = offset_gps;
+        m_norm_conf_a = norm_conf_a;
+        m_norm_conf_b = norm_conf_b;
+        m_imu_period = imu_period;
+        m_noise_imu = noise_imu;
+        return true;
+    }
+
+    template <typename T>
+    static void writeValue(std::vector<uchar>& buffer, const T& value)
+    {
+        const uchar* ptr = reinterpret_cast<const uchar*>(&value);
+        buffer.insert(buffer.end(), ptr, ptr + sizeof(T));
+    }
+
+    template <typename T>
+    static bool readValue(const std::vector<uchar>& buffer, size_t& offset, T& value)
+    {
+        if (offset + sizeof(T) > buffer.size()) return false;
+        memcpy(&value, buffer.data() + offset, sizeof(T));
+        offset += sizeof(T);
+        return true;
+    }
+
+    static void writeMat(std::vector<uchar>& buffer, const cv::Mat& mat)
+    {
+        cv::Mat data;
+        mat.convertTo(data, CV_64F);
+        writeValue(buffer, data.rows);
+        writeValue(buffer, data.cols);
+        for (int r = 0; r < data.rows; r++)
+            for (int c = 0; c < data.cols; c++)
+                writeValue(buffer, data.at<double>(r, c));
+    }
+
+    static bool readMat(const std::vector<uchar>& buffer, size_t& offset, cv::Mat& mat)
+    {
+        int rows = 0, cols = 0;
+        if (!readValue(buffer, offset, rows) || !readValue(buffer, offset, cols)) return false;
+        if (rows < 0 || cols < 0 || rows * cols > 1024) return false;
+        mat.create(rows, cols, CV_64F);
+        for (int r = 0; r < rows; r++)
+            for (int c = 0; c < cols; c++)
+                if (!readValue(buffer, offset, mat.at<double>(r, c))) return false;
+        return true;
+    }
+
+    static uint64 getChecksum(const std::vector<uchar>& buffer)
+    {
+        // FNV-1a hash
+        uint64 hash = 14695981039346656037ULL;
+        for (auto b = buffer.begin(); b != buffer.end(); b++)
+        {
+            hash ^= *b;
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    bool flushIMU()
+    {
+        if (m_imu_count <= 0) return true;
+        m_imu_count = 0;
+        return applyEvent(EVENT_CONTROL, m_imu_preint, m_imu_time);
+    }
+
+    struct HistoryItem
+    {
+        int type;
+        Timestamp time;
+        cv::Mat data;
+        Timestamp time_prev;
+        cv::Mat state_vec;
+        cv::Mat state_cov;
+    };
+
+    bool processEvent(int type, const cv::Mat& data, Timestamp time)
+    {
+        if (type == EVENT_CONTROL)
+        {
+            // The control input: [ dt, ... ]
+            double interval = time - m_time_last_update;
+            if (interval <= DBL_EPSILON) return false;
+            cv::Mat control(data.rows + 1, 1, CV_64F);
+            control.at<double>(0) = interval;
+            data.copyTo(control.rowRange(1, control.rows));
+            if (!predict(control)) return false;
+            syncSmootherTime(time);
+        }
+        else
+        {
+            double interval = 0;
+            if (m_time_last_update > 0) interval = time - m_time_last_update;
+            if (interval > m_threshold_time && predict(interval))
+            {
+                m_time_last_update = time;
+                syncSmootherTime(time);
+            }
+
+            cv::Mat measure = data;
+            if (type == EVENT_OBSERVE_SCALED)
+            {
+                // Separate the noise scale and unwrap the heading around the current state
+                m_noise_scale = data.at<double>(data.rows - 1);
+                measure = data.rowRange(0, data.rows - 1).clone();
+                double& theta = measure.at<double>(measure.rows - 1);
+                theta = m_state_vec.at<double>(2) + cx::trimRad(theta - m_state_vec.at<double>(2));
+            }
+            else if (measure.rows == 2)
+            {
+                // Select GPS noise by its geofence zone
+                const GeoZone* zone = m_geofence.findZone(Point2(measure.at<double>(0), measure.at<double>(1)));
+                m_noise_gps = m_noise_gps_normal;
+                if (zone != nullptr)
+                {
+                    if (zone->gps_noise > 0) m_noise_gps = (cv::Mat_<double>(2, 2) << zone->gps_noise * zone->gps_noise, 0, 0, zone->gps_noise * zone->gps_noise);
+                    else m_noise_gps = m_noise_gps_deadzone;
+
+                    // Reject outlier GPS data affected by multipath
+                    if (zone->multipath && m_gate_gps_multipath > 0 && checkMeasurement(measure) > m_gate_gps_multipath) return false;
+                }
+            }
+            else if (type == EVENT_OBSERVE_CLUE)
+            {
+                // Separate the noise scale of each clue and reject outlier clues using their Mahalanobis distance
+                cv::Mat inlier;
+                std::vector<double> scales;
+                m_clue_rejected = 0;
+                for (int r = 0; r < data.rows; r += 5)
+                {
+                    cv::Mat z = data.rowRange(r, r + 4);
+                    m_noise_clue_scale.assign(1, data.at<double>(r + 4));
+                    if (m_gate_loc_clue > 0 && checkMeasurement(z) > m_gate_loc_clue)
+                    {
+                        m_clue_rejected++;
+                        continue;
+                    }
+                    inlier.push_back(z);
+                    scales.push_back(m_noise_clue_scale.front());
+                }
+                if (inlier.empty()) return false;
+                measure = inlier;
+                m_noise_clue_scale = scales;
+            }
+            if (!correct(measure)) return false;
+        }
+        m_state_vec.at<double>(2) = cx::trimRad(m_state_vec.at<double>(2));
+        m_state_version++;
+        if (m_smoother != nullptr) m_smoother->updateStep(m_state_vec, m_state_cov);
+        if (m_smoother != nullptr && m_smoother_time.size() == 1 && m_smoother_time.front() < 0) m_smoother_time.front() = time; // Stamp the initial state by its first update
+        m_time_last_update = time;
+        return true;
+    }
+
+    void syncSmootherTime(Timestamp time)
+    {
+        if (m_smoother != nullptr) m_smoother_time.resize(m_rts_smoother.countSteps(), time);
+    }
+
+    bool applyEvent(int type, const cv::Mat& data, Timestamp time)
+    {
+        if (m_imu_count > 0) flushIMU(); // Apply the pending IMU samples before the new event
+        if (time < 0) time = m_time_last_update;
+        if (m_history_size <= 0)
+        {
+            if (!processEvent(type, data, time)) return false;
+            return publishSnapshot(m_time_last_update);
+        }
+
+        // Apply the in-sequence event and record it
+        if (m_history.empty() || time >= m_history.back().time)
+        {
+            HistoryItem item = { type, time, data.clone(), m_time_last_update, m_state_vec.clone(), m_state_cov.clone() };
+            if (!processEvent(type, data, time)) return false;
+            m_history.push_back(item);
+            while (m_history.size() > static_cast<size_t>(m_history_size)) m_history.pop_front();
+            return publishSnapshot(m_time_last_update);
+        }
+
+        // Find where the out-of-sequence event should be inserted
+        auto itr = std::upper_bound(m_history.begin(), m_history.end(), time, [](Timestamp t, const HistoryItem& h) { return t < h.time; });
+        if (itr == m_history.begin()) return false; // Older than the history
+        if (static_cast<int>(m_history.end() - itr) > m_history_replay) return false; // Exceed the replay budget
+
+        // Roll back the filter to the capture time
+        m_state_vec = itr->state_vec.clone();
+        m_state_cov = itr->state_cov.clone();
+        m_state_version++;
+        m_time_last_update = itr->time_prev;
+        if (m_smoother != nullptr)
+        {
+            // Discard the recorded steps after the capture time
+            int n_steps = static_cast<int>(std::upper_bound(m_smoother_time.begin(), m_smoother_time.end(), m_time_last_update) - m_smoother_time.begin());
+            m_rts_smoother.truncate(std::max(n_steps, 1));
+            syncSmootherTime(m_time_last_update);
+            m_rts_smoother.updateStep(m_state_vec, m_state_cov);
+        }
+
+        // Apply the delayed event and replay the subsequent events
+        HistoryItem item = { type, time, data.clone(), m_time_last_update, m_state_vec.clone(), m_state_cov.clone() };
+        bool success = processEvent(type, data, time);
+        int clue_rejected = m_clue_rejected; // Keep the outcome of the delayed event, not of the replayed ones
+        if (success) itr = m_history.insert(itr, item) + 1;
+        while (itr != m_history.end())
+        {
+            itr->time_prev = m_time_last_update;
+            m_state_vec.copyTo(itr->state_vec);
+            m_state_cov.copyTo(itr->state_cov);
+            if (processEvent(itr->type, itr->data, itr->time)) itr++;
+            else itr = m_history.erase(itr); // Drop the event rejected on replay not to replay it again
+        }
+        while (m_history.size() > static_cast<size_t>(m_history_size)) m_history.pop_front();
+        m_clue_rejected = clue_rejected;
+        publishSnapshot(m_time_last_update);
+        return success;
+    }
+
     double m_threshold_time;
 
     double m_threshold_dist;
 
+    double m_gate_loc_clue;
+
     cv::Mat m_noise_motion;
 
     cv::Mat m_noise_gps;
@@ -379,6 +936,14 @@ protected:
 
     cv::Mat m_noise_loc_clue;
 
+    cv::Mat m_noise_pose;
+
+    double m_noise_orientation;
+
+    double m_noise_scale;
+
+    std::vector<double> m_noise_clue_scale;
+
     cv::Vec2d m_offset_gps;
 
     double m_norm_conf_a;
@@ -389,7 +954,51 @@ protected:
 
     double m_time_last_delta;
 
-    std::vector<cv::Rect2d> m_gps_dead_zones;
+    Geofence m_geofence;
+
+    std::vector<ID> m_dead_zone_ids;
+
+    double m_gate_gps_multipath;
+
+    int m_history_size;
+
+    int m_history_replay;
+
+    std::deque<HistoryItem> m_history;
+
+    double m_imu_period;
+
+    cv::Vec2d m_noise_imu;
+
+    cv::Mat m_imu_preint;
+
+    Timestamp m_imu_time;
+
+    int m_imu_count;
+
+    int m_clue_rejected;
+
+    cx::RTSSmoother m_rts_smoother;
+
+    std::vector<Timestamp> m_smoother_time;
+
+    LatLon m_cache_gps;
+
+    Point2UTM m_cache_gps_refer;
+
+    uint64 m_cache_gps_version;
+
+    TopometricPose m_cache_topo;
+
+    uint64 m_cache_topo_map;
+
+    uint64 m_cache_topo_version;
+
+    double m_cache_conf;
+
+    cv::Vec2d m_cache_conf_norm;
+
+    uint64 m_cache_conf_version;
 
 }; // End of 'EKFLocalizer'
 
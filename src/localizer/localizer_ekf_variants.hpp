@@ -112,12 +112,53 @@ public:
                 }
             }
             m_track_prev = m_track_topo;
-            return true;
+            m_state_version++; // Invalidate outputs derived from the previous track
+            return publishSnapshot(m_time_last_update);
         }
         return false;
     }
 
 protected:
+    virtual bool writeState(std::vector<uchar>& buffer)
+    {
+        const TopometricPose* tracks[] = { &m_track_topo, &m_track_prev };
+        for (int i = 0; i < 2; i++)
+        {
+            writeValue(buffer, tracks[i]->node_id);
+            writeValue(buffer, tracks[i]->edge_idx);
+            writeValue(buffer, tracks[i]->dist);
+            writeValue(buffer, tracks[i]->head);
+        }
+        writeValue(buffer, m_track_converge);
+        return EKFLocalizerHyperTan::writeState(buffer);
+    }
+
+    virtual bool readState(const std::vector<uchar>& buffer, size_t& offset)
+    {
+        // Parse the track before the filter state not to restore them partially
+        TopometricPose tracks[2];
+        int track_converge = 0;
+        for (int i = 0; i < 2; i++)
+        {
+            if (!readValue(buffer, offset, tracks[i].node_id) || !readValue(buffer, offset, tracks[i].edge_idx)) return false;
+            if (!readValue(buffer, offset, tracks[i].dist) || !readValue(buffer, offset, tracks[i].head)) return false;
+        }
+        if (!readValue(buffer, offset, track_converge)) return false;
+        if (!EKFLocalizerHyperTan::readState(buffer, offset)) return false;
+
+        // Restart tracking if the map does not contain the track
+        Point2 track_node;
+        if (!findLandmark(tracks[0].node_id, track_node))
+        {
+            tracks[0] = tracks[1] = TopometricPose();
+            track_converge = 0;
+        }
+        m_track_topo = tracks[0];
+        m_track_prev = tracks[1];
+        m_track_converge = track_converge;
+        return true;
+    }
+
     TopometricPose m_track_topo;
 
     TopometricPose m_track_prev;
@@ -0,0 +1,446 @@
+#ifndef __ENSEMBLE_LOCALIZER__
+#define __ENSEMBLE_LOCALIZER__
+
+#include "localizer/localizer_ekf.hpp"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace dg
+{
+
+struct EnsembleMemberStatus
+{
+    /** The name of the member */
+    std::string name;
+
+    /** A flag whether the member accepted the latest data */
+    bool updated = false;
+
+    /** The weight of the member in the latest fusion */
+    double weight = 0;
+
+    /** The processing time of the member for the latest data (Unit: [sec]) */
+    double elapsed = 0;
+
+    /** The latest output of the member */
+    std::shared_ptr<const PoseSnapshot> snapshot;
+};
+
+class EnsembleLocalizer : public BaseLocalizer, public cx::Algorithm
+{
+public:
+    enum
+    {
+        FUSION_CONFIDENCE = 0,
+        FUSION_COVARIANCE_INTERSECTION = 1,
+    };
+
+    EnsembleLocalizer(int thread_num = -1)
+    {
+        // Parameters
+        m_fusion = FUSION_CONFIDENCE;
+        m_thread_num = thread_num;
+
+        // Internal variables
+        m_time_last_update = -1;
+        m_fused_conf = 0;
+        m_fused_cov = cv::Mat::eye(3, 3, CV_64F);
+        m_fused_version = 0;
+        m_cache_topo_version = UINT64_MAX;
+        m_cache_topo_map = UINT64_MAX;
+        m_task = nullptr;
+        m_task_version = 0;
+        m_task_next = 0;
+        m_task_remain = 0;
+        m_pool_stop = false;
+    }
+
+    virtual ~EnsembleLocalizer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_pool_mutex);
+            m_pool_stop = true;
+        }
+        m_pool_wake.notify_all();
+        for (auto worker = m_workers.begin(); worker != m_workers.end(); worker++) worker->join();
+
+        // Let members which outlive this ensemble stop referring to its map
+        for (auto member = m_members.begin(); member != m_members.end(); member++) (*member)->shareMap(nullptr);
+    }
+
+    virtual int readParam(const cv::FileNode& fn)
+    {
+        int n_read = cx::Algorithm::readParam(fn);
+        CX_LOAD_PARAM_COUNT(fn, "fusion", m_fusion, n_read);
+        CX_LOAD_PARAM_COUNT(fn, "thread_num", m_thread_num, n_read);
+        CX_LOAD_PARAM_COUNT(fn, "extrapolation_horizon", m_extrapolation_horizon, n_read);
+        CX_LOAD_PARAM_COUNT(fn, "pose_trail_size", m_trail_size, n_read);
+        return n_read;
+    }
+
+    bool setParamFusion(int fusion)
+    {
+        if (fusion != FUSION_CONFIDENCE && fusion != FUSION_COVARIANCE_INTERSECTION) return false;
+        cv::AutoLock lock(m_mutex);
+        m_fusion = fusion;
+        return true;
+    }
+
+    bool addMember(cv::Ptr<EKFLocalizer> member, const std::string& name = "")
+    {
+        if (member.empty()) return false;
+
+        // Let the member use the map and reference of this ensemble
+        std::lock_guard<std::mutex> dispatch_lock(m_dispatch_mutex);
+        if (!member->shareMap(this)) return false;
+        member->setReference(getReference());
+
+        cv::AutoLock lock(m_mutex);
+        EnsembleMemberStatus status;
+        status.name = name.empty() ? cv::format("member%d", static_cast<int>(m_members.size())) : name;
+        status.snapshot = member->getPoseSnapshot();
+        m_members.push_back(member);
+        m_status.push_back(status);
+        return true;
+    }
+
+    bool setReference(const Point2UTM& utm)
+    {
+        // Keep the reference of members same with this ensemble
+        std::lock_guard<std::mutex> dispatch_lock(m_dispatch_mutex);
+        UTMConverter::setReference(utm);
+        for (auto member = m_members.begin(); member != m_members.end(); member++) (*member)->setReference(utm);
+        return true;
+    }
+
+    bool setReference(const LatLon& ll) { return setReference(cvtLatLon2UTM(ll)); }
+
+    int countMembers() const
+    {
+        cv::AutoLock lock(m_mutex);
+        return static_cast<int>(m_members.size());
+    }
+
+    cv::Ptr<EKFLocalizer> getMember(int index) const
+    {
+        cv::AutoLock lock(m_mutex);
+        if (index < 0 || index >= static_cast<int>(m_members.size())) return cv::Ptr<EKFLocalizer>();
+        return m_members[index];
+    }
+
+    std::vector<EnsembleMemberStatus> getMemberStatus() const
+    {
+        cv::AutoLock lock(m_mutex);
+        return m_status;
+    }
+
+    virtual Pose2 getPose()
+    {
+        cv::AutoLock lock(m_mutex);
+        return m_fused_pose;
+    }
+
+    virtual Polar2 getVelocity()
+    {
+        cv::AutoLock lock(m_mutex);
+        return m_fused_velocity;
+    }
+
+    virtual LatLon getPoseGPS()
+    {
+        return toLatLon(getPose());
+    }
+
+    virtual TopometricPose getPoseTopometric()
+    {
+        cv::AutoLock lock(m_mutex);
+        const uint64 map_version = getMapVersion();
+        if (m_cache_topo_version != m_fused_version || m_cache_topo_map != map_version)
+        {
+            m_cache_topo = findNearestTopoPose(m_fused_pose);
+            m_cache_topo_map = map_version;
+            m_cache_topo_version = m_fused_version;
+        }
+        return m_cache_topo;
+    }
+
+    virtual double getPoseConfidence()
+    {
+        cv::AutoLock lock(m_mutex);
+        return m_fused_conf;
+    }
+
+    cv::Mat getPoseCov()
+    {
+        cv::AutoLock lock(m_mutex);
+        return m_fused_cov.clone();
+    }
+
+    virtual bool applyOdometry(const Pose2& pose_curr, const Pose2& pose_prev, Timestamp time_curr = -1, Timestamp time_prev = -1, double confidence = -1)
+    {
+        return dispatch([&](EKFLocalizer* member) { return member->applyOdometry(pose_curr, pose_prev, time_curr, time_prev, confidence); });
+    }
+
+    virtual bool applyOdometry(const Polar2& delta, Timestamp time = -1, double confidence = -1)
+    {
+        return dispatch([&](EKFLocalizer* member) { return member->applyOdometry(delta, time, confidence); });
+    }
+
+    virtual bool applyOdometry(double theta_curr, double theta_prev, Timestamp time_curr = -1, Timestamp time_prev = -1, double confidence = -1)
+    {
+        return dispatch([&](EKFLocalizer* member) { return member->applyOdometry(theta_curr, theta_prev, time_curr, time_prev, confidence); });
+    }
+
+    bool applyIMU(double gyro, double accel, Timestamp time, double confidence = -1)
+    {
+        return dispatch([&](EKFLocalizer* member) { return member->applyIMU(gyro, accel, time, confidence); });
+    }
+
+    virtual bool applyPose(const Pose2& pose, Timestamp time = -1, double confidence = -1)
+    {
+        return dispatch([&](EKFLocalizer* member) { return member->applyPose(pose, time, confidence); });
+    }
+
+    virtual bool applyPosition(const Point2& xy, Timestamp time = -1, double confidence = -1)
+    {
+        return dispatch([&](EKFLocalizer* member) { return member->applyPosition(xy, time, confidence); });
+    }
+
+    virtual bool applyGPS(const LatLon& ll, Timestamp time = -1, double confidence = -1)
+    {
+        Point2 xy = toMetric(ll);
+        return applyPosition(xy, time, confidence);
+    }
+
+    virtual bool applyOrientation(double theta, Timestamp time = -1, double confidence = -1)
+    {
+        return dispatch([&](EKFLocalizer* member) { return member->applyOrientation(theta, time, confidence); });
+    }
+
+    virtual bool applyLocClue(ID node_id, const Polar2& obs = Polar2(-1, CV_PI), Timestamp time = -1, double confidence = -1)
+    {
+        return dispatch([&](EKFLocalizer* member) { return member->applyLocClue(node_id, obs, time, confidence); });
+    }
+
+    virtual bool applyLocClue(const std::vector<ID>& node_ids, const std::vector<Polar2>& obs, Timestamp time = -1, const std::vector<double>& confidence = std::vector<double>())
+    {
+        return dispatch([&](EKFLocalizer* member) { return member->applyLocClue(node_ids, obs, time, confidence); });
+    }
+
+protected:
+    bool dispatch(const std::function<bool(EKFLocalizer*)>& task)
+    {
+        std::lock_guard<std::mutex> dispatch_lock(m_dispatch_mutex);
+        const int n_members = static_cast<int>(m_members.size());
+        if (n_members <= 0) return false;
+        m_task_result.resize(n_members);
+        m_task_elapsed.resize(n_members);
+        startWorkers(n_members);
+
+        // Wake workers and process tasks together until all members are done
+        {
+            std::lock_guard<std::mutex> lock(m_pool_mutex);
+            m_task = &task;
+            m_task_remain = n_members;
+            m_task_next = 0;
+            m_task_version++;
+        }
+        m_pool_wake.notify_all();
+        runTasks();
+        {
+            std::unique_lock<std::mutex> lock(m_pool_mutex);
+            while (m_task_remain > 0) m_pool_done.wait(lock);
+            m_task = nullptr;
+        }
+        return fuseMembers();
+    }
+
+    void startWorkers(int n_members)
+    {
+        // Workers are created once and reused for all following data
+        int n_threads = n_members - 1;
+        if (m_thread_num >= 0) n_threads = std::min(n_threads, m_thread_num);
+        else n_threads = std::min(n_threads, std::max(static_cast<int>(std::thread::hardware_concurrency()) - 1, 0));
+        while (static_cast<int>(m_workers.size()) < n_threads)
+            m_workers.push_back(std::thread(&EnsembleLocalizer::runWorker, this));
+    }
+
+    void runWorker()
+    {
+        uint64 version = 0;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_pool_mutex);
+                while (!m_pool_stop && m_task_version == version) m_pool_wake.wait(lock);
+                if (m_pool_stop) return;
+                version = m_task_version;
+            }
+            runTasks();
+        }
+    }
+
+    void runTasks()
+    {
+        const int n_members = static_cast<int>(m_members.size());
+        while (true)
+        {
+            const int i = m_task_next++;
+            if (i >= n_members) break;
+            const int64 tick = cv::getTickCount();
+            m_task_result[i] = (*m_task)(m_members[i].get()) ? 1 : 0;
+            m_task_elapsed[i] = (cv::getTickCount() - tick) / cv::getTickFrequency();
+            if (--m_task_remain == 0)
+            {
+                std::lock_guard<std::mutex> lock(m_pool_mutex);
+                m_pool_done.notify_all();
+            }
+        }
+    }
+
+    bool fuseMembers()
+    {
+        cv::AutoLock lock(m_mutex);
+        bool updated = false;
+        int best = -1;
+        for (size_t i = 0; i < m_members.size(); i++)
+        {
+            EnsembleMemberStatus& status = m_status[i];
+            status.updated = (m_task_result[i] != 0);
+            status.elapsed = m_task_elapsed[i];
+            status.snapshot = m_members[i]->getPoseSnapshot();
+            status.weight = 0;
+            if (status.updated) updated = true;
+            if (status.snapshot->time < 0) continue;
+            if (best < 0 || status.snapshot->confidence > m_status[best].snapshot->confidence) best = static_cast<int>(i);
+        }
+        if (!updated || best < 0) return false;
+
+        // Assign weights to members
+        const Pose2 refer = m_status[best].snapshot->pose;
+        bool use_cov = (m_fusion == FUSION_COVARIANCE_INTERSECTION);
+        for (auto status = m_status.begin(); use_cov && status != m_status.end(); status++)
+            if (status->snapshot->time >= 0 && status->snapshot->covariance.rows < 3) use_cov = false;
+        double weight_sum = 0;
+        for (auto status = m_status.begin(); status != m_status.end(); status++)
+        {
+            if (status->snapshot->time < 0) continue;
+            if (use_cov) status->weight = 1 / std::max(cv::trace(status->snapshot->covariance(cv::Rect(0, 0, 3, 3)))[0], DBL_EPSILON);
+            else status->weight = std::max(status->snapshot->confidence, 0.);
+            weight_sum += status->weight;
+        }
+        if (weight_sum <= 0)
+        {
+            for (auto status = m_status.begin(); status != m_status.end(); status++)
+            {
+                if (status->snapshot->time < 0) continue;
+                status->weight = 1;
+                weight_sum += 1;
+            }
+        }
+        for (auto status = m_status.begin(); status != m_status.end(); status++) status->weight /= weight_sum;
+
+        // Combine member poses (angles are averaged around the most confident one)
+        cv::Mat info = cv::Mat::zeros(3, 3, CV_64F), info_mean = cv::Mat::zeros(3, 1, CV_64F);
+        cv::Mat pose_mean = cv::Mat::zeros(3, 1, CV_64F), cov_mean = cv::Mat::zeros(3, 3, CV_64F);
+        double lin = 0, ang = 0, conf = 0;
+        Timestamp time = -1;
+        for (auto status = m_status.begin(); status != m_status.end(); status++)
+        {
+            if (status->weight <= 0) continue;
+            const PoseSnapshot& snapshot = *status->snapshot;
+            cv::Mat pose = (cv::Mat_<double>(3, 1) << snapshot.pose.x, snapshot.pose.y, refer.theta + cx::trimRad(snapshot.pose.theta - refer.theta));
+            if (use_cov)
+            {
+                cv::Mat cov_inv = snapshot.covariance(cv::Rect(0, 0, 3, 3)).inv(cv::DECOMP_SVD);
+                info += status->weight * cov_inv;
+                info_mean += status->weight * cov_inv * pose;
+            }
+            else
+            {
+                pose_mean += status->weight * pose;
+                if (snapshot.covariance.rows >= 3) cov_mean += status->weight * snapshot.covariance(cv::Rect(0, 0, 3, 3));
+            }
+            lin += status->weight * snapshot.velocity.lin;
+            ang += status->weight * snapshot.velocity.ang;
+            conf += status->weight * snapshot.confidence;
+            time = std::max(time, snapshot.time);
+        }
+        if (use_cov)
+        {
+            cov_mean = info.inv(cv::DECOMP_SVD);
+            pose_mean = cov_mean * info_mean;
+        }
+        m_fused_pose = Pose2(pose_mean.at<double>(0), pose_mean.at<double>(1), cx::trimRad(pose_mean.at<double>(2)));
+        m_fused_velocity = Polar2(lin, ang);
+        m_fused_cov = cov_mean;
+        m_fused_conf = conf;
+        m_fused_version++;
+        m_time_last_update = time;
+        return publishSnapshot(m_time_last_update);
+    }
+
+    virtual bool fillSnapshot(PoseSnapshot& snapshot)
+    {
+        if (!BaseLocalizer::fillSnapshot(snapshot)) return false;
+        snapshot.velocity = m_fused_velocity;
+        snapshot.covariance = m_fused_cov.clone();
+        return true;
+    }
+
+    int m_fusion;
+
+    int m_thread_num;
+
+    Timestamp m_time_last_update;
+
+    Pose2 m_fused_pose;
+
+    Polar2 m_fused_velocity;
+
+    double m_fused_conf;
+
+    cv::Mat m_fused_cov;
+
+    uint64 m_fused_version;
+
+    TopometricPose m_cache_topo;
+
+    uint64 m_cache_topo_version;
+
+    uint64 m_cache_topo_map;
+
+    std::vector<cv::Ptr<EKFLocalizer>> m_members;
+
+    std::vector<EnsembleMemberStatus> m_status;
+
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_dispatch_mutex;
+
+    std::mutex m_pool_mutex;
+
+    std::condition_variable m_pool_wake;
+
+    std::condition_variable m_pool_done;
+
+    bool m_pool_stop;
+
+    const std::function<bool(EKFLocalizer*)>* m_task;
+
+    uint64 m_task_version;
+
+    std::atomic<int> m_task_next;
+
+    std::atomic<int> m_task_remain;
+
+    std::vector<int> m_task_result;
+
+    std::vector<double> m_task_elapsed;
+};
+
+} // End of 'dg'
+
+#endif // End of '__ENSEMBLE_LOCALIZER__'
@@ -0,0 +1,672 @@
+#ifndef __PARTICLE_LOCALIZER__
+#define __PARTICLE_LOCALIZER__
+
+#include "localizer/localizer_base.hpp"
+
+namespace dg
+{
+
+class ParticleLocalizer : public BaseLocalizer, public cx::Algorithm
+{
+public:
+    ParticleLocalizer()
+    {
+        // Parameters
+        m_num_particles = 1000;
+        m_block_size = 256;
+        m_threshold_time = 0.01;
+        m_threshold_dist = 1;
+        m_noise_motion = cv::Vec2d(0.5, 0.1);
+        m_noise_gps = 1;
+        m_noise_orientation = 0.1;
+        m_noise_loc_clue = cv::Vec2d(1, 0.1);
+        m_init_radius = 20;
+        m_resample_ratio = 0.5;
+        m_turn_kappa = 2;
+
+        // Internal variables
+        m_time_last_update = -1;
+        m_edge_version = UINT64_MAX;
+        m_confidence = 0;
+    }
+
+    virtual int readParam(const cv::FileNode& fn)
+    {
+        int n_read = cx::Algorithm::readParam(fn);
+        CX_LOAD_PARAM_COUNT(fn, "num_particles", m_num_particles, n_read);
+        CX_LOAD_PARAM_COUNT(fn, "block_size", m_block_size, n_read);
+        CX_LOAD_PARAM_COUNT(fn, "threshold_time", m_threshold_time, n_read);
+        CX_LOAD_PARAM_COUNT(fn, "threshold_dist", m_threshold_dist, n_read);
+        CX_LOAD_PARAM_COUNT(fn, "noise_motion", m_noise_motion, n_read);
+        CX_LOAD_PARAM_COUNT(fn, "noise_gps", m_noise_gps, n_read);
+        CX_LOAD_PARAM_COUNT(fn, "noise_orientation", m_noise_orientation, n_read);
+        CX_LOAD_PARAM_COUNT(fn, "noise_loc_clue", m_noise_loc_clue, n_read);
+        CX_LOAD_PARAM_COUNT(fn, "init_radius", m_init_radius, n_read);
+        CX_LOAD_PARAM_COUNT(fn, "resample_ratio", m_resample_ratio, n_read);
+        CX_LOAD_PARAM_COUNT(fn, "turn_kappa", m_turn_kappa, n_read);
+        return n_read;
+    }
+
+    virtual Pose2 getPose()
+    {
+        cv::AutoLock lock(m_mutex);
+        return m_pose;
+    }
+
+    virtual LatLon getPoseGPS()
+    {
+        return toLatLon(getPose());
+    }
+
+    virtual TopometricPose getPoseTopometric()
+    {
+        cv::AutoLock lock(m_mutex);
+        return m_pose_topo;
+    }
+
+    virtual double getPoseConfidence()
+    {
+        cv::AutoLock lock(m_mutex);
+        return m_confidence;
+    }
+
+    size_t countParticles() const
+    {
+        cv::AutoLock lock(m_mutex);
+        return m_p_edge.size();
+    }
+
+    bool resetParticles(const Point2& xy, double radius = -1, Timestamp time = -1)
+    {
+        cv::AutoLock lock(m_mutex);
+        if (!updateEdgeTable()) return false;
+        if (radius <= 0) radius = m_init_radius;
+
+        // Collect edges around the given position
+        std::vector<int> candidates;
+        const Pose2 p(xy.x, xy.y, 0);
+        for (int e = 0; e < static_cast<int>(m_edge_len.size()); e++)
+        {
+            Point2 from(m_edge_x[e], m_edge_y[e]), to(m_edge_x[e] + m_edge_len[e] * m_edge_ux[e], m_edge_y[e] + m_edge_len[e] * m_edge_uy[e]);
+            if (calcDist2FromLineSeg(from, to, p).first <= radius * radius) candidates.push_back(e);
+        }
+        if (candidates.empty()) return false;
+
+        // Spread particles uniformly on the edges
+        const int n = std::max(m_num_particles, 1);
+        resizeParticles(n);
+        for (int i = 0; i < n; i++)
+        {
+            int e = candidates[m_rng.uniform(0, static_cast<int>(candidates.size()))];
+            m_p_edge[i] = e;
+            m_p_dist[i] = m_rng.uniform(0., std::max(m_edge_len[e], DBL_EPSILON));
+            m_p_theta[i] = m_edge_theta[e];
+            m_p_velocity[i] = 0;
+            m_p_weight[i] = 1. / n;
+        }
+        updatePositions();
+        if (time >= 0) m_time_last_update = time;
+        updateEstimate();
+        return publishSnapshot(m_time_last_update);
+    }
+
+    virtual bool applyOdometry(const Pose2& pose_curr, const Pose2& pose_prev, Timestamp time_curr = -1, Timestamp time_prev = -1, double confidence = -1)
+    {
+        double dx = pose_curr.x - pose_prev.x, dy = pose_curr.y - pose_prev.y;
+        return applyMotion(sqrt(dx * dx + dy * dy), cx::trimRad(pose_curr.theta - pose_prev.theta), time_curr);
+    }
+
+    virtual bool applyOdometry(const Polar2& delta, Timestamp time = -1, double confidence = -1)
+    {
+        return applyMotion(delta.lin, delta.ang, time);
+    }
+
+    virtual bool applyOdometry(double theta_curr, double theta_prev, Timestamp time_curr = -1, Timestamp time_prev = -1, double confidence = -1)
+    {
+        return applyMotion(-1, cx::trimRad(theta_curr - theta_prev), time_curr);
+    }
+
+    virtual bool applyPose(const Pose2& pose, Timestamp time = -1, double confidence = -1)
+    {
+        cv::AutoLock lock(m_mutex);
+        if (m_p_edge.empty()) return resetParticles(pose, -1, time);
+        if (!prepareObservation(time)) return false;
+        const double gps_inv = -0.5 / (m_noise_gps * m_noise_gps), theta_inv = -0.5 / (m_noise_orientation * m_noise_orientation);
+        const double* px = m_p_x.data();
+        const double* py = m_p_y.data();
+        const double* pt = m_p_theta.data();
+        double* ll = m_p_loglik.data();
+        runParallel([&](int start, int end, cv::RNG&)
+        {
+            for (int i = start; i < end; i++)
+            {
+                double dx = px[i] - pose.x, dy = py[i] - pose.y, dt = cx::trimRad(pt[i] - pose.theta);
+                ll[i] = gps_inv * (dx * dx + dy * dy) + theta_inv * dt * dt;
+            }
+        });
+        return finishObservation(time);
+    }
+
+    virtual bool applyPosition(const Point2& xy, Timestamp time = -1, double confidence = -1)
+    {
+        cv::AutoLock lock(m_mutex);
+        if (m_p_edge.empty()) return resetParticles(xy, -1, time);
+        if (!prepareObservation(time)) return false;
+        const double gps_inv = -0.5 / (m_noise_gps * m_noise_gps);
+        const double* px = m_p_x.data();
+        const double* py = m_p_y.data();
+        double* ll = m_p_loglik.data();
+        runParallel([&](int start, int end, cv::RNG&)
+        {
+            for (int i = start; i < end; i++)
+            {
+                double dx = px[i] - xy.x, dy = py[i] - xy.y;
+                ll[i] = gps_inv * (dx * dx + dy * dy);
+            }
+        });
+        return finishObservation(time);
+    }
+
+    virtual bool applyGPS(const LatLon& ll, Timestamp time = -1, double confidence = -1)
+    {
+        Point2 xy = toMetric(ll);
+        return applyPosition(xy, time, confidence);
+    }
+
+    virtual bool applyOrientation(double theta, Timestamp time = -1, double confidence = -1)
+    {
+        cv::AutoLock lock(m_mutex);
+        if (!prepareObservation(time)) return false;
+        const double theta_inv = -0.5 / (m_noise_orientation * m_noise_orientation);
+        const double* pt = m_p_theta.data();
+        double* ll = m_p_loglik.data();
+        runParallel([&](int start, int end, cv::RNG&)
+        {
+            for (int i = start; i < end; i++)
+            {
+                double dt = cx::trimRad(pt[i] - theta);
+                ll[i] = theta_inv * dt * dt;
+            }
+        });
+        return finishObservation(time);
+    }
+
+    virtual bool applyLocClue(ID node_id, const Polar2& obs = Polar2(-1, CV_PI), Timestamp time = -1, double confidence = -1)
+    {
+        return applyLocClue(std::vector<ID>(1, node_id), std::vector<Polar2>(1, obs), time, std::vector<double>(1, confidence));
+    }
+
+    virtual bool applyLocClue(const std::vector<ID>& node_ids, const std::vector<Polar2>& obs, Timestamp time = -1, const std::vector<double>& confidence = std::vector<double>())
+    {
+        if (node_ids.empty() || node_ids.size() != obs.size()) return false;
+
+        // Keep clues with their distance or angle (the weight of a missing one is zero)
+        cv::AutoLock lock(m_mutex);
+        const double rho_inv = -0.5 / (m_noise_loc_clue[0] * m_noise_loc_clue[0]), phi_inv = -0.5 / (m_noise_loc_clue[1] * m_noise_loc_clue[1]);
+        std::vector<cv::Vec<double, 6>> clues;
+        for (size_t i = 0; i < node_ids.size(); i++)
+        {
+            bool has_lin = (obs[i].lin > m_threshold_dist), has_ang = (obs[i].ang < CV_PI);
+            if (!has_lin && !has_ang) continue;
+            Point2 landmark;
+            if (!findLandmark(node_ids[i], landmark)) continue;
+            clues.push_back(cv::Vec<double, 6>(obs[i].lin, obs[i].ang, landmark.x, landmark.y, has_lin ? rho_inv : 0, has_ang ? phi_inv : 0));
+        }
+        if (clues.empty()) return false;
+        if (!prepareObservation(time)) return false;
+
+        const double* px = m_p_x.data();
+        const double* py = m_p_y.data();
+        const double* pt = m_p_theta.data();
+        double* ll = m_p_loglik.data();
+        runParallel([&](int start, int end, cv::RNG&)
+        {
+            std::fill(ll + start, ll + end, 0.);
+            for (auto clue = clues.begin(); clue != clues.end(); clue++)
+            {
+                const cv::Vec<double, 6>& c = *clue;
+                for (int i = start; i < end; i++)
+                {
+                    double dx = c[2] - px[i], dy = c[3] - py[i];
+                    if (c[4] < 0)
+                    {
+                        double dr = sqrt(dx * dx + dy * dy) - c[0];
+                        ll[i] += c[4] * dr * dr;
+                    }
+                    if (c[5] < 0)
+                    {
+                        double da = cx::trimRad(atan2(dy, dx) - pt[i] - c[1]);
+                        ll[i] += c[5] * da * da;
+                    }
+                }
+            }
+        });
+        return finishObservation(time);
+    }
+
+protected:
+    bool applyMotion(double lin, double ang, Timestamp time)
+    {
+        cv::AutoLock lock(m_mutex);
+        if (m_p_edge.empty() || !updateEdgeTable()) return false;
+        double dt = 0;
+        if (time >= 0 && m_time_last_update >= 0) dt = time - m_time_last_update;
+        if (dt < 0) return false;
+        predictParticles(dt, lin, ang);
+        if (time >= 0) m_time_last_update = time;
+        updateEstimate();
+        return publishSnapshot(m_time_last_update);
+    }
+
+    bool prepareObservation(Timestamp time)
+    {
+        if (m_p_edge.empty() || !updateEdgeTable()) return false;
+
+        // Move particles to the observation time with their own velocity
+        if (time >= 0 && m_time_last_update >= 0)
+        {
+            double dt = time - m_time_last_update;
+            if (dt > m_threshold_time)
+            {
+                predictParticles(dt, -1, 0);
+                m_time_last_update = time;
+            }
+        }
+        return true;
+    }
+
+    bool finishObservation(Timestamp time)
+    {
+        // Update weights with the log-likelihood using vectorized operations
+        const int n = static_cast<int>(m_p_edge.size());
+        cv::Mat loglik(n, 1, CV_64F, m_p_loglik.data()), weight(n, 1, CV_64F, m_p_weight.data());
+        double loglik_max;
+        cv::minMaxLoc(loglik, nullptr, &loglik_max);
+        if (!std::isfinite(loglik_max)) return false;
+        cv::subtract(loglik, loglik_max, loglik);
+        cv::exp(loglik, loglik);
+        cv::multiply(weight, loglik, weight);
+        double weight_sum = cv::sum(weight)(0);
+        if (weight_sum > DBL_MIN && std::isfinite(weight_sum)) weight /= weight_sum;
+        else weight.setTo(1. / n);
+
+        // Resample particles if they are degenerated
+        double ess = 1 / weight.dot(weight);
+        if (ess < m_resample_ratio * n) resampleParticles();
+
+        if (time >= 0 && time > m_time_last_update) m_time_last_update = time;
+        updateEstimate();
+        return publishSnapshot(m_time_last_update);
+    }
+
+    void predictParticles(double dt, double lin, double ang)
+    {
+        const double sigma_t = sqrt(std::max(dt, m_threshold_time));
+        const double sigma_v = m_noise_motion[0] * sigma_t, sigma_w = m_noise_motion[1] * sigma_t;
+        runParallel([&](int start, int end, cv::RNG& rng)
+        {
+            for (int i = start; i < end; i++)
+            {
+                double ds;
+                if (lin >= 0)
+                {
+                    ds = std::max(lin + rng.gaussian(sigma_v), 0.);
+                    if (dt > m_threshold_time) m_p_velocity[i] = ds / dt;
+                }
+                else
+                {
+                    m_p_velocity[i] = std::max(m_p_velocity[i] + rng.gaussian(sigma_v), 0.);
+                    ds = m_p_velocity[i] * dt;
+                }
+                m_p_theta[i] = cx::trimRad(m_p_theta[i] + ang + rng.gaussian(sigma_w));
+                moveParticle(i, ds, rng);
+            }
+        });
+        updatePositions();
+    }
+
+    void moveParticle(int i, double ds, cv::RNG& rng)
+    {
+        int e = m_p_edge[i];
+        double d = m_p_dist[i] + ds;
+        while (d > m_edge_len[e])
+        {
+            // Select the next edge, preferring ones aligned with the particle heading
+            const int begin = m_next_offset[e], end = m_next_offset[e + 1];
+            if (begin >= end)
+            {
+                d = m_edge_len[e];
+                break;
+            }
+            double score_sum = 0;
+            for (int k = begin; k < end; k++) score_sum += scoreNextEdge(e, m_next_edge[k], m_p_theta[i], end - begin);
+            double pick = rng.uniform(0., score_sum);
+            int next = m_next_edge[end - 1];
+            for (int k = begin; k < end; k++)
+            {
+                pick -= scoreNextEdge(e, m_next_edge[k], m_p_theta[i], end - begin);
+                if (pick <= 0)
+                {
+                    next = m_next_edge[k];
+                    break;
+                }
+            }
+            d -= m_edge_len[e];
+            e = next;
+        }
+        m_p_edge[i] = e;
+        m_p_dist[i] = std::max(d, 0.);
+    }
+
+    double scoreNextEdge(int curr, int next, double theta, int n_next) const
+    {
+        // Avoid U-turns unless the edge is a dead end
+        if (m_edge_to[next] == m_edge_from[curr] && n_next > 1) return 0;
+        return exp(m_turn_kappa * cos(theta - m_edge_theta[next]));
+    }
+
+    void updatePositions()
+    {
+        const int* pe = m_p_edge.data();
+        const double* pd = m_p_dist.data();
+        double* px = m_p_x.data();
+        double* py = m_p_y.data();
+        runParallel([&](int start, int end, cv::RNG&)
+        {
+            for (int i = start; i < end; i++)
+            {
+                const int e = pe[i];
+                px[i] = m_edge_x[e] + pd[i] * m_edge_ux[e];
+                py[i] = m_edge_y[e] + pd[i] * m_edge_uy[e];
+            }
+        });
+    }
+
+    void resampleParticles()
+    {
+        // Systematic resampling
+        const int n = static_cast<int>(m_p_edge.size());
+        const double step = 1. / n;
+        double u = m_rng.uniform(0., step), cumsum = m_p_weight[0];
+        int j = 0;
+        m_q_edge.resize(n);
+        m_q_dist.resize(n);
+        m_q_theta.resize(n);
+        m_q_velocity.resize(n);
+        for (int i = 0; i < n; i++, u += step)
+        {
+            while (u > cumsum && j < n - 1) cumsum += m_p_weight[++j];
+            m_q_edge[i] = m_p_edge[j];
+            m_q_dist[i] = m_p_dist[j];
+            m_q_theta[i] = m_p_theta[j];
+            m_q_velocity[i] = m_p_velocity[j];
+        }
+        m_p_edge.swap(m_q_edge);
+        m_p_dist.swap(m_q_dist);
+        m_p_theta.swap(m_q_theta);
+        m_p_velocity.swap(m_q_velocity);
+        std::fill(m_p_weight.begin(), m_p_weight.end(), step);
+        updatePositions();
+    }
+
+    void updateEstimate()
+    {
+        const int n = static_cast<int>(m_p_edge.size());
+        if (n <= 0) return;
+
+        // Estimate the metric pose as the weighted mean
+        double x = 0, y = 0, c = 0, s = 0;
+        std::fill(m_edge_weight.begin(), m_edge_weight.end(), 0.);
+        for (int i = 0; i < n; i++)
+        {
+            const double w = m_p_weight[i];
+            x += w * m_p_x[i];
+            y += w * m_p_y[i];
+            c += w * cos(m_p_theta[i]);
+            s += w * sin(m_p_theta[i]);
+            m_edge_weight[m_p_edge[i]] += w;
+        }
+        m_pose = Pose2(x, y, atan2(s, c));
+
+        // Estimate the topometric pose on the most probable edge
+        int best = static_cast<int>(std::max_element(m_edge_weight.begin(), m_edge_weight.end()) - m_edge_weight.begin());
+        double dist = 0, bc = 0, bs = 0;
+        for (int i = 0; i < n; i++)
+        {
+            if (m_p_edge[i] != best) continue;
+            const double w = m_p_weight[i];
+            dist += w * m_p_dist[i];
+            bc += w * cos(m_p_theta[i]);
+            bs += w * sin(m_p_theta[i]);
+        }
+        m_confidence = m_edge_weight[best];
+        if (m_confidence > 0) dist /= m_confidence;
+        m_pose_topo = TopometricPose(m_edge_from[best], m_edge_idx[best], dist, cx::trimRad(atan2(bs, bc) - m_edge_theta[best]));
+    }
+
+    bool updateEdgeTable()
+    {
+        const uint64 map_version = getMapVersion();
+        if (m_edge_version == map_version) return true;
+
+        // Copy the shared map from its owner (only when the map is updated)
+        RoadMap map_shared;
+        if (m_map_owner != nullptr) map_shared = m_map_owner->getMap();
+        RoadMap& map = (m_map_owner != nullptr) ? map_shared : m_map;
+
+        // Keep the previous edges to move particles to the new table
+        std::vector<ID> edge_from_prev, edge_to_prev;
+        edge_from_prev.swap(m_edge_from);
+        edge_to_prev.swap(m_edge_to);
+
+        // Flatten edges of the road map
+        m_edge_x.clear();
+        m_edge_y.clear();
+        m_edge_ux.clear();
+        m_edge_uy.clear();
+        m_edge_len.clear();
+        m_edge_theta.clear();
+        m_edge_idx.clear();
+        std::map<std::pair<ID, ID>, int> edge_lookup;
+        for (auto from = map.getHeadNodeConst(); from != map.getTailNodeConst(); from++)
+        {
+            int edge_idx = 0;
+            for (auto edge = map.getHeadEdgeConst(from); edge != map.getTailEdgeConst(from); edge++, edge_idx++)
+            {
+                if (edge->to == nullptr) continue;
+                double dx = edge->to->data.x - from->data.x, dy = edge->to->data.y - from->data.y;
+                double len = sqrt(dx * dx + dy * dy);
+                edge_lookup[std::make_pair(from->data.id, edge->to->data.id)] = static_cast<int>(m_edge_len.size());
+                m_edge_x.push_back(from->data.x);
+                m_edge_y.push_back(from->data.y);
+                m_edge_ux.push_back(len > DBL_EPSILON ? dx / len : 0);
+                m_edge_uy.push_back(len > DBL_EPSILON ? dy / len : 0);
+                m_edge_len.push_back(len);
+                m_edge_theta.push_back(atan2(dy, dx));
+                m_edge_from.push_back(from->data.id);
+                m_edge_to.push_back(edge->to->data.id);
+                m_edge_idx.push_back(edge_idx);
+            }
+        }
+
+        // Build successors of each edge in the compressed row format
+        const int n_edge = static_cast<int>(m_edge_len.size());
+        m_next_offset.assign(n_edge + 1, 0);
+        m_next_edge.clear();
+        for (int e = 0; e < n_edge; e++)
+        {
+            const RoadMap::Node* to = map.getNode(m_edge_to[e]);
+            for (auto edge = map.getHeadEdgeConst(to); edge != map.getTailEdgeConst(to); edge++)
+            {
+                auto found = edge_lookup.find(std::make_pair(m_edge_to[e], edge->to->data.id));
+                if (found != edge_lookup.end()) m_next_edge.push_back(found->second);
+            }
+            m_next_offset[e + 1] = static_cast<int>(m_next_edge.size());
+        }
+        m_edge_weight.resize(n_edge);
+        m_edge_version = map_version;
+
+        // Move particles to the new table (drop particles on removed edges)
+        int n_keep = 0;
+        for (size_t i = 0; i < m_p_edge.size(); i++)
+        {
+            auto found = edge_lookup.find(std::make_pair(edge_from_prev[m_p_edge[i]], edge_to_prev[m_p_edge[i]]));
+            if (found == edge_lookup.end()) continue;
+            m_p_edge[n_keep] = found->second;
+            m_p_dist[n_keep] = std::min(m_p_dist[i], m_edge_len[found->second]);
+            m_p_theta[n_keep] = m_p_theta[i];
+            m_p_velocity[n_keep] = m_p_velocity[i];
+            m_p_weight[n_keep] = m_p_weight[i];
+            n_keep++;
+        }
+        resizeParticles(n_keep);
+        if (n_keep > 0)
+        {
+            cv::Mat weight(n_keep, 1, CV_64F, m_p_weight.data());
+            double weight_sum = cv::sum(weight)(0);
+            if (weight_sum > DBL_MIN) weight /= weight_sum;
+            else weight.setTo(1. / n_keep);
+            updatePositions();
+        }
+        return n_edge > 0;
+    }
+
+    void resizeParticles(int n)
+    {
+        m_p_edge.resize(n);
+        m_p_dist.resize(n);
+        m_p_theta.resize(n);
+        m_p_velocity.resize(n);
+        m_p_weight.resize(n);
+        m_p_x.resize(n);
+        m_p_y.resize(n);
+        m_p_loglik.resize(n);
+    }
+
+    template <typename Func>
+    void runParallel(Func func)
+    {
+        // Split particles into blocks which have their own random number generators
+        const int n = static_cast<int>(m_p_edge.size());
+        const int block = std::max(m_block_size, 1);
+        const int n_block = (n + block - 1) / block;
+        m_block_seed.resize(n_block);
+        for (int b = 0; b < n_block; b++) m_block_seed[b] = m_rng.next();
+        cv::parallel_for_(cv::Range(0, n_block), ParallelBlocks<Func>(func, m_block_seed, block, n));
+    }
+
+    template <typename Func>
+    class ParallelBlocks : public cv::ParallelLoopBody
+    {
+    public:
+        ParallelBlocks(Func& func, const std::vector<uint64>& seeds, int block, int n) : m_func(func), m_seeds(seeds), m_block(block), m_n(n) { }
+
+        virtual void operator()(const cv::Range& range) const
+        {
+            for (int b = range.start; b < range.end; b++)
+            {
+                cv::RNG rng(m_seeds[b]);
+                m_func(b * m_block, std::min((b + 1) * m_block, m_n), rng);
+            }
+        }
+
+    protected:
+        Func& m_func;
+
+        const std::vector<uint64>& m_seeds;
+
+        int m_block;
+
+        int m_n;
+    };
+
+    int m_num_particles;
+
+    int m_block_size;
+
+    double m_threshold_time;
+
+    double m_threshold_dist;
+
+    cv::Vec2d m_noise_motion;
+
+    double m_noise_gps;
+
+    double m_noise_orientation;
+
+    cv::Vec2d m_noise_loc_clue;
+
+    double m_init_radius;
+
+    double m_resample_ratio;
+
+    double m_turn_kappa;
+
+    double m_time_last_update;
+
+    Pose2 m_pose;
+
+    TopometricPose m_pose_topo;
+
+    double m_confidence;
+
+    cv::RNG m_rng;
+
+    std::vector<uint64> m_block_seed;
+
+    // Particles (structure of arrays)
+    std::vector<int> m_p_edge;
+
+    std::vector<double> m_p_dist;
+
+    std::vector<double> m_p_theta;
+
+    std::vector<double> m_p_velocity;
+
+    std::vector<double> m_p_weight;
+
+    std::vector<double> m_p_x;
+
+    std::vector<double> m_p_y;
+
+    std::vector<double> m_p_loglik;
+
+    std::vector<int> m_q_edge;
+
+    std::vector<double> m_q_dist;
+
+    std::vector<double> m_q_theta;
+
+    std::vector<double> m_q_velocity;
+
+    // Edges of the road map (structure of arrays)
+    uint64 m_edge_version;
+
+    std::vector<double> m_edge_x;
+
+    std::vector<double> m_edge_y;
+
+    std::vector<double> m_edge_ux;
+
+    std::vector<double> m_edge_uy;
+
+    std::vector<double> m_edge_len;
+
+    std::vector<double> m_edge_theta;
+
+    std::vector<ID> m_edge_from;
+
+    std::vector<ID> m_edge_to;
+
+    std::vector<int> m_edge_idx;
+
+    std::vector<double> m_edge_weight;
+
+    std::vector<int> m_next_offset;
+
+    std::vector<int> m_next_edge;
+}; // End of 'ParticleLocalizer'
+
+} // End of 'dg'
+
+#endif // End of '__PARTICLE_LOCALIZER__'
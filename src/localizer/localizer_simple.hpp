@@ -39,6 +39,7 @@ public:
         m_pose.x += c * dx - s * dy;
         m_pose.x += s * dx + c * dy;
         m_pose.theta = cx::trimRad(m_pose.theta + pose_curr.theta - pose_prev.theta);
+        publishSnapshot(time_curr);
         return true;
     }
 
@@ -48,6 +49,7 @@ public:
         m_pose.x += delta.lin * cos(m_pose.theta + delta.ang / 2);
         m_pose.y += delta.lin * sin(m_pose.theta + delta.ang / 2);
         m_pose.theta = cx::trimRad(m_pose.theta + delta.ang);
+        publishSnapshot(time);
         return true;
     }
 
@@ -55,6 +57,7 @@ public:
     {
         cv::AutoLock lock(m_mutex);
         m_pose.theta = cx::trimRad(m_pose.theta + theta_curr - theta_prev);
+        publishSnapshot(time_curr);
         return true;
     }
 
@@ -62,6 +65,7 @@ public:
     {
         cv::AutoLock lock(m_mutex);
         m_pose = pose;
+        publishSnapshot(time);
         return true;
     }
 
@@ -70,6 +74,7 @@ public:
         cv::AutoLock lock(m_mutex);
         m_pose.x = xy.x;
         m_pose.y = xy.y;
+        publishSnapshot(time);
         return true;
     }
 
@@ -83,16 +88,18 @@ public:
     {
         cv::AutoLock lock(m_mutex);
         m_pose.theta = theta;
+        publishSnapshot(time);
         return true;
     }
 
     virtual bool applyLocClue(ID node_id, const Polar2& obs = Polar2(-1, CV_PI), Timestamp time = -1, double confidence = -1)
     {
         cv::AutoLock lock(m_mutex);
-        RoadMap::Node* node = m_map.getNode(Point2ID(node_id));
-        if (node == nullptr) return false;
-        m_pose.x = node->data.x;
-        m_pose.y = node->data.y;
+        Point2 landmark;
+        if (!findLandmark(node_id, landmark)) return false;
+        m_pose.x = landmark.x;
+        m_pose.y = landmark.y;
+        publishSnapshot(time);
         return true;
     }
 
@@ -0,0 +1,578 @@
+#ifndef __HMM_MAP_MATCHER__
+#define __HMM_MAP_MATCHER__
+
+#include "localizer/localizer_base.hpp"
+
+namespace dg
+{
+
+class HMMMapMatcher : public BaseLocalizer, public cx::Algorithm
+{
+public:
+    HMMMapMatcher()
+    {
+        // Parameters
+        m_noise_gps = 5;
+        m_transit_beta = 2;
+        m_candidate_radius = 30;
+        m_candidate_max = 8;
+        m_fixed_lag = 5;
+        m_route_factor = 2;
+        m_grid_cell = 50;
+
+        // Internal variables
+        m_edge_version = UINT64_MAX;
+        m_edge_stamp_curr = 0;
+        m_n_fixes = 0;
+        m_time_last_update = -1;
+        m_time_lagged = -1;
+        m_confidence = 0;
+    }
+
+    virtual int readParam(const cv::FileNode& fn)
+    {
+        int n_read = cx::Algorithm::readParam(fn);
+        CX_LOAD_PARAM_COUNT(fn, "noise_gps", m_noise_gps, n_read);
+        CX_LOAD_PARAM_COUNT(fn, "transit_beta", m_transit_beta, n_read);
+        CX_LOAD_PARAM_COUNT(fn, "candidate_radius", m_candidate_radius, n_read);
+        CX_LOAD_PARAM_COUNT(fn, "candidate_max", m_candidate_max, n_read);
+        CX_LOAD_PARAM_COUNT(fn, "fixed_lag", m_fixed_lag, n_read);
+        CX_LOAD_PARAM_COUNT(fn, "route_factor", m_route_factor, n_read);
+        CX_LOAD_PARAM_COUNT(fn, "grid_cell", m_grid_cell, n_read);
+        return n_read;
+    }
+
+    virtual Pose2 getPose()
+    {
+        cv::AutoLock lock(m_mutex);
+        return m_pose;
+    }
+
+    virtual LatLon getPoseGPS()
+    {
+        return toLatLon(getPose());
+    }
+
+    virtual TopometricPose getPoseTopometric()
+    {
+        cv::AutoLock lock(m_mutex);
+        return m_pose_topo;
+    }
+
+    virtual double getPoseConfidence()
+    {
+        cv::AutoLock lock(m_mutex);
+        return m_confidence;
+    }
+
+    bool getPoseLagged(TopometricPose& pose, Timestamp& time)
+    {
+        cv::AutoLock lock(m_mutex);
+        if (m_n_fixes == 0) return false;
+        pose = m_pose_lagged;
+        time = m_time_lagged;
+        return true;
+    }
+
+    void reset()
+    {
+        cv::AutoLock lock(m_mutex);
+        m_n_fixes = 0;
+        m_time_last_update = -1;
+        m_time_lagged = -1;
+        m_pose_lagged = TopometricPose();
+    }
+
+    bool matchBatch(const std::vector<std::pair<double, LatLon>>& gps_data, std::vector<TopometricPose>& path)
+    {
+        cv::AutoLock lock(m_mutex);
+        path.assign(gps_data.size(), TopometricPose());
+        if (!updateEdgeTable()) return false;
+
+        // Run forward Viterbi over all GPS data (positions without any candidate are skipped and left as empty poses)
+        Trellis trellis;
+        trellis.resize(static_cast<int>(gps_data.size()), std::max(m_candidate_max, 1));
+        std::vector<int> data_idx;
+        data_idx.reserve(gps_data.size());
+        for (size_t i = 0; i < gps_data.size(); i++)
+        {
+            const int col = static_cast<int>(data_idx.size());
+            if (!addColumn(trellis, col, toMetric(gps_data[i].second), gps_data[i].first)) continue;
+            data_idx.push_back(static_cast<int>(i));
+        }
+        if (data_idx.empty()) return false;
+
+        // Backtrack the most probable sequence
+        int k = findBest(trellis, static_cast<int>(data_idx.size()) - 1);
+        for (int col = static_cast<int>(data_idx.size()) - 1; col >= 0; col--)
+        {
+            path[data_idx[col]] = getTopoPose(trellis, col, k);
+            if (col > 0)
+            {
+                k = trellis.back[col * trellis.capacity + k];
+                if (k < 0) k = findBest(trellis, col - 1); // Restart at the broken chain
+            }
+        }
+        return true;
+    }
+
+    virtual bool applyPosition(const Point2& xy, Timestamp time = -1, double confidence = -1)
+    {
+        cv::AutoLock lock(m_mutex);
+        if (!updateEdgeTable()) return false;
+        const int width = std::max(m_fixed_lag, 0) + 1, capacity = std::max(m_candidate_max, 1);
+        if (m_trellis.width != width || m_trellis.capacity != capacity)
+        {
+            m_trellis.resize(width, capacity);
+            m_n_fixes = 0;
+        }
+
+        // Append a column to the sliding window
+        const int col = static_cast<int>(m_n_fixes % width);
+        if (!addColumn(m_trellis, col, xy, time, m_n_fixes > 0 ? static_cast<int>((m_n_fixes - 1) % width) : -1)) return false;
+        m_n_fixes++;
+
+        // Update the current pose and its confidence
+        const int base = col * capacity;
+        int k = findBest(m_trellis, col);
+        double prob_sum = 0;
+        for (int i = 0; i < m_trellis.count[col]; i++) prob_sum += exp(m_trellis.score[base + i] - m_trellis.score[base + k]);
+        m_confidence = 1 / prob_sum;
+        m_pose_topo = getTopoPose(m_trellis, col, k);
+        const int e = m_trellis.edge[base + k];
+        const double offset = m_trellis.offset[base + k];
+        m_pose = Pose2(m_edge_x[e] + offset * m_edge_ux[e], m_edge_y[e] + offset * m_edge_uy[e], m_edge_theta[e]);
+
+        // Decode the lagged pose by backtracking the window
+        int lag_col = col;
+        for (int step = 0; step < width - 1 && step + 1 < static_cast<int>(m_n_fixes); step++)
+        {
+            int k_prev = m_trellis.back[lag_col * capacity + k];
+            if (k_prev < 0) break;
+            lag_col = (lag_col + width - 1) % width;
+            k = k_prev;
+        }
+        m_pose_lagged = getTopoPose(m_trellis, lag_col, k);
+        m_time_lagged = m_trellis.time[lag_col];
+
+        if (time >= 0) m_time_last_update = time;
+        return publishSnapshot(m_time_last_update);
+    }
+
+    virtual bool applyGPS(const LatLon& ll, Timestamp time = -1, double confidence = -1)
+    {
+        Point2 xy = toMetric(ll);
+        return applyPosition(xy, time, confidence);
+    }
+
+    virtual bool applyPose(const Pose2& pose, Timestamp time = -1, double confidence = -1)
+    {
+        return applyPosition(pose, time, confidence);
+    }
+
+    virtual bool applyOrientation(double theta, Timestamp time = -1, double confidence = -1) { return false; }
+
+    virtual bool applyOdometry(const Pose2& pose_curr, const Pose2& pose_prev, Timestamp time_curr = -1, Timestamp time_prev = -1, double confidence = -1) { return false; }
+
+    virtual bool applyOdometry(const Polar2& delta, Timestamp time = -1, double confidence = -1) { return false; }
+
+    virtual bool applyOdometry(double theta_curr, double theta_prev, Timestamp time_curr = -1, Timestamp time_prev = -1, double confidence = -1) { return false; }
+
+    virtual bool applyLocClue(ID node_id, const Polar2& obs = Polar2(-1, CV_PI), Timestamp time = -1, double confidence = -1) { return false; }
+
+    virtual bool applyLocClue(const std::vector<ID>& node_ids, const std::vector<Polar2>& obs, Timestamp time = -1, const std::vector<double>& confidence = std::vector<double>()) { return false; }
+
+protected:
+    struct Trellis
+    {
+        void resize(int _width, int _capacity)
+        {
+            width = _width;
+            capacity = _capacity;
+            count.assign(width, 0);
+            fix.resize(width);
+            time.resize(width);
+            edge.resize(width * capacity);
+            offset.resize(width * capacity);
+            dist.resize(width * capacity);
+            score.resize(width * capacity);
+            back.resize(width * capacity);
+        }
+
+        int width = 0;
+
+        int capacity = 0;
+
+        std::vector<int> count;
+
+        std::vector<Point2> fix;
+
+        std::vector<Timestamp> time;
+
+        std::vector<int> edge;
+
+        std::vector<double> offset;
+
+        std::vector<double> dist;
+
+        std::vector<double> score;
+
+        std::vector<int> back;
+    };
+
+    bool addColumn(Trellis& trellis, int col, const Point2& xy, Timestamp time, int col_prev = -2)
+    {
+        if (col_prev == -2) col_prev = col - 1;
+        if (!findCandidates(trellis, col, xy)) return false;
+        trellis.time[col] = time;
+
+        // Initialize with emission probabilities
+        const int base = col * trellis.capacity;
+        const double emit_inv = -0.5 / (m_noise_gps * m_noise_gps);
+        for (int j = 0; j < trellis.count[col]; j++)
+        {
+            trellis.score[base + j] = emit_inv * trellis.dist[base + j] * trellis.dist[base + j];
+            trellis.back[base + j] = -1;
+        }
+        if (col_prev < 0 || trellis.count[col_prev] <= 0) return true;
+
+        // Add the best transition from the previous column
+        // Ref. Newson and Krumm, Hidden Markov Map Matching Through Noise and Sparseness, ACM SIGSPATIAL GIS, 2009
+        const int base_prev = col_prev * trellis.capacity;
+        const double dx = xy.x - trellis.fix[col_prev].x, dy = xy.y - trellis.fix[col_prev].y;
+        const double straight = sqrt(dx * dx + dy * dy);
+        const double limit = m_route_factor * straight + 2 * m_candidate_radius;
+        m_score_best.assign(trellis.count[col], -DBL_MAX);
+        m_score_back.assign(trellis.count[col], -1);
+        for (int i = 0; i < trellis.count[col_prev]; i++)
+        {
+            const int e_prev = trellis.edge[base_prev + i];
+            const double t_prev = trellis.offset[base_prev + i];
+            runDijkstra(m_edge_to[e_prev], limit);
+            for (int j = 0; j < trellis.count[col]; j++)
+            {
+                const int e = trellis.edge[base + j];
+                const double t = trellis.offset[base + j];
+                double route = DBL_MAX;
+                if (e == e_prev && t >= t_prev) route = t - t_prev;
+                else if (m_node_dist[m_edge_from[e]] < DBL_MAX) route = m_edge_len[e_prev] - t_prev + m_node_dist[m_edge_from[e]] + t;
+                if (route == DBL_MAX) continue;
+                double score = trellis.score[base_prev + i] - fabs(route - straight) / m_transit_beta;
+                if (score > m_score_best[j])
+                {
+                    m_score_best[j] = score;
+                    m_score_back[j] = i;
+                }
+            }
+        }
+
+        // Normalize scores to avoid their drift (keep the emission only if the chain is broken)
+        bool is_connected = false;
+        double score_max = -DBL_MAX;
+        for (int j = 0; j < trellis.count[col]; j++)
+        {
+            if (m_score_back[j] < 0) continue;
+            is_connected = true;
+            trellis.score[base + j] += m_score_best[j];
+            trellis.back[base + j] = m_score_back[j];
+        }
+        if (!is_connected) return true;
+        for (int j = 0; j < trellis.count[col]; j++)
+        {
+            if (trellis.back[base + j] < 0) trellis.score[base + j] = -DBL_MAX;
+            else score_max = std::max(score_max, trellis.score[base + j]);
+        }
+        for (int j = 0; j < trellis.count[col]; j++)
+            if (trellis.back[base + j] >= 0) trellis.score[base + j] -= score_max;
+        return true;
+    }
+
+    bool findCandidates(Trellis& trellis, int col, const Point2& xy)
+    {
+        const int capacity = trellis.capacity, base = col * capacity;
+        trellis.count[col] = 0;
+        trellis.fix[col] = xy;
+        if (m_grid_size.area() <= 0) return false;
+
+        // Find nearby edges using the grid index (keep the nearest ones sorted by distance)
+        const int x0 = std::max(cvFloor((xy.x - m_candidate_radius - m_grid_origin.x) / m_grid_cell), 0);
+        const int x1 = std::min(cvFloor((xy.x + m_candidate_radius - m_grid_origin.x) / m_grid_cell), m_grid_size.width - 1);
+        const int y0 = std::max(cvFloor((xy.y - m_candidate_radius - m_grid_origin.y) / m_grid_cell), 0);
+        const int y1 = std::min(cvFloor((xy.y + m_candidate_radius - m_grid_origin.y) / m_grid_cell), m_grid_size.height - 1);
+        const double radius2 = m_candidate_radius * m_candidate_radius;
+        m_edge_stamp_curr++;
+        int n = 0;
+        for (int y = y0; y <= y1; y++)
+        {
+            for (int x = x0; x <= x1; x++)
+            {
+                const int cell = y * m_grid_size.width + x;
+                for (int idx = m_grid_offset[cell]; idx < m_grid_offset[cell + 1]; idx++)
+                {
+                    const int e = m_grid_edge[idx];
+                    if (m_edge_stamp[e] == m_edge_stamp_curr) continue;
+                    m_edge_stamp[e] = m_edge_stamp_curr;
+
+                    const double t = std::max(0., std::min((xy.x - m_edge_x[e]) * m_edge_ux[e] + (xy.y - m_edge_y[e]) * m_edge_uy[e], m_edge_len[e]));
+                    const double dx = m_edge_x[e] + t * m_edge_ux[e] - xy.x, dy = m_edge_y[e] + t * m_edge_uy[e] - xy.y;
+                    const double d2 = dx * dx + dy * dy;
+                    if (d2 > radius2) continue;
+                    const double d = sqrt(d2);
+
+                    int pos;
+                    if (n < capacity) pos = n++;
+                    else if (d < trellis.dist[base + capacity - 1]) pos = capacity - 1;
+                    else continue;
+                    while (pos > 0 && trellis.dist[base + pos - 1] > d)
+                    {
+                        trellis.edge[base + pos] = trellis.edge[base + pos - 1];
+                        trellis.offset[base + pos] = trellis.offset[base + pos - 1];
+                        trellis.dist[base + pos] = trellis.dist[base + pos - 1];
+                        pos--;
+                    }
+                    trellis.edge[base + pos] = e;
+                    trellis.offset[base + pos] = t;
+                    trellis.dist[base + pos] = d;
+                }
+            }
+        }
+        trellis.count[col] = n;
+        return n > 0;
+    }
+
+    void runDijkstra(int source, double limit)
+    {
+        // Reset only the visited nodes
+        for (auto v = m_node_touched.begin(); v != m_node_touched.end(); v++) m_node_dist[*v] = DBL_MAX;
+        m_node_touched.clear();
+        m_node_heap.clear();
+
+        m_node_dist[source] = 0;
+        m_node_touched.push_back(source);
+        m_node_heap.push_back(std::make_pair(0., source));
+        while (!m_node_heap.empty())
+        {
+            std::pop_heap(m_node_heap.begin(), m_node_heap.end(), std::greater<std::pair<double, int>>());
+            const std::pair<double, int> top = m_node_heap.back();
+            m_node_heap.pop_back();
+            if (top.first > m_node_dist[top.second]) continue;
+            for (int idx = m_node_offset[top.second]; idx < m_node_offset[top.second + 1]; idx++)
+            {
+                const int e = m_node_edge[idx], to = m_edge_to[e];
+                const double d = top.first + m_edge_len[e];
+                if (d > limit || d >= m_node_dist[to]) continue;
+                if (m_node_dist[to] == DBL_MAX) m_node_touched.push_back(to);
+                m_node_dist[to] = d;
+                m_node_heap.push_back(std::make_pair(d, to));
+                std::push_heap(m_node_heap.begin(), m_node_heap.end(), std::greater<std::pair<double, int>>());
+            }
+        }
+    }
+
+    int findBest(const Trellis& trellis, int col) const
+    {
+        const int base = col * trellis.capacity;
+        int best = 0;
+        for (int j = 1; j < trellis.count[col]; j++)
+            if (trellis.score[base + j] > trellis.score[base + best]) best = j;
+        return best;
+    }
+
+    TopometricPose getTopoPose(const Trellis& trellis, int col, int k) const
+    {
+        const int e = trellis.edge[col * trellis.capacity + k];
+        return TopometricPose(m_node_ids[m_edge_from[e]], m_edge_idx[e], trellis.offset[col * trellis.capacity + k], 0);
+    }
+
+    bool updateEdgeTable()
+    {
+        const uint64 map_version = getMapVersion();
+        if (m_edge_version == map_version) return !m_edge_len.empty();
+
+        // Copy the shared map from its owner (only when the map is updated)
+        RoadMap map_shared;
+        if (m_map_owner != nullptr) map_shared = m_map_owner->getMap();
+        RoadMap& map = (m_map_owner != nullptr) ? map_shared : m_map;
+
+        // Index nodes
+        m_node_ids.clear();
+        std::map<ID, int> node_lookup;
+        for (auto node = map.getHeadNodeConst(); node != map.getTailNodeConst(); node++)
+        {
+            node_lookup[node->data.id] = static_cast<int>(m_node_ids.size());
+            m_node_ids.push_back(node->data.id);
+        }
+
+        // Flatten edges and their adjacency in the compressed row format
+        m_edge_x.clear();
+        m_edge_y.clear();
+        m_edge_ux.clear();
+        m_edge_uy.clear();
+        m_edge_len.clear();
+        m_edge_theta.clear();
+        m_edge_from.clear();
+        m_edge_to.clear();
+        m_edge_idx.clear();
+        m_node_offset.assign(m_node_ids.size() + 1, 0);
+        m_node_edge.clear();
+        int node_idx = 0;
+        for (auto from = map.getHeadNodeConst(); from != map.getTailNodeConst(); from++, node_idx++)
+        {
+            int edge_idx = 0;
+            for (auto edge = map.getHeadEdgeConst(from); edge != map.getTailEdgeConst(from); edge++, edge_idx++)
+            {
+                if (edge->to == nullptr) continue;
+                double dx = edge->to->data.x - from->data.x, dy = edge->to->data.y - from->data.y;
+                double len = sqrt(dx * dx + dy * dy);
+                m_node_edge.push_back(static_cast<int>(m_edge_len.size()));
+                m_edge_x.push_back(from->data.x);
+                m_edge_y.push_back(from->data.y);
+                m_edge_ux.push_back(len > DBL_EPSILON ? dx / len : 0);
+                m_edge_uy.push_back(len > DBL_EPSILON ? dy / len : 0);
+                m_edge_len.push_back(len);
+                m_edge_theta.push_back(atan2(dy, dx));
+                m_edge_from.push_back(node_idx);
+                m_edge_to.push_back(node_lookup[edge->to->data.id]);
+                m_edge_idx.push_back(edge_idx);
+            }
+            m_node_offset[node_idx + 1] = static_cast<int>(m_node_edge.size());
+        }
+        const int n_edge = static_cast<int>(m_edge_len.size());
+        m_edge_stamp.assign(n_edge, 0);
+        m_edge_stamp_curr = 0;
+        m_node_dist.assign(m_node_ids.size(), DBL_MAX);
+        m_node_touched.clear();
+
+        // Build the grid index of edges in the compressed row format
+        m_grid_size = cv::Size();
+        m_grid_offset.clear();
+        m_grid_edge.clear();
+        if (n_edge > 0)
+        {
+            double x_min = DBL_MAX, y_min = DBL_MAX, x_max = -DBL_MAX, y_max = -DBL_MAX;
+            for (int e = 0; e < n_edge; e++)
+            {
+                const double x_to = m_edge_x[e] + m_edge_len[e] * m_edge_ux[e], y_to = m_edge_y[e] + m_edge_len[e] * m_edge_uy[e];
+                x_min = std::min(x_min, std::min(m_edge_x[e], x_to));
+                y_min = std::min(y_min, std::min(m_edge_y[e], y_to));
+                x_max = std::max(x_max, std::max(m_edge_x[e], x_to));
+                y_max = std::max(y_max, std::max(m_edge_y[e], y_to));
+            }
+            m_grid_origin = Point2(x_min, y_min);
+            m_grid_size = cv::Size(cvFloor((x_max - x_min) / m_grid_cell) + 1, cvFloor((y_max - y_min) / m_grid_cell) + 1);
+            m_grid_offset.assign(m_grid_size.area() + 1, 0);
+            for (int pass = 0; pass < 2; pass++)
+            {
+                if (pass == 1)
+                {
+                    for (size_t c = 1; c < m_grid_offset.size(); c++) m_grid_offset[c] += m_grid_offset[c - 1];
+                    m_grid_edge.resize(m_grid_offset.back());
+                }
+                std::vector<int> fill(m_grid_offset.begin(), m_grid_offset.end() - 1);
+                for (int e = 0; e < n_edge; e++)
+                {
+                    const double x_to = m_edge_x[e] + m_edge_len[e] * m_edge_ux[e], y_to = m_edge_y[e] + m_edge_len[e] * m_edge_uy[e];
+                    const int cx0 = cvFloor((std::min(m_edge_x[e], x_to) - x_min) / m_grid_cell), cx1 = cvFloor((std::max(m_edge_x[e], x_to) - x_min) / m_grid_cell);
+                    const int cy0 = cvFloor((std::min(m_edge_y[e], y_to) - y_min) / m_grid_cell), cy1 = cvFloor((std::max(m_edge_y[e], y_to) - y_min) / m_grid_cell);
+                    for (int y = cy0; y <= cy1; y++)
+                    {
+                        for (int x = cx0; x <= cx1; x++)
+                        {
+                            const int cell = y * m_grid_size.width + x;
+                            if (pass == 0) m_grid_offset[cell + 1]++;
+                            else m_grid_edge[fill[cell]++] = e;
+                        }
+                    }
+                }
+            }
+        }
+
+        m_edge_version = map_version;
+        m_n_fixes = 0;
+        return n_edge > 0;
+    }
+
+    double m_noise_gps;
+
+    double m_transit_beta;
+
+    double m_candidate_radius;
+
+    int m_candidate_max;
+
+    int m_fixed_lag;
+
+    double m_route_factor;
+
+    double m_grid_cell;
+
+    double m_time_last_update;
+
+    Pose2 m_pose;
+
+    TopometricPose m_pose_topo;
+
+    double m_confidence;
+
+    TopometricPose m_pose_lagged;
+
+    Timestamp m_time_lagged;
+
+    Trellis m_trellis;
+
+    uint64 m_n_fixes;
+
+    std::vector<double> m_score_best;
+
+    std::vector<int> m_score_back;
+
+    // Nodes and edges of the road map (structure of arrays)
+    uint64 m_edge_version;
+
+    std::vector<ID> m_node_ids;
+
+    std::vector<int> m_node_offset;
+
+    std::vector<int> m_node_edge;
+
+    std::vector<double> m_node_dist;
+
+    std::vector<int> m_node_touched;
+
+    std::vector<std::pair<double, int>> m_node_heap;
+
+    std::vector<double> m_edge_x;
+
+    std::vector<double> m_edge_y;
+
+    std::vector<double> m_edge_ux;
+
+    std::vector<double> m_edge_uy;
+
+    std::vector<double> m_edge_len;
+
+    std::vector<double> m_edge_theta;
+
+    std::vector<int> m_edge_from;
+
+    std::vector<int> m_edge_to;
+
+    std::vector<int> m_edge_idx;
+
+    std::vector<int> m_edge_stamp;
+
+    int m_edge_stamp_curr;
+
+    // Grid index of edges
+    Point2 m_grid_origin;
+
+    cv::Size m_grid_size;
+
+    std::vector<int> m_grid_offset;
+
+    std::vector<int> m_grid_edge;
+}; // End of 'HMMMapMatcher'
+
+} // End of 'dg'
+
+#endif // End of '__HMM_MAP_MATCHER__'
@@ -0,0 +1,113 @@
+#include "image_cache.hpp"
+
+namespace dg
+{
+
+ImageCache::ImageCache(size_t max_bytes)
+{
+	m_max_bytes = max_bytes;
+	m_total_bytes = 0;
+}
+
+void ImageCache::setMaxBytes(size_t max_bytes)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_max_bytes = max_bytes;
+	evict();
+}
+
+size_t ImageCache::getMaxBytes() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_max_bytes;
+}
+
+bool ImageCache::load(const std::string& key, cv::Mat& image)
+{
+	cv::Mat found_image;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto found = m_images.find(key);
+		if (found == m_images.end()) return false;
+		m_recency.splice(m_recency.begin(), m_recency, found->second.recency);
+		found_image = found->second.image;
+	}
+
+	// Copy the image without the lock (the stored image is never modified, so sharing its data is safe)
+	image = found_image.clone();
+	return true;
+}
+
+bool ImageCache::store(const std::string& key, const cv::Mat& image)
+{
+	if (image.empty()) return false;
+	size_t size = image.total() * image.elemSize();
+	cv::Mat copy = image.clone();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	forget(key);
+	if (size > m_max_bytes) return false;
+	m_recency.push_front(key);
+	ImageItem item;
+	item.image = copy;
+	item.size = size;
+	item.recency = m_recency.begin();
+	m_images[key] = item;
+	m_total_bytes += size;
+	evict();
+	return true;
+}
+
+bool ImageCache::contains(const std::string& key) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_images.find(key) != m_images.end();
+}
+
+bool ImageCache::remove(const std::string& key)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_images.find(key) == m_images.end()) return false;
+	forget(key);
+	return true;
+}
+
+void ImageCache::clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_images.clear();
+	m_recency.clear();
+	m_total_bytes = 0;
+}
+
+size_t ImageCache::countImages() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_images.size();
+}
+
+size_t ImageCache::getTotalSize() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_total_bytes;
+}
+
+void ImageCache::forget(const std::string& key)
+{
+	auto found = m_images.find(key);
+	if (found == m_images.end()) return;
+	m_total_bytes -= found->second.size;
+	m_recency.erase(found->second.recency);
+	m_images.erase(found);
+}
+
+void ImageCache::evict()
+{
+	while (m_total_bytes > m_max_bytes && !m_recency.empty())
+	{
+		std::string key = m_recency.back();
+		forget(key);
+	}
+}
+
+} // End of 'dg'
@@ -0,0 +1,127 @@
+#ifndef __IMAGE_CACHE__
+#define __IMAGE_CACHE__
+
+#include "opencv2/core.hpp"
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+
+namespace dg
+{
+
+/**
+ * @brief Memory cache of decoded images
+ *
+ * An <b>image cache</b> keeps decoded images in memory so that repeated requests are served without downloading and decoding them again.
+ * When the total size of images exceeds its bound, the least recently used images are removed.
+ * Images are copied when they are stored and loaded, so users can modify them freely.
+ */
+class ImageCache
+{
+public:
+	/**
+	 * The default constructor
+	 * @param max_bytes The maximum total size of images (Unit: [byte]; 0 to disable the cache)
+	 */
+	ImageCache(size_t max_bytes = 256 * 1024 * 1024);
+
+	/**
+	 * Set the maximum total size of images (the least recently used images are removed if necessary)
+	 * @param max_bytes The maximum total size of images (Unit: [byte]; 0 to disable the cache)
+	 */
+	void setMaxBytes(size_t max_bytes);
+
+	/**
+	 * Get the maximum total size of images
+	 * @return The maximum total size of images (Unit: [byte])
+	 */
+	size_t getMaxBytes() const;
+
+	/**
+	 * Find the image of the given key and mark it as the most recently used one
+	 * @param key The key of the image
+	 * @param image A reference to the copy of the found image
+	 * @return True if found (false if not)
+	 */
+	bool load(const std::string& key, cv::Mat& image);
+
+	/**
+	 * Store a copy of the image (the previous image is replaced)
+	 * @param key The key of the image
+	 * @param image The image to store
+	 * @return True if successful (false if the image is empty or larger than the bound)
+	 */
+	bool store(const std::string& key, const cv::Mat& image);
+
+	/**
+	 * Check whether the image of the given key exists (its recency is not changed)
+	 * @param key The key of the image
+	 * @return True if exist (false if not)
+	 */
+	bool contains(const std::string& key) const;
+
+	/**
+	 * Remove the image of the given key
+	 * @param key The key of the image
+	 * @return True if successful (false if failed)
+	 */
+	bool remove(const std::string& key);
+
+	/**
+	 * Remove all images
+	 */
+	void clear();
+
+	/**
+	 * Get the number of stored images
+	 * @return The number of stored images
+	 */
+	size_t countImages() const;
+
+	/**
+	 * Get the total size of stored images
+	 * @return The total size of stored images (Unit: [byte])
+	 */
+	size_t getTotalSize() const;
+
+protected:
+	/**
+	 * Forget the given image
+	 * @param key The key of the image
+	 */
+	void forget(const std::string& key);
+
+	/**
+	 * Remove the least recently used images until the total size is within its bound
+	 */
+	void evict();
+
+	/**
+	 * A cached image in memory
+	 */
+	struct ImageItem
+	{
+		/** The decoded image */
+		cv::Mat image;
+		/** The size of the image (Unit: [byte]) */
+		size_t size;
+		/** The position in the recency list */
+		std::list<std::string>::iterator recency;
+	};
+
+	/** The maximum total size of images (Unit: [byte]) */
+	size_t m_max_bytes;
+	/** The total size of images (Unit: [byte]) */
+	size_t m_total_bytes;
+	/** The keys of images from the most recently used one */
+	std::list<std::string> m_recency;
+	/** A hash table of images */
+	std::unordered_map<std::string, ImageItem> m_images;
+	/** A mutex to share the cache between threads */
+	mutable std::mutex m_mutex;
+};
+
+} // End of 'dg'
+
+#endif // End of '__IMAGE_CACHE__'
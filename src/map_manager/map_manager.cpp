@@ -18,11 +18,7 @@ bool MapManager::initialize()
 
 		return false;
 	}	
-	for (std::vector<POI>::iterator it = m_map->pois.begin(); it != m_map->pois.end(); ++it)
-	{
-		lookup_pois_name.insert(std::make_pair(it->name, LatLon(it->lat, it->lon)));
-		//lookup_pois_id.insert(std::make_pair(it->id, LatLon(it->lat, it->lon)));
-	}
+	m_poi_index.build(m_map->pois);
 	m_map->pois.clear();
 
 	//std::vector<StreetView> sv_vec;
@@ -58,6 +54,36 @@ std::string MapManager::getIP()
 	return m_ip;
 }
 
+bool MapManager::setCacheDir(const std::string& dir, double ttl, size_t max_bytes)
+{
+	if (dir.empty())
+	{
+		m_cache.close();
+		return true;
+	}
+	return m_cache.open(dir, ttl, max_bytes);
+}
+
+ResponseCache& MapManager::getCache()
+{
+	return m_cache;
+}
+
+bool MapManager::setImageCacheDir(const std::string& dir, double ttl, size_t max_bytes)
+{
+	if (dir.empty())
+	{
+		m_image_cache.close();
+		return true;
+	}
+	return m_image_cache.open(dir, ttl, max_bytes);
+}
+
+ImageCache& MapManager::getImageCache()
+{
+	return m_image_memory;
+}
+
 //int MapManager::lat2tiley(double lat, int z)
 //{
 //	double latrad = lat * M_PI / 180.0;
@@ -91,44 +117,175 @@ size_t MapManager::write_callback(void* ptr, size_t size, size_t count, void* st
 	return size * count;
 }
 	
-bool MapManager::query2server(std::string url)
+bool MapManager::initCurlGlobal()
 {
-#ifdef _WIN32
-	SetConsoleOutputCP(65001);
-#endif
-		
-	curl_global_init(CURL_GLOBAL_ALL);
-	CURL* curl = curl_easy_init();
-	CURLcode res;
+	struct CurlGlobal
+	{
+		CurlGlobal() { ok = (curl_global_init(CURL_GLOBAL_ALL) == CURLE_OK); }
+		~CurlGlobal() { if (ok) curl_global_cleanup(); }
+		bool ok;
+	};
+	static CurlGlobal global;
+	return global.ok;
+}
+
+CURL* MapManager::getCurl()
+{
+	if (m_curl == nullptr)
+	{
+		if (!initCurlGlobal()) return nullptr;
+		m_curl = curl_easy_init();
+		if (m_curl == nullptr) return nullptr;
+	}
+	else curl_easy_reset(m_curl); // Options are cleared, but alive connections are kept.
 
-	if (curl)
+	curl_easy_setopt(m_curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+	curl_easy_setopt(m_curl, CURLOPT_TCP_KEEPALIVE, 1L);
+	curl_easy_setopt(m_curl, CURLOPT_USERAGENT, "libcurl-agent/1.0");
+	return m_curl;
+}
+
+size_t MapManager::header_callback(char* ptr, size_t size, size_t nmemb, void* userdata)
+{
+	CachedResponse* received = (CachedResponse*)userdata;
+	size_t count = size * nmemb;
+	std::string line(ptr, count);
+	size_t colon = line.find(':');
+	if (colon != std::string::npos)
 	{
-		curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-		std::string response;
-		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-		curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-		curl_easy_setopt(curl, CURLOPT_USERAGENT, "libcurl-agent/1.0");
+		std::string name = line.substr(0, colon);
+		std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+		size_t start = line.find_first_not_of(" \t", colon + 1);
+		size_t end = line.find_last_not_of(" \t\r\n");
+		std::string value = (start == std::string::npos || end < start) ? "" : line.substr(start, end - start + 1);
+		if (name == "etag") received->etag = value;
+		else if (name == "last-modified") received->last_modified = value;
+	}
+	return count;
+}
 
-		// Perform the request, res will get the return code.
-		res = curl_easy_perform(curl);
+curl_slist* MapManager::makeValidatorHeaders(const CachedResponse& cached)
+{
+	curl_slist* headers = nullptr;
+	if (!cached.etag.empty()) headers = curl_slist_append(headers, ("If-None-Match: " + cached.etag).c_str());
+	if (!cached.last_modified.empty()) headers = curl_slist_append(headers, ("If-Modified-Since: " + cached.last_modified).c_str());
+	return headers;
+}
 
-		// Always cleanup.
-		curl_easy_cleanup(curl);
-		curl_global_cleanup();
+/**
+ * @brief SAX handler to check results in a response
+ *
+ * A <b>result checker</b> finds whether any array in a response has an element, so empty results (e.g. '[]' or a feature collection without features) are distinguished.
+ */
+class ResultChecker : public BaseReaderHandler<UTF8<>, ResultChecker>
+{
+public:
+	bool Default() { return element(); }
+	bool StartObject() { element(); m_arrays.push_back(false); return true; }
+	bool EndObject(SizeType) { m_arrays.pop_back(); return true; }
+	bool StartArray() { element(); m_arrays.push_back(true); return true; }
+	bool EndArray(SizeType) { m_arrays.pop_back(); return true; }
+
+	/** A flag whether any element of arrays is found */
+	bool found = false;
+
+protected:
+	bool element()
+	{
+		if (!m_arrays.empty() && m_arrays.back()) found = true;
+		return true;
+	}
 
-		// Check for errors.
-		if (res != CURLE_OK)
-		{
-			fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-			return false;
-		}
-		else
-		{
-			//fprintf(stdout, "%s\n", response.c_str());
-			m_json = response;
-		}
+	std::vector<bool> m_arrays;
+};
+
+bool MapManager::isValidResponse(const std::vector<uchar>& response)
+{
+	if (response.size() >= 8 && memcmp(response.data(), "No valid", 8) == 0) return false;
+	size_t start = 0;
+	while (start < response.size() && isspace(response[start])) start++;
+	if (start >= response.size()) return false;
+	if (response[start] != '[' && response[start] != '{') return true; // Not JSON (e.g. images)
+
+	// Accept a complete JSON response which has results
+	Reader reader;
+	ResultChecker checker;
+	MemoryStream stream(reinterpret_cast<const char*>(response.data()), response.size());
+	return !reader.Parse<kParseStopWhenDoneFlag>(stream, checker).IsError() && checker.found;
+}
+
+bool MapManager::updateCache(ResponseCache& cache, const std::string& url, bool ok, long code, std::vector<uchar>& response, CachedResponse& cached, const CachedResponse& received)
+{
+	bool has_cached = !cached.key.empty();
+	if (ok && code == 304 && has_cached)
+	{
+		// Not modified, so extend the life of the cached response
+		cache.renew(url);
+		response.swap(cached.body);
+		return true;
+	}
+	if (ok && code == 200)
+	{
+		// Keep error messages and empty results out of the cache not to serve them for its time-to-live
+		if (isValidResponse(response)) cache.store(url, response, received.etag, received.last_modified);
+		return true;
+	}
+	if ((!ok || code >= 500) && has_cached)
+	{
+		// Serve the stale response when the server is not reachable
+		response.swap(cached.body);
+		return true;
+	}
+	return ok;
+}
+
+bool MapManager::request2server(const std::string& url, std::vector<uchar>& response, int timeout, ResponseCache* cache)
+{
+	ResponseCache& disk = (cache != nullptr) ? *cache : m_cache;
+	CachedResponse cached;
+	if (disk.load(url, cached) && cached.fresh)
+	{
+		response.swap(cached.body);
+		return true;
 	}
 
+	std::lock_guard<std::mutex> lock(m_curl_mutex);
+	CURL* curl = getCurl();
+	if (curl == nullptr) return updateCache(disk, url, false, 0, response, cached, CachedResponse());
+
+	CachedResponse received;
+	curl_slist* headers = makeValidatorHeaders(cached);
+	curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeImage_callback);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+	curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback);
+	curl_easy_setopt(curl, CURLOPT_HEADERDATA, &received);
+	if (headers != nullptr) curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+	if (timeout > 0) curl_easy_setopt(curl, CURLOPT_TIMEOUT, timeout);
+
+	// Perform the request, res will get the return code.
+	CURLcode res = curl_easy_perform(curl);
+	long code = 0;
+	curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, static_cast<curl_slist*>(nullptr));
+	if (headers != nullptr) curl_slist_free_all(headers);
+
+	// Check for errors.
+	if (res != CURLE_OK) fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
+	return updateCache(disk, url, res == CURLE_OK, code, response, cached, received);
+}
+
+bool MapManager::query2server(std::string url)
+{
+#ifdef _WIN32
+	SetConsoleOutputCP(65001);
+#endif
+
+	std::vector<uchar> response;
+	if (!request2server(url, response, 0)) return false;
+	//fprintf(stdout, "%s\n", response.c_str());
+	m_json.assign(response.begin(), response.end());
+
 	return true;
 }
 
@@ -247,29 +404,198 @@ bool MapManager::downloadMap(cv::Point2i tile)
 	return query2server(url);
 }
 
-bool MapManager::parseMap(const char* json)
+/**
+ * @brief SAX handler for GeoJSON features
+ *
+ * A <b>feature reader</b> collects 'properties' of each feature and passes them to a callback one by one, so a response is parsed without building its DOM.
+ * Values in a nested array (e.g. 'edge_ids') are collected as unsigned integers, and values in deeper levels are ignored.
+ * When the root is an array of feature collections, the index of the collection is also given to the callback.
+ */
+class FeatureReader : public BaseReaderHandler<UTF8<>, FeatureReader>
 {
-	Document document;
-	document.Parse(json);
+public:
+	/**
+	 * A property of a feature
+	 */
+	struct Property
+	{
+		/** The name of this property */
+		std::string key;
+		/** The string value (nullptr if not a string) */
+		const char* str = nullptr;
+		/** The numeric value */
+		double real = 0;
+		/** The numeric value as an unsigned integer */
+		uint64_t uint = 0;
+		/** The values of an array */
+		std::vector<uint64_t> array;
+	};
+
+	/**
+	 * A constructor with the callback
+	 * @param callback A function to receive properties of each feature with the index of its collection (it returns false to stop parsing)
+	 */
+	FeatureReader(std::function<bool(int collection, const FeatureReader& feature)> callback) : m_callback(callback) { }
+
+	/**
+	 * Parse the given response in situ (the response is modified)
+	 * @param json A response received (null-terminated)
+	 * @return True if successful (false if failed)
+	 */
+	bool parse(char* json)
+	{
+		Reader reader;
+		InsituStringStream stream(json);
+		bool ok = !reader.Parse<kParseInsituFlag | kParseStopWhenDoneFlag>(stream, *this).IsError();
+		return ok || m_stopped;
+	}
 
-	if(!document.IsObject()) return false;
-	const Value& features = document["features"];
-	if(!features.IsArray()) return false;
+	/**
+	 * Find a property of the current feature
+	 * @param key The name of the property
+	 * @return A pointer to the found property (nullptr if not exist)
+	 */
+	const Property* find(const char* key) const
+	{
+		for (size_t i = 0; i < m_n_props; i++)
+			if (m_props[i].key == key) return &m_props[i];
+		return nullptr;
+	}
 
-	std::vector<EdgeTemp> temp_edge;
-	for (SizeType i = 0; i < features.Size(); i++)
-	{
-		const Value& feature = features[i];
-		if(!feature.IsObject()) return false;
-		if(!feature.HasMember("properties")) return false;
-		const Value& properties = feature["properties"];
-		if(!properties.IsObject()) return false;
-		std::string name = properties["name"].GetString();
+	/** Get a string property ("" if not exist) */
+	const char* getString(const char* key) const { const Property* p = find(key); return (p && p->str) ? p->str : ""; }
+	/** Get an unsigned integer property (a string is also converted; 0 if not exist) */
+	uint64_t getUint64(const char* key) const { const Property* p = find(key); return p ? (p->str ? std::strtoull(p->str, nullptr, 0) : p->uint) : 0; }
+	/** Get an integer property (0 if not exist) */
+	int getInt(const char* key) const { const Property* p = find(key); return p ? static_cast<int>(p->real) : 0; }
+	/** Get a real number property (0 if not exist) */
+	double getDouble(const char* key) const { const Property* p = find(key); return p ? p->real : 0; }
+	/** Get an array property (an empty array if not exist) */
+	const std::vector<uint64_t>& getArray(const char* key) const { static const std::vector<uint64_t> empty; const Property* p = find(key); return p ? p->array : empty; }
+
+	bool Null() { return addValue(nullptr, 0, 0); }
+	bool Bool(bool b) { return addValue(nullptr, b ? 1 : 0, b ? 1 : 0); }
+	bool Int(int i) { return addValue(nullptr, i, i > 0 ? i : 0); }
+	bool Uint(unsigned u) { return addValue(nullptr, u, u); }
+	bool Int64(int64_t i) { return addValue(nullptr, static_cast<double>(i), i > 0 ? i : 0); }
+	bool Uint64(uint64_t u) { return addValue(nullptr, static_cast<double>(u), u); }
+	bool Double(double d) { return addValue(nullptr, d, d > 0 ? static_cast<uint64_t>(d) : 0); }
+	bool String(const char* str, SizeType length, bool copy) { return addValue(str, 0, 0); }
+
+	bool Key(const char* str, SizeType length, bool copy)
+	{
+		m_key.assign(str, length);
+		return true;
+	}
+
+	bool StartObject()
+	{
+		m_depth++;
+		if (m_depth == 1) m_collection = 0;
+		else if (m_depth == 2 && m_root_array) m_collection++;
+		if (m_props_depth == 0 && m_key == "properties")
+		{
+			m_props_depth = m_depth;
+			m_n_props = 0;
+		}
+		m_key.clear();
+		return true;
+	}
+
+	bool EndObject(SizeType count)
+	{
+		bool ok = true;
+		if (m_depth == m_props_depth)
+		{
+			m_props_depth = 0;
+			if (m_callback && !m_callback(m_collection, *this))
+			{
+				m_stopped = true;
+				ok = false;
+			}
+		}
+		m_depth--;
+		return ok;
+	}
+
+	bool StartArray()
+	{
+		m_depth++;
+		if (m_depth == 1) m_root_array = true;
+		if (m_props_depth > 0 && m_depth == m_props_depth + 1) addProperty();
+		m_key.clear();
+		return true;
+	}
+
+	bool EndArray(SizeType count)
+	{
+		m_depth--;
+		return true;
+	}
+
+protected:
+	Property& addProperty()
+	{
+		if (m_n_props >= m_props.size()) m_props.resize(m_n_props + 1);
+		Property& p = m_props[m_n_props++];
+		p.key = m_key;
+		p.str = nullptr;
+		p.real = 0;
+		p.uint = 0;
+		p.array.clear();
+		return p;
+	}
+
+	bool addValue(const char* str, double real, uint64_t uint)
+	{
+		if (m_props_depth == 0) return true;
+		if (m_depth == m_props_depth)
+		{
+			Property& p = addProperty();
+			p.str = str;
+			p.real = real;
+			p.uint = uint;
+		}
+		else if (m_depth == m_props_depth + 1 && m_n_props > 0) m_props[m_n_props - 1].array.push_back(uint);
+		return true;
+	}
+
+	std::function<bool(int, const FeatureReader&)> m_callback;
+	std::vector<Property> m_props;
+	size_t m_n_props = 0;
+	std::string m_key;
+	int m_depth = 0;
+	int m_props_depth = 0;
+	bool m_root_array = false;
+	int m_collection = -1;
+	bool m_stopped = false;
+};
+
+bool MapManager::parseMap(char* json, Map& map)
+{
+	MapTile tile;
+	if (!parseMap(json, tile)) return false;
+	buildMap(std::vector<const MapTile*>(1, &tile), map);
+
+	return true;
+}
+
+bool MapManager::parseMap(char* json, MapTile& tile)
+{
+	// Reserve memory with the number of features (an upper bound of nodes and edges)
+	size_t n_features = 0;
+	for (const char* p = strstr(json, "\"properties\""); p != nullptr; p = strstr(p + 12, "\"properties\"")) n_features++;
+	tile.nodes.reserve(n_features);
+	tile.node_edges.reserve(n_features);
+	tile.edges.reserve(n_features);
+	FeatureReader reader([&](int collection, const FeatureReader& properties) -> bool
+	{
+		std::string name = properties.getString("name");
 		if (name == "edge") //continue; //TODO
 		{
 			EdgeTemp edge;
-			edge.id = properties["id"].GetUint64();
-			switch (properties["type"].GetInt())
+			edge.id = properties.getUint64("id");
+			switch (properties.getInt("type"))
 			{
 			/** Sidewalk */
 			case 0: edge.type = Edge::EDGE_SIDEWALK; break;
@@ -284,26 +610,14 @@ bool MapManager::parseMap(const char* json)
 			/** Stair section */
 			case 5: edge.type = Edge::EDGE_STAIR; break;
 			}
-			edge.length = properties["length"].GetDouble();
-			temp_edge.push_back(edge);
+			edge.length = properties.getDouble("length");
+			tile.edges.push_back(std::move(edge));
 		}
-	}
-
-	int numNonEdges = 0;
-	int numEdges = 0;
-	for (SizeType i = 0; i < features.Size(); i++)
-	{
-		const Value& feature = features[i];
-		if(!feature.IsObject()) return false;
-		if(!feature.HasMember("properties")) return false;
-		const Value& properties = feature["properties"];
-		if(!properties.IsObject()) return false;
-		std::string name = properties["name"].GetString();
-		if (name == "Node")
+		else if (name == "Node")
 		{
 			Node node;
-			node.id = properties["id"].GetUint64();
-			switch (properties["type"].GetInt())
+			node.id = properties.getUint64("id");
+			switch (properties.getInt("type"))
 			{
 			/** Basic node */
 			case 0: node.type = Node::NODE_BASIC; break;
@@ -316,39 +630,74 @@ bool MapManager::parseMap(const char* json)
 			/** Escalator node */
 			case 4: node.type = Node::NODE_ESCALATOR; break;
 			}
-			node.floor = properties["floor"].GetInt();
+			node.floor = properties.getInt("floor");
 
 			// swapped lat and lon
-			if ((properties["latitude"].GetDouble()) > (properties["longitude"].GetDouble()))
+			double latitude = properties.getDouble("latitude"), longitude = properties.getDouble("longitude");
+			if (latitude > longitude)
 			{
-				node.lon = properties["latitude"].GetDouble();
-				node.lat = properties["longitude"].GetDouble();
+				node.lon = latitude;
+				node.lat = longitude;
 			}
 			else
 			{
-				node.lat = properties["latitude"].GetDouble();
-				node.lon = properties["longitude"].GetDouble();
+				node.lat = latitude;
+				node.lon = longitude;
 			}
 
-			const Value& edge_ids = properties["edge_ids"];
+			const std::vector<uint64_t>& edge_ids = properties.getArray("edge_ids");
+			tile.nodes.push_back(std::move(node));
+			tile.node_edges.push_back(std::vector<ID>(edge_ids.begin(), edge_ids.end()));
+		}
+		return true;
+	});
+	return reader.parse(json);
+}
 
-			for (Value::ConstValueIterator edge_id = edge_ids.Begin(); edge_id != edge_ids.End(); ++edge_id)
-			{
-				ID id = edge_id->GetUint64();
-				std::vector<EdgeTemp>::iterator itr = std::find_if(temp_edge.begin(), temp_edge.end(), [id](EdgeTemp e) -> bool { return e.id == id; });
-				if (itr != temp_edge.end())
-					itr->node_ids.push_back(node.id);
-				//#ifdef _DEBUG
-				//				else
-				//					fprintf(stdout, "%d %s\n", ++numNonEdges, "<=======================the number of the edge_ids without edgeinfo"); // the number of the edge_ids without edgeinfo
-				//#endif
-			}
-			m_map->addNode(node);
-			//#ifdef _DEBUG
-			//			fprintf(stdout, "%d\n", i + 1); // the number of nodes
-			//#endif
+void MapManager::buildMap(const std::vector<const MapTile*>& tiles, Map& map)
+{
+	size_t n_nodes = 0, n_edges = 0;
+	for (auto tile = tiles.begin(); tile != tiles.end(); tile++)
+	{
+		n_nodes += (*tile)->nodes.size();
+		n_edges += (*tile)->edges.size();
+	}
+	map.nodes.reserve(map.nodes.size() + n_nodes);
+
+	// Add nodes once (tiles overlap each other), and find nodes of each edge using a hash table.
+	// Edges come with their lengths, and nodes come with their edges, so edges are connected after all nodes are read.
+	std::unordered_map<ID, std::vector<ID>> edge_nodes;
+	edge_nodes.reserve(n_edges);
+	for (auto tile = tiles.begin(); tile != tiles.end(); tile++)
+	{
+		for (size_t i = 0; i < (*tile)->nodes.size(); i++)
+		{
+			const Node& node = (*tile)->nodes[i];
+			if (map.findNode(node.id) != nullptr) continue;
+			map.addNode(node);
+			const std::vector<ID>& edge_ids = (*tile)->node_edges[i];
+			for (auto edge_id = edge_ids.begin(); edge_id != edge_ids.end(); edge_id++)
+				edge_nodes[*edge_id].push_back(node.id);
+		}
+	}
+
+	// The edge IDs without edge information are ignored
+	std::vector<EdgeTemp> temp_edge;
+	temp_edge.reserve(n_edges);
+	n_edges = 0;
+	for (auto tile = tiles.begin(); tile != tiles.end(); tile++)
+	{
+		for (auto it = (*tile)->edges.begin(); it != (*tile)->edges.end(); it++)
+		{
+			auto found = edge_nodes.find(it->id);
+			if (found == edge_nodes.end()) continue;
+			temp_edge.push_back(*it);
+			temp_edge.back().node_ids = std::move(found->second);
+			edge_nodes.erase(found);
+			n_edges += temp_edge.back().node_ids.size() * (temp_edge.back().node_ids.size() - 1) / 2;
 		}
 	}
+	map.edges.reserve(map.edges.size() + n_edges);
 
 	for (std::vector<EdgeTemp>::iterator it = temp_edge.begin(); it < temp_edge.end(); it++)
 	{
@@ -357,7 +706,7 @@ bool MapManager::parseMap(const char* json)
 			for (auto j = i; j < it->node_ids.end(); j++)
 			{
 				if (i == j) continue;
-				m_map->addEdge(*i, *j, Edge(it->id, it->length, it->type));
+				map.addEdge(*i, *j, Edge(it->id, it->length, it->type));
 				//m_map.addEdge(*j, *i, Edge(it->id, it->length, it->type));
 //#ifdef _DEBUG
 //					fprintf(stdout, "%d %s\n", ++numEdges, "<=======================the number of edges"); // the number of edges
@@ -365,8 +714,6 @@ bool MapManager::parseMap(const char* json)
 			}
 		}
 	}
-
-	return true;
 }
 //
 //bool MapManager::loadMap(double lat, double lon, double radius)
@@ -387,7 +734,7 @@ bool MapManager::parseMap(const char* json)
 //	bool ok = downloadMap(lat, lon, radius); // 1000.0);
 //	if (!ok) return false;
 //	//decodeUni();
-//	const char* json = m_json.c_str();
+//	char* json = &m_json[0];
 ////#ifdef _DEBUG
 ////	fprintf(stdout, "%s\n", json);
 ////#endif
@@ -419,12 +766,12 @@ bool MapManager::getMap(double lat, double lon, double radius, Map& map)
 	bool ok = downloadMap(lat, lon, radius);
 	if (!ok) return false;
 	//decodeUni();
-	const char* json = m_json.c_str();
+	char* json = &m_json[0];
 	//#ifdef _DEBUG
 	//	fprintf(stdout, "%s\n", json);
 	//#endif
 
-	ok = parseMap(json);
+	ok = parseMap(json, *m_map);
 	if (!ok) return false;
 	map = getMap();
 
@@ -450,12 +797,12 @@ bool MapManager::getMap(ID node_id, double radius, Map& map)
 	bool ok = downloadMap(node_id, radius);
 	if (!ok) return false;
 	//decodeUni();
-	const char* json = m_json.c_str();
+	char* json = &m_json[0];
 	//#ifdef _DEBUG
 	//	fprintf(stdout, "%s\n", json);
 	//#endif
 
-	ok = parseMap(json);
+	ok = parseMap(json, *m_map);
 	if (!ok) return false;
 	map = getMap();
 
@@ -481,12 +828,12 @@ bool MapManager::getMap(cv::Point2i tile, Map& map)
 	bool ok = downloadMap(tile);
 	if (!ok) return false;
 	//decodeUni();
-	const char* json = m_json.c_str();
+	char* json = &m_json[0];
 	//#ifdef _DEBUG
 	//	fprintf(stdout, "%s\n", json);
 	//#endif
 
-	ok = parseMap(json);
+	ok = parseMap(json, *m_map);
 	if (!ok) return false;
 	map = getMap();
 
@@ -555,8 +902,8 @@ bool MapManager::getMap(Path path, Map& map, double alpha)
 	bool ok = downloadMap(center_lat, center_lon, (dist_metric / 2) + alpha);
 	if (!ok) return false;
 
-	const char* json = m_json.c_str();
-	ok = parseMap(json);
+	char* json = &m_json[0];
+	ok = parseMap(json, *m_map);
 	if (!ok) return false;
 
 	map = getMap();
@@ -648,8 +995,8 @@ bool MapManager::getMap_expansion(Path path, Map& map, double alpha)
 	bool ok = downloadMap(center_lat, center_lon, (dist_metric / 2) + alpha);
 	if (!ok) return false;
 
-	const char* json = m_json.c_str();
-	ok = parseMap(json);
+	char* json = &m_json[0];
+	ok = parseMap(json, *m_map);
 	if (!ok) return false;
 
 	map = getMap();
@@ -699,114 +1046,69 @@ bool MapManager::downloadPath(double start_lat, double start_lon, double dest_la
 	return query2server(url);
 }
 
-bool MapManager::parsePath(const char* json)
+bool MapManager::parsePath(char* json, Path& path, std::map<ID, LatLon>& lookup)
 {
-	Document document;
-	document.Parse(json);
-
-	if(!document[0].IsObject()) return false;
-	const Value& features = document[0]["features"];
-	if(!features.IsArray()) return false;
-
+	// Nodes and edges come in turn, and only the first path is read.
 	Node node;
 	Edge edge;
-	for (SizeType i = 0; i < features.Size(); i++)
-	{
-		const Value& feature = features[i];
-		if(!feature.IsObject()) return false;
-		if(!feature.HasMember("properties")) return false;
-		const Value& properties = feature["properties"];
-		if(!properties.IsObject()) return false;
-		std::string name = properties["name"].GetString();
+	int i = 0;
+	bool valid = true;
+	FeatureReader reader([&](int collection, const FeatureReader& properties) -> bool
+	{
+		if (collection != 0) return false;
+		std::string name = properties.getString("name");
 		if (i % 2 == 0)	// node
 		{
-			if (!(name == "Node" || name == "node")) return false;
-			//node = new Node();
-			node.id = properties["id"].GetUint64();
-			//switch (properties["type"].GetInt())
-			//{
-			///** Basic node */
-			//case 0: node.type = Node::NODE_BASIC; break;
-			///** Junction node (e.g. intersecting point, corner point, and end point of the road) */
-			//case 1: node.type = Node::NODE_JUNCTION; break;
-			///** Door node (e.g. exit and entrance) */
-			//case 2: node.type = Node::NODE_DOOR; break;
-			///** Elevator node */
-			//case 3: node.type = Node::NODE_ELEVATOR; break;
-			///** Escalator node */
-			//case 4: node.type = Node::NODE_ESCALATOR; break;
-			//}
-			//node.floor = properties["floor"].GetInt();
+			if (!(name == "Node" || name == "node"))
+			{
+				valid = false;
+				return false;
+			}
+			node.id = properties.getUint64("id");
 
 			// swapped lat and lon
-			if ((properties["latitude"].GetDouble()) > (properties["longitude"].GetDouble()))
+			double latitude = properties.getDouble("latitude"), longitude = properties.getDouble("longitude");
+			if (latitude > longitude)
 			{
-				node.lon = properties["latitude"].GetDouble();
-				node.lat = properties["longitude"].GetDouble();
+				node.lon = latitude;
+				node.lat = longitude;
 			}
 			else
 			{
-				node.lat = properties["latitude"].GetDouble();
-				node.lon = properties["longitude"].GetDouble();
-			}
-
-			const Value& edge_ids = properties["edge_ids"];
-
-			/*for (Value::ConstValueIterator edge_id = edge_ids.Begin(); edge_id != edge_ids.End(); ++edge_id)
-			{
-				node.edge_ids.push_back(edge_id->GetUint64());
-			}*/
-
-			if (!((i + 1) < features.Size()))
-			{
-				edge.id = 0;
-				m_path.pts.push_back(PathElement(node.id, edge.id));
-				lookup_path.insert(std::make_pair(node.id, LatLon(node.lat, node.lon)));
+				node.lat = latitude;
+				node.lon = longitude;
 			}
 		}
 		else			// edge
 		{
-			if(!(name == "Edge" || name == "edge")) return false;
-			//edge = new Edge();
-			edge.id = properties["id"].GetUint64();
-			//switch (properties["type"].GetInt())
-			//{
-			///** Sidewalk */
-			//case 0: edge.type = Edge::EDGE_SIDEWALK; break;
-			///** General road (e.g. roads shared by pedestrians and cars, street, alley, corridor, ...) */
-			//case 1: edge.type = Edge::EDGE_ROAD; break;
-			///** Crosswalk */
-			//case 2: edge.type = Edge::EDGE_CROSSWALK; break;
-			///** Elevator section */
-			//case 3: edge.type = Edge::EDGE_ELEVATOR; break;
-			///** Escalator section */
-			//case 4: edge.type = Edge::EDGE_ESCALATOR; break;
-			///** Stair section */
-			//case 5: edge.type = Edge::EDGE_STAIR; break;
-			//}
-			//edge.length = properties["length"].GetDouble();
-
-			m_path.pts.push_back(PathElement(node.id, edge.id));
-			lookup_path.insert(std::make_pair(node.id, LatLon(node.lat, node.lon)));
+			if (!(name == "Edge" || name == "edge"))
+			{
+				valid = false;
+				return false;
+			}
+			edge.id = properties.getUint64("id");
+
+			path.pts.push_back(PathElement(node.id, edge.id));
+			lookup.insert(std::make_pair(node.id, LatLon(node.lat, node.lon)));
 		}
+		i++;
+		return true;
+	});
+	if (!reader.parse(json) || !valid) return false;
+
+	// The last node has no edge
+	if (i % 2 == 1)
+	{
+		edge.id = 0;
+		path.pts.push_back(PathElement(node.id, edge.id));
+		lookup.insert(std::make_pair(node.id, LatLon(node.lat, node.lon)));
 	}
 
 	return true;
 }
 
-bool MapManager::generatePath(double start_lat, double start_lon, double dest_lat, double dest_lon, int num_paths)
+bool MapManager::receivePath(double start_lat, double start_lon, double dest_lat, double dest_lon, int num_paths)
 {
-	/*UTMConverter utm_conv;
-	Point2 start_metric = utm_conv.toMetric(LatLon(start_lat, start_lon));
-	Point2 dest_metric = utm_conv.toMetric(LatLon(dest_lat, dest_lon));
-	double dist_metric = sqrt(pow((dest_metric.x - start_metric.x), 2) + pow((dest_metric.y - start_metric.y), 2));
-	double alpha = 50;*/
-
-	//double center_lat = (start_lat + dest_lat) / 2;
-	//double center_lon = (start_lon + dest_lon) / 2;
-	//bool ok = loadMap(center_lat, center_lon, 200);//(dist_metric / 2) + alpha);
-	//if (!ok) return false;
-
 	m_path.pts.clear();
 	lookup_path.clear();
 	m_json = "";
@@ -826,12 +1128,31 @@ bool MapManager::generatePath(double start_lat, double start_lon, double dest_la
 		if (!ok) return false;
 	}
 	
-	const char* json = m_json.c_str();
+	char* json = &m_json[0];
 
 //#ifdef _DEBUG
 //	fprintf(stdout, "%s\n", json);
 //#endif
-	ok = parsePath(json);
+	ok = parsePath(json, m_path, lookup_path);
+	if (!ok) return false;
+
+	return true;
+}
+
+bool MapManager::generatePath(double start_lat, double start_lon, double dest_lat, double dest_lon, int num_paths)
+{
+	/*UTMConverter utm_conv;
+	Point2 start_metric = utm_conv.toMetric(LatLon(start_lat, start_lon));
+	Point2 dest_metric = utm_conv.toMetric(LatLon(dest_lat, dest_lon));
+	double dist_metric = sqrt(pow((dest_metric.x - start_metric.x), 2) + pow((dest_metric.y - start_metric.y), 2));
+	double alpha = 50;*/
+
+	//double center_lat = (start_lat + dest_lat) / 2;
+	//double center_lon = (start_lon + dest_lon) / 2;
+	//bool ok = loadMap(center_lat, center_lon, 200);//(dist_metric / 2) + alpha);
+	//if (!ok) return false;
+
+	bool ok = receivePath(start_lat, start_lon, dest_lat, dest_lon, num_paths);
 	if (!ok) return false;
 
 	Path path = m_path;
@@ -872,31 +1193,7 @@ bool MapManager::generatePath_expansion(double start_lat, double start_lon, doub
 	//bool ok = loadMap(center_lat, center_lon, 200);//(dist_metric / 2) + alpha);
 	//if (!ok) return false;
 
-	m_path.pts.clear();
-	lookup_path.clear();
-	m_json = "";
-
-	// by communication
-	bool ok = downloadPath(start_lat, start_lon, dest_lat, dest_lon, num_paths);
-	if (!ok) return false;
-	//decodeUni();
-	if (m_json == "[]\n" || m_json == "{\"type\": \"FeatureCollection\", \"features\": []}\n")
-	{
-		ok = downloadPath(round(start_lat * 1000) / 1000, round(start_lon * 1000) / 1000, round(dest_lat * 1000) / 1000, round(dest_lon * 1000) / 1000, num_paths);
-		if (m_json == "[]\n" || m_json == "{\"type\": \"FeatureCollection\", \"features\": []}\n")
-		{
-			std::cout << "Invalid latitude or longitude!!" << std::endl;
-			return false;
-		}
-		if (!ok) return false;
-	}
-
-	const char* json = m_json.c_str();
-
-	//#ifdef _DEBUG
-	//	fprintf(stdout, "%s\n", json);
-	//#endif
-	ok = parsePath(json);
+	bool ok = receivePath(start_lat, start_lon, dest_lat, dest_lon, num_paths);
 	if (!ok) return false;
 
 	Path path = m_path;
@@ -949,6 +1246,16 @@ bool MapManager::getPath_expansion(double start_lat, double start_lon, double de
 	return true;
 }
 
+bool MapManager::getPath_streaming(double start_lat, double start_lon, double dest_lat, double dest_lon, Path& path, int num_paths)
+{
+	bool ok = receivePath(start_lat, start_lon, dest_lat, dest_lon, num_paths);
+	if (!ok) return false;
+
+	path = getPath();
+
+	return true;
+}
+
 bool MapManager::getPath(const char* filename, Path& path)
 {
 	m_path.pts.clear();
@@ -963,10 +1270,10 @@ bool MapManager::getPath(const char* filename, Path& path)
 	{
 		text += line + "\n";
 	}
-	const char* json = text.c_str();
+	char* json = &text[0];
 	is.close();
 
-	bool ok = parsePath(json);
+	bool ok = parsePath(json, m_path, lookup_path);
 	if (!ok)
 	{
 		m_path.pts.clear();
@@ -1012,34 +1319,23 @@ bool MapManager::downloadPOI_poi(ID poi_id, double radius)
 	return query2server(url);
 }
 
-bool MapManager::parsePOI(const char* json)
+bool MapManager::parsePOI(char* json, Map& map)
 {
-	Document document;
-	document.Parse(json);
-
-	if(!document.IsObject()) return false;
-	const Value& features = document["features"];
-	if(!features.IsArray()) return false;
-
-	for (SizeType i = 0; i < features.Size(); i++)
+	FeatureReader reader([&](int collection, const FeatureReader& properties) -> bool
 	{
-		const Value& feature = features[i];
-		if(!feature.IsObject()) return false;
-		if(!feature.HasMember("properties")) return false;
-		const Value& properties = feature["properties"];
-		if(!properties.IsObject()) return false;
 		POI poi;
-		poi.id = properties["id"].GetUint64();
-		const char* utf8 = properties["name"].GetString();
+		poi.id = properties.getUint64("id");
+		const char* utf8 = properties.getString("name");
 		utf8to16(utf8, poi.name);
-		poi.floor = properties["floor"].GetInt();
-		poi.lat = properties["latitude"].GetDouble();
-		poi.lon = properties["longitude"].GetDouble();
+		poi.floor = properties.getInt("floor");
+		poi.lat = properties.getDouble("latitude");
+		poi.lon = properties.getDouble("longitude");
 
-		m_map->addPOI(poi);
-	}
+		map.addPOI(poi);
+		return true;
+	});
 
-	return true;
+	return reader.parse(json);
 }
 
 std::vector<POI>& MapManager::getPOI()
@@ -1055,7 +1351,7 @@ bool MapManager::getPOI(double lat, double lon, double radius, std::vector<POI>&
 	// by communication
 	downloadPOI(lat, lon, radius);
 	//decodeUni();
-	const char* json = m_json.c_str();
+	char* json = &m_json[0];
 //#ifdef _DEBUG
 //	fprintf(stdout, "%s\n", json);
 //#endif
@@ -1065,7 +1361,7 @@ bool MapManager::getPOI(double lat, double lon, double radius, std::vector<POI>&
 		return false;
 	}
 
-	bool ok = parsePOI(json);
+	bool ok = parsePOI(json, *m_map);
 	if (!ok)
 	{
 		m_map->pois.clear();
@@ -1086,7 +1382,7 @@ bool MapManager::getPOI(double lat, double lon, double radius, std::vector<POI>&
 	// by communication
 	downloadPOI(node_id, radius);
 	//decodeUni();
-	const char* json = m_json.c_str();
+	char* json = &m_json[0];
 //#ifdef _DEBUG
 //	fprintf(stdout, "%s\n", json);
 //#endif
@@ -1096,7 +1392,7 @@ bool MapManager::getPOI(double lat, double lon, double radius, std::vector<POI>&
 		return false;
 	}
 
-	bool ok = parsePOI(json);
+	bool ok = parsePOI(json, *m_map);
 	if (!ok)
 	{
 		m_map->pois.clear();
@@ -1117,7 +1413,7 @@ bool MapManager::getPOI(cv::Point2i tile, std::vector<POI>& poi_vec)
 	// by communication
 	downloadPOI(tile);
 	//decodeUni();
-	const char* json = m_json.c_str();
+	char* json = &m_json[0];
 	//#ifdef _DEBUG
 	//	fprintf(stdout, "%s\n", json);
 	//#endif
@@ -1127,7 +1423,7 @@ bool MapManager::getPOI(cv::Point2i tile, std::vector<POI>& poi_vec)
 		return false;
 	}
 
-	bool ok = parsePOI(json);
+	bool ok = parsePOI(json, *m_map);
 	if (!ok)
 	{
 		m_map->pois.clear();
@@ -1174,7 +1470,7 @@ std::vector<POI> MapManager::getPOI(ID poi_id, double radius)
 	// by communication
 	downloadPOI_poi(poi_id, radius);
 	//decodeUni();
-	const char* json = m_json.c_str();
+	char* json = &m_json[0];
 	//#ifdef _DEBUG
 	//	fprintf(stdout, "%s\n", json);
 	//#endif
@@ -1184,7 +1480,7 @@ std::vector<POI> MapManager::getPOI(ID poi_id, double radius)
 		return std::vector<POI>();
 	}
 
-	bool ok = parsePOI(json);
+	bool ok = parsePOI(json, *m_map);
 	if (!ok)
 	{
 		m_map->pois.clear();
@@ -1197,13 +1493,23 @@ std::vector<POI> MapManager::getPOI(ID poi_id, double radius)
 
 std::vector<POI> MapManager::getPOI(const std::string poi_name, LatLon latlon, double radius)
 {	
+	std::wstring name;
+	utf8to16(poi_name.c_str(), name);
+	if (!m_poi_index.empty())
+	{
+		std::vector<const POI*> found = m_poi_index.findByName(name, latlon, radius);
+		std::vector<POI> poi_vec;
+		poi_vec.reserve(found.size());
+		for (auto it = found.begin(); it != found.end(); ++it)
+			poi_vec.push_back(**it);
+		return poi_vec;
+	}
+
 	std::vector<POI> poi_vec;
 	bool ok = getPOI(latlon.lat, latlon.lon, radius, poi_vec);
 	if (!ok)
 		return std::vector<POI>();
 	poi_vec.clear();
-	std::wstring name;
-	utf8to16(poi_name.c_str(), name);
 	for (std::vector<POI>::iterator it = m_map->pois.begin(); it != m_map->pois.end(); ++it)
 	{		
 		if (it->name == name)
@@ -1215,35 +1521,28 @@ std::vector<POI> MapManager::getPOI(const std::string poi_name, LatLon latlon, d
 
 std::vector<POI> MapManager::getPOI_sorting(const std::string poi_name, LatLon latlon, double radius, LatLon cur_latlon)
 {
-	std::vector<POI> poi_vec;
-	bool ok = getPOI(latlon.lat, latlon.lon, radius, poi_vec);
-	if (!ok)
-		return std::vector<POI>();
-	poi_vec.clear();
 	std::wstring name;
 	utf8to16(poi_name.c_str(), name);
-
-	UTMConverter utm_conv;
-	Point2 cur_metric = utm_conv.toMetric(cur_latlon);
-	Point2 poi_metric;
-	double dist_metric;
-	/** A hash table for finding POIs by distance */
-	std::map<double, POI> lookup_pois_dist;
-	
-	for (std::vector<POI>::iterator it = m_map->pois.begin(); it != m_map->pois.end(); ++it)
+	std::vector<const POI*> found;
+	POIIndex downloaded;
+	if (!m_poi_index.empty())
+		found = m_poi_index.findByName(name, latlon, radius);
+	else
 	{
-		if (it->name == name)
-		{
-			poi_metric = utm_conv.toMetric(LatLon(it->lat, it->lon));
-			dist_metric = sqrt(pow((cur_metric.x - poi_metric.x), 2) + pow((cur_metric.y - poi_metric.y), 2));
-			lookup_pois_dist.insert(std::make_pair(dist_metric, *it));
-		}
+		std::vector<POI> poi_vec;
+		bool ok = getPOI(latlon.lat, latlon.lon, radius, poi_vec);
+		if (!ok)
+			return std::vector<POI>();
+		downloaded.build(m_map->pois);
+		found = downloaded.findByName(name);
 	}
 
-	for (std::map<double, POI>::iterator it = lookup_pois_dist.begin(); it != lookup_pois_dist.end(); ++it)
-	{
-		poi_vec.push_back(it->second);
-	}
+	// Sort by distance (POIs in the same distance are all kept)
+	m_poi_index.sortByDistance(found, cur_latlon);
+	std::vector<POI> poi_vec;
+	poi_vec.reserve(found.size());
+	for (auto it = found.begin(); it != found.end(); ++it)
+		poi_vec.push_back(**it);
 
 	return poi_vec;
 }
@@ -1252,22 +1551,60 @@ std::vector<POI> MapManager::getPOI(const std::string poi_name)
 {
 	std::wstring name;
 	utf8to16(poi_name.c_str(), name);
-	auto found = lookup_pois_name.find(name);
-	if (found == lookup_pois_name.end()) 
-		return std::vector<POI>();
+	std::vector<const POI*> found = m_poi_index.findByName(name);
+	std::vector<POI> poi_vec;
+	poi_vec.reserve(found.size());
+	for (auto it = found.begin(); it != found.end(); ++it)
+		poi_vec.push_back(**it);
 
-	return getPOI(poi_name, found->second, 10.0);
+	return poi_vec;
 }
 
 std::vector<POI> MapManager::getPOI_sorting(const std::string poi_name, LatLon cur_latlon)
 {
 	std::wstring name;
 	utf8to16(poi_name.c_str(), name);
-	auto found = lookup_pois_name.find(name);
-	if (found == lookup_pois_name.end())
-		return std::vector<POI>();
+	std::vector<const POI*> found = m_poi_index.findByName(name);
+	m_poi_index.sortByDistance(found, cur_latlon);
+	std::vector<POI> poi_vec;
+	poi_vec.reserve(found.size());
+	for (auto it = found.begin(); it != found.end(); ++it)
+		poi_vec.push_back(**it);
+
+	return poi_vec;
+}
+
+std::vector<POI> MapManager::getPOI_prefix(const std::string poi_prefix, LatLon latlon, double radius)
+{
+	std::wstring prefix;
+	utf8to16(poi_prefix.c_str(), prefix);
+	std::vector<const POI*> found = m_poi_index.findByPrefix(prefix, latlon, radius);
+	std::vector<POI> poi_vec;
+	poi_vec.reserve(found.size());
+	for (auto it = found.begin(); it != found.end(); ++it)
+		poi_vec.push_back(**it);
+
+	return poi_vec;
+}
+
+std::vector<POI> MapManager::getPOI_similar(const std::string poi_name, LatLon latlon, double radius, int max_edits)
+{
+	std::wstring name;
+	utf8to16(poi_name.c_str(), name);
+	if (max_edits < 0)
+		max_edits = static_cast<int>(POIIndex::normalizeName(name).size()) / 3;
+	std::vector<POIMatch> found = m_poi_index.findSimilar(name, max_edits, latlon, radius);
+	std::vector<POI> poi_vec;
+	poi_vec.reserve(found.size());
+	for (auto it = found.begin(); it != found.end(); ++it)
+		poi_vec.push_back(*it->poi);
 
-	return getPOI_sorting(poi_name, found->second, 10.0, cur_latlon);
+	return poi_vec;
+}
+
+const POIIndex& MapManager::getPOIIndex() const
+{
+	return m_poi_index;
 }
 
 bool MapManager::downloadStreetView(double lat, double lon, double radius)
@@ -1303,37 +1640,30 @@ bool MapManager::downloadStreetView_sv(ID sv_id, double radius)
 	return query2server(url);
 }
 
-bool MapManager::parseStreetView(const char* json)
+bool MapManager::parseStreetView(char* json, Map& map)
 {
-	Document document;
-	document.Parse(json);
-
-	if (!document.IsObject()) return false;
-	const Value& features = document["features"];
-	if (!features.IsArray()) return false;
-
-	for (SizeType i = 0; i < features.Size(); i++)
+	bool valid = true;
+	FeatureReader reader([&](int collection, const FeatureReader& properties) -> bool
 	{
-		const Value& feature = features[i];
-		if (!feature.IsObject()) return false;
-		if (!feature.HasMember("properties")) return false;
-		const Value& properties = feature["properties"];
-		if (!properties.IsObject()) return false;
 		StreetView sv;
-		std::string id_str = properties["id"].GetString();
-		sv.id = std::strtoull(id_str.c_str(), nullptr, 0);
-		std::string name = properties["name"].GetString();
-		if (!(name == "streetview" || name == "StreetView")) return false;
-		sv.floor = properties["floor"].GetInt();
-		sv.date = properties["date"].GetString();
-		sv.heading = properties["heading"].GetDouble();
-		sv.lat = properties["latitude"].GetDouble();
-		sv.lon = properties["longitude"].GetDouble();
+		sv.id = properties.getUint64("id");
+		std::string name = properties.getString("name");
+		if (!(name == "streetview" || name == "StreetView"))
+		{
+			valid = false;
+			return false;
+		}
+		sv.floor = properties.getInt("floor");
+		sv.date = properties.getString("date");
+		sv.heading = properties.getDouble("heading");
+		sv.lat = properties.getDouble("latitude");
+		sv.lon = properties.getDouble("longitude");
 
-		m_map->addView(sv);
-	}
+		map.addView(sv);
+		return true;
+	});
 
-	return true;
+	return reader.parse(json) && valid;
 }
 
 std::vector<StreetView> MapManager::getStreetView()
@@ -1349,11 +1679,11 @@ bool MapManager::getStreetView(double lat, double lon, double radius, std::vecto
 	// by communication
 	downloadStreetView(lat, lon, radius);
 	//decodeUni();
-	const char* json = m_json.c_str();
+	char* json = &m_json[0];
 //#ifdef _DEBUG
 //	fprintf(stdout, "%s\n", json);
 //#endif
-	bool ok = parseStreetView(json);
+	bool ok = parseStreetView(json, *m_map);
 	if (!ok)
 	{
 		m_map->views.clear();
@@ -1374,11 +1704,11 @@ bool MapManager::getStreetView(ID node_id, double radius, std::vector<StreetView
 	// by communication
 	downloadStreetView(node_id, radius);
 	//decodeUni();
-	const char* json = m_json.c_str();
+	char* json = &m_json[0];
 //#ifdef _DEBUG
 //	fprintf(stdout, "%s\n", json);
 //#endif
-	bool ok = parseStreetView(json);
+	bool ok = parseStreetView(json, *m_map);
 	if (!ok)
 	{
 		m_map->views.clear();
@@ -1399,11 +1729,11 @@ bool MapManager::getStreetView(cv::Point2i tile, std::vector<StreetView>& sv_vec
 	// by communication
 	downloadStreetView(tile);
 	//decodeUni();
-	const char* json = m_json.c_str();
+	char* json = &m_json[0];
 	//#ifdef _DEBUG
 	//	fprintf(stdout, "%s\n", json);
 	//#endif
-	bool ok = parseStreetView(json);
+	bool ok = parseStreetView(json, *m_map);
 	if (!ok)
 	{
 		m_map->views.clear();
@@ -1450,11 +1780,11 @@ std::vector<StreetView> MapManager::getStreetView(ID sv_id, double radius)
 	// by communication
 	downloadStreetView_sv(sv_id, radius);
 	//decodeUni();
-	const char* json = m_json.c_str();
+	char* json = &m_json[0];
 	//#ifdef _DEBUG
 	//	fprintf(stdout, "%s\n", json);
 	//#endif
-	bool ok = parseStreetView(json);
+	bool ok = parseStreetView(json, *m_map);
 	if (!ok)
 	{
 		m_map->views.clear();
@@ -1473,79 +1803,776 @@ size_t MapManager::writeImage_callback(char* ptr, size_t size, size_t nmemb, voi
 	return count;
 }
 
-cv::Mat MapManager::queryImage2server(std::string url, int timeout)
+cv::Mat MapManager::queryImage2server(std::string url, int timeout, const cv::Size& target_size)
 {
 #ifdef _WIN32
 	SetConsoleOutputCP(65001);
 #endif
 
 	std::vector<uchar> stream;
-	curl_global_init(CURL_GLOBAL_ALL);
-	CURL* curl = curl_easy_init();
-	CURLcode res;
-
-	if (curl)
+	if (request2server(url, stream, timeout, &m_image_cache) && !stream.empty())
 	{
-		curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeImage_callback);
-		curl_easy_setopt(curl, CURLOPT_WRITEDATA, &stream);
-		curl_easy_setopt(curl, CURLOPT_TIMEOUT, timeout);
+		const unsigned char* novalid = reinterpret_cast<const unsigned char*>("No valid");
+		unsigned char part[8] = { stream[0], stream[1], stream[2], stream[3], stream[4], stream[5], stream[6], stream[7] };
+		if (*part == *novalid)
+		{
+			m_portErr = true;
+			m_image_cache.remove(url);
+		}
 
-		// Perform the request, res will get the return code.
-		res = curl_easy_perform(curl);
+		return decodeImage(stream, target_size);
+	}
 
-		// Always cleanup.
-		curl_easy_cleanup(curl);
-		curl_global_cleanup();
+	return cv::Mat();
+}
 
-		// Check for errors.
-		if (res == CURLE_OK && !stream.empty())
+// Read the image size from the start-of-frame segment of a JPEG image
+static bool readJpegSize(const std::vector<uchar>& data, cv::Size& size)
+{
+	if (data.size() < 4 || data[0] != 0xFF || data[1] != 0xD8) return false;
+	size_t i = 2;
+	while (i + 9 < data.size())
+	{
+		if (data[i] != 0xFF) return false;
+		uchar marker = data[i + 1];
+		if (marker == 0xFF) // A fill byte
 		{
-			const unsigned char* novalid = reinterpret_cast<const unsigned char*>("No valid");
-			unsigned char part[8] = { stream[0], stream[1], stream[2], stream[3], stream[4], stream[5], stream[6], stream[7] };
-			if (*part == *novalid)
-				m_portErr = true;
-
-			return cv::imdecode(stream, -1);      
+			i++;
+			continue;
+		}
+		if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) // A segment without its length
+		{
+			i += 2;
+			continue;
+		}
+		if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+		{
+			size.height = (data[i + 5] << 8) | data[i + 6];
+			size.width = (data[i + 7] << 8) | data[i + 8];
+			return size.width > 0 && size.height > 0;
 		}
+		i += 2 + ((data[i + 2] << 8) | data[i + 3]);
 	}
+	return false;
+}
 
-	return cv::Mat();
+cv::Mat MapManager::decodeImage(const std::vector<uchar>& data, const cv::Size& target_size)
+{
+	cv::Size size;
+	if ((target_size.width > 0 || target_size.height > 0) && readJpegSize(data, size))
+	{
+		const int reductions[] = { 8, 4, 2 };
+		const int flags[] = { cv::IMREAD_REDUCED_COLOR_8, cv::IMREAD_REDUCED_COLOR_4, cv::IMREAD_REDUCED_COLOR_2 };
+		for (int i = 0; i < 3; i++)
+		{
+			if (size.width / reductions[i] >= target_size.width && size.height / reductions[i] >= target_size.height)
+				return cv::imdecode(data, flags[i]);
+		}
+	}
+	return cv::imdecode(data, cv::IMREAD_UNCHANGED);
 }
 
-cv::Mat MapManager::downloadStreetViewImage(ID sv_id, const std::string cubic, int timeout, const std::string url_middle)
+cv::Mat MapManager::downloadStreetViewImage(ID sv_id, const std::string cubic, int timeout, const std::string url_middle, const cv::Size& target_size)
 {
 	//const std::string url_middle = ":10000/";
 	if (cubic == "")
 	{
 		std::string url = "http://" + m_ip + url_middle + std::to_string(sv_id);
-		return queryImage2server(url, timeout);
+		return queryImage2server(url, timeout, target_size);
 	}
 	else
 	{
 		std::string url = "http://" + m_ip + url_middle + std::to_string(sv_id) + "/" + cubic;
-		return queryImage2server(url, timeout);
+		return queryImage2server(url, timeout, target_size);
 	}
 }
 
-bool MapManager::getStreetViewImage(ID sv_id, cv::Mat& sv_image, std::string cubic, int timeout)
+bool MapManager::getStreetViewImage(ID sv_id, cv::Mat& sv_image, std::string cubic, int timeout, const cv::Size& target_size)
 {
 	if (!(cubic == "f" || cubic == "b" || cubic == "l" || cubic == "r" || cubic == "u" || cubic == "d"))
 		cubic = "";
+	std::string key = getStreetViewImageKey(sv_id, cubic, target_size);
+	if (m_image_memory.load(key, sv_image)) return true;
 
-	sv_image = downloadStreetViewImage(sv_id, cubic, timeout);
+	sv_image = downloadStreetViewImage(sv_id, cubic, timeout, ":10000/", target_size);
 
 	if (m_portErr == true)
 	{
 		const std::string url_middle = ":10001/";
-		sv_image = downloadStreetViewImage(sv_id, cubic, timeout, url_middle);
+		sv_image = downloadStreetViewImage(sv_id, cubic, timeout, url_middle, target_size);
 		m_portErr = false;
 	}
 
 	if (sv_image.empty())	return false;
+	m_image_memory.store(key, sv_image);
 
 	return true;
 }
 
+std::string MapManager::getStreetViewImageKey(ID sv_id, const std::string& cubic, const cv::Size& target_size)
+{
+	std::string key = std::to_string(sv_id);
+	if (cubic != "") key += "/" + cubic;
+	if (target_size.width > 0 || target_size.height > 0) key += "@" + std::to_string(target_size.width) + "x" + std::to_string(target_size.height);
+	return key;
+}
+
+ID MapManager::getMapAsync(double lat, double lon, double radius, std::function<void(bool ok, Map& map)> callback, int timeout)
+{
+	const std::string url_middle = ":21500/wgs/";
+	std::string url = "http://" + m_ip + url_middle + std::to_string(lat) + "/" + std::to_string(lon) + "/" + std::to_string(radius);
+
+	return submitAsync(url, timeout, [this, callback](bool ok, std::vector<uchar>& response)
+	{
+		Map map;
+		if (ok)
+		{
+			response.push_back('\0');
+			ok = parseMap(reinterpret_cast<char*>(response.data()), map);
+		}
+		if (callback) callback(ok, map);
+	});
+}
+
+std::future<Map> MapManager::getMapAsync(double lat, double lon, double radius, int timeout, ID* request_id)
+{
+	std::shared_ptr<std::promise<Map>> promise = std::make_shared<std::promise<Map>>();
+	std::future<Map> future = promise->get_future();
+	ID id = getMapAsync(lat, lon, radius, [promise](bool ok, Map& map) { promise->set_value(ok ? std::move(map) : Map()); }, timeout);
+	if (id == 0) promise->set_value(Map());
+	if (request_id) *request_id = id;
+
+	return future;
+}
+
+ID MapManager::getPathAsync(double start_lat, double start_lon, double dest_lat, double dest_lon, std::function<void(bool ok, Path& path)> callback, int num_paths, int timeout)
+{
+	const std::string url_middle = ":20005/"; // routing server (paths)
+	std::string url = "http://" + m_ip + url_middle + std::to_string(start_lat) + "/" + std::to_string(start_lon) + "/" + std::to_string(dest_lat) + "/" + std::to_string(dest_lon) + "/" + std::to_string(num_paths);
+
+	return submitAsync(url, timeout, [this, callback](bool ok, std::vector<uchar>& response)
+	{
+		Path path;
+		if (ok)
+		{
+			response.push_back('\0');
+			char* json = reinterpret_cast<char*>(response.data());
+			if (strcmp(json, "[]\n") == 0 || strcmp(json, "{\"type\": \"FeatureCollection\", \"features\": []}\n") == 0) ok = false;
+			else
+			{
+				std::map<ID, LatLon> lookup;
+				ok = parsePath(json, path, lookup);
+			}
+		}
+		if (callback) callback(ok, path);
+	});
+}
+
+std::future<Path> MapManager::getPathAsync(double start_lat, double start_lon, double dest_lat, double dest_lon, int num_paths, int timeout, ID* request_id)
+{
+	std::shared_ptr<std::promise<Path>> promise = std::make_shared<std::promise<Path>>();
+	std::future<Path> future = promise->get_future();
+	ID id = getPathAsync(start_lat, start_lon, dest_lat, dest_lon, [promise](bool ok, Path& path) { promise->set_value(ok ? std::move(path) : Path()); }, num_paths, timeout);
+	if (id == 0) promise->set_value(Path());
+	if (request_id) *request_id = id;
+
+	return future;
+}
+
+ID MapManager::getPOIAsync(double lat, double lon, double radius, std::function<void(bool ok, std::vector<POI>& poi_vec)> callback, int timeout)
+{
+	const std::string url_middle = ":21502/wgs/";
+	std::string url = "http://" + m_ip + url_middle + std::to_string(lat) + "/" + std::to_string(lon) + "/" + std::to_string(radius);
+
+	return submitAsync(url, timeout, [this, callback](bool ok, std::vector<uchar>& response)
+	{
+		Map map;
+		if (ok)
+		{
+			response.push_back('\0');
+			char* json = reinterpret_cast<char*>(response.data());
+			if (strcmp(json, "[]\n") == 0 || strcmp(json, "{\"type\": \"FeatureCollection\", \"features\": []}\n") == 0) ok = false;
+			else ok = parsePOI(json, map);
+		}
+		if (callback) callback(ok, map.pois);
+	});
+}
+
+std::future<std::vector<POI>> MapManager::getPOIAsync(double lat, double lon, double radius, int timeout, ID* request_id)
+{
+	std::shared_ptr<std::promise<std::vector<POI>>> promise = std::make_shared<std::promise<std::vector<POI>>>();
+	std::future<std::vector<POI>> future = promise->get_future();
+	ID id = getPOIAsync(lat, lon, radius, [promise](bool ok, std::vector<POI>& poi_vec) { promise->set_value(ok ? std::move(poi_vec) : std::vector<POI>()); }, timeout);
+	if (id == 0) promise->set_value(std::vector<POI>());
+	if (request_id) *request_id = id;
+
+	return future;
+}
+
+ID MapManager::getStreetViewAsync(double lat, double lon, double radius, std::function<void(bool ok, std::vector<StreetView>& sv_vec)> callback, int timeout)
+{
+	const std::string url_middle = ":21501/wgs/";
+	std::string url = "http://" + m_ip + url_middle + std::to_string(lat) + "/" + std::to_string(lon) + "/" + std::to_string(radius);
+
+	return submitAsync(url, timeout, [this, callback](bool ok, std::vector<uchar>& response)
+	{
+		Map map;
+		if (ok)
+		{
+			response.push_back('\0');
+			ok = parseStreetView(reinterpret_cast<char*>(response.data()), map);
+		}
+		if (callback) callback(ok, map.views);
+	});
+}
+
+std::future<std::vector<StreetView>> MapManager::getStreetViewAsync(double lat, double lon, double radius, int timeout, ID* request_id)
+{
+	std::shared_ptr<std::promise<std::vector<StreetView>>> promise = std::make_shared<std::promise<std::vector<StreetView>>>();
+	std::future<std::vector<StreetView>> future = promise->get_future();
+	ID id = getStreetViewAsync(lat, lon, radius, [promise](bool ok, std::vector<StreetView>& sv_vec) { promise->set_value(ok ? std::move(sv_vec) : std::vector<StreetView>()); }, timeout);
+	if (id == 0) promise->set_value(std::vector<StreetView>());
+	if (request_id) *request_id = id;
+
+	return future;
+}
+
+ID MapManager::getStreetViewImageAsync(ID sv_id, std::function<void(bool ok, cv::Mat& sv_image)> callback, std::string cubic, int timeout, const cv::Size& target_size)
+{
+	if (!(cubic == "f" || cubic == "b" || cubic == "l" || cubic == "r" || cubic == "u" || cubic == "d"))
+		cubic = "";
+	std::string url_tail = getStreetViewImageKey(sv_id, cubic);
+	std::string url = "http://" + m_ip + ":10000/" + url_tail;
+	std::string url_alt = "http://" + m_ip + ":10001/" + url_tail;
+	std::string key = getStreetViewImageKey(sv_id, cubic, target_size);
+
+	// Finish without transfer if the image is in memory
+	cv::Mat cached;
+	if (m_image_memory.load(key, cached))
+	{
+		return submitAsync("", timeout, [callback, cached](bool ok, std::vector<uchar>& response)
+		{
+			cv::Mat sv_image = ok ? cached : cv::Mat();
+			if (callback) callback(ok, sv_image);
+		});
+	}
+
+	std::function<void(bool, std::vector<uchar>&)> decode = [this, callback, key, target_size](bool ok, std::vector<uchar>& response)
+	{
+		cv::Mat sv_image;
+		if (ok && !response.empty()) sv_image = decodeImage(response, target_size);
+		if (!sv_image.empty()) m_image_memory.store(key, sv_image);
+		if (callback) callback(!sv_image.empty(), sv_image);
+	};
+
+	// Keep the same ID for the retry on the other port to cancel it together
+	ID id = 0;
+	{
+		std::lock_guard<std::mutex> lock(m_async_mutex);
+		id = m_async_next_id++;
+	}
+	return submitAsync(url, timeout, [this, id, url, url_alt, timeout, decode](bool ok, std::vector<uchar>& response)
+	{
+		if (ok && response.size() >= 8 && memcmp(response.data(), "No valid", 8) == 0)
+		{
+			m_image_cache.remove(url);
+			if (submitAsync(url_alt, timeout, decode, id, &m_image_cache) != 0) return;
+			ok = false;
+		}
+		decode(ok, response);
+	}, id, &m_image_cache);
+}
+
+std::future<cv::Mat> MapManager::getStreetViewImageAsync(ID sv_id, std::string cubic, int timeout, ID* request_id, const cv::Size& target_size)
+{
+	std::shared_ptr<std::promise<cv::Mat>> promise = std::make_shared<std::promise<cv::Mat>>();
+	std::future<cv::Mat> future = promise->get_future();
+	ID id = getStreetViewImageAsync(sv_id, [promise](bool ok, cv::Mat& sv_image) { promise->set_value(sv_image); }, cubic, timeout, target_size);
+	if (id == 0) promise->set_value(cv::Mat());
+	if (request_id) *request_id = id;
+
+	return future;
+}
+
+ID MapManager::prefetchStreetViewImages(const LatLon& latlon, double radius, int max_views, const std::string& faces, int timeout, const cv::Size& target_size)
+{
+	return getStreetViewAsync(latlon.lat, latlon.lon, radius, [this, latlon, max_views, faces, timeout, target_size](bool ok, std::vector<StreetView>& sv_vec)
+	{
+		if (!ok) return;
+
+		// Prefetch the nearest StreetViews first
+		UTMConverter converter;
+		Point2 p = converter.toMetric(latlon);
+		std::vector<std::pair<double, ID>> views;
+		for (auto sv = sv_vec.begin(); sv != sv_vec.end(); sv++)
+			views.push_back(std::make_pair(cv::norm(converter.toMetric(LatLon(sv->lat, sv->lon)) - p), sv->id));
+		std::sort(views.begin(), views.end());
+		if (max_views >= 0 && views.size() > static_cast<size_t>(max_views)) views.resize(max_views);
+
+		for (auto view = views.begin(); view != views.end(); view++)
+		{
+			for (auto face = faces.begin(); face != faces.end(); face++)
+			{
+				std::string cubic(1, *face);
+				if (cubic != "f" && cubic != "b" && cubic != "l" && cubic != "r" && cubic != "u" && cubic != "d") continue;
+				std::string key = getStreetViewImageKey(view->second, cubic, target_size);
+				if (m_image_memory.contains(key)) continue;
+				{
+					std::lock_guard<std::mutex> lock(m_prefetch_mutex);
+					if (!m_prefetch_keys.insert(key).second) continue;
+				}
+				ID id = getStreetViewImageAsync(view->second, [this, key](bool ok, cv::Mat& sv_image)
+				{
+					std::lock_guard<std::mutex> lock(m_prefetch_mutex);
+					m_prefetch_keys.erase(key);
+				}, cubic, timeout, target_size);
+				if (id == 0)
+				{
+					std::lock_guard<std::mutex> lock(m_prefetch_mutex);
+					m_prefetch_keys.erase(key);
+				}
+			}
+		}
+	}, timeout);
+}
+
+bool MapManager::cancelAsync(ID request_id)
+{
+	if (request_id == 0) return false;
+	{
+		std::lock_guard<std::mutex> lock(m_async_mutex);
+		if (m_async_stop || !m_async_thread.joinable()) return false;
+		m_async_cancel.insert(request_id);
+	}
+	m_async_wake.notify_one();
+
+	return true;
+}
+
+ID MapManager::submitAsync(const std::string& url, int timeout, std::function<void(bool ok, std::vector<uchar>& response)> done, ID id, ResponseCache* cache)
+{
+	std::shared_ptr<AsyncRequest> request = std::make_shared<AsyncRequest>();
+	request->url = url;
+	request->timeout = timeout;
+	request->done = done;
+	request->cache = (cache != nullptr) ? cache : &m_cache;
+	{
+		std::lock_guard<std::mutex> lock(m_async_mutex);
+		if (m_async_stop) return 0;
+		if (!m_async_thread.joinable())
+		{
+			// Start the background thread at the first request
+			if (!initCurlGlobal()) return 0;
+			m_multi = curl_multi_init();
+			if (m_multi == nullptr) return 0;
+			m_async_thread = std::thread(&MapManager::runAsync, this);
+		}
+		request->id = (id > 0) ? id : m_async_next_id++;
+		m_async_queue.push_back(request);
+	}
+	m_async_wake.notify_one();
+
+	return request->id;
+}
+
+void MapManager::runAsync()
+{
+	// curl_multi_wait() is not woken by new requests, so they wait at most this interval during transfers
+	const int poll_interval = 20; // Unit: [msec]
+
+	std::map<CURL*, std::shared_ptr<AsyncRequest>> active;
+	std::vector<std::shared_ptr<AsyncRequest>> starting;
+	std::vector<std::pair<std::shared_ptr<AsyncRequest>, bool>> finished;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_async_mutex);
+			while (!m_async_stop && active.empty() && m_async_queue.empty()) m_async_wake.wait(lock);
+			if (m_async_stop) break;
+
+			// Take new requests unless they are already canceled
+			while (!m_async_queue.empty())
+			{
+				std::shared_ptr<AsyncRequest> request = m_async_queue.front();
+				m_async_queue.pop_front();
+				if (m_async_cancel.count(request->id) == 0) starting.push_back(request);
+				else finished.push_back(std::make_pair(request, false));
+			}
+
+			// Remove canceled requests in transfer
+			for (auto id = m_async_cancel.begin(); id != m_async_cancel.end(); id++)
+			{
+				for (auto item = active.begin(); item != active.end(); item++)
+				{
+					if (item->second->id != *id) continue;
+					curl_multi_remove_handle(m_multi, item->first);
+					curl_easy_cleanup(item->first);
+					finished.push_back(std::make_pair(item->second, false));
+					active.erase(item);
+					break;
+				}
+			}
+			m_async_cancel.clear();
+		}
+
+		// Start new requests without the lock because the disk cache is read
+		for (auto request = starting.begin(); request != starting.end(); request++)
+		{
+			std::shared_ptr<AsyncRequest> req = *request;
+			if (req->url.empty())
+			{
+				finished.push_back(std::make_pair(req, true));
+				continue;
+			}
+			if (req->cache->load(req->url, req->cached) && req->cached.fresh)
+			{
+				req->response.swap(req->cached.body);
+				finished.push_back(std::make_pair(req, true));
+				continue;
+			}
+			CURL* curl = curl_easy_init();
+			if (curl == nullptr)
+			{
+				finished.push_back(std::make_pair(req, updateCache(*req->cache, req->url, false, 0, req->response, req->cached, req->received)));
+				continue;
+			}
+			req->headers = makeValidatorHeaders(req->cached);
+			curl_easy_setopt(curl, CURLOPT_URL, req->url.c_str());
+			curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeImage_callback);
+			curl_easy_setopt(curl, CURLOPT_WRITEDATA, &req->response);
+			curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback);
+			curl_easy_setopt(curl, CURLOPT_HEADERDATA, &req->received);
+			if (req->headers != nullptr) curl_easy_setopt(curl, CURLOPT_HTTPHEADER, req->headers);
+			curl_easy_setopt(curl, CURLOPT_TIMEOUT, req->timeout);
+			curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+			curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+			curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+			curl_easy_setopt(curl, CURLOPT_USERAGENT, "libcurl-agent/1.0");
+			curl_multi_add_handle(m_multi, curl);
+			active[curl] = req;
+		}
+		starting.clear();
+
+		// Transfer data and collect finished requests
+		if (!active.empty())
+		{
+			int n_running = 0, n_msgs = 0;
+			curl_multi_perform(m_multi, &n_running);
+			CURLMsg* msg = nullptr;
+			while ((msg = curl_multi_info_read(m_multi, &n_msgs)) != nullptr)
+			{
+				if (msg->msg != CURLMSG_DONE) continue;
+				auto item = active.find(msg->easy_handle);
+				if (item == active.end()) continue;
+				long code = 0;
+				curl_easy_getinfo(item->first, CURLINFO_RESPONSE_CODE, &code);
+				std::shared_ptr<AsyncRequest> req = item->second;
+				bool ok = updateCache(*req->cache, req->url, msg->data.result == CURLE_OK, code, req->response, req->cached, req->received);
+				curl_multi_remove_handle(m_multi, item->first);
+				curl_easy_cleanup(item->first);
+				finished.push_back(std::make_pair(req, ok));
+				active.erase(item);
+			}
+		}
+
+		// Process responses without the lock because they may submit new requests
+		for (auto item = finished.begin(); item != finished.end(); item++)
+			if (item->first->done) item->first->done(item->second, item->first->response);
+		finished.clear();
+
+		if (!active.empty()) curl_multi_wait(m_multi, nullptr, 0, poll_interval, nullptr);
+	}
+
+	// Fail all remaining requests
+	for (auto item = active.begin(); item != active.end(); item++)
+	{
+		curl_multi_remove_handle(m_multi, item->first);
+		curl_easy_cleanup(item->first);
+		finished.push_back(std::make_pair(item->second, false));
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_async_mutex);
+		for (auto request = m_async_queue.begin(); request != m_async_queue.end(); request++)
+			finished.push_back(std::make_pair(*request, false));
+		m_async_queue.clear();
+	}
+	for (auto item = finished.begin(); item != finished.end(); item++)
+		if (item->first->done) item->first->done(item->second, item->first->response);
+}
+
+void MapManager::stopAsync()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_async_mutex);
+		m_async_stop = true;
+	}
+	m_async_wake.notify_all();
+	if (m_async_thread.joinable()) m_async_thread.join();
+	if (m_multi != nullptr)
+	{
+		curl_multi_cleanup(m_multi);
+		m_multi = nullptr;
+	}
+}
+
+bool MapManager::startMapStreaming(const Path& path, double corridor, double tile_size, double lookahead, int max_tiles)
+{
+	std::vector<LatLon> route;
+	for (auto it = path.pts.begin(); it != path.pts.end(); it++)
+	{
+		auto found = lookup_path.find(it->node_id);
+		if (found == lookup_path.end()) return false;
+
+		// swapped lat and lon
+		if (found->second.lat > found->second.lon) route.push_back(LatLon(found->second.lon, found->second.lat));
+		else route.push_back(found->second);
+	}
+
+	return startMapStreaming(route, corridor, tile_size, lookahead, max_tiles);
+}
+
+bool MapManager::startMapStreaming(const std::vector<LatLon>& route, double corridor, double tile_size, double lookahead, int max_tiles)
+{
+	if (route.empty() || corridor < 0 || tile_size <= 0 || lookahead < 0 || max_tiles <= 0) return false;
+	stopMapStreaming();
+
+	std::vector<Point2> points;
+	std::vector<double> dists;
+	for (auto it = route.begin(); it != route.end(); it++)
+	{
+		Point2 p = m_stream_utm.toMetric(*it);
+		dists.push_back(points.empty() ? 0 : dists.back() + cv::norm(p - points.back()));
+		points.push_back(p);
+	}
+
+	// Find tiles overlapped with the route buffer by sampling the route with the half of the tile size
+	// (the buffer of each sample is enlarged to cover the route between samples)
+	const double step = tile_size / 2, margin = corridor + step / 2;
+	std::unordered_map<uint64, StreamTile> tiles;
+	for (size_t i = 0; i < points.size(); i++)
+	{
+		double length = (i + 1 < points.size()) ? dists[i + 1] - dists[i] : 0;
+		Point2 delta = (i + 1 < points.size()) ? points[i + 1] - points[i] : Point2(0, 0);
+		int n_samples = std::max(static_cast<int>(ceil(length / step)), 1);
+		for (int k = 0; k < n_samples; k++)
+		{
+			double t = static_cast<double>(k) / n_samples;
+			Point2 p = points[i] + t * delta;
+			double s = dists[i] + t * length;
+			int x0 = static_cast<int>(floor((p.x - margin) / tile_size)), x1 = static_cast<int>(floor((p.x + margin) / tile_size));
+			int y0 = static_cast<int>(floor((p.y - margin) / tile_size)), y1 = static_cast<int>(floor((p.y + margin) / tile_size));
+			for (int y = y0; y <= y1; y++)
+			{
+				for (int x = x0; x <= x1; x++)
+				{
+					uint64 key = (static_cast<uint64>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y);
+					auto found = tiles.find(key);
+					if (found != tiles.end())
+					{
+						found->second.start = std::min(found->second.start, s);
+						found->second.end = std::max(found->second.end, s);
+						continue;
+					}
+					StreamTile tile;
+					tile.key = key;
+					tile.center = m_stream_utm.toLatLon(Point2((x + 0.5) * tile_size, (y + 0.5) * tile_size));
+					tile.start = s;
+					tile.end = s;
+					tiles[key] = tile;
+				}
+			}
+		}
+	}
+
+	std::vector<StreamTile> plan;
+	plan.reserve(tiles.size());
+	for (auto it = tiles.begin(); it != tiles.end(); it++) plan.push_back(it->second);
+	std::sort(plan.begin(), plan.end(), [](const StreamTile& a, const StreamTile& b) { return a.start < b.start || (a.start == b.start && a.key < b.key); });
+
+	{
+		std::lock_guard<std::mutex> lock(m_stream_mutex);
+		m_stream_route.swap(points);
+		m_stream_route_dist.swap(dists);
+		m_stream_plan.swap(plan);
+		m_stream_progress = 0;
+		m_stream_tile_size = tile_size;
+		m_stream_lookahead = lookahead;
+		m_stream_max_tiles = static_cast<size_t>(max_tiles);
+		m_stream_stop = false;
+		m_stream_dirty = true;
+		m_stream_thread = std::thread(&MapManager::runMapStreaming, this);
+	}
+
+	return true;
+}
+
+bool MapManager::updateMapStreaming(const LatLon& latlon)
+{
+	Point2 p = m_stream_utm.toMetric(latlon);
+	{
+		std::lock_guard<std::mutex> lock(m_stream_mutex);
+		if (!m_stream_thread.joinable() || m_stream_route.empty()) return false;
+
+		// Project the position onto the nearest route segment
+		double best_dist2 = DBL_MAX, best_s = 0;
+		for (size_t i = 0; i + 1 < m_stream_route.size(); i++)
+		{
+			Point2 delta = m_stream_route[i + 1] - m_stream_route[i];
+			double length2 = delta.dot(delta);
+			double t = (length2 > 0) ? std::min(std::max((p - m_stream_route[i]).dot(delta) / length2, 0.0), 1.0) : 0;
+			Point2 error = p - (m_stream_route[i] + t * delta);
+			double dist2 = error.dot(error);
+			if (dist2 < best_dist2)
+			{
+				best_dist2 = dist2;
+				best_s = m_stream_route_dist[i] + t * sqrt(length2);
+			}
+		}
+		m_stream_progress = best_s;
+		m_stream_dirty = true;
+	}
+	m_stream_wake.notify_one();
+
+	return true;
+}
+
+std::shared_ptr<const Map> MapManager::getStreamedMap()
+{
+	std::lock_guard<std::mutex> lock(m_stream_mutex);
+	return m_stream_map;
+}
+
+size_t MapManager::countStreamedTiles()
+{
+	std::lock_guard<std::mutex> lock(m_stream_mutex);
+	return m_stream_tiles.size();
+}
+
+void MapManager::stopMapStreaming()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_stream_mutex);
+		m_stream_stop = true;
+		m_stream_generation++;
+	}
+	m_stream_wake.notify_all();
+	if (m_stream_thread.joinable()) m_stream_thread.join();
+
+	std::unordered_map<uint64, ID> pending;
+	{
+		std::lock_guard<std::mutex> lock(m_stream_mutex);
+		pending.swap(m_stream_pending);
+		m_stream_tiles.clear();
+		m_stream_plan.clear();
+		m_stream_route.clear();
+		m_stream_route_dist.clear();
+		m_stream_map.reset();
+		m_stream_changed = false;
+	}
+	for (auto it = pending.begin(); it != pending.end(); it++) cancelAsync(it->second);
+}
+
+ID MapManager::requestStreamTile(const StreamTile& tile)
+{
+	// A circle which contains the square tile
+	const std::string url_middle = ":21500/wgs/";
+	double radius = m_stream_tile_size * sqrt(0.5) + 1;
+	std::string url = "http://" + m_ip + url_middle + std::to_string(tile.center.lat) + "/" + std::to_string(tile.center.lon) + "/" + std::to_string(radius);
+
+	const uint64 key = tile.key, generation = m_stream_generation;
+	return submitAsync(url, 10, [this, key, generation](bool ok, std::vector<uchar>& response)
+	{
+		// Parse the tile before the lock not to block the streaming thread
+		std::shared_ptr<MapTile> parsed;
+		if (ok)
+		{
+			response.push_back('\0');
+			parsed = std::make_shared<MapTile>();
+			if (!parseMap(reinterpret_cast<char*>(response.data()), *parsed)) parsed.reset();
+		}
+		{
+			std::lock_guard<std::mutex> lock(m_stream_mutex);
+			if (generation != m_stream_generation) return;
+			auto found = m_stream_pending.find(key);
+			if (found == m_stream_pending.end()) return; // Already evicted
+			m_stream_pending.erase(found);
+			if (parsed == nullptr) return; // It is requested again at the next update
+			m_stream_tiles[key] = parsed;
+			m_stream_changed = true;
+			m_stream_dirty = true;
+		}
+		m_stream_wake.notify_one();
+	});
+}
+
+void MapManager::runMapStreaming()
+{
+	std::unique_lock<std::mutex> lock(m_stream_mutex);
+	while (true)
+	{
+		while (!m_stream_stop && !m_stream_dirty) m_stream_wake.wait(lock);
+		if (m_stream_stop) break;
+		m_stream_dirty = false;
+
+		// Select tiles from the current position to the lookahead distance along the route
+		std::vector<const StreamTile*> wanted;
+		std::set<uint64> wanted_keys;
+		for (auto tile = m_stream_plan.begin(); tile != m_stream_plan.end() && wanted.size() < m_stream_max_tiles; tile++)
+		{
+			if (tile->start > m_stream_progress + m_stream_lookahead) break;
+			if (tile->end < m_stream_progress - m_stream_tile_size) continue;
+			wanted.push_back(&(*tile));
+			wanted_keys.insert(tile->key);
+		}
+
+		// Evict tiles out of the selection and cancel their requests
+		for (auto tile = m_stream_tiles.begin(); tile != m_stream_tiles.end();)
+		{
+			if (wanted_keys.count(tile->first) > 0) tile++;
+			else
+			{
+				tile = m_stream_tiles.erase(tile);
+				m_stream_changed = true;
+			}
+		}
+		for (auto request = m_stream_pending.begin(); request != m_stream_pending.end();)
+		{
+			if (wanted_keys.count(request->first) > 0) request++;
+			else
+			{
+				cancelAsync(request->second);
+				request = m_stream_pending.erase(request);
+			}
+		}
+
+		// Request missing tiles from the nearest one
+		for (auto tile = wanted.begin(); tile != wanted.end(); tile++)
+		{
+			if (m_stream_tiles.count((*tile)->key) > 0 || m_stream_pending.count((*tile)->key) > 0) continue;
+			ID id = requestStreamTile(**tile);
+			if (id != 0) m_stream_pending[(*tile)->key] = id;
+		}
+
+		// Merge tiles into a new map without the lock, so readers keep the previous map meanwhile
+		if (m_stream_changed)
+		{
+			m_stream_changed = false;
+			std::vector<std::shared_ptr<const MapTile>> tiles;
+			for (auto tile = wanted.begin(); tile != wanted.end(); tile++)
+			{
+				auto found = m_stream_tiles.find((*tile)->key);
+				if (found != m_stream_tiles.end()) tiles.push_back(found->second);
+			}
+			lock.unlock();
+			std::vector<const MapTile*> merging;
+			for (auto tile = tiles.begin(); tile != tiles.end(); tile++) merging.push_back(tile->get());
+			std::shared_ptr<Map> map = std::make_shared<Map>();
+			buildMap(merging, *map);
+			lock.lock();
+			if (!m_stream_stop) m_stream_map = map;
+		}
+	}
+}
+
 } // End of 'dg'
 
@@ -2,12 +2,21 @@
 #define __SIMPLE_MAP_MANAGER__
 
 #include "dg_core.hpp"
+#include "poi_index.hpp"
 
 // rapidjson header files
 #include "rapidjson/document.h" 
 #include "rapidjson/stringbuffer.h"
 #include "rapidjson/prettywriter.h"
 #include <fstream>
+#include <mutex>
+#include <thread>
+#include <future>
+#include <functional>
+#include <condition_variable>
+#include <deque>
+#include <set>
+#include <unordered_map>
 using namespace rapidjson;
 
 #define CURL_STATICLIB
@@ -28,11 +37,37 @@ using namespace rapidjson;
 #include <atlstr.h> 
 #endif
 #include "localizer/utm_converter.hpp"
+#include "map_manager/response_cache.hpp"
+#include "map_manager/image_cache.hpp"
 #define M_PI 3.14159265358979323846
 
 namespace dg
 {
 
+class EdgeTemp : public Edge
+{
+public:
+	//ID id;
+	std::vector<ID> node_ids;
+};
+
+/**
+ * @brief A piece of the topological map
+ *
+ * A <b>map tile</b> keeps nodes and edges as given by the server, so edges across tiles are connected when tiles are merged.
+ */
+struct MapTile
+{
+	/** The nodes without their edges */
+	std::vector<Node> nodes;
+
+	/** The edge IDs of each node given by the server */
+	std::vector<std::vector<ID>> node_edges;
+
+	/** The edges without their nodes */
+	std::vector<EdgeTemp> edges;
+};
+
 /**
  * @brief Simple map manager
  *
@@ -52,6 +87,19 @@ public:
 		m_isMap = false;
 		m_ip = "localhost";
 		m_portErr = false;
+		m_curl = nullptr;
+		m_multi = nullptr;
+		m_async_stop = false;
+		m_async_next_id = 1;
+		m_stream_stop = false;
+		m_stream_dirty = false;
+		m_stream_changed = false;
+		m_stream_generation = 0;
+		m_stream_progress = 0;
+		m_stream_tile_size = 200;
+		m_stream_lookahead = 600;
+		m_stream_max_tiles = 32;
+		initCurlGlobal();
 	}
 
 	/**
@@ -59,11 +107,18 @@ public:
 	 */
 	~MapManager()
 	{
+		stopMapStreaming();
+		stopAsync();
 		if (m_isMap)
 		{
 			delete m_map;
 			m_isMap = false;
 		}
+		if (m_curl != nullptr)
+		{
+			curl_easy_cleanup(m_curl);
+			m_curl = nullptr;
+		}
 	}
 
 	/**
@@ -85,6 +140,38 @@ public:
 	 */
 	std::string getIP();
 
+	/**
+	 * Store responses of the server in the given directory and reuse them<br>
+	 *  A fresh response is served without network, and a stale one is revalidated with the server or served when the server is not reachable.
+	 * @param dir The directory to store responses (an empty string to stop caching)
+	 * @param ttl The time-to-live of responses (Unit: [sec]) (default: 86400)
+	 * @param max_bytes The maximum total size of responses (Unit: [byte]) (default: 1 GB)
+	 * @return True if successful (false if failed)
+	 */
+	bool setCacheDir(const std::string& dir, double ttl = 86400, size_t max_bytes = 1024 * 1024 * 1024);
+
+	/**
+	 * Get the disk cache of server responses
+	 * @return A reference to the disk cache
+	 */
+	ResponseCache& getCache();
+
+	/**
+	 * Store StreetView images in the given directory and reuse them<br>
+	 *  Encoded images are kept apart from other responses, so large images do not evict maps and paths.
+	 * @param dir The directory to store images (an empty string to stop caching)
+	 * @param ttl The time-to-live of images (Unit: [sec]) (default: 30 days)
+	 * @param max_bytes The maximum total size of images (Unit: [byte]) (default: 1 GB)
+	 * @return True if successful (false if failed)
+	 */
+	bool setImageCacheDir(const std::string& dir, double ttl = 30 * 86400, size_t max_bytes = 1024 * 1024 * 1024);
+
+	/**
+	 * Get the memory cache of decoded StreetView images (e.g. to change its size)
+	 * @return A reference to the memory cache
+	 */
+	ImageCache& getImageCache();
+
 	/**
 	 * Get the topological map within a certain radius based on latitude and longitude
 	 * @param lat The given latitude of this topological map (Unit: [deg])
@@ -167,6 +254,18 @@ public:
 	 * @return True if successful (false if failed)
 	 */
 	bool getPath_expansion(double start_lat, double start_lon, double dest_lat, double dest_lon, Path& path, int num_paths = 2);
+
+	/**
+	 * Get the path without downloading its map (the map along the path is supposed to be streamed by startMapStreaming())
+	 * @param start_lat The given origin latitude of this path (Unit: [deg])
+	 * @param start_lon The given origin longitude of this path (Unit: [deg])
+	 * @param dest_lat The given destination latitude of this path (Unit: [deg])
+	 * @param dest_lon The given destination longitude of this path (Unit: [deg])
+	 * @param path A reference to gotten path
+	 * @param num_paths The number of paths requested (default: 2)
+	 * @return True if successful (false if failed)
+	 */
+	bool getPath_streaming(double start_lat, double start_lon, double dest_lat, double dest_lon, Path& path, int num_paths = 2);
 	
 	/**
 	 * Read the path from the given file
@@ -254,7 +353,7 @@ public:
 	/**
 	 * Get the POIs corresponding to a certain POI name
 	 * @param poi_name The given POI name of this POI
-	 * @return A vector of gotten POIs
+	 * @return A vector of gotten POIs (all POIs with the name)
 	 */
 	std::vector<POI> getPOI(const std::string poi_name);
 
@@ -266,6 +365,31 @@ public:
 	 */
 	std::vector<POI> getPOI_sorting(const std::string poi_name, LatLon cur_latlon);
 
+	/**
+	 * Get the POIs whose names start with a certain prefix (case and white spaces are ignored)
+	 * @param poi_prefix The given prefix of POI names
+	 * @param latlon The given latitude and longitude of the search center (Unit: [deg])
+	 * @param radius The given radius of the search area (Unit: [m])
+	 * @return A vector of gotten POIs
+	 */
+	std::vector<POI> getPOI_prefix(const std::string poi_prefix, LatLon latlon, double radius);
+
+	/**
+	 * Get the POIs whose names are similar to a certain name (e.g. a noisy OCR result)
+	 * @param poi_name The given name to match
+	 * @param latlon The given latitude and longitude of the search center (Unit: [deg])
+	 * @param radius The given radius of the search area (Unit: [m])
+	 * @param max_edits The maximum edit distance between names (negative for a third of the name length)
+	 * @return A vector of gotten POIs (Sort in order from the most similar one, and from the nearest one for the same similarity)
+	 */
+	std::vector<POI> getPOI_similar(const std::string poi_name, LatLon latlon, double radius, int max_edits = -1);
+
+	/**
+	 * Get the in-memory index of all POIs loaded at initialization
+	 * @return A reference to the POI index
+	 */
+	const POIIndex& getPOIIndex() const;
+
 	/**
 	 * Get the StreetViews within a certain radius based on latitude and longitude
 	 * @param lat The given latitude of these StreetViews (Unit: [deg])
@@ -322,9 +446,199 @@ public:
 	 * @param sv_image A reference to downloaded StreetView image
 	 * @param cubic The face of an image cube - 360: "", front: "f", back: "b", left: "l", right: "r", up: "u", down: "d" (default: "")
 	 * @param timeout The timeout value of curl (default: 10)
+	 * @param target_size The smallest size needed by the caller (default: an empty size for the full resolution)<br>
+	 *  A JPEG image is decoded at the lowest resolution (1/2, 1/4, or 1/8) which is not smaller than it.
+	 * @return True if successful (false if failed)
+	 */
+	bool getStreetViewImage(ID sv_id, cv::Mat& sv_image, std::string cubic = "", int timeout = 10, const cv::Size& target_size = cv::Size());
+
+	/**
+	 * Get the topological map within a certain radius based on latitude and longitude without blocking
+	 * @param lat The given latitude of this topological map (Unit: [deg])
+	 * @param lon The given longitude of this topological map (Unit: [deg])
+	 * @param radius The given radius of this topological map (Unit: [m])
+	 * @param callback A function to receive the result (it is called on the background thread)
+	 * @param timeout The timeout value of curl (default: 10)
+	 * @return The ID of this request (0 if failed)
+	 */
+	ID getMapAsync(double lat, double lon, double radius, std::function<void(bool ok, Map& map)> callback, int timeout = 10);
+
+	/**
+	 * Get the topological map within a certain radius based on latitude and longitude without blocking
+	 * @param lat The given latitude of this topological map (Unit: [deg])
+	 * @param lon The given longitude of this topological map (Unit: [deg])
+	 * @param radius The given radius of this topological map (Unit: [m])
+	 * @param timeout The timeout value of curl (default: 10)
+	 * @param request_id A pointer to receive the ID of this request (default: nullptr)
+	 * @return A future of the topological map (an empty map if failed or canceled)
+	 */
+	std::future<Map> getMapAsync(double lat, double lon, double radius, int timeout = 10, ID* request_id = nullptr);
+
+	/**
+	 * Get the path from the origin to the destination without blocking<br>
+	 *  Different from getPath(), the topological map along the path is not downloaded.
+	 * @param start_lat The given origin latitude of this path (Unit: [deg])
+	 * @param start_lon The given origin longitude of this path (Unit: [deg])
+	 * @param dest_lat The given destination latitude of this path (Unit: [deg])
+	 * @param dest_lon The given destination longitude of this path (Unit: [deg])
+	 * @param callback A function to receive the result (it is called on the background thread)
+	 * @param num_paths The number of paths requested (default: 2)
+	 * @param timeout The timeout value of curl (default: 10)
+	 * @return The ID of this request (0 if failed)
+	 */
+	ID getPathAsync(double start_lat, double start_lon, double dest_lat, double dest_lon, std::function<void(bool ok, Path& path)> callback, int num_paths = 2, int timeout = 10);
+
+	/**
+	 * Get the path from the origin to the destination without blocking<br>
+	 *  Different from getPath(), the topological map along the path is not downloaded.
+	 * @param start_lat The given origin latitude of this path (Unit: [deg])
+	 * @param start_lon The given origin longitude of this path (Unit: [deg])
+	 * @param dest_lat The given destination latitude of this path (Unit: [deg])
+	 * @param dest_lon The given destination longitude of this path (Unit: [deg])
+	 * @param num_paths The number of paths requested (default: 2)
+	 * @param timeout The timeout value of curl (default: 10)
+	 * @param request_id A pointer to receive the ID of this request (default: nullptr)
+	 * @return A future of the path (an empty path if failed or canceled)
+	 */
+	std::future<Path> getPathAsync(double start_lat, double start_lon, double dest_lat, double dest_lon, int num_paths = 2, int timeout = 10, ID* request_id = nullptr);
+
+	/**
+	 * Get the POIs within a certain radius based on latitude and longitude without blocking
+	 * @param lat The given latitude of these POIs (Unit: [deg])
+	 * @param lon The given longitude of these POIs (Unit: [deg])
+	 * @param radius The given radius of these POIs (Unit: [m])
+	 * @param callback A function to receive the result (it is called on the background thread)
+	 * @param timeout The timeout value of curl (default: 10)
+	 * @return The ID of this request (0 if failed)
+	 */
+	ID getPOIAsync(double lat, double lon, double radius, std::function<void(bool ok, std::vector<POI>& poi_vec)> callback, int timeout = 10);
+
+	/**
+	 * Get the POIs within a certain radius based on latitude and longitude without blocking
+	 * @param lat The given latitude of these POIs (Unit: [deg])
+	 * @param lon The given longitude of these POIs (Unit: [deg])
+	 * @param radius The given radius of these POIs (Unit: [m])
+	 * @param timeout The timeout value of curl (default: 10)
+	 * @param request_id A pointer to receive the ID of this request (default: nullptr)
+	 * @return A future of the POIs vector (an empty vector if failed or canceled)
+	 */
+	std::future<std::vector<POI>> getPOIAsync(double lat, double lon, double radius, int timeout = 10, ID* request_id = nullptr);
+
+	/**
+	 * Get the StreetViews within a certain radius based on latitude and longitude without blocking
+	 * @param lat The given latitude of these StreetViews (Unit: [deg])
+	 * @param lon The given longitude of these StreetViews (Unit: [deg])
+	 * @param radius The given radius of these StreetViews (Unit: [m])
+	 * @param callback A function to receive the result (it is called on the background thread)
+	 * @param timeout The timeout value of curl (default: 10)
+	 * @return The ID of this request (0 if failed)
+	 */
+	ID getStreetViewAsync(double lat, double lon, double radius, std::function<void(bool ok, std::vector<StreetView>& sv_vec)> callback, int timeout = 10);
+
+	/**
+	 * Get the StreetViews within a certain radius based on latitude and longitude without blocking
+	 * @param lat The given latitude of these StreetViews (Unit: [deg])
+	 * @param lon The given longitude of these StreetViews (Unit: [deg])
+	 * @param radius The given radius of these StreetViews (Unit: [m])
+	 * @param timeout The timeout value of curl (default: 10)
+	 * @param request_id A pointer to receive the ID of this request (default: nullptr)
+	 * @return A future of the StreetViews vector (an empty vector if failed or canceled)
+	 */
+	std::future<std::vector<StreetView>> getStreetViewAsync(double lat, double lon, double radius, int timeout = 10, ID* request_id = nullptr);
+
+	/**
+	 * Download the StreetView image corresponding to a certain StreetView ID without blocking
+	 * @param sv_id The given StreetView ID of this StreetView image
+	 * @param callback A function to receive the result (it is called on the background thread)
+	 * @param cubic The face of an image cube - 360: "", front: "f", back: "b", left: "l", right: "r", up: "u", down: "d" (default: "")
+	 * @param timeout The timeout value of curl (default: 10)
+	 * @param target_size The smallest size needed by the caller (default: an empty size for the full resolution)<br>
+	 *  A JPEG image is decoded at the lowest resolution (1/2, 1/4, or 1/8) which is not smaller than it.
+	 * @return The ID of this request (0 if failed)
+	 */
+	ID getStreetViewImageAsync(ID sv_id, std::function<void(bool ok, cv::Mat& sv_image)> callback, std::string cubic = "", int timeout = 10, const cv::Size& target_size = cv::Size());
+
+	/**
+	 * Download the StreetView image corresponding to a certain StreetView ID without blocking
+	 * @param sv_id The given StreetView ID of this StreetView image
+	 * @param cubic The face of an image cube - 360: "", front: "f", back: "b", left: "l", right: "r", up: "u", down: "d" (default: "")
+	 * @param timeout The timeout value of curl (default: 10)
+	 * @param request_id A pointer to receive the ID of this request (default: nullptr)
+	 * @param target_size The smallest size needed by the caller (default: an empty size for the full resolution)<br>
+	 *  A JPEG image is decoded at the lowest resolution (1/2, 1/4, or 1/8) which is not smaller than it.
+	 * @return A future of the StreetView image (an empty image if failed or canceled)
+	 */
+	std::future<cv::Mat> getStreetViewImageAsync(ID sv_id, std::string cubic = "", int timeout = 10, ID* request_id = nullptr, const cv::Size& target_size = cv::Size());
+
+	/**
+	 * Download the images of StreetViews near the given position into the caches without blocking<br>
+	 *  The faces of the nearest StreetViews are requested in parallel, and the images already cached or in transfer are skipped.
+	 * @param latlon The current position
+	 * @param radius The radius to find StreetViews (Unit: [m]) (default: 30)
+	 * @param max_views The maximum number of StreetViews to prefetch (default: 4)
+	 * @param faces The faces of an image cube to prefetch (default: "fblrud")
+	 * @param timeout The timeout value of curl (default: 10)
+	 * @param target_size The smallest size of images to decode (default: an empty size for the full resolution)
+	 * @return The ID of the request to find StreetViews (0 if failed)
+	 */
+	ID prefetchStreetViewImages(const LatLon& latlon, double radius = 30, int max_views = 4, const std::string& faces = "fblrud", int timeout = 10, const cv::Size& target_size = cv::Size());
+
+	/**
+	 * Cancel an asynchronous request<br>
+	 *  Its callback is called with failure (or its future receives an empty result).
+	 * @param request_id The ID of the request to cancel
+	 * @return True if successful (false if failed)
+	 */
+	bool cancelAsync(ID request_id);
+
+	/**
+	 * Start to stream the map along the given path<br>
+	 *  The route buffer is split into square tiles, and tiles ahead of the current position are downloaded on a background thread.
+	 *  Tiles behind the current position are evicted, so the streamed map keeps at most the given number of tiles.
+	 * @param path The path to follow (its nodes should be given by getPath())
+	 * @param corridor The half width of the route buffer (Unit: [m])
+	 * @param tile_size The side length of each tile (Unit: [m])
+	 * @param lookahead The distance along the path to prefetch tiles (Unit: [m])
+	 * @param max_tiles The maximum number of tiles to keep
+	 * @return True if successful (false if failed)
+	 */
+	bool startMapStreaming(const Path& path, double corridor = 50, double tile_size = 200, double lookahead = 600, int max_tiles = 32);
+
+	/**
+	 * Start to stream the map along the given route
+	 * @param route The points of the route to follow
+	 * @param corridor The half width of the route buffer (Unit: [m])
+	 * @param tile_size The side length of each tile (Unit: [m])
+	 * @param lookahead The distance along the route to prefetch tiles (Unit: [m])
+	 * @param max_tiles The maximum number of tiles to keep
 	 * @return True if successful (false if failed)
 	 */
-	bool getStreetViewImage(ID sv_id, cv::Mat& sv_image, std::string cubic = "", int timeout = 10);
+	bool startMapStreaming(const std::vector<LatLon>& route, double corridor = 50, double tile_size = 200, double lookahead = 600, int max_tiles = 32);
+
+	/**
+	 * Update the current position to stream the map (it returns immediately)
+	 * @param latlon The current position
+	 * @return True if successful (false if not streaming)
+	 */
+	bool updateMapStreaming(const LatLon& latlon);
+
+	/**
+	 * Get the latest streamed map<br>
+	 *  The returned map is not modified anymore, and a new map is published whenever tiles are added or evicted.
+	 * @return A pointer to the streamed map (nullptr if no tile is received yet)
+	 */
+	std::shared_ptr<const Map> getStreamedMap();
+
+	/**
+	 * Get the number of tiles in the streamed map
+	 * @return The number of received tiles
+	 */
+	size_t countStreamedTiles();
+
+	/**
+	 * Stop streaming the map and release its tiles
+	 */
+	void stopMapStreaming();
 
 protected:
 	Map* m_map;
@@ -332,8 +646,8 @@ protected:
 	std::string m_json;
 	/** A hash table for finding Path points */
 	std::map<ID, LatLon> lookup_path;
-	/** A hash table for finding POIs by name */
-	std::map<std::wstring, LatLon> lookup_pois_name;
+	/** An in-memory index of all POIs loaded at initialization */
+	POIIndex m_poi_index;
 	///** A hash table for finding POIs by ID */
 	//std::map<ID, LatLon> lookup_pois_id;
 	///** A hash table for finding StreetViews */
@@ -355,6 +669,67 @@ protected:
 	 * @return The size of total data
 	 */
 	static size_t write_callback(void* ptr, size_t size, size_t count, void* stream);
+
+	/**
+	 * Initialize curl once for the whole process (it is cleaned up at exit)
+	 * @return True if successful (false if failed)
+	 */
+	static bool initCurlGlobal();
+
+	/**
+	 * Get the persistent curl handle of this map manager with its options reset
+	 * @return A pointer to the curl handle (nullptr if failed)
+	 * @note The handle keeps its connections alive, so following requests to the same server reuse them.
+	 *  The caller should hold m_curl_mutex while using the handle.
+	 */
+	CURL* getCurl();
+
+	/**
+	 * Callback function for response headers from server
+	 * @param ptr A pointer to a header line
+	 * @param size The size of a single data
+	 * @param nmemb The number of data
+	 * @param userdata A pointer to CachedResponse to receive its validators
+	 * @return The size of total data
+	 */
+	static size_t header_callback(char* ptr, size_t size, size_t nmemb, void* userdata);
+
+	/**
+	 * Make request headers to revalidate a cached response
+	 * @param cached The cached response
+	 * @return A list of request headers (nullptr if the response has no validator)
+	 */
+	static curl_slist* makeValidatorHeaders(const CachedResponse& cached);
+
+	/**
+	 * Check whether a received response is worth caching
+	 * @param response The received response
+	 * @return True if it has results (false if it is an error message, an empty result, or an incomplete JSON)
+	 */
+	static bool isValidResponse(const std::vector<uchar>& response);
+
+	/**
+	 * Reflect a finished request to the disk cache
+	 * @param cache The disk cache of the request
+	 * @param url A web address of the request
+	 * @param ok A flag whether the transfer is successful
+	 * @param code The HTTP response code
+	 * @param response A reference to the received response (replaced with the cached one if it is not modified or the server is not reachable)
+	 * @param cached The cached response before the request (its key is empty if not cached)
+	 * @param received The validators of the received response
+	 * @return True if a response is available (false if not)
+	 */
+	bool updateCache(ResponseCache& cache, const std::string& url, bool ok, long code, std::vector<uchar>& response, CachedResponse& cached, const CachedResponse& received);
+
+	/**
+	 * Request to server through the disk cache and receive response
+	 * @param url A web address to request to the server
+	 * @param response A reference to the received response
+	 * @param timeout The timeout value of curl (0 for no timeout)
+	 * @param cache A pointer to the disk cache (default: nullptr for the cache of server responses)
+	 * @return True if successful (false if failed)
+	 */
+	bool request2server(const std::string& url, std::vector<uchar>& response, int timeout, ResponseCache* cache = nullptr);
 		
 	/**
 	 * Request to server and receive response
@@ -398,11 +773,27 @@ protected:
 	bool downloadMap(cv::Point2i tile);
 
 	/**
-	 * Parse the topological map response received
-	 * @param json A response received
+	 * Parse the topological map response received (it is parsed in situ without building its DOM)
+	 * @param json A response received (it is modified by parsing)
+	 * @param map A reference to the topological map to fill
 	 * @return True if successful (false if failed)
 	 */
-	bool parseMap(const char* json);
+	bool parseMap(char* json, Map& map);
+
+	/**
+	 * Parse a map tile (the given string is parsed in situ, so it is modified)
+	 * @param json A JSON string to parse
+	 * @param tile A reference to the parsed tile
+	 * @return True if successful (false if failed)
+	 */
+	bool parseMap(char* json, MapTile& tile);
+
+	/**
+	 * Merge map tiles into a map (nodes and edges shared by tiles are added once)
+	 * @param tiles The tiles to merge
+	 * @param map A reference to the merged map
+	 */
+	static void buildMap(const std::vector<const MapTile*>& tiles, Map& map);
 
 	/**
 	 * Request the path from the origin to the destination to server and receive response
@@ -416,13 +807,26 @@ protected:
 	bool downloadPath(double start_lat, double start_lon, double dest_lat, double dest_lon, int num_paths = 2);
 
 	/**
-	 * Parse the path response received
-	 * @param json A response received
+	 * Parse the path response received (it is parsed in situ without building its DOM)
+	 * @param json A response received (it is modified by parsing)
+	 * @param path A reference to the path to fill
+	 * @param lookup A reference to the hash table to fill with path points
 	 * @return True if successful (false if failed)
 	 */
-	bool parsePath(const char* json);
+	bool parsePath(char* json, Path& path, std::map<ID, LatLon>& lookup);
 	
 
+	/**
+	 * Receive the path only (the received path is kept in m_path and the positions of its nodes in lookup_path)
+	 * @param start_lat The given origin latitude of this path (Unit: [deg])
+	 * @param start_lon The given origin longitude of this path (Unit: [deg])
+	 * @param dest_lat The given destination latitude of this path (Unit: [deg])
+	 * @param dest_lon The given destination longitude of this path (Unit: [deg])
+	 * @param num_paths The number of paths requested (default: 2)
+	 * @return True if successful (false if failed)
+	 */
+	bool receivePath(double start_lat, double start_lon, double dest_lat, double dest_lon, int num_paths = 2);
+
 	/**
 	 * Receive the topological map including an incomplete path and completely rebuild the path
 	 * @param start_lat The given origin latitude of this path (Unit: [deg])
@@ -478,11 +882,12 @@ protected:
 	bool downloadPOI_poi(ID poi_id, double radius);
 
 	/**
-	 * Parse the POIs response received
-	 * @param json A response received
+	 * Parse the POIs response received (it is parsed in situ without building its DOM)
+	 * @param json A response received (it is modified by parsing)
+	 * @param map A reference to the topological map to fill with POIs
 	 * @return True if successful (false if failed)
 	 */
-	bool parsePOI(const char* json);
+	bool parsePOI(char* json, Map& map);
 
 	/**
 	 * Request the StreetViews within a certain radius based on latitude and longitude to server and receive response
@@ -517,11 +922,12 @@ protected:
 	bool downloadStreetView_sv(ID sv_id, double radius);
 
 	/**
-	 * Parse the StreetViews response received
-	 * @param json A response received
+	 * Parse the StreetViews response received (it is parsed in situ without building its DOM)
+	 * @param json A response received (it is modified by parsing)
+	 * @param map A reference to the topological map to fill with StreetViews
 	 * @return True if successful (false if failed)
 	 */
-	bool parseStreetView(const char* json);
+	bool parseStreetView(char* json, Map& map);
 
 	/**
 	 * Callback function for request to server
@@ -537,9 +943,10 @@ protected:
 	 * Request an image to server and download it
 	 * @param url A web address to request to the server
 	 * @param timeout The timeout value of curl (default: 10)
+	 * @param target_size The smallest size of the image to decode (default: an empty size for the full resolution)
 	 * @return The downloaded image
 	 */
-	cv::Mat queryImage2server(std::string url, int timeout = 10);
+	cv::Mat queryImage2server(std::string url, int timeout = 10, const cv::Size& target_size = cv::Size());
 
 	/**
 	 * Download the StreetView image corresponding to a certain StreetView ID
@@ -547,9 +954,174 @@ protected:
 	 * @param cubic The face of an image cube - 360: "", front: "f", back: "b", left: "l", right: "r", up: "u", down: "d" (default: "")
 	 * @param timeout The timeout value of curl (default: 10)
 	 * @param url_middle The web port number to request to the server (default: ":10000/")
+	 * @param target_size The smallest size of the image to decode (default: an empty size for the full resolution)
 	 * @return The downloaded image
 	 */
-	cv::Mat downloadStreetViewImage(ID sv_id, const std::string cubic = "", int timeout = 10, const std::string url_middle = ":10000/");
+	cv::Mat downloadStreetViewImage(ID sv_id, const std::string cubic = "", int timeout = 10, const std::string url_middle = ":10000/", const cv::Size& target_size = cv::Size());
+
+	/**
+	 * Decode an image at the lowest resolution which is not smaller than the given size<br>
+	 *  A JPEG image is reduced in its DCT domain (1/2, 1/4, or 1/8) as a color image, so its decoding time and memory decrease together.
+	 * @param data The encoded image
+	 * @param target_size The smallest size of the image (an empty size for the full resolution)
+	 * @return The decoded image (an empty image if failed)
+	 */
+	static cv::Mat decodeImage(const std::vector<uchar>& data, const cv::Size& target_size);
+
+	/**
+	 * Get the key of a StreetView image for the memory cache (each resolution has its own key)
+	 * @param sv_id The given StreetView ID of this StreetView image
+	 * @param cubic The face of an image cube
+	 * @param target_size The smallest size of the image (default: an empty size for the full resolution)
+	 * @return The key of the image
+	 */
+	static std::string getStreetViewImageKey(ID sv_id, const std::string& cubic, const cv::Size& target_size = cv::Size());
+
+	/**
+	 * An asynchronous request on the background thread
+	 */
+	struct AsyncRequest
+	{
+		/** The ID of this request */
+		ID id = 0;
+		/** A web address to request to the server */
+		std::string url;
+		/** The timeout value of curl */
+		int timeout = 10;
+		/** The received response */
+		std::vector<uchar> response;
+		/** A function to process the response (it is called on the background thread) */
+		std::function<void(bool ok, std::vector<uchar>& response)> done;
+		/** The cached response before the request */
+		CachedResponse cached;
+		/** The validators of the received response */
+		CachedResponse received;
+		/** The disk cache of this request (nullptr for the cache of server responses) */
+		ResponseCache* cache = nullptr;
+		/** Request headers to revalidate the cached response */
+		curl_slist* headers = nullptr;
+
+		~AsyncRequest() { if (headers != nullptr) curl_slist_free_all(headers); }
+	};
+
+	/**
+	 * Add an asynchronous request to the background thread
+	 * @param url A web address to request to the server (an empty string to finish without transfer, e.g. a result found in memory)
+	 * @param timeout The timeout value of curl
+	 * @param done A function to process the response
+	 * @param id The ID of this request (0 for a new ID)
+	 * @param cache A pointer to the disk cache (default: nullptr for the cache of server responses)
+	 * @return The ID of this request (0 if failed)
+	 */
+	ID submitAsync(const std::string& url, int timeout, std::function<void(bool ok, std::vector<uchar>& response)> done, ID id = 0, ResponseCache* cache = nullptr);
+
+	/**
+	 * Run transfers of asynchronous requests using curl_multi (the background thread)
+	 */
+	void runAsync();
+
+	/**
+	 * Stop the background thread and fail its remaining requests
+	 */
+	void stopAsync();
+
+	/** A curl_multi handle to run asynchronous requests (used only by the background thread) */
+	CURLM* m_multi;
+	/** The background thread for asynchronous requests */
+	std::thread m_async_thread;
+	/** A mutex to protect the following asynchronous request states */
+	std::mutex m_async_mutex;
+	/** A condition to wake up the background thread */
+	std::condition_variable m_async_wake;
+	/** Requests waiting for the background thread */
+	std::deque<std::shared_ptr<AsyncRequest>> m_async_queue;
+	/** The IDs of requests to cancel */
+	std::set<ID> m_async_cancel;
+	/** A flag to stop the background thread */
+	bool m_async_stop;
+	/** The ID of the next request */
+	ID m_async_next_id;
+
+	/** A persistent curl handle to reuse connections */
+	CURL* m_curl;
+	/** A mutex to serialize requests on m_curl */
+	std::mutex m_curl_mutex;
+
+	/** The disk cache of server responses */
+	ResponseCache m_cache;
+
+	/** The disk cache of encoded StreetView images */
+	ResponseCache m_image_cache;
+	/** The memory cache of decoded StreetView images */
+	ImageCache m_image_memory;
+	/** A mutex to protect the keys of prefetching images */
+	std::mutex m_prefetch_mutex;
+	/** The keys of images in transfer for prefetching */
+	std::set<std::string> m_prefetch_keys;
+
+	/**
+	 * A tile in the route buffer
+	 */
+	struct StreamTile
+	{
+		/** The key of this tile made from its grid index */
+		uint64 key;
+		/** The center of this tile */
+		LatLon center;
+		/** The distance along the route where the route buffer enters this tile (Unit: [m]) */
+		double start;
+		/** The distance along the route where the route buffer leaves this tile (Unit: [m]) */
+		double end;
+	};
+
+	/**
+	 * Stream tiles around the current position (the background thread)
+	 */
+	void runMapStreaming();
+
+	/**
+	 * Request a tile to the server
+	 * @param tile The tile to request
+	 * @return The ID of the request (0 if failed)
+	 */
+	ID requestStreamTile(const StreamTile& tile);
+
+	/** The background thread to stream tiles */
+	std::thread m_stream_thread;
+	/** A mutex to protect the following streaming states */
+	std::mutex m_stream_mutex;
+	/** A condition to wake up the streaming thread */
+	std::condition_variable m_stream_wake;
+	/** A flag to stop the streaming thread */
+	bool m_stream_stop;
+	/** A flag whether the streaming thread needs to check its tiles */
+	bool m_stream_dirty;
+	/** A flag whether tiles are changed after the map is merged */
+	bool m_stream_changed;
+	/** The generation of the route to ignore responses of the previous route */
+	uint64 m_stream_generation;
+	/** The route points (Unit: [m]) */
+	std::vector<Point2> m_stream_route;
+	/** The distance along the route of each route point (Unit: [m]) */
+	std::vector<double> m_stream_route_dist;
+	/** The tiles in the route buffer ordered by their start distance */
+	std::vector<StreamTile> m_stream_plan;
+	/** The current distance along the route (Unit: [m]) */
+	double m_stream_progress;
+	/** The side length of each tile (Unit: [m]) */
+	double m_stream_tile_size;
+	/** The distance along the route to prefetch tiles (Unit: [m]) */
+	double m_stream_lookahead;
+	/** The maximum number of tiles to keep */
+	size_t m_stream_max_tiles;
+	/** The received tiles */
+	std::unordered_map<uint64, std::shared_ptr<const MapTile>> m_stream_tiles;
+	/** The requests of tiles in transfer */
+	std::unordered_map<uint64, ID> m_stream_pending;
+	/** The latest merged map */
+	std::shared_ptr<const Map> m_stream_map;
+	/** A converter for the tile grid (its reference is fixed, so tile requests are same for the disk cache) */
+	UTMConverter m_stream_utm;
 
 private:
 	bool m_isMap;
@@ -557,13 +1129,6 @@ private:
 	bool m_portErr;
 };
 
-class EdgeTemp : public Edge
-{
-public:
-	//ID id;
-	std::vector<ID> node_ids;
-};
-
 } // End of 'dg'
 
 #endif // End of '__SIMPLE_MAP_MANAGER__'
@@ -0,0 +1,378 @@
+#include "poi_index.hpp"
+#include <algorithm>
+#include <cwctype>
+
+namespace dg
+{
+
+POIIndex::POIIndex(double cell_size)
+{
+	m_cell_size = (cell_size > 0) ? cell_size : 100;
+}
+
+void POIIndex::build(const std::vector<POI>& pois)
+{
+	clear();
+	m_pois = pois;
+	m_metrics.reserve(m_pois.size());
+	m_ids.reserve(m_pois.size());
+	m_names.reserve(m_pois.size());
+	for (size_t i = 0; i < m_pois.size(); i++)
+	{
+		const POI& poi = m_pois[i];
+		Point2 p = m_converter.toMetric(poi);
+		m_metrics.push_back(p);
+		m_ids.insert(std::make_pair(poi.id, i));
+		m_names.insert(std::make_pair(poi.name, i));
+		m_grid[getCellKey(getCellIndex(p.x), getCellIndex(p.y))].push_back(i);
+
+		// Index the normalized name
+		m_normalized.push_back(normalizeName(poi.name));
+		std::vector<uint64> grams = getBigrams(m_normalized.back());
+		for (auto gram = grams.begin(); gram != grams.end(); gram++) m_bigrams[*gram].push_back(i);
+	}
+
+	m_sorted.resize(m_pois.size());
+	for (size_t i = 0; i < m_sorted.size(); i++) m_sorted[i] = i;
+	std::stable_sort(m_sorted.begin(), m_sorted.end(), [this](size_t a, size_t b) { return m_normalized[a] < m_normalized[b]; });
+}
+
+void POIIndex::clear()
+{
+	m_pois.clear();
+	m_metrics.clear();
+	m_ids.clear();
+	m_names.clear();
+	m_grid.clear();
+	m_normalized.clear();
+	m_sorted.clear();
+	m_bigrams.clear();
+}
+
+bool POIIndex::empty() const
+{
+	return m_pois.empty();
+}
+
+size_t POIIndex::size() const
+{
+	return m_pois.size();
+}
+
+const std::vector<POI>& POIIndex::getPOIs() const
+{
+	return m_pois;
+}
+
+const POI* POIIndex::findPOI(ID id) const
+{
+	auto found = m_ids.find(id);
+	if (found == m_ids.end()) return nullptr;
+	return &m_pois[found->second];
+}
+
+std::vector<const POI*> POIIndex::findByName(const std::wstring& name) const
+{
+	std::vector<size_t> indices;
+	auto range = m_names.equal_range(name);
+	for (auto it = range.first; it != range.second; it++) indices.push_back(it->second);
+	std::sort(indices.begin(), indices.end());
+
+	std::vector<const POI*> pois;
+	pois.reserve(indices.size());
+	for (auto i = indices.begin(); i != indices.end(); i++) pois.push_back(&m_pois[*i]);
+	return pois;
+}
+
+std::vector<const POI*> POIIndex::findByName(const std::wstring& name, const LatLon& center, double radius) const
+{
+	Point2 c = m_converter.toMetric(center);
+	const double radius2 = radius * radius;
+	std::vector<size_t> indices;
+
+	// Check POIs of the name or POIs around the center (whichever is smaller)
+	auto range = m_names.equal_range(name);
+	size_t n_named = std::distance(range.first, range.second);
+	if (n_named <= scanGrid(c, radius, true, nullptr))
+	{
+		for (auto it = range.first; it != range.second; it++)
+		{
+			Point2 d = m_metrics[it->second] - c;
+			if (d.dot(d) <= radius2) indices.push_back(it->second);
+		}
+	}
+	else
+	{
+		std::vector<size_t> nearby;
+		scanGrid(c, radius, false, &nearby);
+		for (auto i = nearby.begin(); i != nearby.end(); i++)
+		{
+			Point2 d = m_metrics[*i] - c;
+			if (d.dot(d) <= radius2 && m_pois[*i].name == name) indices.push_back(*i);
+		}
+	}
+	std::sort(indices.begin(), indices.end());
+
+	std::vector<const POI*> pois;
+	pois.reserve(indices.size());
+	for (auto i = indices.begin(); i != indices.end(); i++) pois.push_back(&m_pois[*i]);
+	return pois;
+}
+
+std::vector<const POI*> POIIndex::findInRadius(const LatLon& center, double radius) const
+{
+	Point2 c = m_converter.toMetric(center);
+	const double radius2 = radius * radius;
+	std::vector<size_t> nearby;
+	scanGrid(c, radius, false, &nearby);
+	std::sort(nearby.begin(), nearby.end());
+
+	std::vector<const POI*> pois;
+	for (auto i = nearby.begin(); i != nearby.end(); i++)
+	{
+		Point2 d = m_metrics[*i] - c;
+		if (d.dot(d) <= radius2) pois.push_back(&m_pois[*i]);
+	}
+	return pois;
+}
+
+std::vector<const POI*> POIIndex::findByPrefix(const std::wstring& prefix) const
+{
+	std::wstring key = normalizeName(prefix);
+	auto lower = std::lower_bound(m_sorted.begin(), m_sorted.end(), key, [this](size_t i, const std::wstring& k) { return m_normalized[i] < k; });
+	std::vector<size_t> indices;
+	for (auto i = lower; i != m_sorted.end() && m_normalized[*i].compare(0, key.size(), key) == 0; i++) indices.push_back(*i);
+	std::sort(indices.begin(), indices.end());
+
+	std::vector<const POI*> pois;
+	pois.reserve(indices.size());
+	for (auto i = indices.begin(); i != indices.end(); i++) pois.push_back(&m_pois[*i]);
+	return pois;
+}
+
+std::vector<const POI*> POIIndex::findByPrefix(const std::wstring& prefix, const LatLon& center, double radius) const
+{
+	Point2 c = m_converter.toMetric(center);
+	const double radius2 = radius * radius;
+	std::vector<const POI*> pois = findByPrefix(prefix);
+	auto last = std::remove_if(pois.begin(), pois.end(), [&](const POI* poi)
+	{
+		Point2 d = m_metrics[poi - m_pois.data()] - c;
+		return d.dot(d) > radius2;
+	});
+	pois.erase(last, pois.end());
+	return pois;
+}
+
+std::vector<POIMatch> POIIndex::findSimilar(const std::wstring& name, int max_edits) const
+{
+	return findSimilar(name, max_edits, nullptr, 0);
+}
+
+std::vector<POIMatch> POIIndex::findSimilar(const std::wstring& name, int max_edits, const LatLon& center, double radius) const
+{
+	Point2 c = m_converter.toMetric(center);
+	return findSimilar(name, max_edits, &c, radius);
+}
+
+std::vector<POIMatch> POIIndex::findSimilar(const std::wstring& name, int max_edits, const Point2* center, double radius) const
+{
+	std::wstring query = normalizeName(name);
+	if (query.empty() || max_edits < 0 || m_pois.empty()) return std::vector<POIMatch>();
+
+	// Count the postings of the query bigrams which a similar name should share at least 'threshold' of
+	std::vector<uint64> grams = getBigrams(query);
+	const int threshold = static_cast<int>(grams.size()) - 2 * max_edits;
+	size_t n_postings = 0;
+	if (threshold > 0)
+	{
+		for (auto gram = grams.begin(); gram != grams.end(); gram++)
+		{
+			auto found = m_bigrams.find(*gram);
+			if (found != m_bigrams.end()) n_postings += found->second.size();
+		}
+	}
+
+	// Collect candidates from the bigrams or the search area (whichever is smaller)
+	std::vector<size_t> candidates;
+	if (center != nullptr && (threshold <= 0 || scanGrid(*center, radius, true, nullptr) < n_postings))
+		scanGrid(*center, radius, false, &candidates);
+	else if (threshold <= 0)
+	{
+		candidates.resize(m_pois.size());
+		for (size_t i = 0; i < candidates.size(); i++) candidates[i] = i;
+	}
+	else
+	{
+		std::vector<size_t> postings;
+		postings.reserve(n_postings);
+		for (auto gram = grams.begin(); gram != grams.end(); gram++)
+		{
+			auto found = m_bigrams.find(*gram);
+			if (found != m_bigrams.end()) postings.insert(postings.end(), found->second.begin(), found->second.end());
+		}
+		std::sort(postings.begin(), postings.end());
+		for (size_t i = 0; i < postings.size();)
+		{
+			size_t j = i + 1;
+			while (j < postings.size() && postings[j] == postings[i]) j++;
+			if (static_cast<int>(j - i) >= threshold) candidates.push_back(postings[i]);
+			i = j;
+		}
+	}
+
+	// Verify the candidates with their distance and edit distance
+	const double radius2 = radius * radius;
+	std::vector<POIMatch> matches;
+	for (auto i = candidates.begin(); i != candidates.end(); i++)
+	{
+		POIMatch match;
+		if (center != nullptr)
+		{
+			Point2 d = m_metrics[*i] - *center;
+			double dist2 = d.dot(d);
+			if (dist2 > radius2) continue;
+			match.distance = sqrt(dist2);
+		}
+		match.edits = getEditDistance(query, m_normalized[*i], max_edits);
+		if (match.edits > max_edits) continue;
+		match.poi = &m_pois[*i];
+		matches.push_back(match);
+	}
+	std::sort(matches.begin(), matches.end(), [](const POIMatch& a, const POIMatch& b)
+	{
+		if (a.edits != b.edits) return a.edits < b.edits;
+		if (a.distance != b.distance) return a.distance < b.distance;
+		return a.poi < b.poi;
+	});
+	return matches;
+}
+
+std::wstring POIIndex::normalizeName(const std::wstring& name)
+{
+	// Hangul jamo and syllables in Unicode
+	const wchar_t L_BASE = 0x1100, V_BASE = 0x1161, T_BASE = 0x11A7, S_BASE = 0xAC00;
+	const int L_COUNT = 19, V_COUNT = 21, T_COUNT = 28, S_COUNT = L_COUNT * V_COUNT * T_COUNT;
+
+	std::wstring normalized;
+	normalized.reserve(name.size());
+	for (auto c = name.begin(); c != name.end(); c++)
+	{
+		wchar_t ch = *c;
+		if (std::iswspace(ch)) continue;
+		if (ch >= L'A' && ch <= L'Z') ch = ch - L'A' + L'a';
+		if (!normalized.empty())
+		{
+			// Compose a leading consonant and a vowel, or a syllable without a trailing consonant and a trailing consonant
+			wchar_t& last = normalized.back();
+			if (last >= L_BASE && last < L_BASE + L_COUNT && ch >= V_BASE && ch < V_BASE + V_COUNT)
+			{
+				last = S_BASE + ((last - L_BASE) * V_COUNT + (ch - V_BASE)) * T_COUNT;
+				continue;
+			}
+			if (last >= S_BASE && last < S_BASE + S_COUNT && (last - S_BASE) % T_COUNT == 0 && ch > T_BASE && ch < T_BASE + T_COUNT)
+			{
+				last += ch - T_BASE;
+				continue;
+			}
+		}
+		normalized.push_back(ch);
+	}
+	return normalized;
+}
+
+int POIIndex::getEditDistance(const std::wstring& a, const std::wstring& b, int max_edits)
+{
+	if (max_edits < 0) max_edits = 0;
+	const int n = static_cast<int>(a.size()), m = static_cast<int>(b.size());
+	const int bound = max_edits + 1;
+	if (std::abs(n - m) > max_edits) return bound;
+	if (n == 0 || m == 0) return std::max(n, m);
+
+	// Fill only the diagonal band whose width is 2 * max_edits + 1
+	std::vector<int> prev(m + 1), curr(m + 1);
+	for (int j = 0; j <= m; j++) prev[j] = std::min(j, bound);
+	for (int i = 1; i <= n; i++)
+	{
+		const int lo = std::max(1, i - max_edits), hi = std::min(m, i + max_edits);
+		curr[0] = std::min(i, bound);
+		curr[lo - 1] = (lo == 1) ? curr[0] : bound;
+		int row_min = curr[lo - 1];
+		for (int j = lo; j <= hi; j++)
+		{
+			int cost = (a[i - 1] == b[j - 1]) ? 0 : 1;
+			curr[j] = std::min(std::min(prev[j] + 1, curr[j - 1] + 1), std::min(prev[j - 1] + cost, bound));
+			row_min = std::min(row_min, curr[j]);
+		}
+		if (hi < m) curr[hi + 1] = bound;
+		if (row_min >= bound) return bound;
+		std::swap(prev, curr);
+	}
+	return std::min(prev[m], bound);
+}
+
+std::vector<uint64> POIIndex::getBigrams(const std::wstring& name)
+{
+	std::vector<uint64> grams;
+	if (name.empty()) return grams;
+	grams.reserve(name.size() + 1);
+	uint32_t prev = 0;
+	for (size_t i = 0; i <= name.size(); i++)
+	{
+		uint32_t curr = (i < name.size()) ? static_cast<uint32_t>(name[i]) : 0;
+		grams.push_back((static_cast<uint64>(prev) << 32) | curr);
+		prev = curr;
+	}
+	std::sort(grams.begin(), grams.end());
+	grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+	return grams;
+}
+
+void POIIndex::sortByDistance(std::vector<const POI*>& pois, const LatLon& from) const
+{
+	Point2 p = m_converter.toMetric(from);
+	std::vector<std::pair<double, const POI*>> dists;
+	dists.reserve(pois.size());
+	for (auto poi = pois.begin(); poi != pois.end(); poi++)
+	{
+		Point2 d = m_converter.toMetric(**poi) - p;
+		dists.push_back(std::make_pair(d.dot(d), *poi));
+	}
+	std::stable_sort(dists.begin(), dists.end(), [](const std::pair<double, const POI*>& a, const std::pair<double, const POI*>& b) { return a.first < b.first; });
+	for (size_t i = 0; i < dists.size(); i++) pois[i] = dists[i].second;
+}
+
+size_t POIIndex::scanGrid(const Point2& center, double radius, bool count_only, std::vector<size_t>* indices) const
+{
+	if (radius < 0 || m_pois.empty()) return 0;
+
+	// Check every grid cell in the area or every POI in the grid (whichever is smaller)
+	const int x0 = getCellIndex(center.x - radius), x1 = getCellIndex(center.x + radius);
+	const int y0 = getCellIndex(center.y - radius), y1 = getCellIndex(center.y + radius);
+	const double n_cells = (static_cast<double>(x1) - x0 + 1) * (static_cast<double>(y1) - y0 + 1);
+	size_t count = 0;
+	if (n_cells > m_grid.size())
+	{
+		for (auto cell = m_grid.begin(); cell != m_grid.end(); cell++)
+		{
+			int x = static_cast<int32_t>(cell->first >> 32), y = static_cast<int32_t>(cell->first & 0xFFFFFFFF);
+			if (x < x0 || x > x1 || y < y0 || y > y1) continue;
+			count += cell->second.size();
+			if (!count_only) indices->insert(indices->end(), cell->second.begin(), cell->second.end());
+		}
+		return count;
+	}
+	for (int y = y0; y <= y1; y++)
+	{
+		for (int x = x0; x <= x1; x++)
+		{
+			auto cell = m_grid.find(getCellKey(x, y));
+			if (cell == m_grid.end()) continue;
+			count += cell->second.size();
+			if (!count_only) indices->insert(indices->end(), cell->second.begin(), cell->second.end());
+		}
+	}
+	return count;
+}
+
+} // End of 'dg'
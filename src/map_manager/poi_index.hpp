@@ -0,0 +1,224 @@
+#ifndef __POI_INDEX__
+#define __POI_INDEX__
+
+#include "dg_core.hpp"
+#include "localizer/utm_converter.hpp"
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace dg
+{
+
+/**
+ * @brief POI matched with a query name
+ */
+struct POIMatch
+{
+	/** A pointer to the matched POI */
+	const POI* poi = nullptr;
+
+	/** The edit distance between the normalized names of the query and the POI */
+	int edits = 0;
+
+	/** The distance from the query center (Unit: [m]; 0 if no center is given) */
+	double distance = 0;
+};
+
+/**
+ * @brief In-memory index of POIs
+ *
+ * A <b>POI index</b> keeps all POIs in memory and finds them by their names, IDs, and locations without network.
+ * Names are indexed with a hash table which allows duplicated names, and locations are indexed with a uniform grid on the metric coordinate.
+ * A query with both a name and a radius checks whichever is smaller between the POIs of the name and the POIs in the grid cells of the radius.
+ *
+ * Noisy names (e.g. OCR results) are matched with normalized names, where Hangul jamo are composed into syllables (NFC), ASCII letters become lowercase, and white spaces are removed.
+ * Prefix search uses the normalized names in sorted order.
+ * Similar names are found with an inverted index of character bigrams, where a name within <i>k</i> edits shares all but 2<i>k</i> of its distinct bigrams, and each candidate is verified with the bounded edit distance.
+ *
+ * Returned pointers are valid until the index is built again or cleared.
+ */
+class POIIndex
+{
+public:
+	/**
+	 * The default constructor
+	 * @param cell_size The size of each grid cell (Unit: [m])
+	 */
+	POIIndex(double cell_size = 100);
+
+	/**
+	 * Build the index of the given POIs (the previous POIs are removed)
+	 * @param pois The POIs to index
+	 */
+	void build(const std::vector<POI>& pois);
+
+	/**
+	 * Remove all POIs
+	 */
+	void clear();
+
+	/**
+	 * Check whether the index has no POI
+	 * @return True if empty (false if not)
+	 */
+	bool empty() const;
+
+	/**
+	 * Get the number of POIs
+	 * @return The number of POIs
+	 */
+	size_t size() const;
+
+	/**
+	 * Get all POIs
+	 * @return A reference to all POIs
+	 */
+	const std::vector<POI>& getPOIs() const;
+
+	/**
+	 * Find a POI using its ID
+	 * @param id The ID to search
+	 * @return A pointer to the found POI (nullptr if not exist)
+	 */
+	const POI* findPOI(ID id) const;
+
+	/**
+	 * Find POIs with the given name
+	 * @param name The name to search
+	 * @return Pointers to the found POIs in their given order
+	 */
+	std::vector<const POI*> findByName(const std::wstring& name) const;
+
+	/**
+	 * Find POIs with the given name within a certain radius
+	 * @param name The name to search
+	 * @param center The center of the search area
+	 * @param radius The radius of the search area (Unit: [m])
+	 * @return Pointers to the found POIs in their given order
+	 */
+	std::vector<const POI*> findByName(const std::wstring& name, const LatLon& center, double radius) const;
+
+	/**
+	 * Find POIs within a certain radius
+	 * @param center The center of the search area
+	 * @param radius The radius of the search area (Unit: [m])
+	 * @return Pointers to the found POIs in their given order
+	 */
+	std::vector<const POI*> findInRadius(const LatLon& center, double radius) const;
+
+	/**
+	 * Find POIs whose normalized names start with the given prefix
+	 * @param prefix The prefix to search
+	 * @return Pointers to the found POIs in their given order
+	 */
+	std::vector<const POI*> findByPrefix(const std::wstring& prefix) const;
+
+	/**
+	 * Find POIs whose normalized names start with the given prefix within a certain radius
+	 * @param prefix The prefix to search
+	 * @param center The center of the search area
+	 * @param radius The radius of the search area (Unit: [m])
+	 * @return Pointers to the found POIs in their given order
+	 */
+	std::vector<const POI*> findByPrefix(const std::wstring& prefix, const LatLon& center, double radius) const;
+
+	/**
+	 * Find POIs whose normalized names are similar to the given name
+	 * @param name The name to search
+	 * @param max_edits The maximum edit distance between normalized names
+	 * @return The matched POIs from the most similar one (the nearer one first for the same edit distance)
+	 */
+	std::vector<POIMatch> findSimilar(const std::wstring& name, int max_edits) const;
+
+	/**
+	 * Find POIs whose normalized names are similar to the given name within a certain radius
+	 * @param name The name to search
+	 * @param max_edits The maximum edit distance between normalized names
+	 * @param center The center of the search area
+	 * @param radius The radius of the search area (Unit: [m])
+	 * @return The matched POIs from the most similar one (the nearer one first for the same edit distance)
+	 */
+	std::vector<POIMatch> findSimilar(const std::wstring& name, int max_edits, const LatLon& center, double radius) const;
+
+	/**
+	 * Normalize a name to be matched<br>
+	 *  Hangul jamo are composed into syllables, ASCII letters become lowercase, and white spaces are removed.
+	 * @param name A name to normalize
+	 * @return The normalized name
+	 */
+	static std::wstring normalizeName(const std::wstring& name);
+
+	/**
+	 * Calculate the edit distance (Levenshtein distance) between two strings up to the given bound
+	 * @param a A string to compare
+	 * @param b The other string to compare
+	 * @param max_edits The maximum edit distance to calculate
+	 * @return The edit distance (max_edits + 1 if it exceeds the bound)
+	 */
+	static int getEditDistance(const std::wstring& a, const std::wstring& b, int max_edits);
+
+	/**
+	 * Sort POIs from the nearest one to the given position (POIs in the same distance keep their order)
+	 * @param pois Pointers to POIs to sort
+	 * @param from The position to measure distance
+	 */
+	void sortByDistance(std::vector<const POI*>& pois, const LatLon& from) const;
+
+protected:
+	/**
+	 * Find the indices of POIs in the grid cells which cover the given circle
+	 * @param center The center of the circle (Unit: [m])
+	 * @param radius The radius of the circle (Unit: [m])
+	 * @param count_only A flag whether only the number of POIs in the cells is counted
+	 * @param indices A pointer to the found indices (not used if count_only is true)
+	 * @return The number of POIs in the cells
+	 */
+	size_t scanGrid(const Point2& center, double radius, bool count_only, std::vector<size_t>* indices) const;
+
+	/**
+	 * Find POIs whose normalized names are similar to the given name
+	 * @param name The name to search
+	 * @param max_edits The maximum edit distance between normalized names
+	 * @param center A pointer to the center of the search area (Unit: [m]; nullptr for no area)
+	 * @param radius The radius of the search area (Unit: [m])
+	 * @return The matched POIs from the most similar one
+	 */
+	std::vector<POIMatch> findSimilar(const std::wstring& name, int max_edits, const Point2* center, double radius) const;
+
+	/**
+	 * Get the distinct bigrams of the given normalized name (padded at both ends)
+	 * @param name The normalized name
+	 * @return The sorted bigrams
+	 */
+	static std::vector<uint64> getBigrams(const std::wstring& name);
+
+	int getCellIndex(double v) const { return static_cast<int>(floor(v / m_cell_size)); }
+
+	static uint64 getCellKey(int x, int y) { return (static_cast<uint64>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y); }
+
+	/** The size of each grid cell (Unit: [m]) */
+	double m_cell_size;
+	/** A converter to the metric coordinate */
+	UTMConverter m_converter;
+	/** All POIs */
+	std::vector<POI> m_pois;
+	/** The metric location of each POI */
+	std::vector<Point2> m_metrics;
+	/** A hash table for finding POIs by ID */
+	std::unordered_map<ID, size_t> m_ids;
+	/** A hash table for finding POIs by name (duplicated names are allowed) */
+	std::unordered_multimap<std::wstring, size_t> m_names;
+	/** A uniform grid for finding POIs by location */
+	std::unordered_map<uint64, std::vector<size_t>> m_grid;
+	/** The normalized name of each POI */
+	std::vector<std::wstring> m_normalized;
+	/** The indices of POIs in the order of their normalized names */
+	std::vector<size_t> m_sorted;
+	/** An inverted index from bigrams of normalized names to POIs */
+	std::unordered_map<uint64, std::vector<size_t>> m_bigrams;
+};
+
+} // End of 'dg'
+
+#endif // End of '__POI_INDEX__'
@@ -0,0 +1,416 @@
+#include "response_cache.hpp"
+#include "opencv2/core/utility.hpp"
+#include <algorithm>
+#include <atomic>
+#include <ctime>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#else
+#include <cerrno>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+namespace dg
+{
+
+static const char* CACHE_MAGIC = "DGCACHE 1";
+static const char* CACHE_EXTENSION = ".dgc";
+
+static bool makeDirectories(const std::string& dir)
+{
+	for (size_t i = 1; i <= dir.size(); i++)
+	{
+		if (i < dir.size() && dir[i] != '/' && dir[i] != '\\') continue;
+		std::string sub = dir.substr(0, i);
+		if (sub.back() == ':') continue; // Skip a drive letter
+#ifdef _WIN32
+		_mkdir(sub.c_str());
+#else
+		mkdir(sub.c_str(), 0755);
+#endif
+	}
+	FILE* fid = fopen((dir + "/.probe").c_str(), "wb");
+	if (fid == nullptr) return false;
+	fclose(fid);
+	std::remove((dir + "/.probe").c_str());
+	return true;
+}
+
+static bool readLine(FILE* fid, std::string& line)
+{
+	line.clear();
+	int c;
+	while ((c = fgetc(fid)) != EOF && c != '\n') line.push_back(static_cast<char>(c));
+	return c == '\n';
+}
+
+static bool isProcessAlive(int pid)
+{
+#ifdef _WIN32
+	HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, static_cast<DWORD>(pid));
+	if (process == nullptr) return GetLastError() != ERROR_INVALID_PARAMETER;
+	bool alive = (WaitForSingleObject(process, 0) == WAIT_TIMEOUT);
+	CloseHandle(process);
+	return alive;
+#else
+	return kill(static_cast<pid_t>(pid), 0) == 0 || errno != ESRCH;
+#endif
+}
+
+static bool isStaleTemp(const std::string& path, double max_age)
+{
+	// A temporary file is named as '<name>.<pid>.<counter>.tmp' by its writer
+	size_t counter_dot = path.rfind('.', path.size() - 5);
+	size_t pid_dot = (counter_dot == std::string::npos || counter_dot == 0) ? std::string::npos : path.rfind('.', counter_dot - 1);
+	if (pid_dot != std::string::npos)
+	{
+		int pid = atoi(path.substr(pid_dot + 1, counter_dot - pid_dot - 1).c_str());
+		if (pid > 0 && !isProcessAlive(pid)) return true;
+	}
+
+	// Keep a file which is being written unless it is not touched for a long time (e.g. its process ID is reused)
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0) return false;
+	return difftime(std::time(nullptr), info.st_mtime) > max_age;
+}
+
+static std::string removeNewline(const std::string& text)
+{
+	std::string result = text;
+	result.erase(std::remove_if(result.begin(), result.end(), [](char c) { return c == '\r' || c == '\n'; }), result.end());
+	return result;
+}
+
+ResponseCache::ResponseCache()
+{
+	m_ttl = 86400;
+	m_max_bytes = 0;
+	m_total_bytes = 0;
+}
+
+bool ResponseCache::open(const std::string& dir, double ttl, size_t max_bytes)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_dir.clear();
+	m_files.clear();
+	m_recency.clear();
+	m_total_bytes = 0;
+	if (dir.empty() || !makeDirectories(dir)) return false;
+
+	std::vector<cv::String> files, temps;
+	try
+	{
+		cv::glob(dir + "/*" + CACHE_EXTENSION, files, false);
+		cv::glob(dir + "/*.tmp", temps, false);
+	}
+	catch (const cv::Exception&) { return false; }
+
+	// Remove temporary files left by interrupted writes, but not ones still being written by other processes
+	const double temp_max_age = 3600; // Unit: [sec]
+	for (auto temp = temps.begin(); temp != temps.end(); temp++)
+		if (isStaleTemp(*temp, temp_max_age)) std::remove(temp->c_str());
+
+	// Index stored files from the most recently stored one
+	std::vector<std::pair<int64, std::pair<uint64, size_t>>> items;
+	for (auto file = files.begin(); file != files.end(); file++)
+	{
+		CachedResponse response;
+		size_t size = 0;
+		if (!readFile(*file, response, size, true))
+		{
+			std::remove(file->c_str());
+			continue;
+		}
+		uint64 hash = 0;
+		getPath(response.key, hash);
+		items.push_back(std::make_pair(response.stored_time, std::make_pair(hash, size)));
+	}
+	std::sort(items.begin(), items.end());
+
+	m_dir = dir;
+	m_ttl = ttl;
+	m_max_bytes = max_bytes;
+	for (auto item = items.begin(); item != items.end(); item++)
+		use(item->second.first, item->second.second);
+	evict();
+	return true;
+}
+
+void ResponseCache::close()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_dir.clear();
+	m_files.clear();
+	m_recency.clear();
+	m_total_bytes = 0;
+}
+
+bool ResponseCache::isOpened() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return !m_dir.empty();
+}
+
+bool ResponseCache::load(const std::string& url, CachedResponse& response)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_dir.empty()) return false;
+
+	std::string key = normalize(url);
+	uint64 hash = 0;
+	std::string path = getPath(key, hash);
+	size_t size = 0;
+	bool read = readFile(path, response, size);
+	if (!read || response.key != key)
+	{
+		// The file is removed (e.g. by another process) or belongs to another request with the same hash
+		if (!read) forget(hash);
+		response = CachedResponse();
+		return false;
+	}
+	response.fresh = (static_cast<double>(std::time(nullptr) - response.stored_time) < m_ttl);
+	use(hash, size);
+	return true;
+}
+
+bool ResponseCache::store(const std::string& url, const std::vector<uchar>& body, const std::string& etag, const std::string& last_modified)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_dir.empty()) return false;
+
+	CachedResponse response;
+	response.key = normalize(url);
+	response.stored_time = std::time(nullptr);
+	response.etag = removeNewline(etag);
+	response.last_modified = removeNewline(last_modified);
+	response.body = body;
+
+	uint64 hash = 0;
+	std::string path = getPath(response.key, hash);
+	size_t size = 0;
+	if (!writeFile(path, response, size)) return false;
+	use(hash, size);
+	evict();
+	return true;
+}
+
+bool ResponseCache::renew(const std::string& url)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_dir.empty()) return false;
+
+	std::string key = normalize(url);
+	uint64 hash = 0;
+	std::string path = getPath(key, hash);
+	CachedResponse response;
+	size_t size = 0;
+	if (!readFile(path, response, size) || response.key != key) return false;
+	response.stored_time = std::time(nullptr);
+	if (!writeFile(path, response, size)) return false;
+	use(hash, size);
+	return true;
+}
+
+bool ResponseCache::remove(const std::string& url)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_dir.empty()) return false;
+
+	uint64 hash = 0;
+	std::string path = getPath(normalize(url), hash);
+	if (m_files.find(hash) == m_files.end()) return false;
+	std::remove(path.c_str());
+	forget(hash);
+	return true;
+}
+
+void ResponseCache::clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_dir.empty()) return;
+
+	std::vector<cv::String> files;
+	try { cv::glob(m_dir + "/*" + CACHE_EXTENSION, files, false); }
+	catch (const cv::Exception&) { }
+	for (auto file = files.begin(); file != files.end(); file++)
+		std::remove(file->c_str());
+	m_files.clear();
+	m_recency.clear();
+	m_total_bytes = 0;
+}
+
+size_t ResponseCache::countResponses() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_files.size();
+}
+
+size_t ResponseCache::getTotalSize() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_total_bytes;
+}
+
+std::string ResponseCache::normalize(const std::string& url)
+{
+	std::string rest = url.substr(0, url.find('#'));
+
+	// Make the scheme and host lowercase
+	std::string scheme = "http";
+	size_t scheme_end = rest.find("://");
+	if (scheme_end != std::string::npos)
+	{
+		scheme = rest.substr(0, scheme_end);
+		rest = rest.substr(scheme_end + 3);
+	}
+	std::transform(scheme.begin(), scheme.end(), scheme.begin(), ::tolower);
+	size_t host_end = std::min(rest.find('/'), rest.find('?'));
+	std::string host = rest.substr(0, host_end);
+	rest = (host_end == std::string::npos) ? "" : rest.substr(host_end);
+	std::transform(host.begin(), host.end(), host.begin(), ::tolower);
+	if ((scheme == "http" && host.size() > 3 && host.compare(host.size() - 3, 3, ":80") == 0) ||
+		(scheme == "https" && host.size() > 4 && host.compare(host.size() - 4, 4, ":443") == 0))
+		host = host.substr(0, host.rfind(':'));
+
+	// Sort parameters
+	size_t query_start = rest.find('?');
+	std::string path = rest.substr(0, query_start);
+	if (path.empty()) path = "/";
+	std::string key = scheme + "://" + host + path;
+	if (query_start != std::string::npos)
+	{
+		std::vector<std::string> params;
+		std::string query = rest.substr(query_start + 1);
+		size_t start = 0;
+		while (start <= query.size())
+		{
+			size_t end = query.find('&', start);
+			if (end == std::string::npos) end = query.size();
+			if (end > start) params.push_back(query.substr(start, end - start));
+			start = end + 1;
+		}
+		std::sort(params.begin(), params.end());
+		for (size_t i = 0; i < params.size(); i++)
+			key += ((i == 0) ? "?" : "&") + params[i];
+	}
+	return key;
+}
+
+std::string ResponseCache::getPath(const std::string& key, uint64& hash) const
+{
+	// FNV-1a hash
+	hash = 14695981039346656037ULL;
+	for (auto c = key.begin(); c != key.end(); c++)
+	{
+		hash ^= static_cast<uchar>(*c);
+		hash *= 1099511628211ULL;
+	}
+	char name[32];
+	sprintf(name, "/%016llx", static_cast<unsigned long long>(hash));
+	return m_dir + name + CACHE_EXTENSION;
+}
+
+bool ResponseCache::readFile(const std::string& path, CachedResponse& response, size_t& size, bool header_only)
+{
+	FILE* fid = fopen(path.c_str(), "rb");
+	if (fid == nullptr) return false;
+
+	std::string magic, stored_time, body_size;
+	bool ok = readLine(fid, magic) && magic == CACHE_MAGIC && readLine(fid, response.key) && readLine(fid, stored_time)
+		&& readLine(fid, response.etag) && readLine(fid, response.last_modified) && readLine(fid, body_size);
+	if (ok)
+	{
+		response.stored_time = strtoll(stored_time.c_str(), nullptr, 10);
+		size_t n_body = static_cast<size_t>(strtoull(body_size.c_str(), nullptr, 10));
+		long header_end = ftell(fid);
+		if (header_only)
+		{
+			// Check the file is complete without reading its body
+			ok = (fseek(fid, 0, SEEK_END) == 0 && ftell(fid) == header_end + static_cast<long>(n_body));
+		}
+		else
+		{
+			response.body.resize(n_body);
+			ok = (n_body == 0 || fread(response.body.data(), 1, n_body, fid) == n_body) && fgetc(fid) == EOF;
+		}
+		size = static_cast<size_t>(header_end) + n_body;
+	}
+	fclose(fid);
+	return ok;
+}
+
+bool ResponseCache::writeFile(const std::string& path, const CachedResponse& response, size_t& size)
+{
+	// Write a temporary file whose name is unique over processes and threads
+	static std::atomic<unsigned int> counter(0);
+#ifdef _WIN32
+	int pid = _getpid();
+#else
+	int pid = getpid();
+#endif
+	std::string temp = path + "." + std::to_string(pid) + "." + std::to_string(counter++) + ".tmp";
+	FILE* fid = fopen(temp.c_str(), "wb");
+	if (fid == nullptr) return false;
+
+	std::string header = std::string(CACHE_MAGIC) + "\n" + response.key + "\n" + std::to_string(response.stored_time) + "\n"
+		+ response.etag + "\n" + response.last_modified + "\n" + std::to_string(response.body.size()) + "\n";
+	bool ok = fwrite(header.data(), 1, header.size(), fid) == header.size();
+	if (ok && !response.body.empty()) ok = fwrite(response.body.data(), 1, response.body.size(), fid) == response.body.size();
+	ok = (fclose(fid) == 0) && ok;
+
+	// Replace the previous file at once
+#ifdef _WIN32
+	if (ok) ok = (MoveFileExA(temp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0);
+#else
+	if (ok) ok = (std::rename(temp.c_str(), path.c_str()) == 0);
+#endif
+	if (!ok)
+	{
+		std::remove(temp.c_str());
+		return false;
+	}
+	size = header.size() + response.body.size();
+	return true;
+}
+
+void ResponseCache::use(uint64 hash, size_t size)
+{
+	forget(hash);
+	m_recency.push_front(hash);
+	FileItem item;
+	item.size = size;
+	item.recency = m_recency.begin();
+	m_files[hash] = item;
+	m_total_bytes += size;
+}
+
+void ResponseCache::forget(uint64 hash)
+{
+	auto found = m_files.find(hash);
+	if (found == m_files.end()) return;
+	m_total_bytes -= found->second.size;
+	m_recency.erase(found->second.recency);
+	m_files.erase(found);
+}
+
+void ResponseCache::evict()
+{
+	// Keep the most recently used file even if it is larger than the bound
+	while (m_total_bytes > m_max_bytes && m_recency.size() > 1)
+	{
+		uint64 hash = m_recency.back();
+		char name[32];
+		sprintf(name, "/%016llx", static_cast<unsigned long long>(hash));
+		std::remove((m_dir + name + CACHE_EXTENSION).c_str());
+		forget(hash);
+	}
+}
+
+} // End of 'dg'
@@ -0,0 +1,212 @@
+#ifndef __RESPONSE_CACHE__
+#define __RESPONSE_CACHE__
+
+#include "opencv2/core.hpp"
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+
+namespace dg
+{
+
+/**
+ * @brief Cached server response
+ *
+ * A <b>cached response</b> contains a body received from the server and its validators to revalidate it.
+ */
+struct CachedResponse
+{
+	/** The normalized request of this response (empty if not cached) */
+	std::string key;
+
+	/** The time when this response is received or revalidated (Unit: [sec] since the epoch) */
+	int64 stored_time = 0;
+
+	/** The entity tag given by the server (empty if not given) */
+	std::string etag;
+
+	/** The last modified time given by the server (empty if not given) */
+	std::string last_modified;
+
+	/** A flag whether this response is younger than the time-to-live of the cache */
+	bool fresh = false;
+
+	/** The body of this response */
+	std::vector<uchar> body;
+};
+
+/**
+ * @brief Disk cache of server responses
+ *
+ * A <b>response cache</b> keeps server responses as files in a directory so that repeated requests are served without network.
+ * Each file is named by the hash of its normalized request (URL with sorted parameters), and it stores the request itself to reject hash collisions.
+ * A file is written to a temporary file first and renamed to its name, so other readers and crashes never see a partial file.
+ * When the total size exceeds its bound, the least recently used files are removed.
+ * The recency is kept only in memory, so the stored time of files is used as their recency when the cache is opened again.
+ *
+ * A response older than the time-to-live is not removed but marked as stale.
+ * A stale response can be revalidated with its validators (ETag and Last-Modified), and it can be used when the server is not reachable.
+ */
+class ResponseCache
+{
+public:
+	/**
+	 * The default constructor
+	 */
+	ResponseCache();
+
+	/**
+	 * Open the cache at the given directory (the directory is created if not exist)
+	 * @param dir The directory to store responses
+	 * @param ttl The time-to-live of responses (Unit: [sec])
+	 * @param max_bytes The maximum total size of responses (Unit: [byte])
+	 * @return True if successful (false if failed)
+	 */
+	bool open(const std::string& dir, double ttl = 86400, size_t max_bytes = 1024 * 1024 * 1024);
+
+	/**
+	 * Close the cache (the stored responses are kept in the directory)
+	 */
+	void close();
+
+	/**
+	 * Check whether the cache is opened
+	 * @return True if opened (false if not)
+	 */
+	bool isOpened() const;
+
+	/**
+	 * Find the response of the given request
+	 * @param url A web address of the request
+	 * @param response A reference to the found response
+	 * @return True if found (false if not)
+	 */
+	bool load(const std::string& url, CachedResponse& response);
+
+	/**
+	 * Store the response of the given request (the previous response is replaced)
+	 * @param url A web address of the request
+	 * @param body The body of the response
+	 * @param etag The entity tag given by the server (default: "")
+	 * @param last_modified The last modified time given by the server (default: "")
+	 * @return True if successful (false if failed)
+	 */
+	bool store(const std::string& url, const std::vector<uchar>& body, const std::string& etag = "", const std::string& last_modified = "");
+
+	/**
+	 * Renew the stored time of the response of the given request (e.g. the server confirms it is not modified)
+	 * @param url A web address of the request
+	 * @return True if successful (false if failed)
+	 */
+	bool renew(const std::string& url);
+
+	/**
+	 * Remove the response of the given request
+	 * @param url A web address of the request
+	 * @return True if successful (false if failed)
+	 */
+	bool remove(const std::string& url);
+
+	/**
+	 * Remove all responses
+	 */
+	void clear();
+
+	/**
+	 * Get the number of stored responses
+	 * @return The number of stored responses
+	 */
+	size_t countResponses() const;
+
+	/**
+	 * Get the total size of stored responses
+	 * @return The total size of stored responses (Unit: [byte])
+	 */
+	size_t getTotalSize() const;
+
+	/**
+	 * Normalize a web address to be used as a cache key<br>
+	 *  Its scheme and host become lowercase, the default port and fragment are removed, and its parameters are sorted.
+	 * @param url A web address to normalize
+	 * @return The normalized web address
+	 */
+	static std::string normalize(const std::string& url);
+
+protected:
+	/**
+	 * Get the file path of the given normalized request
+	 * @param key The normalized request
+	 * @param hash A reference to the hash of the request
+	 * @return The file path
+	 */
+	std::string getPath(const std::string& key, uint64& hash) const;
+
+	/**
+	 * Read a cached response from the given file
+	 * @param path The file path to read
+	 * @param response A reference to the read response
+	 * @param size A reference to the size of the file (Unit: [byte])
+	 * @param header_only A flag whether its body is skipped (default: false)
+	 * @return True if successful (false if failed)
+	 */
+	static bool readFile(const std::string& path, CachedResponse& response, size_t& size, bool header_only = false);
+
+	/**
+	 * Write a cached response to the given file using a temporary file and renaming it
+	 * @param path The file path to write
+	 * @param response The response to write
+	 * @param size A reference to the size of the written file (Unit: [byte])
+	 * @return True if successful (false if failed)
+	 */
+	static bool writeFile(const std::string& path, const CachedResponse& response, size_t& size);
+
+	/**
+	 * Mark the given file as the most recently used one
+	 * @param hash The hash of the file
+	 * @param size The size of the file (Unit: [byte])
+	 */
+	void use(uint64 hash, size_t size);
+
+	/**
+	 * Forget the given file
+	 * @param hash The hash of the file
+	 */
+	void forget(uint64 hash);
+
+	/**
+	 * Remove the least recently used files until the total size is within its bound
+	 */
+	void evict();
+
+	/**
+	 * A cached file in memory
+	 */
+	struct FileItem
+	{
+		/** The size of the file (Unit: [byte]) */
+		size_t size;
+		/** The position in the recency list */
+		std::list<uint64>::iterator recency;
+	};
+
+	/** The directory to store responses (empty if not opened) */
+	std::string m_dir;
+	/** The time-to-live of responses (Unit: [sec]) */
+	double m_ttl;
+	/** The maximum total size of responses (Unit: [byte]) */
+	size_t m_max_bytes;
+	/** The total size of responses (Unit: [byte]) */
+	size_t m_total_bytes;
+	/** The hashes of files from the most recently used one */
+	std::list<uint64> m_recency;
+	/** A hash table of files */
+	std::unordered_map<uint64, FileItem> m_files;
+	/** A mutex to share the cache between threads */
+	mutable std::mutex m_mutex;
+};
+
+} // End of 'dg'
+
+#endif // End of '__RESPONSE_CACHE__'
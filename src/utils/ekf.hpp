@@ -19,6 +19,217 @@
 
 namespace cx
 {
+    /**
+     * @brief Fixed-interval Rauch-Tung-Striebel (RTS) smoother
+     *
+     * The RTS smoother records the forward pass of a Kalman filter and refines all recorded states with a single backward sweep.
+     * Each step is stored as one row of a matrix, [ F | x_pred | P_pred | x_filt | P_filt ], where covariances are packed as their upper triangles.
+     * The backward sweep keeps only the next smoothed state and covariance, so its extra memory does not grow with the number of steps.
+     *
+     * @see Rauch, Tung, and Striebel, Maximum Likelihood Estimates of Linear Dynamic Systems, AIAA Journal, Vol. 3, No. 8, 1965
+     */
+    class RTSSmoother
+    {
+    public:
+        /**
+         * The default constructor
+         */
+        RTSSmoother() : m_dim(0), m_angular_dim(-1) { }
+
+        /**
+         * Initialize the smoother and remove all recorded steps
+         * @param state_dim The dimension of state variable
+         * @param reserve The number of steps to reserve memory
+         * @return True if successful (false if failed)
+         */
+        bool initialize(int state_dim, int reserve = 0)
+        {
+            if (state_dim <= 0) return false;
+            m_dim = state_dim;
+            m_steps = cv::Mat(0, getStepSize(), CV_64F);
+            if (reserve > 0) m_steps.reserve(reserve);
+            return true;
+        }
+
+        /**
+         * Assign the index of an angular state variable whose differences are wrapped into [-CV_PI, CV_PI)
+         * @param dim The index of the angular state variable (-1 for none)
+         * @return True if successful (false if failed)
+         */
+        bool setAngularDim(int dim)
+        {
+            if (dim >= m_dim) return false;
+            m_angular_dim = dim;
+            return true;
+        }
+
+        /**
+         * Get the number of recorded steps
+         * @return The number of recorded steps
+         */
+        int countSteps() const { return m_steps.rows; }
+
+        /**
+         * Add a new step with its predicted state and covariance
+         * @param jacobian The state transition Jacobian from the previous step
+         * @param state_vec The predicted state variable, which is also used as the filtered one until updated
+         * @param state_cov The predicted state covariance, which is also used as the filtered one until updated
+         * @return True if successful (false if failed)
+         */
+        bool addStep(const cv::Mat& jacobian, const cv::Mat& state_vec, const cv::Mat& state_cov)
+        {
+            if (m_dim <= 0 || state_vec.total() != static_cast<size_t>(m_dim)) return false;
+            cv::Mat row(1, getStepSize(), CV_64F);
+            double* ptr = row.ptr<double>();
+            cv::Mat F(m_dim, m_dim, CV_64F, ptr);
+            if (jacobian.empty()) cv::setIdentity(F);
+            else jacobian.convertTo(F, CV_64F);
+            ptr += m_dim * m_dim;
+            ptr = packState(state_vec, ptr);
+            ptr = packCov(state_cov, ptr);
+            ptr = packState(state_vec, ptr);
+            packCov(state_cov, ptr);
+            m_steps.push_back(row);
+            return true;
+        }
+
+        /**
+         * Overwrite the filtered state and covariance of the last step
+         * @param state_vec The filtered state variable
+         * @param state_cov The filtered state covariance
+         * @return True if successful (false if failed)
+         */
+        bool updateStep(const cv::Mat& state_vec, const cv::Mat& state_cov)
+        {
+            if (m_steps.empty() || state_vec.total() != static_cast<size_t>(m_dim)) return false;
+            double* ptr = m_steps.ptr<double>(m_steps.rows - 1) + m_dim * m_dim + m_dim + getCovSize();
+            ptr = packState(state_vec, ptr);
+            packCov(state_cov, ptr);
+            return true;
+        }
+
+        /**
+         * Remove the recorded steps after the given number of steps
+         * @param n_steps The number of steps to keep
+         * @return True if successful (false if failed)
+         */
+        bool truncate(int n_steps)
+        {
+            if (n_steps < 0) return false;
+            if (n_steps < m_steps.rows) m_steps.pop_back(m_steps.rows - n_steps);
+            return true;
+        }
+
+        /**
+         * Smooth all recorded steps with the backward sweep
+         * @param states The smoothed state variables, one row for each step (return value)
+         * @param covs The smoothed state covariances (return value; optional)
+         * @return True if successful (false if failed)
+         */
+        bool smooth(cv::Mat& states, std::vector<cv::Mat>* covs = nullptr) const
+        {
+            const int n = m_steps.rows;
+            if (n <= 0) return false;
+            states.create(n, m_dim, CV_64F);
+            if (covs != nullptr) covs->resize(n);
+
+            // Start from the last filtered step
+            cv::Mat xs(m_dim, 1, CV_64F), Ps(m_dim, m_dim, CV_64F);
+            const int offset_filt = m_dim * m_dim + m_dim + getCovSize();
+            unpackState(m_steps.ptr<double>(n - 1) + offset_filt, xs);
+            unpackCov(m_steps.ptr<double>(n - 1) + offset_filt + m_dim, Ps);
+            storeResult(n - 1, xs, Ps, states, covs);
+
+            // Sweep backward
+            cv::Mat F(m_dim, m_dim, CV_64F), xp(m_dim, 1, CV_64F), Pp(m_dim, m_dim, CV_64F), xf(m_dim, 1, CV_64F), Pf(m_dim, m_dim, CV_64F), Ct;
+            for (int k = n - 2; k >= 0; k--)
+            {
+                const double* next = m_steps.ptr<double>(k + 1);
+                const double* curr = m_steps.ptr<double>(k);
+                cv::Mat(m_dim, m_dim, CV_64F, const_cast<double*>(next)).copyTo(F);
+                unpackState(next + m_dim * m_dim, xp);
+                unpackCov(next + m_dim * m_dim + m_dim, Pp);
+                unpackState(curr + offset_filt, xf);
+                unpackCov(curr + offset_filt + m_dim, Pf);
+
+                // Solve the smoother gain, C = Pf * F^T * Pp^-1, as Pp * C^T = F * Pf
+                cv::Mat FPf = F * Pf;
+                if (!cv::solve(Pp, FPf, Ct, cv::DECOMP_CHOLESKY))
+                    cv::solve(Pp, FPf, Ct, cv::DECOMP_SVD);
+                cv::Mat C = Ct.t();
+
+                cv::Mat dx = xs - xp;
+                if (m_angular_dim >= 0) dx.at<double>(m_angular_dim) = wrapAngle(dx.at<double>(m_angular_dim));
+                xs = xf + C * dx;
+                Ps = Pf + C * (Ps - Pp) * Ct;
+                Ps = 0.5 * Ps + 0.5 * cv::Mat(Ps.t());
+                if (m_angular_dim >= 0) xs.at<double>(m_angular_dim) = wrapAngle(xs.at<double>(m_angular_dim));
+                storeResult(k, xs, Ps, states, covs);
+            }
+            return true;
+        }
+
+    protected:
+        int getCovSize() const { return m_dim * (m_dim + 1) / 2; }
+
+        int getStepSize() const { return m_dim * m_dim + 2 * (m_dim + getCovSize()); }
+
+        double* packState(const cv::Mat& state, double* ptr) const
+        {
+            cv::Mat dst(m_dim, 1, CV_64F, ptr);
+            state.reshape(1, m_dim).convertTo(dst, CV_64F);
+            return ptr + m_dim;
+        }
+
+        double* packCov(const cv::Mat& cov, double* ptr) const
+        {
+            cv::Mat P;
+            cov.convertTo(P, CV_64F);
+            for (int r = 0; r < m_dim; r++)
+                for (int c = r; c < m_dim; c++)
+                    *(ptr++) = P.at<double>(r, c);
+            return ptr;
+        }
+
+        void unpackState(const double* ptr, cv::Mat& state) const
+        {
+            for (int r = 0; r < m_dim; r++)
+                state.at<double>(r) = ptr[r];
+        }
+
+        void unpackCov(const double* ptr, cv::Mat& cov) const
+        {
+            for (int r = 0; r < m_dim; r++)
+            {
+                for (int c = r; c < m_dim; c++)
+                {
+                    cov.at<double>(r, c) = *ptr;
+                    cov.at<double>(c, r) = *(ptr++);
+                }
+            }
+        }
+
+        void storeResult(int k, const cv::Mat& xs, const cv::Mat& Ps, cv::Mat& states, std::vector<cv::Mat>* covs) const
+        {
+            cv::Mat(xs.t()).copyTo(states.row(k));
+            if (covs != nullptr) (*covs)[k] = Ps.clone();
+        }
+
+        static double wrapAngle(double rad)
+        {
+            return rad - 2 * CV_PI * floor((rad + CV_PI) / (2 * CV_PI));
+        }
+
+        /** The dimension of state variable */
+        int m_dim;
+
+        /** The index of an angular state variable */
+        int m_angular_dim;
+
+        /** The recorded steps, one row for each step */
+        cv::Mat m_steps;
+    }; // End of 'RTSSmoother'
+
     /**
      * @brief Extended Kalman Filter (EKF)
      *
@@ -32,6 +243,11 @@ namespace cx
     class EKF
     {
     public:
+        /**
+         * The default constructor
+         */
+        EKF() : m_state_version(0), m_smoother(nullptr) { }
+
         /**
          * The virtual destructor
          */
@@ -67,6 +283,8 @@ namespace cx
                 CV_DbgAssert(m_state_cov.rows == dim && m_state_cov.cols == dim);
             }
             else m_state_cov = cv::Mat::eye(dim, dim, m_state_vec.type());
+            m_state_version++;
+            if (m_smoother != nullptr && m_smoother->initialize(dim)) m_smoother->addStep(cv::Mat(), m_state_vec, m_state_cov);
             return true;
         }
 
@@ -87,6 +305,8 @@ namespace cx
 
             // Enforce the state covariance symmetric
             m_state_cov = 0.5 * m_state_cov + 0.5 * m_state_cov.t();
+            m_state_version++;
+            if (m_smoother != nullptr) m_smoother->addStep(F, m_state_vec, m_state_cov);
             return true;
         }
 
@@ -115,6 +335,8 @@ namespace cx
 
             // Enforce the state covariance symmetric
             m_state_cov = 0.5 * m_state_cov + 0.5 * cv::Mat(m_state_cov.t());
+            m_state_version++;
+            if (m_smoother != nullptr) m_smoother->updateStep(m_state_vec, m_state_cov);
             return true;
         }
 
@@ -146,6 +368,8 @@ namespace cx
             CV_DbgAssert(state.size() == m_state_vec.size());
             CV_DbgAssert(state.type() == m_state_vec.type());
             m_state_vec = state.getMat();
+            m_state_version++;
+            if (m_smoother != nullptr) m_smoother->updateStep(m_state_vec, m_state_cov);
             return true;
         }
 
@@ -165,6 +389,8 @@ namespace cx
             CV_DbgAssert(covariance.size() == m_state_cov.size());
             CV_DbgAssert(covariance.type() == m_state_cov.type());
             m_state_cov = covariance.getMat();
+            m_state_version++;
+            if (m_smoother != nullptr) m_smoother->updateStep(m_state_vec, m_state_cov);
             return true;
         }
 
@@ -174,6 +400,26 @@ namespace cx
          */
         const cv::Mat getStateCov() { return m_state_cov; }
 
+        /**
+         * Get the version of the state, which increases whenever the state variable or covariance is changed
+         * @return The state version
+         */
+        uint64 getStateVersion() const { return m_state_version; }
+
+        /**
+         * Attach a smoother which records the following predictions and corrections
+         * @param smoother The smoother to record the filter (nullptr to detach)
+         * @return True if successful (false if failed)
+         * @note The smoother is restarted from the current state.
+         */
+        bool setSmoother(RTSSmoother* smoother)
+        {
+            m_smoother = smoother;
+            if (m_smoother == nullptr) return true;
+            if (!m_smoother->initialize(m_state_vec.rows)) return false;
+            return m_smoother->addStep(cv::Mat(), m_state_vec, m_state_cov);
+        }
+
     protected:
         /**
          * The state transition function, its Jacobian, and noise
@@ -200,6 +446,12 @@ namespace cx
 
         /** The state covariance */
         cv::Mat m_state_cov;
+
+        /** The state version (increase it whenever the state is modified directly) */
+        uint64 m_state_version;
+
+        /** The attached smoother (nullptr if not attached) */
+        RTSSmoother* m_smoother;
     }; // End of 'EKF'
 
 } // End of 'cx'